@@ -10,17 +10,20 @@
 #include <cmath>
 #include <algorithm>
 #include <iostream>
+#include <cstring>
 
 #include "common/fileUtil.hpp"
 #include "common/util.h"
+#include "common/log.hpp"
 #include "rsnd/SoundSequence.hpp"
+#include "rsnd/SeqProgram.hpp"
 #include "helper.h"
 #include "MidiFile.h"
 
-MidiFile::MidiFile(const rsnd::SoundSequence *theAssocSeq)
+MidiFile::MidiFile(const rsnd::SoundSequence *theAssocSeq, const rsnd::SeqPlayLimits &theLimits)
     : assocSeq(theAssocSeq),
+      limits(theLimits),
       globalTrack(this, false),
-      globalTranspose(0),
       bMonophonicTracks(false) {
   this->bMonophonicTracks = false; // I think BRSEQs are monophonic?
   this->globalTrack.bMonophonic = this->bMonophonicTracks;
@@ -63,288 +66,113 @@ uint32_t MidiFile::GetPPQN() const {
 }
 
 void MidiFile::Sort(void) {
+  globalTrack.FlushPendingEvents();
   for (uint32_t i = 0; i < aTracks.size(); i++) {
     if (aTracks[i]) {
+      aTracks[i]->Sort();
       if (aTracks[i]->aEvents.size() == 0) {
         delete aTracks[i];
         aTracks.erase(aTracks.begin() + i--);
-      } else
-        aTracks[i]->Sort();
+      }
     }
   }
 }
 
-bool MidiFile::SaveMidiFile(const std::filesystem::path &filepath) {
+bool MidiFile::SaveMidiFile(const std::filesystem::path &filepath, uint32_t startOffset) {
   std::vector<uint8_t> midiBuf;
-  WriteMidiToBuffer(midiBuf);
+  WriteMidiToBuffer(midiBuf, startOffset);
   rsnd::writeBinary(filepath, midiBuf.data(), midiBuf.size());
   return true;
 }
 
-uint32_t ReadVarLen(const u8* data, uint32_t &offset) {
-  uint32_t value = 0;
+const uint8_t *MidiFile::ArenaCopy(const void *data, size_t size) {
+  void *copy = arena.allocate(std::max<size_t>(size, 1), 1);
+  memcpy(copy, data, size);
+  return static_cast<const uint8_t *>(copy);
+}
 
-  for (int i = 0; i < 5; i++) {
-	  uint8_t c = *(data + offset++);
-    value = (value << 7) + (c & 0x7F);
-	  // Check if continue bit is set
-	  if((c & 0x80) == 0) {
-		  break;
-	  }
-  }
-  return value;
-}
-
-rsnd::SeqArgType nextArgType = rsnd::SEQ_ARG_NONE;
-
-uint32_t ReadArg(rsnd::SeqArgType defaultArgType, const u8* data, uint32_t &offset) {
-  rsnd::SeqArgType argType = nextArgType == rsnd::SEQ_ARG_NONE ? defaultArgType : nextArgType;
-  nextArgType = rsnd::SEQ_ARG_NONE;
-
-  switch (argType) {
-  case rsnd::SEQ_ARG_VARIABLE:
-    return ReadVarLen(data, offset);
-  case rsnd::SEQ_ARG_U8:
-    return *(data + offset++);
-  case rsnd::SEQ_ARG_S16: {
-    auto val = std::byteswap(*(u16*)(data + offset));
-    offset += 2;
-    return val;
-  } case rsnd::SEQ_ARG_RANDOM: {
-    int16_t min = std::byteswap(*(u16*)(data + offset));
-    offset += 2;
-    int16_t max = std::byteswap(*(u16*)(data + offset));
-    offset += 2;
-    /* To be consistent, return the average of min/max. */
-    return (min + max) / 2;
-  }
-  case rsnd::SEQ_ARG_NONE:
-  default:
-    std::cerr << "Warning: unhandled argument type " << argType << '\n';
-    return 0;
+#include <deque>
+
+//  Converts what one RSEQ track does into events of its own MidiTrack
+class MidiTrackSink : public rsnd::SeqTrackSink {
+ public:
+  MidiTrackSink(MidiFile *midiFile, std::deque<MidiTrackSink> &sinks, uint8_t channel, uint32_t delta)
+      : midiFile(midiFile), sinks(sinks), t(midiFile->AddTrack()), c(channel) {
+    t->SetDelta(delta);
   }
 
-  return ReadVarLen(data, offset);
-}
+  void note(u8 key, u8 vel, s32 dur) override {
+    t->AddNoteByDur(c, key + transpose, vel, dur);
+    RSND_TRACE(rsnd::LOG_MIDI, "note " << (int)key << ", " << (int)vel << ", " << (int)dur);
+  }
 
-uint32_t readbe24(const u8* data, uint32_t &offset) {
-  const u8* bytes = data + offset;
-  uint32_t result = (uint32_t)bytes[2] |
-                      (uint32_t)bytes[1] << 8  |
-                      (uint32_t)bytes[0] << 16;
-  
-  offset += 3;
-  return result;
-}
+  void wait(s32 dur) override {
+    RSND_TRACE(rsnd::LOG_MIDI, "rest " << (int)dur);
+    t->PurgePrevNoteOffs();
+    t->AddDelta(dur);
+  }
 
-#include <stack>
-#include <queue>
-#include <unordered_set>
+  rsnd::SeqTrackSink *openTrack(u8 trackNo) override {
+    return &sinks.emplace_back(midiFile, sinks, trackNo, t->GetDelta());
+  }
 
-struct StackFrame {
-  uint32_t retOffset;
-  uint32_t delta;
-  uint32_t loopCount;
-};
+  void command(const rsnd::SeqInstr &instr, s32 value) override {
+    switch (instr.cmd) {
+    case rsnd::MML_PRG:
+      RSND_TRACE(rsnd::LOG_MIDI, "program change " << (int)(u8)value);
+      t->AddProgramChange(c, value);
+      break;
+    case rsnd::MML_PAN:
+      t->AddPan(c, value);
+      break;
+    case rsnd::MML_VOLUME:
+      t->AddVol(c, value);
+      break;
+    case rsnd::MML_MAIN_VOLUME:
+      t->AddMasterVol(c, value);
+      break;
+    case rsnd::MML_TRANSPOSE:
+      transpose = value;
+      break;
+    case rsnd::MML_PITCH_BEND:
+      t->AddPitchBend(c, (u8)value);
+      break;
+    case rsnd::MML_BEND_RANGE:
+      t->AddPitchBendRange(c, value, 0);
+      break;
+    case rsnd::MML_PORTA_SW:
+      t->AddPortamento(c, value != 0);
+      break;
+    case rsnd::MML_PORTA_TIME:
+      t->AddPortamentoTime(c, value);
+      break;
+    case rsnd::MML_TEMPO:
+      t->AddTempoBPM((s16)value);
+      break;
+    case rsnd::MML_MOD_DEPTH:
+      t->AddModulation(c, value);
+      break;
+    default:
+      //  MIDI incompatible commands
+      break;
+    }
+  }
 
-struct TrackQueueElem {
-  u32 trackIdx; // player track idx
-  u32 delta;
-  u32 begOffset;
+ private:
+  MidiFile *midiFile;
+  std::deque<MidiTrackSink> &sinks;
+  MidiTrack *t;
+  uint8_t c;
+  s8 transpose = 0;
 };
 
-void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
-  u8 c = 0;
-  const u8* trackData = static_cast<const u8*>(assocSeq->getSeqData());
-  std::queue<TrackQueueElem> toProcessTracks;
-  toProcessTracks.push({ 0, 0, 0 });
-
-  while (!toProcessTracks.empty()) {
-    TrackQueueElem toProcessTrack = toProcessTracks.front();
-    toProcessTracks.pop();
-
-    std::stack<StackFrame> callStack;
-    std::unordered_set<u32> processedJumps;
-
-    MidiTrack* t = this->AddTrack();
-    t->SetDelta(toProcessTrack.delta);
-
-    // parse track
-    u32 curOffset = toProcessTrack.begOffset;
-    c = toProcessTrack.trackIdx;
-    s8 transpose = 0;
-    bool noteWait = false;
-    bool exitLoop = false;
-    while (!exitLoop) {
-      int beginOffset = curOffset;
-      u8 status_byte = *rsnd::getOffsetT<const u8>(trackData, curOffset++);
-      if (status_byte < 0x80) {
-        /* Note on. */
-        uint8_t vel = *rsnd::getOffsetT<const u8>(trackData, curOffset++);
-        int dur = ReadArg(rsnd::SEQ_ARG_VARIABLE, trackData, curOffset);
-        t->AddNoteByDur(c, status_byte + transpose, vel, dur);
-        std::cout << "Note " << std::dec << (int)status_byte << ", " << (int)vel << ", " << (int)dur << '\n';
-        if (noteWait) {
-          t->AddDelta(dur);
-        }
-      } else {
-        switch (status_byte)
-        {
-        case rsnd::MML_RANDOM:
-        {
-          nextArgType = rsnd::SEQ_ARG_RANDOM;
-          break;
-        }
-        case rsnd::MML_WAIT:
-        {
-          int dur = ReadArg(rsnd::SEQ_ARG_VARIABLE, trackData, curOffset);
-          std::cout << "rest " << std::dec << (int)dur << '\n';
-          t->PurgePrevNoteOffs();
-          t->AddDelta(dur);
-          break;
-        }
-        case rsnd::MML_PRG:
-        {
-          u8 prog = ReadArg(rsnd::SEQ_ARG_VARIABLE, trackData, curOffset);
-          std::cout << "Program change " << std::dec << (int)prog << '\n';
-          t->AddProgramChange(c, prog);
-          break;
-        }
-        case rsnd::MML_PAN:
-        {
-          u8 pan = *(trackData + curOffset++);
-          t->AddPan(c, pan);
-          break;
-        }
-        case rsnd::MML_VOLUME:
-        {
-          u8 vol = *(trackData + curOffset++);
-          t->AddVol(c, vol);
-          break;
-        }
-        case rsnd::MML_MAIN_VOLUME:
-        {
-          u8 vol = *(trackData + curOffset++);
-          t->AddMasterVol(c, vol);
-          break;
-        }
-        case rsnd::MML_TRANSPOSE:
-        {
-          transpose = ReadArg(rsnd::SEQ_ARG_U8, trackData, curOffset);
-          break;
-        }
-        case rsnd::MML_PITCH_BEND:
-        {
-          u8 pitch_bend = ReadArg(rsnd::SEQ_ARG_U8, trackData, curOffset);
-          t->AddPitchBend(c, pitch_bend);
-          break;
-        }
-        case rsnd::MML_BEND_RANGE:
-        {
-          u8 bend_range = *(trackData + curOffset++);
-          t->AddPitchBendRange(c, bend_range, 0);
-          break;
-        }
-        case rsnd::MML_PORTA_SW:
-        {
-          bool portOn = *(trackData + curOffset++) != 0;
-          t->AddPortamento(c, portOn);
-          break;
-        }
-        case rsnd::MML_PORTA_TIME:
-        {
-          u8 portTime = *(trackData + curOffset++);
-          t->AddPortamentoTime(c, portTime);
-          break;
-        }
-        case rsnd::MML_TEMPO:
-        {
-          s16 tempo = ReadArg(rsnd::SEQ_ARG_S16, trackData, curOffset);
-          t->AddTempoBPM(tempo);
-          break;
-        }
-        case rsnd::MML_FIN:
-        {
-          exitLoop = true;
-          break;
-        }
-        // MIDI incompatible commands
-        case rsnd::MML_ALLOC_TRACK:
-        {
-          curOffset += 2;
-          break;
-        }
-        case rsnd::MML_OPEN_TRACK:
-        {
-          auto trackNo = *(trackData + curOffset++);
-          auto begOffset = readbe24(trackData, curOffset);
-          toProcessTracks.push({ trackNo, t->GetDelta(), begOffset});
-          break;
-        }
-        case rsnd::MML_CALL:
-        {
-          u32 destOffset = readbe24(trackData, curOffset);
-          callStack.push({ curOffset, t->GetDelta(), 0 });
-          curOffset = destOffset;
-          std::cout << "push curOffset " << curOffset << std::endl;
-          break;
-        }
-        case rsnd::MML_RET:
-        {
-          if (callStack.size() == 0) {
-            exitLoop = true;
-            break;
-          }
-          curOffset = callStack.top().retOffset;
-          callStack.pop();
-          std::cout << "pop curOffset " << curOffset << std::endl;
-          break;
-        }
-        case rsnd::MML_JUMP:
-        {
-          // TODO: jump?
-          u32 destOffset = readbe24(trackData, curOffset);
-          if (processedJumps.contains(curOffset)) {
-            /* This isn't going to go anywhere... just quit early. */
-            exitLoop = true;
-          } else {
-            processedJumps.insert(curOffset);
-            curOffset = destOffset;
-            std::cout << "Jump curOffset " << curOffset << std::endl;
-          }
-          break;
-        }
-        case rsnd::MML_NOTE_WAIT:
-        {
-          noteWait = !!*(trackData + curOffset++);
-          break;
-        }
-        case rsnd::MML_MOD_DEPTH:
-        {
-          u8 amount = *(trackData + curOffset++);
-          t->AddModulation(c, amount);
-          break;
-        }
-        case rsnd::MML_MOD_SPEED:
-        case rsnd::MML_MOD_TYPE:
-        case rsnd::MML_MOD_RANGE:
-        {
-          curOffset++;
-          break;
-        }
-        case rsnd::MML_FXSEND_A:
-        case rsnd::MML_FXSEND_B:
-        case rsnd::MML_FXSEND_C:
-          curOffset++;
-          break;
-        default:
-          std::cerr << "Error: Unknown MML command " << std::hex << "0x" << (int)status_byte << '\n';
-          exit(-1);
-          break;
-        }
-      }
-    }
-  }
+void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf, uint32_t startOffset) {
+  //  decoded once, calls and loops then run from the instructions
+  const rsnd::SeqProgram program(*assocSeq, { startOffset });
+  const rsnd::SeqInterpreter interpreter(program, limits);
+  //  one per track, opened tracks add theirs
+  std::deque<MidiTrackSink> sinks;
+  interpreter.run(program.indexOf(startOffset), sinks.emplace_back(this, sinks, 0, 0));
   
   Sort();
 
@@ -367,12 +195,10 @@ void MidiFile::WriteMidiToBuffer(std::vector<uint8_t> &buf) {
   for (uint32_t i = 0; i < aTracks.size(); i++) {
     if (aTracks[i]) {
       std::vector<uint8_t> trackBuf;
-      globalTranspose = 0;
       aTracks[i]->WriteTrack(trackBuf);
       buf.insert(buf.end(), trackBuf.begin(), trackBuf.end());
     }
   }
-  globalTranspose = 0;
 }
 
 //  *********
@@ -385,24 +211,31 @@ MidiTrack::MidiTrack(MidiFile *theParentSeq, bool monophonic)
       bHasEndOfTrack(false),
       channelGroup(0),
       DeltaTime(0),
-      prevDurEvent(nullptr),
-      prevKey(0),
-      bSustain(false) {}
+      bSustain(false),
+      aEvents(&theParentSeq->arena),
+      pendingEvents(&theParentSeq->arena),
+      nextPendingSeq(0) {}
 
-MidiTrack::~MidiTrack(void) {
-  DeleteVect<MidiEvent>(aEvents);
-}
+MidiTrack::~MidiTrack(void) = default;
 
+//  aEvents is kept ordered by time, then priority, then insertion as events are added, so sorting only has to
+//  move the pending events behind it
 void MidiTrack::Sort(void) {
-  std::ranges::stable_sort(aEvents, PriorityCmp()); // Sort all the events by priority
-  std::ranges::stable_sort(aEvents, AbsTimeCmp());  // Sort all the events by absolute time,
-                                                             // so that delta times can be recorded correctly
+  FlushPendingEvents();
   if (!bHasEndOfTrack && aEvents.size()) {
-    aEvents.push_back(new EndOfTrackEvent(this, aEvents.back()->AbsTime));
+    AppendOrdered(NewEvent(MIDIEVENT_ENDOFTRACK, 0, aEvents.back().AbsTime, PRIORITY_LOWEST));
     bHasEndOfTrack = true;
   }
 }
 
+void MidiTrack::FlushPendingEvents() {
+  while (!pendingEvents.empty()) {
+    std::ranges::pop_heap(pendingEvents, PendingEventCmp());
+    AppendOrdered(pendingEvents.back().event);
+    pendingEvents.pop_back();
+  }
+}
+
 void MidiTrack::WriteTrack(std::vector<uint8_t> &buf) const {
   buf.push_back('M');
   buf.push_back('T');
@@ -413,19 +246,19 @@ void MidiTrack::WriteTrack(std::vector<uint8_t> &buf) const {
   buf.push_back(0);
   buf.push_back(0);
   uint32_t time = 0;  // start at 0 ticks
-
-  std::vector<MidiEvent *> finalEvents(aEvents);
-  std::vector<MidiEvent *> &globEvents = parentSeq->globalTrack.aEvents;
-  finalEvents.insert(finalEvents.end(), globEvents.begin(), globEvents.end());
-
-  std::ranges::stable_sort(finalEvents, PriorityCmp()); // Sort all the events by priority
-  std::ranges::stable_sort(finalEvents, AbsTimeCmp());  // Sort all the events by absolute time,
-                                                                 // so that delta times can be recorded correctly
-
-  size_t numEvents = finalEvents.size();
-
-  for (size_t i = 0; i < numEvents; i++)
-    time = finalEvents[i]->WriteEvent(buf, time);  // write all events into the buffer
+  int8_t globalTranspose = 0;
+
+  //  Merge the track's events with the global track's, both already ordered (see Sort). On ties the track's come
+  //  first, as a stable sort of the track's events followed by the global ones would have it
+  const std::pmr::vector<MidiEvent> &globEvents = parentSeq->globalTrack.aEvents;
+  auto event = aEvents.begin();
+  auto globEvent = globEvents.begin();
+  while (event != aEvents.end() || globEvent != globEvents.end()) {
+    if (globEvent == globEvents.end() || (event != aEvents.end() && !EventOrderCmp()(*globEvent, *event)))
+      time = WriteEvent(*event++, buf, time, globalTranspose);
+    else
+      time = WriteEvent(*globEvent++, buf, time, globalTranspose);
+  }
 
   size_t trackSize = buf.size() - 8;  // -8 for MTrk and size that shouldn't be accounted for
   buf[4] = static_cast<uint8_t>((trackSize & 0xFF000000) >> 24);
@@ -434,6 +267,155 @@ void MidiTrack::WriteTrack(std::vector<uint8_t> &buf) const {
   buf[7] = static_cast<uint8_t>(trackSize & 0x000000FF);
 }
 
+static uint32_t WriteMetaEvent(std::vector<uint8_t> &buf, uint32_t time, uint32_t absTime, uint8_t metaType,
+                               const uint8_t *data, size_t dataSize) {
+  MidiEvent::WriteVarLength(buf, absTime - time);
+  buf.push_back(0xFF);
+  buf.push_back(metaType);
+  MidiEvent::WriteVarLength(buf, static_cast<uint32_t>(dataSize));
+  buf.insert(buf.end(), data, data + dataSize);
+  return absTime;
+}
+
+//  Writes one event and returns its time, the time the next delta is relative to. globalTranspose is the
+//  transpose in effect, set by global transpose events
+uint32_t MidiTrack::WriteEvent(const MidiEvent &event, std::vector<uint8_t> &buf, uint32_t time,
+                               int8_t &globalTranspose) {
+  switch (event.type) {
+  case MIDIEVENT_NOTEON: {
+    MidiEvent::WriteVarLength(buf, event.AbsTime - time);
+    buf.push_back((event.note.bNoteDown ? 0x90 : 0x80) + event.channel);
+    buf.push_back(event.note.key + ((event.channel == 9) ? 0 : globalTranspose));
+    buf.push_back(event.note.vel);
+    return event.AbsTime;
+  }
+  case MIDIEVENT_CONTROLLER:
+  case MIDIEVENT_VOLUME:
+  case MIDIEVENT_EXPRESSION:
+  case MIDIEVENT_PAN:
+  case MIDIEVENT_MODULATION:
+  case MIDIEVENT_BREATH:
+  case MIDIEVENT_SUSTAIN:
+  case MIDIEVENT_PORTAMENTO:
+  case MIDIEVENT_PORTAMENTOTIME:
+  case MIDIEVENT_PORTAMENTOTIMEFINE:
+  case MIDIEVENT_PORTAMENTOCONTROL:
+  case MIDIEVENT_BANKSELECT:
+  case MIDIEVENT_BANKSELECTFINE:
+  case MIDIEVENT_MONO:
+    MidiEvent::WriteVarLength(buf, event.AbsTime - time);
+    buf.push_back(0xB0 + event.channel);
+    buf.push_back(event.controller.controlNum & 0x7F);
+    buf.push_back(event.controller.dataByte);
+    return event.AbsTime;
+  case MIDIEVENT_SYSEX:
+  case MIDIEVENT_MASTERVOL:
+  case MIDIEVENT_RESET:
+    MidiEvent::WriteVarLength(buf, event.AbsTime - time);
+    buf.push_back(0xF0);
+    buf.insert(buf.end(), event.bytes.data, event.bytes.data + event.bytes.size);
+    buf.push_back(0xF7);
+    return event.AbsTime;
+  case MIDIEVENT_PROGRAMCHANGE:
+    MidiEvent::WriteVarLength(buf, event.AbsTime - time);
+    buf.push_back(0xC0 + event.channel);
+    buf.push_back(event.programNum & 0x7F);
+    return event.AbsTime;
+  case MIDIEVENT_PITCHBEND:
+    MidiEvent::WriteVarLength(buf, event.AbsTime - time);
+    buf.push_back(0xE0 + event.channel);
+    buf.push_back((event.bend + 0x2000) & 0x7F);
+    buf.push_back(((event.bend + 0x2000) & 0x3F80) >> 7);
+    return event.AbsTime;
+  case MIDIEVENT_TEMPO: {
+    uint8_t data[3] = {
+        static_cast<uint8_t>((event.microSecs & 0xFF0000) >> 16),
+        static_cast<uint8_t>((event.microSecs & 0x00FF00) >> 8),
+        static_cast<uint8_t>(event.microSecs & 0x0000FF)
+    };
+    return WriteMetaEvent(buf, time, event.AbsTime, 0x51, data, 3);
+  }
+  case MIDIEVENT_MIDIPORT:
+    return WriteMetaEvent(buf, time, event.AbsTime, 0x21, &event.port, 1);
+  case MIDIEVENT_TIMESIG: {
+    //denom is expressed in power of 2... so if we have 6/8 time.  it's 6 = 2^x  ==  ln6 / ln2
+    uint8_t data[4] = {
+        event.timeSig.numer,
+        static_cast<uint8_t>(log(static_cast<double>(event.timeSig.denom)) / 0.69314718055994530941723212145818),
+        event.timeSig.ticksPerQuarter,
+        8
+    };
+    return WriteMetaEvent(buf, time, event.AbsTime, 0x58, data, 4);
+  }
+  case MIDIEVENT_ENDOFTRACK:
+    return WriteMetaEvent(buf, time, event.AbsTime, 0x2F, nullptr, 0);
+  case MIDIEVENT_TEXT:
+    return WriteMetaEvent(buf, time, event.AbsTime, event.bytes.metaType, event.bytes.data, event.bytes.size);
+  // SPECIAL EVENTS THAT AFFECT OTHER MIDI EVENTS RATHER THAN DIRECTLY OUTPUT TO THE FILE
+  case MIDIEVENT_GLOBALTRANSPOSE:
+    globalTranspose = event.semitones;
+    return time;
+  default:
+    return time;
+  }
+}
+
+MidiEvent MidiTrack::NewEvent(MidiEventType type, uint8_t channel, uint32_t absTime, int8_t priority) {
+  MidiEvent event = {};
+  event.AbsTime = absTime;
+  event.type = type;
+  event.channel = channel;
+  event.priority = priority;
+  return event;
+}
+
+//  Events ahead of the current time that would come after everything in aEvents (mostly the note offs of notes
+//  still playing) wait in the pending heap. Anything else goes into aEvents, after the pending events that come
+//  before it
+void MidiTrack::InsertEvent(const MidiEvent &event) {
+  if (event.AbsTime > DeltaTime && (aEvents.empty() || !EventOrderCmp()(event, aEvents.back()))) {
+    pendingEvents.push_back({event, nextPendingSeq++});
+    std::ranges::push_heap(pendingEvents, PendingEventCmp());
+    return;
+  }
+  while (!pendingEvents.empty() && !EventOrderCmp()(event, pendingEvents.front().event)) {
+    std::ranges::pop_heap(pendingEvents, PendingEventCmp());
+    AppendOrdered(pendingEvents.back().event);
+    pendingEvents.pop_back();
+  }
+  AppendOrdered(event);
+}
+
+//  Adds an event no older than any in aEvents, moving it back past the events of its tick with lower priority
+void MidiTrack::AppendOrdered(const MidiEvent &event) {
+  aEvents.push_back(event);
+  for (size_t i = aEvents.size() - 1; i > 0 && EventOrderCmp()(aEvents[i], aEvents[i - 1]); i--)
+    std::swap(aEvents[i], aEvents[i - 1]);
+}
+
+void MidiTrack::InsertController(MidiEventType type, uint8_t channel, uint8_t controllerNum, uint8_t theDataByte,
+                                 uint32_t absTime, int8_t priority) {
+  MidiEvent event = NewEvent(type, channel, absTime, priority);
+  event.controller.controlNum = controllerNum;
+  event.controller.dataByte = theDataByte;
+  InsertEvent(event);
+}
+
+void MidiTrack::InsertSysex(MidiEventType type, const uint8_t *data, size_t size, int8_t priority, uint32_t absTime) {
+  MidiEvent event = NewEvent(type, 0, absTime, priority);
+  event.bytes.data = data;
+  event.bytes.size = static_cast<uint32_t>(size);
+  InsertEvent(event);
+}
+
+void MidiTrack::InsertMetaText(uint8_t metaType, const std::string &str, uint32_t absTime) {
+  MidiEvent event = NewEvent(MIDIEVENT_TEXT, 0, absTime, PRIORITY_LOWEST);
+  event.bytes.data = parentSeq->ArenaCopy(str.data(), str.size());
+  event.bytes.size = static_cast<uint32_t>(str.size());
+  event.bytes.metaType = metaType;
+  InsertEvent(event);
+}
+
 void MidiTrack::SetChannelGroup(int theChannelGroup) {
   channelGroup = theChannelGroup;
 }
@@ -460,36 +442,41 @@ void MidiTrack::ResetDelta(void) {
 }
 
 void MidiTrack::AddNoteOn(uint8_t channel, int8_t key, int8_t vel) {
-  aEvents.push_back(new NoteEvent(this, channel, GetDelta(), true, key, vel));
+  InsertNoteOn(channel, key, vel, GetDelta());
 }
 
 void MidiTrack::InsertNoteOn(uint8_t channel, int8_t key, int8_t vel, uint32_t absTime) {
-  aEvents.push_back(new NoteEvent(this, channel, absTime, true, key, vel));
+  MidiEvent event = NewEvent(MIDIEVENT_NOTEON, channel, absTime, PRIORITY_LOWER);
+  event.note.bNoteDown = true;
+  event.note.key = key;
+  event.note.vel = vel;
+  InsertEvent(event);
 }
 
 void MidiTrack::AddNoteOff(uint8_t channel, int8_t key) {
-  aEvents.push_back(new NoteEvent(this, channel, GetDelta(), false, key));
+  InsertNoteOff(channel, key, GetDelta());
 }
 
 void MidiTrack::InsertNoteOff(uint8_t channel, int8_t key, uint32_t absTime) {
-  aEvents.push_back(new NoteEvent(this, channel, absTime, false, key));
+  MidiEvent event = NewEvent(MIDIEVENT_NOTEON, channel, absTime, PRIORITY_LOWER);
+  event.note.bNoteDown = false;
+  event.note.key = key;
+  event.note.vel = 64;
+  InsertEvent(event);
 }
 
 void MidiTrack::AddNoteByDur(uint8_t channel, int8_t key, int8_t vel, uint32_t duration) {
-  PurgePrevNoteOffs(GetDelta());
-  aEvents.push_back(new NoteEvent(this, channel, GetDelta(), true, key, vel));  // add note on
-  NoteEvent *prevDurNoteOff = new NoteEvent(this, channel, GetDelta() + duration, false, key);
-  prevDurNoteOffs.push_back(prevDurNoteOff);
-  aEvents.push_back(prevDurNoteOff);  // add note off at end of dur
+  InsertNoteByDur(channel, key, vel, duration, GetDelta());
 }
 
 //TODO: MOVE! This definitely doesn't belong here.
 void MidiTrack::AddNoteByDur_TriAce(uint8_t channel, int8_t key, int8_t vel, uint32_t duration) {
   uint32_t CurDelta = GetDelta();
-  size_t nNumEvents = aEvents.size();
 
-  NoteEvent* ContNote = nullptr;  // Continuted Note
-  for (size_t curEvt = 0; curEvt < nNumEvents; curEvt++) {
+  // A note off ahead of the current time is still pending
+  PendingEvent *ContNote = nullptr;  // Continuted Note
+  for (PendingEvent &pending : pendingEvents) {
+    const MidiEvent &event = pending.event;
     // Check for a event on this track with the following conditions:
     //	1. Its Event Delta Time is > current Delta Time.
     //	2. It's a Note Off event
@@ -500,32 +487,27 @@ void MidiTrack::AddNoteByDur_TriAce(uint8_t channel, int8_t key, int8_t vel, uin
     // Note: In previous TriAce drivers (like MegaDrive and SNES versions),
     //       a Note gets extended by a Note On event at the tick where another note expires.
     //       Valkyrie Profile: 225 Fragments of the Heart confirms, that this is NOT the case in the PS1 version.
-    if (aEvents[curEvt]->AbsTime > CurDelta && aEvents[curEvt]->GetEventType() == MIDIEVENT_NOTEON) {
-      NoteEvent *NoteEvt = static_cast<NoteEvent*>(aEvents[curEvt]);
-      if (NoteEvt->key == key && !NoteEvt->bNoteDown) {
-        ContNote = NoteEvt;
+    if (event.AbsTime > CurDelta && event.type == MIDIEVENT_NOTEON) {
+      if (event.note.key == key && !event.note.bNoteDown) {
+        ContNote = &pending;
         break;
       }
     }
   }
 
   if (ContNote == nullptr) {
-    PurgePrevNoteOffs(CurDelta);
-    aEvents.push_back(new NoteEvent(this, channel, CurDelta, true, key, vel));  // add note on
-    NoteEvent *prevDurNoteOff = new NoteEvent(this, channel, CurDelta + duration, false, key);
-    prevDurNoteOffs.push_back(prevDurNoteOff);
-    aEvents.push_back(prevDurNoteOff);  // add note off at end of dur
+    InsertNoteByDur(channel, key, vel, duration, CurDelta);
   } else {
-    ContNote->AbsTime = CurDelta + duration;  // fix DeltaTime of the already inserted NoteOff event
+    ContNote->event.AbsTime = CurDelta + duration;  // fix DeltaTime of the already inserted NoteOff event
+    std::ranges::make_heap(pendingEvents, PendingEventCmp());
   }
 }
 
 void MidiTrack::InsertNoteByDur(uint8_t channel, int8_t key, int8_t vel, uint32_t duration, uint32_t absTime) {
   PurgePrevNoteOffs(std::max(GetDelta(), absTime));
-  aEvents.push_back(new NoteEvent(this, channel, absTime, true, key, vel));  // add note on
-  NoteEvent *prevDurNoteOff = new NoteEvent(this, channel, absTime + duration, false, key);
-  prevDurNoteOffs.push_back(prevDurNoteOff);
-  aEvents.push_back(prevDurNoteOff);  // add note off at end of dur
+  InsertNoteOn(channel, key, vel, absTime);  // add note on
+  prevDurNoteOffs.push_back(absTime + duration);
+  InsertNoteOff(channel, key, absTime + duration);  // add note off at end of dur
 }
 
 void MidiTrack::PurgePrevNoteOffs() {
@@ -533,141 +515,128 @@ void MidiTrack::PurgePrevNoteOffs() {
 }
 
 void MidiTrack::PurgePrevNoteOffs(uint32_t absTime) {
-  prevDurNoteOffs.erase(std::remove_if(prevDurNoteOffs.begin(), prevDurNoteOffs.end(),
-    [absTime](const NoteEvent *e) { return e && e->AbsTime <= absTime; }),
-    prevDurNoteOffs.end());
-}
-
-/*void MidiTrack::AddVolMarker(uint8_t channel, uint8_t vol, int8_t priority)
-{
-	MidiEvent* newEvent = new VolMarkerEvent(this, channel, GetDelta(), vol);
-	aEvents.push_back(newEvent);
+  std::erase_if(prevDurNoteOffs, [absTime](uint32_t noteOffTime) { return noteOffTime <= absTime; });
 }
 
-void MidiTrack::InsertVolMarker(uint8_t channel, uint8_t vol, uint32_t absTime, int8_t priority)
-{
-	MidiEvent* newEvent = new VolMarkerEvent(this, channel, absTime, vol);
-	aEvents.push_back(newEvent);
-}*/
-
 void MidiTrack::AddControllerEvent(uint8_t channel, uint8_t controllerNum, uint8_t theDataByte) {
-  aEvents.push_back(new ControllerEvent(this, channel, GetDelta(), controllerNum, theDataByte));
+  InsertControllerEvent(channel, controllerNum, theDataByte, GetDelta());
 }
 
 void MidiTrack::InsertControllerEvent(uint8_t channel, uint8_t controllerNum, uint8_t theDataByte, uint32_t absTime) {
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, controllerNum, theDataByte));
+  InsertController(MIDIEVENT_CONTROLLER, channel, controllerNum, theDataByte, absTime);
 }
 
 void MidiTrack::AddVol(uint8_t channel, uint8_t vol) {
-  aEvents.push_back(new VolumeEvent(this, channel, GetDelta(), vol));
+  InsertVol(channel, vol, GetDelta());
 }
 
 void MidiTrack::InsertVol(uint8_t channel, uint8_t vol, uint32_t absTime) {
-  aEvents.push_back(new VolumeEvent(this, channel, absTime, vol));
+  InsertController(MIDIEVENT_VOLUME, channel, 7, vol, absTime);
 }
 
 //TODO: Master Volume sysex events are meant to be global to device, not per channel.
 // For per channel master volume, we should add a system for normalizing controller vol events.
 void MidiTrack::AddMasterVol(uint8_t channel, uint8_t mastVol) {
-  MidiEvent *newEvent = new MasterVolEvent(this, channel, GetDelta(), mastVol);
-  aEvents.push_back(newEvent);
+  InsertMasterVol(channel, mastVol, GetDelta());
 }
 
-void MidiTrack::InsertMasterVol(uint8_t channel, uint8_t mastVol, uint32_t absTime) {
-  MidiEvent *newEvent = new MasterVolEvent(this, channel, absTime, mastVol);
-  aEvents.push_back(newEvent);
+void MidiTrack::InsertMasterVol(uint8_t /* channel */, uint8_t mastVol, uint32_t absTime) {
+  const uint8_t data[] = {0x07, 0x7F, 0x7F, 0x04, 0x01, 0, mastVol};
+  InsertSysex(MIDIEVENT_MASTERVOL, parentSeq->ArenaCopy(data, sizeof(data)), sizeof(data), PRIORITY_HIGHER, absTime);
 }
 
 void MidiTrack::AddExpression(uint8_t channel, uint8_t expression) {
-  aEvents.push_back(new ExpressionEvent(this, channel, GetDelta(), expression));
+  InsertExpression(channel, expression, GetDelta());
 }
 
 void MidiTrack::InsertExpression(uint8_t channel, uint8_t expression, uint32_t absTime) {
-  aEvents.push_back(new ExpressionEvent(this, channel, absTime, expression));
+  InsertController(MIDIEVENT_EXPRESSION, channel, 11, expression, absTime);
 }
 
 void MidiTrack::AddSustain(uint8_t channel, uint8_t depth) {
-  aEvents.push_back(new SustainEvent(this, channel, GetDelta(), depth));
+  InsertSustain(channel, depth, GetDelta());
 }
 
 void MidiTrack::InsertSustain(uint8_t channel, uint8_t depth, uint32_t absTime) {
-  aEvents.push_back(new SustainEvent(this, channel, absTime, depth));
+  InsertController(MIDIEVENT_SUSTAIN, channel, 64, depth, absTime);
 }
 
 void MidiTrack::AddPortamento(uint8_t channel, bool bOn) {
-  aEvents.push_back(new PortamentoEvent(this, channel, GetDelta(), bOn));
+  InsertPortamento(channel, bOn, GetDelta());
 }
 
 void MidiTrack::InsertPortamento(uint8_t channel, bool bOn, uint32_t absTime) {
-  aEvents.push_back(new PortamentoEvent(this, channel, absTime, bOn));
+  InsertController(MIDIEVENT_PORTAMENTO, channel, 65, bOn ? 0x7F : 0, absTime);
 }
 
 void MidiTrack::AddPortamentoTime(uint8_t channel, uint8_t time) {
-  aEvents.push_back(new PortamentoTimeEvent(this, channel, GetDelta(), time));
+  InsertPortamentoTime(channel, time, GetDelta());
 }
 
 void MidiTrack::InsertPortamentoTime(uint8_t channel, uint8_t time, uint32_t absTime) {
-  aEvents.push_back(new PortamentoTimeEvent(this, channel, absTime, time));
+  InsertController(MIDIEVENT_PORTAMENTOTIME, channel, 5, time, absTime);
 }
 
 void MidiTrack::AddPortamentoTimeFine(uint8_t channel, uint8_t time) {
-  aEvents.push_back(new PortamentoTimeFineEvent(this, channel, GetDelta(), time));
+  InsertPortamentoTimeFine(channel, time, GetDelta());
 }
 
 void MidiTrack::InsertPortamentoTimeFine(uint8_t channel, uint8_t time, uint32_t absTime) {
-  aEvents.push_back(new PortamentoTimeFineEvent(this, channel, absTime, time));
+  InsertController(MIDIEVENT_PORTAMENTOTIMEFINE, channel, 37, time, absTime);
 }
 
 void MidiTrack::AddPortamentoControl(uint8_t channel, uint8_t key) {
-  aEvents.push_back(new PortamentoControlEvent(this, channel, GetDelta(), key));
+  InsertController(MIDIEVENT_PORTAMENTOCONTROL, channel, 84, key, GetDelta());
 }
 
 void MidiTrack::AddMono(uint8_t channel) {
-  aEvents.push_back(new MonoEvent(this, channel, GetDelta()));
+  InsertMono(channel, GetDelta());
 }
 
 void MidiTrack::InsertMono(uint8_t channel, uint32_t absTime) {
-  aEvents.push_back(new MonoEvent(this, channel, absTime));
+  InsertController(MIDIEVENT_MONO, channel, 126, 0, absTime, PRIORITY_HIGHER);
 }
 
 void MidiTrack::AddPan(uint8_t channel, uint8_t pan) {
-  aEvents.push_back(new PanEvent(this, channel, GetDelta(), pan));
+  InsertPan(channel, pan, GetDelta());
 }
 
 void MidiTrack::InsertPan(uint8_t channel, uint8_t pan, uint32_t absTime) {
-  aEvents.push_back(new PanEvent(this, channel, absTime, pan));
+  InsertController(MIDIEVENT_PAN, channel, 10, pan, absTime);
 }
 
 void MidiTrack::AddReverb(uint8_t channel, uint8_t reverb) {
-  aEvents.push_back(new ControllerEvent(this, channel, GetDelta(), 91, reverb));
+  InsertReverb(channel, reverb, GetDelta());
 }
 
 void MidiTrack::InsertReverb(uint8_t channel, uint8_t reverb, uint32_t absTime) {
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 91, reverb));
+  InsertController(MIDIEVENT_CONTROLLER, channel, 91, reverb, absTime);
 }
 
 void MidiTrack::AddModulation(uint8_t channel, uint8_t depth) {
-  aEvents.push_back(new ModulationEvent(this, channel, GetDelta(), depth));
+  InsertModulation(channel, depth, GetDelta());
 }
 
 void MidiTrack::InsertModulation(uint8_t channel, uint8_t depth, uint32_t absTime) {
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 1, depth));
+  InsertController(MIDIEVENT_MODULATION, channel, 1, depth, absTime);
 }
 
 void MidiTrack::AddBreath(uint8_t channel, uint8_t depth) {
-  aEvents.push_back(new BreathEvent(this, channel, GetDelta(), depth));
+  InsertBreath(channel, depth, GetDelta());
 }
 
 void MidiTrack::InsertBreath(uint8_t channel, uint8_t depth, uint32_t absTime) {
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 2, depth));
+  InsertController(MIDIEVENT_BREATH, channel, 2, depth, absTime);
 }
 
 void MidiTrack::AddPitchBend(uint8_t channel, int16_t bend) {
-  aEvents.push_back(new PitchBendEvent(this, channel, GetDelta(), bend));
+  InsertPitchBend(channel, bend, GetDelta());
 }
 
 void MidiTrack::InsertPitchBend(uint8_t channel, int16_t bend, uint32_t absTime) {
-  aEvents.push_back(new PitchBendEvent(this, channel, absTime, bend));
+  MidiEvent event = NewEvent(MIDIEVENT_PITCHBEND, channel, absTime, PRIORITY_MIDDLE);
+  event.bend = bend;
+  InsertEvent(event);
 }
 
 void MidiTrack::AddPitchBendRange(uint8_t channel, uint8_t semitones, uint8_t cents) {
@@ -676,10 +645,10 @@ void MidiTrack::AddPitchBendRange(uint8_t channel, uint8_t semitones, uint8_t ce
 
 void MidiTrack::InsertPitchBendRange(uint8_t channel, uint8_t semitones, uint8_t cents, uint32_t absTime) {
   // We push the LSB controller event first as somee virtual instruments only react upon receiving MSB
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 101, 0, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 100, 0, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 38, cents, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 6, semitones, PRIORITY_HIGHER - 1));
+  InsertController(MIDIEVENT_CONTROLLER, channel, 101, 0, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 100, 0, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 38, cents, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 6, semitones, absTime, PRIORITY_HIGHER - 1);
 }
 
 void MidiTrack::AddFineTuning(uint8_t channel, uint8_t msb, uint8_t lsb) {
@@ -688,10 +657,10 @@ void MidiTrack::AddFineTuning(uint8_t channel, uint8_t msb, uint8_t lsb) {
 
 void MidiTrack::InsertFineTuning(uint8_t channel, uint8_t msb, uint8_t lsb, uint32_t absTime) {
   // We push the LSB controller event first as somee virtual instruments only react upon receiving MSB
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 101, 0, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 100, 1, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 38, lsb, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 6, msb, PRIORITY_HIGHER - 1));
+  InsertController(MIDIEVENT_CONTROLLER, channel, 101, 0, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 100, 1, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 38, lsb, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 6, msb, absTime, PRIORITY_HIGHER - 1);
 }
 
 void MidiTrack::AddFineTuning(uint8_t channel, double cents) {
@@ -709,10 +678,10 @@ void MidiTrack::AddCoarseTuning(uint8_t channel, uint8_t msb, uint8_t lsb) {
 }
 
 void MidiTrack::InsertCoarseTuning(uint8_t channel, uint8_t msb, uint8_t lsb, uint32_t absTime) {
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 101, 0, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 100, 2, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 38, lsb, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 6, msb, PRIORITY_HIGHER - 1));
+  InsertController(MIDIEVENT_CONTROLLER, channel, 101, 0, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 100, 2, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 38, lsb, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 6, msb, absTime, PRIORITY_HIGHER - 1);
 }
 
 void MidiTrack::AddCoarseTuning(uint8_t channel, double semitones) {
@@ -730,10 +699,10 @@ void MidiTrack::AddModulationDepthRange(uint8_t channel, uint8_t msb, uint8_t ls
 }
 
 void MidiTrack::InsertModulationDepthRange(uint8_t channel, uint8_t msb, uint8_t lsb, uint32_t absTime) {
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 101, 0, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 100, 5, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 38, lsb, PRIORITY_HIGHER - 1));
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 6, msb, PRIORITY_HIGHER - 1));
+  InsertController(MIDIEVENT_CONTROLLER, channel, 101, 0, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 100, 5, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 38, lsb, absTime, PRIORITY_HIGHER - 1);
+  InsertController(MIDIEVENT_CONTROLLER, channel, 6, msb, absTime, PRIORITY_HIGHER - 1);
 }
 
 void MidiTrack::AddModulationDepthRange(uint8_t channel, double semitones) {
@@ -747,125 +716,138 @@ void MidiTrack::InsertModulationDepthRange(uint8_t channel, double semitones, ui
 }
 
 void MidiTrack::AddProgramChange(uint8_t channel, uint8_t progNum) {
-  aEvents.push_back(new ProgChangeEvent(this, channel, GetDelta(), progNum));
+  MidiEvent event = NewEvent(MIDIEVENT_PROGRAMCHANGE, channel, GetDelta(), PRIORITY_HIGH);
+  event.programNum = progNum;
+  InsertEvent(event);
 }
 
 void MidiTrack::AddBankSelect(uint8_t channel, uint8_t bank) {
-  aEvents.push_back(new BankSelectEvent(this, channel, GetDelta(), bank));
+  InsertController(MIDIEVENT_BANKSELECT, channel, 0, bank, GetDelta(), PRIORITY_HIGH);
 }
 
 void MidiTrack::AddBankSelectFine(uint8_t channel, uint8_t lsb) {
-  aEvents.push_back(new BankSelectFineEvent(this, channel, GetDelta(), lsb));
+  InsertController(MIDIEVENT_BANKSELECTFINE, channel, 32, lsb, GetDelta(), PRIORITY_HIGH);
 }
 
 void MidiTrack::InsertBankSelect(uint8_t channel, uint8_t bank, uint32_t absTime) {
-  aEvents.push_back(new ControllerEvent(this, channel, absTime, 0, bank));
+  InsertController(MIDIEVENT_CONTROLLER, channel, 0, bank, absTime);
 }
 
 void MidiTrack::AddTempo(uint32_t microSeconds) {
-  aEvents.push_back(new TempoEvent(this, GetDelta(), microSeconds));
+  InsertTempo(microSeconds, GetDelta());
   //bAddedTempo = true;
 }
 
 void MidiTrack::AddTempoBPM(double BPM) {
-  uint32_t microSecs = static_cast<uint32_t>(std::round(60000000.0 / BPM));
-  aEvents.push_back(new TempoEvent(this, GetDelta(), microSecs));
+  InsertTempoBPM(BPM, GetDelta());
   //bAddedTempo = true;
 }
 
 void MidiTrack::InsertTempo(uint32_t microSeconds, uint32_t absTime) {
-  aEvents.push_back(new TempoEvent(this, absTime, microSeconds));
+  MidiEvent event = NewEvent(MIDIEVENT_TEMPO, 0, absTime, PRIORITY_HIGHEST);
+  event.microSecs = microSeconds;
+  InsertEvent(event);
   //bAddedTempo = true;
 }
 
 void MidiTrack::InsertTempoBPM(double BPM, uint32_t absTime) {
   uint32_t microSecs = static_cast<uint32_t>(std::round(60000000.0 / BPM));
-  aEvents.push_back(new TempoEvent(this, absTime, microSecs));
+  InsertTempo(microSecs, absTime);
   //bAddedTempo = true;
 }
 
 void MidiTrack::AddMidiPort(uint8_t port) {
-  aEvents.push_back(new MidiPortEvent(this, GetDelta(), port));
+  InsertMidiPort(port, GetDelta());
 }
 
 void MidiTrack::InsertMidiPort(uint8_t port, uint32_t absTime) {
-  aEvents.push_back(new MidiPortEvent(this, absTime, port));
+  MidiEvent event = NewEvent(MIDIEVENT_MIDIPORT, 0, absTime, PRIORITY_HIGHEST);
+  event.port = port;
+  InsertEvent(event);
 }
 
 void MidiTrack::AddTimeSig(uint8_t numer, uint8_t denom, uint8_t ticksPerQuarter) {
-  aEvents.push_back(new TimeSigEvent(this, GetDelta(), numer, denom, ticksPerQuarter));
+  InsertTimeSig(numer, denom, ticksPerQuarter, GetDelta());
   //bAddedTimeSig = true;
 }
 
 void MidiTrack::InsertTimeSig(uint8_t numer, uint8_t denom, uint8_t ticksPerQuarter, uint32_t absTime) {
-  aEvents.push_back(new TimeSigEvent(this, absTime, numer, denom, ticksPerQuarter));
+  MidiEvent event = NewEvent(MIDIEVENT_TIMESIG, 0, absTime, PRIORITY_HIGHEST);
+  event.timeSig.numer = numer;
+  event.timeSig.denom = denom;
+  event.timeSig.ticksPerQuarter = ticksPerQuarter;
   //bAddedTimeSig = true;
+  InsertEvent(event);
 }
 
 void MidiTrack::AddEndOfTrack(void) {
-  aEvents.push_back(new EndOfTrackEvent(this, GetDelta()));
-  bHasEndOfTrack = true;
+  InsertEndOfTrack(GetDelta());
 }
 
 void MidiTrack::InsertEndOfTrack(uint32_t absTime) {
-  aEvents.push_back(new EndOfTrackEvent(this, absTime));
+  InsertEvent(NewEvent(MIDIEVENT_ENDOFTRACK, 0, absTime, PRIORITY_LOWEST));
   bHasEndOfTrack = true;
 }
 
 void MidiTrack::AddText(const std::string &str) {
-  aEvents.push_back(new TextEvent(this, GetDelta(), str));
+  InsertText(str, GetDelta());
 }
 
 void MidiTrack::InsertText(const std::string &str, uint32_t absTime) {
-  aEvents.push_back(new TextEvent(this, absTime, str));
+  InsertMetaText(0x01, str, absTime);
 }
 
 void MidiTrack::AddSeqName(const std::string &str) {
-  aEvents.push_back(new SeqNameEvent(this, GetDelta(), str));
+  InsertSeqName(str, GetDelta());
 }
 
 void MidiTrack::InsertSeqName(const std::string &str, uint32_t absTime) {
-  aEvents.push_back(new SeqNameEvent(this, absTime, str));
+  InsertMetaText(0x03, str, absTime);
 }
 
 void MidiTrack::AddTrackName(const std::string &str) {
-  aEvents.push_back(new TrackNameEvent(this, GetDelta(), str));
+  InsertTrackName(str, GetDelta());
 }
 
 void MidiTrack::InsertTrackName(const std::string &str, uint32_t absTime) {
-  aEvents.push_back(new TrackNameEvent(this, absTime, str));
+  InsertMetaText(0x03, str, absTime);
 }
 
+static const uint8_t GM_RESET[] = {0x05, 0x7E, 0x7F, 0x09, 0x01};
+static const uint8_t GM2_RESET[] = {0x05, 0x7E, 0x7F, 0x09, 0x03};
+static const uint8_t GS_RESET[] = {0x0A, 0x41, 0x10, 0x42, 0x12, 0x40, 0x00, 0x7F, 0x00, 0x41};
+static const uint8_t XG_RESET[] = {0x08, 0x43, 0x10, 0x4C, 0x00, 0x00, 0x7E, 0x00};
+
 void MidiTrack::AddGMReset() {
-  aEvents.push_back(new GMResetEvent(this, GetDelta()));
+  InsertGMReset(GetDelta());
 }
 
 void MidiTrack::InsertGMReset(uint32_t absTime) {
-  aEvents.push_back(new GMResetEvent(this, absTime));
+  InsertSysex(MIDIEVENT_RESET, GM_RESET, sizeof(GM_RESET), PRIORITY_HIGHEST, absTime);
 }
 
 void MidiTrack::AddGM2Reset() {
-  aEvents.push_back(new GM2ResetEvent(this, GetDelta()));
+  InsertGM2Reset(GetDelta());
 }
 
 void MidiTrack::InsertGM2Reset(uint32_t absTime) {
-  aEvents.push_back(new GM2ResetEvent(this, absTime));
+  InsertSysex(MIDIEVENT_RESET, GM2_RESET, sizeof(GM2_RESET), PRIORITY_HIGHEST, absTime);
 }
 
 void MidiTrack::AddGSReset() {
-  aEvents.push_back(new GSResetEvent(this, GetDelta()));
+  InsertGSReset(GetDelta());
 }
 
 void MidiTrack::InsertGSReset(uint32_t absTime) {
-  aEvents.push_back(new GSResetEvent(this, absTime));
+  InsertSysex(MIDIEVENT_RESET, GS_RESET, sizeof(GS_RESET), PRIORITY_HIGHEST, absTime);
 }
 
 void MidiTrack::AddXGReset() {
-  aEvents.push_back(new XGResetEvent(this, GetDelta()));
+  InsertXGReset(GetDelta());
 }
 
 void MidiTrack::InsertXGReset(uint32_t absTime) {
-  aEvents.push_back(new XGResetEvent(this, absTime));
+  InsertSysex(MIDIEVENT_RESET, XG_RESET, sizeof(XG_RESET), PRIORITY_HIGHEST, absTime);
 }
 
 // SPECIAL NON-MIDI EVENTS
@@ -879,7 +861,9 @@ void MidiTrack::InsertXGReset(uint32_t absTime) {
 //}
 
 void MidiTrack::InsertGlobalTranspose(uint32_t absTime, int8_t semitones) {
-  aEvents.push_back(new GlobalTransposeEvent(this, absTime, semitones));
+  MidiEvent event = NewEvent(MIDIEVENT_GLOBALTRANSPOSE, 0, absTime, PRIORITY_HIGHEST);
+  event.semitones = semitones;
+  InsertEvent(event);
 }
 
 
@@ -888,7 +872,7 @@ void MidiTrack::AddMarker(uint8_t channel,
                           uint8_t databyte1,
                           uint8_t databyte2,
                           int8_t priority) {
-  aEvents.push_back(new MarkerEvent(this, channel, GetDelta(), markername, databyte1, databyte2, priority));
+  InsertMarker(channel, markername, databyte1, databyte2, priority, GetDelta());
 }
 
 void MidiTrack::InsertMarker(uint8_t channel,
@@ -897,22 +881,19 @@ void MidiTrack::InsertMarker(uint8_t channel,
                   uint8_t databyte2,
                   int8_t priority,
                   uint32_t absTime) {
-  aEvents.push_back(new MarkerEvent(this, channel, absTime, markername, databyte1, databyte2, priority));
+  MidiEvent event = NewEvent(MIDIEVENT_MARKER, channel, absTime, priority);
+  event.marker.name = reinterpret_cast<const char *>(parentSeq->ArenaCopy(markername.data(), markername.size()));
+  event.marker.nameLength = static_cast<uint32_t>(markername.size());
+  event.marker.databyte1 = databyte1;
+  event.marker.databyte2 = databyte2;
+  InsertEvent(event);
 }
 
 //  *********
 //  MidiEvent
 //  *********
 
-MidiEvent::MidiEvent(MidiTrack *thePrntTrk, uint32_t absoluteTime, uint8_t theChannel, int8_t thePriority)
-    : prntTrk(thePrntTrk), channel(theChannel), AbsTime(absoluteTime), priority(thePriority) {
-}
-
-MidiEvent::~MidiEvent(void) {
-}
-
-bool MidiEvent::IsMetaEvent() {
-  MidiEventType type = GetEventType();
+bool MidiEvent::IsMetaEvent() const {
   return type == MIDIEVENT_TEMPO ||
          type == MIDIEVENT_TEXT ||
          type == MIDIEVENT_MIDIPORT ||
@@ -920,10 +901,10 @@ bool MidiEvent::IsMetaEvent() {
          type == MIDIEVENT_ENDOFTRACK;
 }
 
-bool MidiEvent::IsSysexEvent() {
-  MidiEventType type = GetEventType();
+bool MidiEvent::IsSysexEvent() const {
   return type == MIDIEVENT_MASTERVOL ||
-         type == MIDIEVENT_RESET;
+         type == MIDIEVENT_RESET ||
+         type == MIDIEVENT_SYSEX;
 }
 
 void MidiEvent::WriteVarLength(std::vector<uint8_t> &buf, uint32_t value) {
@@ -943,25 +924,6 @@ void MidiEvent::WriteVarLength(std::vector<uint8_t> &buf, uint32_t value) {
   }
 }
 
-uint32_t MidiEvent::WriteMetaEvent(std::vector<uint8_t> &buf,
-                                   uint32_t time,
-                                   uint8_t metaType,
-                                   const uint8_t* data,
-                                   size_t dataSize) const {
-  WriteVarLength(buf, AbsTime - time);
-  buf.push_back(0xFF);
-  buf.push_back(metaType);
-  WriteVarLength(buf, static_cast<uint32_t>(dataSize));
-  for (size_t dataIndex = 0; dataIndex < dataSize; dataIndex++) {
-    buf.push_back(data[dataIndex]);
-  }
-  return AbsTime;
-}
-
-uint32_t MidiEvent::WriteMetaTextEvent(std::vector<uint8_t> &buf, uint32_t time, uint8_t metaType, const std::string& str) const {
-  return WriteMetaEvent(buf, time, metaType, (uint8_t *)str.c_str(), str.length());
-}
-
 std::string MidiEvent::GetNoteName(int noteNumber) {
   const char* noteNames[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
 
@@ -978,278 +940,3 @@ std::string MidiEvent::GetNoteName(int noteNumber) {
 
   return std::string(noteNames[key]) + " " + std::to_string(octave);
 }
-
-bool MidiEvent::operator<(const MidiEvent &theMidiEvent) const {
-  return (AbsTime < theMidiEvent.AbsTime);
-}
-
-bool MidiEvent::operator>(const MidiEvent &theMidiEvent) const {
-  return (AbsTime > theMidiEvent.AbsTime);
-}
-
-//  *********
-//  NoteEvent
-//  *********
-
-
-NoteEvent::NoteEvent(MidiTrack *prntTrk,
-                     uint8_t channel,
-                     uint32_t absoluteTime,
-                     bool bNoteDown,
-                     uint8_t theKey,
-                     uint8_t theVel)
-    : MidiEvent(prntTrk, absoluteTime, channel, PRIORITY_LOWER),
-      bNoteDown(bNoteDown),
-      key(theKey),
-      vel(theVel) {
-}
-
-uint32_t NoteEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  WriteVarLength(buf, AbsTime - time);
-  if (bNoteDown)
-    buf.push_back(0x90 + channel);
-  else
-    buf.push_back(0x80 + channel);
-
-  prntTrk->prevKey = key + ((channel == 9) ? 0 : prntTrk->parentSeq->globalTranspose);
-  buf.push_back(prntTrk->prevKey);
-
-  buf.push_back(vel);
-
-  return AbsTime;
-}
-
-//  ************
-//  DurNoteEvent
-//  ************
-
-//DurNoteEvent::DurNoteEvent(MidiTrack* prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t theKey, uint8_t theVel, uint32_t theDur)
-//: MidiEvent(prntTrk, absoluteTime, channel, PRIORITY_LOWER), key(theKey), vel(theVel), duration(theDur)
-//{
-//}
-/*
-DurNoteEvent* DurNoteEvent::MakeCopy()
-{
-	return new DurNoteEvent(prntTrk, channel, AbsTime, key, vel, duration);
-}*/
-
-/*void DurNoteEvent::PrepareWrite(vector<MidiEvent*> & aEvents)
-{
-	prntTrk->aEvents.push_back(new NoteEvent(prntTrk, channel, AbsTime, true, key, vel));	//add note on
-	prntTrk->aEvents.push_back(new NoteEvent(prntTrk, channel, AbsTime+duration, false, key, vel));  //add note off at end of dur
-}*/
-
-//uint32_t DurNoteEvent::WriteEvent(vector<uint8_t> & buf, uint32_t time)		//we do note use WriteEvent on DurNoteEvents... this is what PrepareWrite is for, to create NoteEvents in substitute
-//{
-//	return false;
-//}
-
-//  ********
-//  VolEvent
-//  ********
-
-/*VolEvent::VolEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t theVol, int8_t thePriority)
-: ControllerEvent(prntTrk, channel, absoluteTime, 7), vol(theVol)
-{
-}
-
-VolEvent* VolEvent::MakeCopy()
-{
-	return new VolEvent(prntTrk, channel, AbsTime, vol, priority);
-}*/
-
-//  ***************
-//  ControllerEvent
-//  ***************
-
-ControllerEvent::ControllerEvent(MidiTrack *prntTrk,
-                                 uint8_t channel,
-                                 uint32_t absoluteTime,
-                                 uint8_t controllerNum,
-                                 uint8_t theDataByte,
-                                 int8_t thePriority)
-    : MidiEvent(prntTrk, absoluteTime, channel, thePriority), controlNum(controllerNum), dataByte(theDataByte) {
-}
-
-uint32_t ControllerEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  WriteVarLength(buf, AbsTime - time);
-  buf.push_back(0xB0 + channel);
-  buf.push_back(controlNum & 0x7F);
-  buf.push_back(dataByte);
-  return AbsTime;
-}
-
-//  **********
-//  SysexEvent
-//  **********
-
-SysexEvent::SysexEvent(MidiTrack *prntTrk,
-                       uint32_t absoluteTime,
-                       const std::vector<uint8_t>& sysexData,
-                       int8_t thePriority)
-    : MidiEvent(prntTrk, absoluteTime, 0, thePriority), sysexData(sysexData) {
-}
-
-uint32_t SysexEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  WriteVarLength(buf, AbsTime - time);
-  buf.push_back(0xF0);
-  buf.insert(buf.end(), sysexData.begin(), sysexData.end());
-  buf.push_back(0xF7);
-  return AbsTime;
-}
-
-//  ***************
-//  ProgChangeEvent
-//  ***************
-
-ProgChangeEvent::ProgChangeEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t progNum)
-    : MidiEvent(prntTrk, absoluteTime, channel, PRIORITY_HIGH), programNum(progNum) {
-}
-
-uint32_t ProgChangeEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  WriteVarLength(buf, AbsTime - time);
-  buf.push_back(0xC0 + channel);
-  buf.push_back(programNum & 0x7F);
-  return AbsTime;
-}
-
-//  **************
-//  PitchBendEvent
-//  **************
-
-PitchBendEvent::PitchBendEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, int16_t bendAmt)
-    : MidiEvent(prntTrk, absoluteTime, channel, PRIORITY_MIDDLE), bend(bendAmt) {
-}
-
-uint32_t PitchBendEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  uint8_t loByte = (bend + 0x2000) & 0x7F;
-  uint8_t hiByte = ((bend + 0x2000) & 0x3F80) >> 7;
-  WriteVarLength(buf, AbsTime - time);
-  buf.push_back(0xE0 + channel);
-  buf.push_back(loByte);
-  buf.push_back(hiByte);
-  return AbsTime;
-}
-
-//  **********
-//  TempoEvent
-//  **********
-
-TempoEvent::TempoEvent(MidiTrack *prntTrk, uint32_t absoluteTime, uint32_t microSeconds)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_HIGHEST), microSecs(microSeconds) {
-}
-
-uint32_t TempoEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  uint8_t data[3] = {
-      static_cast<uint8_t>((microSecs & 0xFF0000) >> 16),
-      static_cast<uint8_t>((microSecs & 0x00FF00) >> 8),
-      static_cast<uint8_t>(microSecs & 0x0000FF)
-  };
-  return WriteMetaEvent(buf, time, 0x51, data, 3);
-}
-
-
-//  *************
-//  MidiPortEvent
-//  *************
-
-MidiPortEvent::MidiPortEvent(MidiTrack *prntTrk, uint32_t absoluteTime, uint8_t port)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_HIGHEST), port(port) {
-}
-
-uint32_t MidiPortEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  return WriteMetaEvent(buf, time, 0x21, &port, 1);
-}
-
-
-//  ************
-//  TimeSigEvent
-//  ************
-
-TimeSigEvent::TimeSigEvent(MidiTrack *prntTrk,
-                           uint32_t absoluteTime,
-                           uint8_t numerator,
-                           uint8_t denominator,
-                           uint8_t clicksPerQuarter)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_HIGHEST), numer(numerator), denom(denominator),
-      ticksPerQuarter(clicksPerQuarter) {
-}
-
-uint32_t TimeSigEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  //denom is expressed in power of 2... so if we have 6/8 time.  it's 6 = 2^x  ==  ln6 / ln2
-  uint8_t data[4] = {
-      numer,
-      static_cast<uint8_t>(log(static_cast<double>(denom)) / 0.69314718055994530941723212145818),
-      ticksPerQuarter,
-      8
-  };
-  return WriteMetaEvent(buf, time, 0x58, data, 4);
-}
-
-//  ***************
-//  EndOfTrackEvent
-//  ***************
-
-EndOfTrackEvent::EndOfTrackEvent(MidiTrack *prntTrk, uint32_t absoluteTime)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_LOWEST) {
-}
-
-
-uint32_t EndOfTrackEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  return WriteMetaEvent(buf, time, 0x2F, nullptr, 0);
-}
-
-//  *********
-//  TextEvent
-//  *********
-
-TextEvent::TextEvent(MidiTrack *prntTrk, uint32_t absoluteTime, const std::string &str)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_LOWEST), text(str) {
-}
-
-uint32_t TextEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  return WriteMetaTextEvent(buf, time, 0x01, text);
-}
-
-//  ************
-//  SeqNameEvent
-//  ************
-
-SeqNameEvent::SeqNameEvent(MidiTrack *prntTrk, uint32_t absoluteTime, const std::string &str)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_LOWEST), text(str) {
-}
-
-uint32_t SeqNameEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  return WriteMetaTextEvent(buf, time, 0x03, text);
-}
-
-//  **************
-//  TrackNameEvent
-//  **************
-
-TrackNameEvent::TrackNameEvent(MidiTrack *prntTrk, uint32_t absoluteTime, const std::string &str)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_LOWEST), text(str) {
-}
-
-uint32_t TrackNameEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  return WriteMetaTextEvent(buf, time, 0x03, text);
-}
-
-//***************
-// SPECIAL EVENTS
-//***************
-
-//  **************
-//  TransposeEvent
-//  **************
-
-
-GlobalTransposeEvent::GlobalTransposeEvent(MidiTrack *prntTrk, uint32_t absoluteTime, int8_t theSemitones)
-    : MidiEvent(prntTrk, absoluteTime, 0, PRIORITY_HIGHEST) {
-  semitones = theSemitones;
-}
-
-uint32_t GlobalTransposeEvent::WriteEvent(std::vector<uint8_t> &buf, uint32_t time) {
-  this->prntTrk->parentSeq->globalTranspose = this->semitones;
-  return time;
-}
\ No newline at end of file
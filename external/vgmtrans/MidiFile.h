@@ -9,14 +9,13 @@
 #include <list>
 #include <cstdint>
 #include <filesystem>
+#include <memory_resource>
 
-#include "rsnd/SoundSequence.hpp"
+#include "rsnd/SeqProgram.hpp"
 
 class MidiFile;
 class MidiTrack;
-class MidiEvent;
-class DurNoteEvent;
-class NoteEvent;
+struct MidiEvent;
 
 #define PRIORITY_LOWEST 127
 #define PRIORITY_LOWER 96
@@ -26,7 +25,7 @@ class NoteEvent;
 #define PRIORITY_HIGHER -96
 #define PRIORITY_HIGHEST -128
 
-typedef enum {
+typedef enum : uint8_t {
   MIDIEVENT_UNDEFINED,
   MIDIEVENT_MASTERVOL,
   MIDIEVENT_GLOBALTRANSPOSE,
@@ -59,15 +58,89 @@ typedef enum {
   MIDIEVENT_ENDOFTRACK,
   MIDIEVENT_TEXT,
   MIDIEVENT_RESET,
-  MIDIEVENT_MIDIPORT
+  MIDIEVENT_MIDIPORT,
+  MIDIEVENT_CONTROLLER,
+  MIDIEVENT_SYSEX
 } MidiEventType;
 
+//  Events are fixed size records tagged by type, variable length data (text, sysex) lives in the arena of the
+//  MidiFile. NOTEON is used for note offs too, with bNoteDown cleared
+struct MidiEvent {
+  uint32_t AbsTime;            //absolute time... the number of ticks from the very beginning of the sequence at which this event occurs
+  MidiEventType type;
+  uint8_t channel;
+  int8_t priority;
+  union {
+    struct {
+      bool bNoteDown;
+      int8_t key;
+      int8_t vel;
+    } note;
+    struct {
+      uint8_t controlNum;
+      uint8_t dataByte;
+    } controller;
+    uint8_t programNum;
+    int16_t bend;
+    uint32_t microSecs;
+    uint8_t port;
+    struct {
+      uint8_t numer;
+      uint8_t denom;
+      uint8_t ticksPerQuarter;
+    } timeSig;
+    // text meta events and sysex messages (without the F0/F7 framing)
+    struct {
+      const uint8_t *data;
+      uint32_t size;
+      uint8_t metaType;
+    } bytes;
+    int8_t semitones;
+    struct {
+      const char *name;
+      uint32_t nameLength;
+      uint8_t databyte1;
+      uint8_t databyte2;
+    } marker;
+  };
+
+  bool IsMetaEvent() const;
+  bool IsSysexEvent() const;
+  static void WriteVarLength(std::vector<uint8_t> &buf, uint32_t value);
+  static std::string GetNoteName(int noteNumber);
+};
+
+//  The order events are written in: by absolute time, then priority
+class EventOrderCmp {
+ public:
+  bool operator()(const MidiEvent &a, const MidiEvent &b) const {
+    return a.AbsTime < b.AbsTime || (a.AbsTime == b.AbsTime && a.priority < b.priority);
+  }
+};
+
+//  An event waiting to be merged into its track, seq keeps the insertion order among equal events
+struct PendingEvent {
+  MidiEvent event;
+  uint32_t seq;
+};
+
+//  Heap order, earliest on top
+class PendingEventCmp {
+ public:
+  bool operator()(const PendingEvent &a, const PendingEvent &b) const {
+    if (EventOrderCmp()(a.event, b.event)) return false;
+    if (EventOrderCmp()(b.event, a.event)) return true;
+    return a.seq > b.seq;
+  }
+};
+
 class MidiTrack {
  public:
   MidiTrack(MidiFile *parentSeq, bool bMonophonic);
   virtual ~MidiTrack(void);
 
   void Sort(void);
+  void FlushPendingEvents();
   void WriteTrack(std::vector<uint8_t> &buf) const;
 
   //void SetChannel(int theChannel);
@@ -193,26 +266,40 @@ class MidiTrack {
 
   // state
   uint32_t DeltaTime;            //a time value to be used for AddEvent
-  DurNoteEvent *prevDurEvent;
-  std::vector<NoteEvent *> prevDurNoteOffs;
-  int8_t prevKey;
+  std::vector<uint32_t> prevDurNoteOffs;  // times of the note offs added by duration
   bool bSustain;
 
-  std::vector<MidiEvent *> aEvents;
+  std::pmr::vector<MidiEvent> aEvents;  // ordered by EventOrderCmp, then insertion
+  std::pmr::vector<PendingEvent> pendingEvents;  // heap of events not yet in aEvents
+  uint32_t nextPendingSeq;
+
+ private:
+  static MidiEvent NewEvent(MidiEventType type, uint8_t channel, uint32_t absTime, int8_t priority);
+  void InsertEvent(const MidiEvent &event);
+  void AppendOrdered(const MidiEvent &event);
+  void InsertController(MidiEventType type, uint8_t channel, uint8_t controllerNum, uint8_t theDataByte, uint32_t absTime,
+                        int8_t priority = PRIORITY_MIDDLE);
+  void InsertSysex(MidiEventType type, const uint8_t *data, size_t size, int8_t priority, uint32_t absTime);
+  void InsertMetaText(uint8_t metaType, const std::string &str, uint32_t absTime);
+  static uint32_t WriteEvent(const MidiEvent &event, std::vector<uint8_t> &buf, uint32_t time, int8_t &globalTranspose);
 };
 
 class MidiFile {
  public:
-  MidiFile(const rsnd::SoundSequence *assocSeq);
+  // limits bound how far sequences that loop forever are played
+  MidiFile(const rsnd::SoundSequence *assocSeq, const rsnd::SeqPlayLimits &limits = {});
   ~MidiFile();
   MidiTrack *AddTrack();
   MidiTrack *InsertTrack(uint32_t trackNum);
   int GetMidiTrackIndex(const MidiTrack *midiTrack);
   void SetPPQN(uint16_t ppqn);
   uint32_t GetPPQN() const;
-  void WriteMidiToBuffer(std::vector<uint8_t> &buf);
+  // startOffset is where in the sequence data playback starts, e.g. the dataOffset of a SeqLabel
+  void WriteMidiToBuffer(std::vector<uint8_t> &buf, uint32_t startOffset = 0);
   void Sort(void);
-  bool SaveMidiFile(const std::filesystem::path &filepath);
+  bool SaveMidiFile(const std::filesystem::path &filepath, uint32_t startOffset = 0);
+  // Copies data into the arena, it lives as long as the MidiFile
+  const uint8_t *ArenaCopy(const void *data, size_t size);
 
  protected:
   //bool bAddedTempo;
@@ -220,448 +307,13 @@ class MidiFile {
 
  public:
   const rsnd::SoundSequence *assocSeq;
+  rsnd::SeqPlayLimits limits;
   uint16_t ppqn;
 
+  // the event records of every track and their text and sysex data, released together with the MidiFile
+  std::pmr::monotonic_buffer_resource arena;
+
   std::vector<MidiTrack *> aTracks;
   MidiTrack globalTrack;            //events in the globalTrack will be copied into every other track
-  int8_t globalTranspose;
   bool bMonophonicTracks;
 };
-
-class MidiEvent {
- public:
-  MidiEvent(MidiTrack *thePrntTrk, uint32_t absoluteTime, uint8_t theChannel, int8_t thePriority);
-  virtual ~MidiEvent(void);
-  virtual MidiEventType GetEventType() = 0;
-  bool IsMetaEvent();
-  bool IsSysexEvent();
-  static void WriteVarLength(std::vector<uint8_t> &buf, uint32_t value);
-  //virtual void PrepareWrite(void/*vector<MidiEvent*> & aEvents*/);
-  virtual uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) = 0;
-  uint32_t WriteMetaEvent(std::vector<uint8_t> &buf, uint32_t time, uint8_t metaType,
-    const uint8_t* data, size_t dataSize) const;
-  uint32_t WriteMetaTextEvent(std::vector<uint8_t> &buf, uint32_t time, uint8_t metaType,
-    const std::string& str) const;
-
-  static std::string GetNoteName(int noteNumber);
-
-  bool operator<(const MidiEvent &) const;
-  bool operator>(const MidiEvent &) const;
-
-  MidiTrack *prntTrk;
-  uint8_t channel;
-  uint32_t AbsTime;            //absolute time... the number of ticks from the very beginning of the sequence at which this event occurs
-  int8_t priority;
-};
-
-class PriorityCmp {
- public:
-  bool operator()(const MidiEvent *a, const MidiEvent *b) const {
-    return (a->priority < b->priority);
-  }
-};
-
-class AbsTimeCmp {
- public:
-  bool operator()(const MidiEvent *a, const MidiEvent *b) const {
-    return (a->AbsTime < b->AbsTime);
-  }
-};
-
-class NoteEvent
-    : public MidiEvent {
- public:
-  NoteEvent
-      (MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, bool bNoteDown, uint8_t theKey, uint8_t theVel = 64);
-  MidiEventType GetEventType() override { return MIDIEVENT_NOTEON; }
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  bool bNoteDown;
-  int8_t key;
-  int8_t vel;
-};
-
-//class DurNoteEvent
-//	: public MidiEvent
-//{
-//public:
-//	DurNoteEvent(MidiTrack* prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t theKey, uint8_t theVel, uint32_t theDur);
-//	//virtual void PrepareWrite(std::vector<MidiEvent*> & aEvents);
-//	virtual uint32_t WriteEvent(std::vector<uint8_t> & buf, uint32_t time);
-//
-//	bool bNoteDown;
-//	int8_t key;
-//	int8_t vel;
-//	uint32_t duration;
-//};
-
-class ControllerEvent
-    : public MidiEvent {
- public:
-  ControllerEvent(MidiTrack *prntTrk,
-                  uint8_t channel,
-                  uint32_t absoluteTime,
-                  uint8_t controllerNum,
-                  uint8_t theDataByte,
-                  int8_t thePriority = PRIORITY_MIDDLE);
-  MidiEventType GetEventType() override { return MIDIEVENT_UNDEFINED; }
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  uint8_t controlNum;
-  uint8_t dataByte;
-};
-
-class SysexEvent
-    : public MidiEvent {
-public:
-  SysexEvent(MidiTrack *prntTrk,
-             uint32_t absoluteTime,
-             const std::vector<uint8_t>& sysexData,
-             int8_t thePriority = PRIORITY_MIDDLE);
-  MidiEventType GetEventType() override { return MIDIEVENT_UNDEFINED; }
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  std::vector<uint8_t> sysexData;
-};
-
-class VolumeEvent
-    : public ControllerEvent {
- public:
-  VolumeEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t volume)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 7, volume, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_VOLUME; }
-};
-
-class ExpressionEvent
-    : public ControllerEvent {
- public:
-  ExpressionEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t expression)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 11, expression, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_EXPRESSION; }
-};
-
-class SustainEvent
-    : public ControllerEvent {
- public:
-  SustainEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t depth)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 64, depth, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_SUSTAIN; }
-};
-
-class PortamentoEvent
-    : public ControllerEvent {
- public:
-  PortamentoEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t bOn)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 65, (bOn) ? 0x7F : 0, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_PORTAMENTO; }
-};
-
-class PortamentoTimeEvent
-    : public ControllerEvent {
- public:
-  PortamentoTimeEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t time)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 5, time, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_PORTAMENTOTIME; }
-};
-
-class PortamentoTimeFineEvent
-    : public ControllerEvent {
-public:
-  PortamentoTimeFineEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t time)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 37, time, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_PORTAMENTOTIMEFINE; }
-};
-
-class PortamentoControlEvent
-    : public ControllerEvent {
-public:
-  PortamentoControlEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t key)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 84, key, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_PORTAMENTOCONTROL; }
-};
-
-class PanEvent
-    : public ControllerEvent {
- public:
-  PanEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t pan)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 10, pan, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_PAN; }
-};
-
-class ModulationEvent
-    : public ControllerEvent {
- public:
-  ModulationEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t depth)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 1, depth, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_MODULATION; }
-};
-
-class BreathEvent
-    : public ControllerEvent {
- public:
-  BreathEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t depth)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 2, depth, PRIORITY_MIDDLE) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_BREATH; }
-};
-
-class BankSelectEvent
-    : public ControllerEvent {
- public:
-  BankSelectEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t bank)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 0, bank, PRIORITY_HIGH) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_BANKSELECT; }
-};
-
-class BankSelectFineEvent
-    : public ControllerEvent {
- public:
-  BankSelectFineEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t bank)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 32, bank, PRIORITY_HIGH) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_BANKSELECTFINE; }
-};
-
-/*
-class VolEvent
-	: public ControllerEvent
-{
-public:
-	VolEvent(MidiTrack* prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t theVol, int8_t thePriority = PRIORITY_MIDDLE);
-	virtual VolEvent* MakeCopy();
-	//virtual uint32_t WriteEvent(std::vector<uint8_t> & buf, uint32_t time);
-
-	uint8_t vol;
-};
-
-class VolMarkerEvent
-	: public MidiEvent
-{
-public:
-	VolMarkerEvent(MidiTrack* prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t theVol, int8_t thePriority = PRIORITY_HIGHER);
-	virtual VolMarkerEvent* MakeCopy();
-	virtual uint32_t WriteEvent(std::vector<uint8_t> & buf, uint32_t time);
-
-	uint8_t vol;
-};*/
-
-class MasterVolEvent
-    : public SysexEvent {
-public:
-  MasterVolEvent(MidiTrack *prntTrk, uint8_t /* channel */, uint32_t absoluteTime, uint8_t msb)
-      : SysexEvent(prntTrk, absoluteTime, {0x07, 0x7F, 0x7F, 0x04, 0x01, 0, msb }, PRIORITY_HIGHER) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_MASTERVOL; }
-};
-
-/*
-class ExpressionEvent
-	: public MidiEvent
-{
-public:
-	ExpressionEvent(MidiTrack* prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t expression, int8_t thePriority = PRIORITY_HIGHER);
-	virtual ExpressionEvent* MakeCopy();
-	virtual uint32_t WriteEvent(std::vector<uint8_t> & buf, uint32_t time);
-
-	uint8_t expression;
-};*/
-
-class MonoEvent
-    : public ControllerEvent {
- public:
-  MonoEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime)
-      : ControllerEvent(prntTrk, channel, absoluteTime, 126, 0, PRIORITY_HIGHER) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_MONO; }
-};
-
-class ProgChangeEvent
-    : public MidiEvent {
- public:
-  ProgChangeEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, uint8_t progNum);
-  MidiEventType GetEventType() override { return MIDIEVENT_PROGRAMCHANGE; }
-  //virtual ProgChangeEvent* MakeCopy();
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  uint8_t programNum;
-};
-
-class PitchBendEvent
-    : public MidiEvent {
- public:
-  PitchBendEvent(MidiTrack *prntTrk, uint8_t channel, uint32_t absoluteTime, int16_t bend);
-  MidiEventType GetEventType() override { return MIDIEVENT_PITCHBEND; }
-  //virtual PitchBendEvent* MakeCopy();
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  int16_t bend;
-};
-
-
-class TempoEvent
-    : public MidiEvent {
- public:
-  TempoEvent(MidiTrack *prntTrk, uint32_t absoluteTime, uint32_t microSeconds);
-  MidiEventType GetEventType() override { return MIDIEVENT_TEMPO; }
-  //virtual TempoEvent* MakeCopy();
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  uint32_t microSecs;
-};
-
-class MidiPortEvent : public MidiEvent {
-public:
-  MidiPortEvent(MidiTrack *prntTrk, uint32_t absoluteTime, uint8_t port);
-  MidiEventType GetEventType() override { return MIDIEVENT_MIDIPORT; }
-  // virtual TimeSigEvent* MakeCopy();
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  uint8_t port;
-};
-
-class TimeSigEvent
-    : public MidiEvent {
- public:
-  TimeSigEvent
-      (MidiTrack *prntTrk, uint32_t absoluteTime, uint8_t numerator, uint8_t denominator, uint8_t clicksPerQuarter);
-  MidiEventType GetEventType() override { return MIDIEVENT_TIMESIG; }
-  //virtual TimeSigEvent* MakeCopy();
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  uint8_t numer;
-  uint8_t denom;
-  uint8_t ticksPerQuarter;
-};
-
-class EndOfTrackEvent
-    : public MidiEvent {
- public:
-  EndOfTrackEvent(MidiTrack *prntTrk, uint32_t absoluteTime);
-  MidiEventType GetEventType() override { return MIDIEVENT_ENDOFTRACK; }
-  //virtual EndOfTrackEvent* MakeCopy();
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-};
-
-class TextEvent
-    : public MidiEvent {
- public:
-  TextEvent(MidiTrack *prntTrk, uint32_t absoluteTime, const std::string &str);
-  MidiEventType GetEventType() override { return MIDIEVENT_TEXT; }
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  std::string text;
-};
-
-class SeqNameEvent
-    : public MidiEvent {
- public:
-  SeqNameEvent(MidiTrack *prntTrk, uint32_t absoluteTime, const std::string &str);
-  MidiEventType GetEventType() override { return MIDIEVENT_TEXT; }
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  std::string text;
-};
-
-class TrackNameEvent
-    : public MidiEvent {
- public:
-  TrackNameEvent(MidiTrack *prntTrk, uint32_t absoluteTime, const std::string &str);
-  MidiEventType GetEventType() override { return MIDIEVENT_TEXT; }
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  std::string text;
-};
-
-// SPECIAL EVENTS THAT AFFECT OTHER MIDI EVENTS RATHER THAN DIRECTLY OUTPUT TO THE FILE
-class GlobalTransposeEvent
-    : public MidiEvent {
- public:
-  GlobalTransposeEvent(MidiTrack *prntTrk, uint32_t absoluteTime, int8_t semitones);
-  MidiEventType GetEventType() override { return MIDIEVENT_GLOBALTRANSPOSE; }
-  uint32_t WriteEvent(std::vector<uint8_t> &buf, uint32_t time) override;
-
-  int8_t semitones;
-};
-
-class MarkerEvent
-    : public MidiEvent {
- public:
-  MarkerEvent(MidiTrack *prntTrk,
-              uint8_t channel,
-              uint32_t absoluteTime,
-              const std::string &name,
-              uint8_t databyte1,
-              uint8_t databyte2,
-              int8_t thePriority = PRIORITY_MIDDLE)
-      : MidiEvent(prntTrk, absoluteTime, channel, thePriority), name(name), databyte1(databyte1),
-        databyte2(databyte2) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_MARKER; }
-  uint32_t WriteEvent(std::vector<uint8_t>& /*buf*/, uint32_t time) override { return time; }
-
-  std::string name;
-  uint8_t databyte1, databyte2;
-};
-
-class GMResetEvent
-    : public SysexEvent {
- public:
-  GMResetEvent(MidiTrack *prntTrk, uint32_t absoluteTime)
-       : SysexEvent(prntTrk, absoluteTime, { 0x05, 0x7E, 0x7F, 0x09, 0x01 }, PRIORITY_HIGHEST) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_RESET; }
-};
-
-class GM2ResetEvent
-    : public SysexEvent {
- public:
-  GM2ResetEvent(MidiTrack *prntTrk, uint32_t absoluteTime)
-       : SysexEvent(prntTrk, absoluteTime, { 0x05, 0x7E, 0x7F, 0x09, 0x03 }, PRIORITY_HIGHEST) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_RESET; }
-};
-
-class GSResetEvent
-    : public SysexEvent {
- public:
-  GSResetEvent(MidiTrack *prntTrk, uint32_t absoluteTime)
-       : SysexEvent(prntTrk, absoluteTime, { 0x0A, 0x41, 0x10, 0x42, 0x12, 0x40, 0x00, 0x7F, 0x00, 0x41 },
-                    PRIORITY_HIGHEST) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_RESET; }
-};
-
-class XGResetEvent
-    : public SysexEvent {
- public:
-  XGResetEvent(MidiTrack *prntTrk, uint32_t absoluteTime)
-       : SysexEvent(prntTrk, absoluteTime,  { 0x08, 0x43, 0x10, 0x4C, 0x00, 0x00, 0x7E, 0x00 },
-                    PRIORITY_HIGHEST) { }
-  MidiEventType GetEventType() override { return MIDIEVENT_RESET; }
-};
-
-
-
-/*
-class AFX_EXT_CLASS ProgChangeEvent
-	: public MidiEvent
-{
-	ProgChangeEvent(void);
-	~ProgramChangeEvent(void);
-
-	uint8_t progNum;
-}
-
-class AFX_EXT_CLASS ControllerEvent
-	: public MidiEvent
-{
-public:
-	NoteEvent(void);
-	~NoteEvent(void);
-
-	int8_t key;
-	int8_t vel;
-};*/
-
-/*class AFX_EXT_CLASS NoteEventDur
-	: public MidiEvent
-{
-public:
-	NoteEvent(void);
-	~NoteEvent(void);
-
-	int8_t key;
-	int8_t vel;
-}*/
\ No newline at end of file
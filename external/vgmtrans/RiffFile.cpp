@@ -6,12 +6,15 @@
 
 #include "RiffFile.h"
 
+#include "common/fileUtil.hpp"
+
 uint32_t Chunk::GetSize() {
   return 8 + GetPaddedSize(size);
 }
 
 void Chunk::SetData(const void *src, uint32_t datasize) {
   size = datasize;
+  borrowed = nullptr;
 
   // set the size and copy from the data source
   datasize = GetPaddedSize(size);
@@ -29,46 +32,66 @@ void Chunk::SetData(const void *src, uint32_t datasize) {
   }
 }
 
-void Chunk::Write(uint8_t *buffer) {
-  uint32_t padsize = GetPaddedSize(size) - size;
-  memcpy(buffer, id, 4);
-  *reinterpret_cast<uint32_t*>(buffer + 4) = size + padsize; // Microsoft says the chunkSize doesn't contain padding size, but many software cannot handle the alignment.
-  memcpy(buffer + 8, data, GetPaddedSize(size));
+void Chunk::BorrowData(const void *src, uint32_t datasize) {
+  if (data != nullptr) {
+    delete[] data;
+    data = nullptr;
+  }
+  size = datasize;
+  borrowed = src;
+}
+
+void Chunk::WriteHeader(RiffSink &sink, uint32_t dataSize) {
+  sink.Write(id, 4);
+  // Microsoft says the chunkSize doesn't contain padding size, but many software cannot handle the alignment.
+  uint32_t paddedSize = GetPaddedSize(dataSize);
+  sink.Write(&paddedSize, 4);
+}
+
+void Chunk::WritePadding(RiffSink &sink, uint32_t dataSize) {
+  if (dataSize % 2) sink.Write("", 1);
+}
+
+void Chunk::Write(RiffSink &sink) {
+  WriteHeader(sink, size);
+  sink.Write(borrowed ? borrowed : data, size);
+  WritePadding(sink, size);
 }
 
 Chunk *ListTypeChunk::AddChildChunk(Chunk *ck) {
   childChunks.push_back(ck);
+  cachedSize = 0;
   return ck;
 }
 
 uint32_t ListTypeChunk::GetSize() {
-  uint32_t size = 12;        //id + size + "LIST"
-  for (auto iter = this->childChunks.begin(); iter != childChunks.end(); ++iter)
-    size += (*iter)->GetSize();
-  return GetPaddedSize(size);
-}
-
-void ListTypeChunk::Write(uint8_t *buffer) {
-  memcpy(buffer, this->id, 4);
-  memcpy(buffer + 8, this->type, 4);
-
-  uint32_t bufOffset = 12;
-  for (auto iter = this->childChunks.begin(); iter != childChunks.end(); ++iter) {
-    (*iter)->Write(buffer + bufOffset);
-    bufOffset += (*iter)->GetSize();
+  if (cachedSize == 0) {
+    cachedSize = 12;        //id + size + "LIST"
+    for (auto iter = this->childChunks.begin(); iter != childChunks.end(); ++iter)
+      cachedSize += (*iter)->GetSize();
+    cachedSize = GetPaddedSize(cachedSize);
   }
+  return cachedSize;
+}
 
-  uint32_t size = bufOffset;
-  uint32_t padsize = GetPaddedSize(size) - size;
-  *reinterpret_cast<uint32_t*>(buffer + 4) = size + padsize - 8; // Microsoft says the chunkSize doesn't contain padding size, but many software cannot handle the alignment.
-
-  // Add pad byte
-  if (padsize != 0) {
-    memset(data + size, 0, padsize);
-  }
+void ListTypeChunk::Write(RiffSink &sink) {
+  // GetSize() is already padded, the pad byte is always zero as every child is padded
+  WriteHeader(sink, GetSize() - 8);
+  sink.Write(this->type, 4);
+  for (auto iter = this->childChunks.begin(); iter != childChunks.end(); ++iter)
+    (*iter)->Write(sink);
 }
 
 RiffFile::RiffFile(const std::string& file_name, const std::string& form)
     : RIFFChunk(form),
       name(file_name) {
-}
\ No newline at end of file
+}
+
+bool RiffFile::SaveFile(const std::filesystem::path &filepath) {
+  std::ofstream file;
+  std::ostream& out = rsnd::openBinaryOutput(filepath, file);
+  RiffStreamSink sink(out);
+  Write(sink);
+  out.flush();
+  return static_cast<bool>(out);
+}
@@ -5,11 +5,46 @@
 #include <string>
 #include <cassert>
 #include <list>
+#include <ostream>
+#include <filesystem>
 #include <vector>
 #include "common.h"
 #include "helper.h"
 
 
+//////////////////////////////////////////////
+// RiffSink	- Where a RIFF file is serialized to
+//////////////////////////////////////////////
+class RiffSink {
+ public:
+  virtual ~RiffSink() = default;
+  virtual void Write(const void *src, size_t size) = 0;
+};
+
+//  A file or any other stream, the output does not need to be seekable
+class RiffStreamSink: public RiffSink {
+ public:
+  RiffStreamSink(std::ostream &out) : out(out) { }
+  void Write(const void *src, size_t size) override { out.write(static_cast<const char*>(src), size); }
+
+ private:
+  std::ostream &out;
+};
+
+//  Caller provided memory of GetSize() bytes, e.g. a buffer or a mapped file
+class RiffMemorySink: public RiffSink {
+ public:
+  RiffMemorySink(uint8_t *buffer) : buffer(buffer) { }
+  void Write(const void *src, size_t size) override {
+    memcpy(buffer, src, size);
+    buffer += size;
+  }
+
+ private:
+  uint8_t *buffer;
+};
+
+
 //////////////////////////////////////////////
 // Chunk		- Riff format chunk
 //////////////////////////////////////////////
@@ -17,11 +52,11 @@ class Chunk {
  public:
   char id[4];        //  A chunk ID identifies the type of data within the chunk.
   uint32_t size;        //  The size of the chunk data in bytes, excluding any pad byte.
-  uint8_t *data;        //  The actual data not including a possible pad byte to word align
+  uint8_t *data;        //  The actual data not including a possible pad byte to word align, owned by the chunk
 
  public:
   Chunk(const std::string& theId)
-      : size(0), data(nullptr) {
+      : size(0), data(nullptr), borrowed(nullptr) {
     assert(theId.length() == 4);
     memcpy(id, theId.c_str(), 4);
   }
@@ -32,10 +67,17 @@ class Chunk {
     }
   }
   void SetData(const void *src, uint32_t datasize);
+  //  Refers to src instead of copying it, src has to outlive the chunk being written
+  void BorrowData(const void *src, uint32_t datasize);
   virtual uint32_t GetSize();    //  Returns the size of the chunk in bytes, including any pad byte.
-  virtual void Write(uint8_t *buffer);
+  //  Writes GetSize() bytes to the sink in one pass, each header before its contents
+  virtual void Write(RiffSink &sink);
 
  protected:
+  const void *borrowed;
+
+  void WriteHeader(RiffSink &sink, uint32_t dataSize);
+  static void WritePadding(RiffSink &sink, uint32_t dataSize);
   static inline uint32_t GetPaddedSize(uint32_t size) {
     return size + (size % 2);
   }
@@ -53,7 +95,7 @@ class ListTypeChunk: public Chunk {
 
  public:
   ListTypeChunk(const std::string& theId, const std::string& theType)
-      : Chunk(theId) {
+      : Chunk(theId), cachedSize(0) {
     assert(theType.length() == 4);
     memcpy(type, theType.c_str(), 4);
   }
@@ -61,9 +103,24 @@ class ListTypeChunk: public Chunk {
     DeleteList(childChunks);
   }
 
+  //  Children have to be complete when they are added, the size of the list is only computed once
   Chunk *AddChildChunk(Chunk *ck);
   uint32_t GetSize() override;    //  Returns the size of the chunk in bytes, including any pad byte.
-  void Write(uint8_t *buffer) override;
+  void Write(RiffSink &sink) override;
+
+ private:
+  uint32_t cachedSize;    //  0 until GetSize() is first called
+};
+
+////////////////////////////////////////////////////////////////////////////
+// TrailingChunk	- Chunk of which only the header is written. Its data (and pad
+//					  byte) is written to the sink by the caller once the file is
+//					  written, so it has to be the last chunk of the file
+////////////////////////////////////////////////////////////////////////////
+class TrailingChunk: public Chunk {
+ public:
+  TrailingChunk(const std::string& theId, uint32_t dataSize) : Chunk(theId) { size = dataSize; }
+  void Write(RiffSink &sink) override { WriteHeader(sink, size); }
 };
 
 ////////////////////////////////////////////////////////////////////////////
@@ -90,6 +147,9 @@ class RiffFile: public RIFFChunk {
  public:
   RiffFile(const std::string& file_name, const std::string& form);
 
+  //  Streams the file to path ("-" for stdout)
+  bool SaveFile(const std::filesystem::path &filepath);
+
   static void WriteLIST(std::vector<uint8_t> &buf, uint32_t listName, uint32_t listSize) {
     PushTypeOnVectBE<uint32_t>(buf, 0x4C495354);    //write "LIST"
     PushTypeOnVect<uint32_t>(buf, listSize);
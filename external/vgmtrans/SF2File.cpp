@@ -10,19 +10,12 @@
 #include "SF2File.h"
 //#include "Root.h"
 
+#include "common/log.hpp"
 #include "rsnd/SoundBank.hpp"
 #include "rsnd/SoundWaveArchive.hpp"
 #include "rsnd/SoundWave.hpp"
 #include "common/fileUtil.hpp"
 
-struct EnvelopeParams {
-  double attack_time;
-  double decay_time;
-  double sustain_level;
-  double release_time;
-  double hold_time;
-};
-
 static float GetFallingRate(uint8_t DecayTime) {
   if (DecayTime == 0x7F)
     return 65535.0f;
@@ -52,15 +45,11 @@ static double timeToTimecents(double time){
   }
 }
 
-static EnvelopeParams envelopeFromInfo(const rsnd::InstrInfo* info) {
+EnvelopeParams envelopeFromInfo(const rsnd::InstrInfo* info) {
   // mostly taken from https://github.com/soneek/3DSUSoundArchiveTool
   EnvelopeParams envelope;
 
-  double attackTable[] = {13122, 6546, 4356, 3261, 2604, 2163, 1851, 1617, 1434, 1287, 1167, 1068, 984, 912, 849, 795, 747, 702, 666, 630, 600, 570, 543, 519, 498, 477, 459, 441, 426, 411, 396, 384, 372, 360, 348, 336, 327, 318, 309, 300, 294, 285, 279, 270, 264, 258, 252, 246, 240, 234, 231, 225, 219, 216, 210, 207, 201, 198, 195, 192, 186, 183, 180, 177, 174, 171, 168, 165, 162, 159, 156, 153.5, 153, 150, 147, 144, 141.5, 141, 138, 135.5, 135, 132, 129.5, 129, 126, 123.5, 123, 120.5, 120, 117, 114.5, 114, 111.5, 111, 108.5, 108, 105.7, 105.35, 105, 102.5, 102, 99.5, 99, 96.7, 96.35, 96, 93.5, 93, 90, 87, 81, 75, 72, 69, 63, 60, 54, 48, 45, 39, 36, 30, 24, 21, 15, 12, 9, 6.1e-6};
-  double holdTable[] = {6e-6, 1, 2, 4, 6, 9, 12, 16, 20, 25, 30, 36, 42, 49, 56, 64, 72, 81, 90, 100, 110, 121, 132, 144, 156, 169, 182, 196, 210, 225, 240, 256, 272, 289, 306, 324, 342, 361, 380, 400, 420, 441, 462, 484, 506, 529, 552, 576, 600, 625, 650, 676, 702, 729, 756, 784, 812, 841, 870, 900, 930, 961, 992, 1024, 1056, 1089, 1122, 1156, 1190, 1225, 1260, 1296, 1332, 1369, 1406, 1444, 1482, 1521, 1560, 1600, 1640, 1681, 1722, 1764, 1806, 1849, 1892, 1936, 1980, 2025, 2070, 2116, 2162, 2209, 2256, 2304, 2352, 2401, 2450, 2500, 2550, 2601, 2652, 2704, 2756, 2809, 2862, 2916, 2970, 3025, 3080, 3136, 3192, 3249, 3306, 3364, 3422, 3481, 3540, 3600, 3660, 3721, 3782, 3844, 3906, 3969, 4032, 4096};
-  double decayTable[] = { -0.00016, -0.00047, -0.00078, -0.00109, -0.00141, -0.00172, -0.00203, -0.00234, -0.00266, -0.00297, -0.00328, -0.00359, -0.00391, -0.00422, -0.00453, -0.00484, -0.00516, -0.00547, -0.00578, -0.00609, -0.00641, -0.00672, -0.00703, -0.00734, -0.00766, -0.00797, -0.00828, -0.00859, -0.00891, -0.00922, -0.00953, -0.00984, -0.01016, -0.01047, -0.01078, -0.01109, -0.01141, -0.01172, -0.01203, -0.01234, -0.01266, -0.01297, -0.01328, -0.01359, -0.01391, -0.01422, -0.01453, -0.01484, -0.01516, -0.01547, -0.01579, -0.016, -0.01622, -0.01644, -0.01667, -0.0169, -0.01714, -0.01739, -0.01765, -0.01791, -0.01818, -0.01846, -0.01875, -0.01905, -0.01935, -0.01967, -0.02, -0.02034, -0.02069, -0.02105, -0.02143, -0.02182, -0.02222, -0.02264, -0.02308, -0.02353, -0.024, -0.02449, -0.025, -0.02553, -0.02609, -0.02667, -0.02727, -0.02791, -0.02857, -0.02927, -0.03, -0.03077, -0.03158, -0.03243, -0.03333, -0.03429, -0.03529, -0.03636, -0.0375, -0.03871, -0.04, -0.04138, -0.04286, -0.04444, -0.04615, -0.048, -0.05, -0.05217, -0.05455, -0.05714, -0.06, -0.06316, -0.06667, -0.07059, -0.075, -0.08, -0.08571, -0.09231, -1, -0.10909, -0.12, -0.13333, -0.15, -0.17143, -2, -2.4, -3, -4, -6, -12, -24, -65535 };
-
-  envelope.attack_time = timeToTimecents(attackTable[info->attack] / 1000);
+  envelope.attack_time = timeToTimecents(rsnd::envelopeAttackMs(info->attack) / 1000);
 
   double sustainVol = 20 * LogB(pow(((double)info->sustain / 127.0000), 2), 10);
 
@@ -68,9 +57,9 @@ static EnvelopeParams envelopeFromInfo(const rsnd::InstrInfo* info) {
     envelope.decay_time = -12000;
   } else {
     if (info->sustain == 0) {
-      envelope.decay_time = timeToTimecents(-90.25 / decayTable[info->decay] / 1000);
+      envelope.decay_time = timeToTimecents(-90.25 / rsnd::envelopeFallRate(info->decay) / 1000);
     } else {
-      envelope.decay_time = timeToTimecents(sustainVol / decayTable[info->decay] / 1000);
+      envelope.decay_time = timeToTimecents(sustainVol / rsnd::envelopeFallRate(info->decay) / 1000);
     }
   }
 
@@ -84,13 +73,13 @@ static EnvelopeParams envelopeFromInfo(const rsnd::InstrInfo* info) {
     envelope.release_time = -12000;
   } else {
     if (info->sustain == 0) {
-			envelope.release_time = timeToTimecents(-90.25 / decayTable[info->release] / 1000);
+			envelope.release_time = timeToTimecents(-90.25 / rsnd::envelopeFallRate(info->release) / 1000);
     } else {
-			envelope.release_time = timeToTimecents((-90.25 - sustainVol) / decayTable[info->release] / 1000);
+			envelope.release_time = timeToTimecents((-90.25 - sustainVol) / rsnd::envelopeFallRate(info->release) / 1000);
     }
   }
 
-  envelope.hold_time = timeToTimecents(holdTable[info->hold] / 1000);
+  envelope.hold_time = timeToTimecents(rsnd::envelopeHoldMs(info->hold) / 1000);
 
   return envelope;
 }
@@ -115,11 +104,33 @@ SF2InfoListChunk::SF2InfoListChunk(const std::string& name)
 }
 
 
+//  **************
+//  SF2SampleChunk
+//  **************
+
+SF2SampleChunk::SF2SampleChunk(const std::vector<WaveAudioSource>& waves)
+    : Chunk("smpl"), waves(waves) {
+  for (const WaveAudioSource& wav : waves) {
+    size += wav.dataLength + (46 * 2);    // plus the 46 padding samples required by sf2 spec
+  }
+}
+
+void SF2SampleChunk::Write(RiffSink &sink) {
+  WriteHeader(sink, size);
+  const char padding[46 * 2] = {};
+  for (const WaveAudioSource& source : waves) {
+    WaveAudio wav = source.decode();
+    sink.Write(wav.data, wav.dataLength);
+    sink.Write(padding, sizeof(padding));
+  }
+  WritePadding(sink, size);
+}
+
 //  *******
 //  SF2File
 //  *******
 
-SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>& waves)
+SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudioSource>& waves)
     : RiffFile("RSND bank", "sfbk") {
 
   //***********
@@ -129,28 +140,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
 
   // sdta chunk and its child smpl chunk containing all samples
   LISTChunk *sdtaCk = new LISTChunk("sdta");
-  Chunk *smplCk = new Chunk("smpl");
-
-  // Concatanate all of the samples together and add the result to the smpl chunk data
-  size_t numWaves = waves.size();
-  smplCk->size = 0;
-  for (size_t i = 0; i < numWaves; i++) {
-    const WaveAudio& wav = waves[i];
-    smplCk->size += wav.dataLength + (46 * 2);    // plus the 46 padding samples required by sf2 spec
-  }
-  smplCk->data = new uint8_t[smplCk->size];
-  uint32_t bufPtr = 0;
-  for (size_t i = 0; i < numWaves; i++) {
-    const WaveAudio& wav = waves[i];
-    size_t waveSz = wav.dataLength;
-
-    void* pcm = wav.data;
-    memcpy(smplCk->data + bufPtr, pcm, waveSz);
-    memset(smplCk->data + bufPtr + waveSz, 0, 46 * 2);
-    bufPtr += waveSz + (46 * 2);        // plus the 46 padding samples required by sf2 spec
-  }
-
-  sdtaCk->AddChildChunk(smplCk);
+  sdtaCk->AddChildChunk(new SF2SampleChunk(waves));
   this->AddChildChunk(sdtaCk);
 
   //***********
@@ -309,7 +299,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
     for (size_t j = 0; j < numRgns; j++) {
       sfInstBag instBag{};
       instBag.wInstGenNdx = instGenCounter;
-      instGenCounter += 12;
+      instGenCounter += 14;
       instBag.wInstModNdx = 0;
 
       memcpy(ibagCk->data + (rgnCounter++ * sizeof(sfInstBag)), &instBag, sizeof(sfInstBag));
@@ -335,7 +325,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   // igen chunk
   //***********
   Chunk *igenCk = new Chunk("igen");
-  igenCk->size = (numTotalRgns * sizeof(sfInstGenList) * 12) + sizeof(sfInstGenList);
+  igenCk->size = (numTotalRgns * sizeof(sfInstGenList) * 14) + sizeof(sfInstGenList);
   igenCk->data = new uint8_t[igenCk->size];
   dataPtr = 0;
   for (size_t i = 0; i < numInstrs; i++) {
@@ -366,7 +356,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
 
       auto* instrInfo = instrRegion.instrInfo;
       EnvelopeParams envelope = envelopeFromInfo(instrInfo);
-      const WaveAudio& wav = waves[instrInfo->waveIdx];
+      const WaveAudioSource& wav = waves[instrInfo->waveIdx];
 
       // initialAttenuation
       instGenList.sfGenOper = initialAttenuation;
@@ -393,6 +383,17 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
       memcpy(igenCk->data + dataPtr, &instGenList, sizeof(sfInstGenList));
       dataPtr += sizeof(sfInstGenList);
 
+      // coarseTune and fineTune - pitch is a frequency ratio
+      int tuneCents = std::isfinite(instrInfo->pitch) && instrInfo->pitch > 0 ? std::lround(1200 * std::log2(instrInfo->pitch)) : 0;
+      instGenList.sfGenOper = coarseTune;
+      instGenList.genAmount.shAmount = static_cast<int16_t>(tuneCents / 100);
+      memcpy(igenCk->data + dataPtr, &instGenList, sizeof(sfInstGenList));
+      dataPtr += sizeof(sfInstGenList);
+      instGenList.sfGenOper = fineTune;
+      instGenList.genAmount.shAmount = static_cast<int16_t>(tuneCents % 100);
+      memcpy(igenCk->data + dataPtr, &instGenList, sizeof(sfInstGenList));
+      dataPtr += sizeof(sfInstGenList);
+
       // attackVolEnv
       instGenList.sfGenOper = attackVolEnv;
       instGenList.genAmount.shAmount = envelope.attack_time;
@@ -461,7 +462,7 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
 
   uint32_t sampOffset = 0;
   for (size_t i = 0; i < numSamps; i++) {
-    const WaveAudio& wav = waves[i];
+    const WaveAudioSource& wav = waves[i];
     std::string waveName = "wav" + std::to_string(i);
 
     sfSample samp{};
@@ -470,33 +471,17 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
     samp.dwEnd = samp.dwStart + (wav.dataLength / sizeof(uint16_t));
     sampOffset = samp.dwEnd + 46;        // plus the 46 padding samples required by sf2 spec
 
-    // Search through all regions for an associated sampInfo structure with this sample
-    rsnd::InstrInfo *instrInfo = nullptr;
-    for (size_t j = 0; j < numInstrs; j++) {
-      auto instrRegions = bankfile->getInstrRegions(j);
-
-      size_t numRgns = instrRegions.size();
-      for (size_t k = 0; k < numRgns; k++) {
-        auto instrRegion = instrRegions[k];
-        if (instrRegion.instrInfo->waveIdx == i) {
-          instrInfo = instrRegion.instrInfo;
-          break;
-        }
-      }
-      if (instrInfo != nullptr)
-        break;
-    }
-    //  If we didn't find a rgn association, then idk.
-    if (instrInfo == nullptr) {
-      std::cout << "Warn: No instrument info for wave index " << i << '\n';
-      continue;
+    // the first region playing this sample gives its root key
+    const rsnd::SoundBank::InstrumentRegion *waveRegion = bankfile->getWaveRegion(i);
+    //  Samples no region plays are kept for their indices, with a middle C root key
+    if (waveRegion == nullptr) {
+      RSND_WARN(rsnd::LOG_DECODE, "no instrument info for wave index " << i);
     }
-    assert (instrInfo != NULL);
 
     samp.dwStartloop = samp.dwStart + wav.loopStart;
     samp.dwEndloop = samp.dwStart + wav.loopEnd + 1;
     samp.dwSampleRate = wav.sampleRate;
-    samp.byOriginalKey = static_cast<uint8_t>(instrInfo->originalKey);
+    samp.byOriginalKey = static_cast<uint8_t>(waveRegion ? waveRegion->instrInfo->originalKey : 60);
     samp.chCorrection = 0;
     samp.wSampleLink = 0;
     samp.sfSampleType = monoSample; // Do stereo samples exist in RBNKs?
@@ -511,14 +496,6 @@ SF2File::SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>&
   this->AddChildChunk(pdtaCk);
 }
 
-std::vector<uint8_t> SF2File::SaveToMem() {
-  std::vector<uint8_t> buf(GetSize());
-  Write(buf.data());
-  return buf;
-}
-
 bool SF2File::SaveSF2File(const std::filesystem::path &filepath) {
-  auto buf = SaveToMem();
-  rsnd::writeBinary(filepath, buf.data(), buf.size());
-  return true;
-}
\ No newline at end of file
+  return SaveFile(filepath);
+}
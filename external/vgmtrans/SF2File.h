@@ -259,6 +259,17 @@ struct sfSample {
 
 #pragma pack(pop)   /* restore original alignment from stack */
 
+// SF2 volume envelope generators (timecents, centibels) of an instrument
+struct EnvelopeParams {
+  double attack_time;
+  double decay_time;
+  double sustain_level;
+  double release_time;
+  double hold_time;
+};
+
+EnvelopeParams envelopeFromInfo(const rsnd::InstrInfo* info);
+
 class SF2StringChunk: public Chunk {
  public:
   SF2StringChunk(const std::string& ckSig, const std::string& info)
@@ -277,13 +288,24 @@ class SF2sdtaChunk: public LISTChunk {
   SF2sdtaChunk();
 };
 
+// smpl chunk of the waves, each followed by the 46 padding samples required by the sf2 spec. Only its size is known
+// up front, every wave is decoded while the chunk is written and freed right after
+class SF2SampleChunk: public Chunk {
+ public:
+  SF2SampleChunk(const std::vector<WaveAudioSource>& waves);
+  void Write(RiffSink &sink) override;
+
+ private:
+  std::vector<WaveAudioSource> waves;
+};
+
 class SynthFile;
 
 class SF2File: public RiffFile {
  public:
-  SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudio>& waves);
+  SF2File(const rsnd::SoundBank *bankfile, const std::vector<WaveAudioSource>& waves);
   ~SF2File() override = default;
 
-  std::vector<uint8_t> SaveToMem();
+  // streams the file out, holding at most one decoded wave
   bool SaveSF2File(const std::filesystem::path &filepath);
 };
@@ -5,56 +5,67 @@
 
 using namespace rsnd;
 
-std::vector<WaveAudio> toWaveCollection(const rsnd::SoundBank *bankfile, void* waveData) {
-  std::vector<WaveAudio> waveAudios;
+std::vector<WaveAudioSource> toWaveSources(const rsnd::SoundBank *bankfile, void* waveData) {
+  std::vector<WaveAudioSource> sources;
 
   for (int i = 0; i < bankfile->bankWave->waveInfos.size; i++) {
     const WaveInfo* waveInfo = bankfile->getWaveInfo(i);
     u32 channelCount = waveInfo->channelCount;
-      
-    u32 loopStart = dspAddressToSamples(waveInfo->loopStart);
-    u32 loopEnd = dspAddressToSamples(waveInfo->loopEnd);
-    u32 sampleBufferSize = channelCount * loopEnd * sizeof(s16);
-    s16* pcmBuffer = static_cast<s16*>(malloc(sampleBufferSize));
-
-    for (int j = 0; j < waveInfo->channelCount; j++) {
-      const SoundWaveChannelInfo* chInfo = bankfile->getChannelInfo(waveInfo, j);
-      const AdpcParams* adpcParams = bankfile->getAdpcParams(waveInfo, chInfo);
-
-      const u8* blockData = (const u8*)waveData + waveInfo->dataLoc + chInfo->dataOffset;
-
-      decodeBlock(blockData, loopEnd, pcmBuffer + j, channelCount, waveInfo->format, adpcParams);
-    }
-
-    waveAudios.emplace_back();
-    WaveAudio& newWave = waveAudios[waveAudios.size() - 1];
-    newWave.data = pcmBuffer;
-    newWave.dataLength = sampleBufferSize;
-    newWave.sampleRate = waveInfo->sampleRate;
-    newWave.loop = waveInfo->loop;
-    newWave.loopStart = loopStart;
-    newWave.loopEnd = loopEnd;
+    u32 sampleCount = waveLoopEnd(waveInfo);
+
+    WaveAudioSource& source = sources.emplace_back();
+    source.sampleRate = waveInfo->sampleRate;
+    source.loop = waveInfo->loop;
+    source.loopStart = waveLoopStart(waveInfo);
+    // the last sample of the loop
+    source.loopEnd = sampleCount - 1;
+    source.dataLength = channelCount * sampleCount * sizeof(s16);
+    source.decode = [bankfile, waveData, waveInfo, source, sampleCount]() {
+      s16* pcmBuffer = static_cast<s16*>(malloc(source.dataLength));
+      for (int j = 0; j < waveInfo->channelCount; j++) {
+        const SoundWaveChannelInfo* chInfo = bankfile->getChannelInfo(waveInfo, j);
+        const AdpcParams* adpcParams = bankfile->getAdpcParams(waveInfo, chInfo);
+
+        const u8* blockData = (const u8*)waveData + waveInfo->dataLoc + chInfo->dataOffset;
+
+        decodeBlock(blockData, sampleCount, pcmBuffer + j, waveInfo->channelCount, waveInfo->format, adpcParams);
+      }
+
+      WaveAudio wave;
+      wave.data = pcmBuffer;
+      wave.dataLength = source.dataLength;
+      wave.sampleRate = source.sampleRate;
+      wave.loop = source.loop;
+      wave.loopStart = source.loopStart;
+      wave.loopEnd = source.loopEnd;
+      return wave;
+    };
   }
 
-  return waveAudios;
+  return sources;
 }
 
-WaveAudio toWaveAudio(const rsnd::SoundWave *waveFile) {
-  WaveAudio waveAudio;
-    
-  const WaveInfo* waveInfo = waveFile->info;
-    
-  u32 loopStart = dspAddressToSamples(waveInfo->loopStart);
-  u32 loopEnd = dspAddressToSamples(waveInfo->loopEnd);
-  void* pcmBuffer = waveFile->getTrackPcm();
-  u32 sampleBufferSize = waveFile->getTrackSampleBufferSize();
-
-  waveAudio.data = pcmBuffer;
-  waveAudio.dataLength = sampleBufferSize;
-  waveAudio.sampleRate = waveInfo->sampleRate;
-  waveAudio.loop = waveInfo->loop;
-  waveAudio.loopStart = loopStart;
-  waveAudio.loopEnd = loopEnd;
-
-  return waveAudio;
-}
\ No newline at end of file
+WaveAudioSource toWaveSource(const rsnd::SoundWave& waveFile) {
+  WaveAudioSource source;
+
+  const WaveInfo* waveInfo = waveFile.info;
+
+  source.sampleRate = waveInfo->sampleRate;
+  source.loop = waveInfo->loop;
+  source.loopStart = waveFile.getLoopStart();
+  source.loopEnd = waveFile.getLoopEnd() - 1;
+  // the decoded ADPCM data runs to the end of the padded data block, the wave itself ends at the loop end
+  source.dataLength = waveFile.getLoopEnd() * waveInfo->channelCount * static_cast<u32>(sizeof(s16));
+  source.decode = [waveFile, source]() {
+    WaveAudio wave;
+    wave.data = waveFile.getTrackPcm();
+    wave.dataLength = source.dataLength;
+    wave.sampleRate = source.sampleRate;
+    wave.loop = source.loop;
+    wave.loopStart = source.loopStart;
+    wave.loopEnd = source.loopEnd;
+    return wave;
+  };
+
+  return source;
+}
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <cstdlib>
+#include <functional>
 #include <vector>
 #include <utility>
 #include <cstring>
@@ -69,5 +70,18 @@ struct WaveAudio {
   ~WaveAudio() { if (data) { free(data); data = nullptr; } }
 };
 
-std::vector<WaveAudio> toWaveCollection(const rsnd::SoundBank *bankfile, void* waveData);
-WaveAudio toWaveAudio(const rsnd::SoundWave *waveFile);
\ No newline at end of file
+// A wave's format and loop without its samples. decode() yields the whole WaveAudio, so that writers can hold
+// one decoded wave at a time. It refers to the bank/wave data, which has to outlive it
+struct WaveAudioSource {
+  int sampleRate;
+  int loop;
+  int loopStart;
+  int loopEnd;
+  // bytes of the decoded 16 bit PCM
+  int dataLength;
+
+  std::function<WaveAudio()> decode;
+};
+
+std::vector<WaveAudioSource> toWaveSources(const rsnd::SoundBank *bankfile, void* waveData);
+WaveAudioSource toWaveSource(const rsnd::SoundWave& waveFile);
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "types.h"
+#include "util.h"
+
+namespace rsnd {
+// Builds a big endian Nintendoware file in memory. Structs are written through their bswap(), so the same
+// definitions used for reading describe the output. Offsets are relative to the start of the file
+class BinaryWriter {
+private:
+  std::vector<u8> bytes;
+
+public:
+  u32 tell() const { return bytes.size(); }
+  const std::vector<u8>& getBytes() const { return bytes; }
+
+  void write(const void* data, size_t size) {
+    const u8* src = static_cast<const u8*>(data);
+    bytes.insert(bytes.end(), src, src + size);
+  }
+  // zero padding up to the next multiple of alignment
+  void align(u32 alignment) { bytes.resize((bytes.size() + alignment - 1) / alignment * alignment); }
+
+  template <std::integral T>
+  u32 writeInt(T value) {
+    u32 offset = tell();
+    value = std::byteswap(value);
+    write(&value, sizeof(T));
+    return offset;
+  }
+  template <typename T>
+  u32 writeStruct(T value) {
+    u32 offset = tell();
+    value.bswap();
+    write(&value, sizeof(T));
+    return offset;
+  }
+
+  template <std::integral T>
+  void patchInt(u32 offset, T value) {
+    value = std::byteswap(value);
+    memcpy(bytes.data() + offset, &value, sizeof(T));
+  }
+  template <typename T>
+  void patchStruct(u32 offset, T value) {
+    value.bswap();
+    memcpy(bytes.data() + offset, &value, sizeof(T));
+  }
+};
+
+inline void writeBlockHeader(BinaryWriter& out, const char (&magic)[5]) {
+  BinaryBlockHeader header = {};
+  memcpy(header.magic, magic, 4);
+  out.writeStruct(header);
+}
+
+// pads the block to 32 bytes and fills in its length
+inline u32 finishBlock(BinaryWriter& out, u32 blockOffset) {
+  out.align(0x20);
+  u32 length = out.tell() - blockOffset;
+  out.patchInt(blockOffset + offsetof(BinaryBlockHeader, length), length);
+  return length;
+}
+
+inline DataRef offsetRef(u32 offset, u8 dataType = 0) {
+  DataRef ref = {};
+  ref.refType = REFTYPE_OFFSET;
+  ref.dataType = dataType;
+  ref.value = offset;
+  return ref;
+}
+
+inline void initFileHeader(BinaryFileHeader& header, const char (&magic)[5], u16 version, u32 fileSize, u16 headerSize, u16 numBlocks) {
+  memcpy(header.magic, magic, 4);
+  header.byteOrder = 0xFEFF;
+  header.version = version;
+  header.fileSize = fileSize;
+  header.headerSize = headerSize;
+  header.numBlocks = numBlocks;
+}
+}
@@ -3,6 +3,12 @@
 
 #include <filesystem>
 #include <string>
+#include <vector>
+
+#include "common/types.h"
+#include "common/resampler.hpp"
+#include "rsnd/AdpcmEncoder.hpp"
+#include "rsnd/SeqProgram.hpp"
 
 enum ExtractionStyle {
   EXTRACT_GROUPS,
@@ -20,18 +26,86 @@ struct ExtractOpts {
   RsarExtractOpts rsarExtractOpts;
 };
 
+enum AudioFormat {
+  AUDIO_WAV,
+  AUDIO_FLAC,
+};
+
+struct DecodeOpts {
+  // output format for decoded audio
+  AudioFormat format;
+  // 0 keeps the source sample rate
+  u32 resampleRate;
+  rsnd::ResampleQuality resampleQuality;
+  // for looped BRSTM/BRWAV: how many times the loop body is played, and how long to keep looping while fading out after that
+  u32 loops;
+  double fadeSeconds;
+  // range to decode, durationSeconds < 0 decodes to the end
+  double startSeconds;
+  double durationSeconds;
+  // channels to decode into a single file instead of one file per track, empty for all tracks
+  std::vector<u8> channels;
+  // use (and create if missing) a seek index sidecar file for ranged decodes of ADPCM BRWAVs
+  bool seekIndex;
+  // 1 or 2 to mix all BRSTM tracks into a single mono or stereo file, 0 for one file per track
+  u8 mixdownChannels;
+  // for BRSEQ: one MIDI per label instead of a single MIDI played from the start of the sequence data
+  bool allLabels;
+  // for BRSEQ: how often loops that never end go round, and a tick limit for the whole sequence
+  rsnd::SeqPlayLimits seqLimits;
+};
+
+struct EncodeOpts {
+  rsnd::AdpcmEncodeQuality quality;
+};
+
+struct PatchOpts {
+  // file to replace, by index or by the name of a sound using it (fileIdx < 0)
+  s32 fileIdx;
+  std::string soundName;
+  // new file data and/or wave data, empty to keep
+  std::filesystem::path filePath;
+  std::filesystem::path wavePath;
+};
+
+struct TranscodeOpts {
+  // StreamDataInfo format, < 0 keeps the source format
+  s16 format;
+  // bytes per channel block, 0 keeps the source block size
+  u32 blockSize;
+};
+
 struct ListOpts {
   bool sounds;
   bool groups;
   bool banks;
+  // BRSEQ labels or BRSAR SEQ sounds: duration, opened tracks, programs and polyphony as JSON
+  bool analyze;
+};
+
+struct RenderOpts {
+  // bank a BRSEQ is played with, its wave data next to it as for decoding the bank
+  std::filesystem::path bankPath;
+  // for BRSAR: the SEQ sound to render, empty for all of them
+  std::string soundName;
 };
 
 struct CliOpts {
   std::filesystem::path inputFile;
   std::string subcommand;
   std::filesystem::path outputPath;
+  // specific to the decode subcommand, also used by extract --decode
+  DecodeOpts decodeOpts;
   // specific to the extract subcommand
   ExtractOpts extractOpts;
+  // specific to the encode subcommand
+  EncodeOpts encodeOpts;
+  // specific to the patch subcommand
+  PatchOpts patchOpts;
+  // specific to the transcode subcommand, ADPCM output also uses encodeOpts
+  TranscodeOpts transcodeOpts;
   // specific to the list subcommand
   ListOpts listOpts;
+  // specific to the render subcommand, which also takes the audio format and the BRSEQ options of decodeOpts
+  RenderOpts renderOpts;
 };
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "types.h"
+
+namespace rsnd {
+// An output file laid out as a list of pieces: bytes built in memory and ranges of existing files.
+// Source files are only read by write(), which copies their ranges straight into the output
+// (copy_file_range on Linux) and gathers runs of in-memory pieces into single writev calls
+class FilePlan {
+private:
+  struct Piece {
+    // index into buffers, or -1 for a range of source
+    s32 buffer;
+    std::filesystem::path source;
+    u64 sourceOffset;
+    u64 size;
+  };
+
+  std::vector<Piece> pieces;
+  std::vector<std::vector<u8>> buffers;
+  u64 planSize;
+
+public:
+  FilePlan() : planSize(0) {}
+
+  u64 size() const { return planSize; }
+  // each returns the offset of the piece in the output
+  u64 addBytes(std::vector<u8> bytes);
+  u64 addFile(const std::filesystem::path& source, u64 sourceOffset, u64 size);
+  u64 addFile(const std::filesystem::path& source);
+  // zero padding up to the next multiple of alignment
+  void align(u32 alignment);
+
+  void write(const std::filesystem::path& path) const;
+};
+
+// FNV-1a of a file, read in chunks
+u64 hashFile(const std::filesystem::path& path);
+// whether two files have the same bytes, read in chunks. For files whose hashes match, as FNV-1a can collide
+bool sameFileContents(const std::filesystem::path& a, const std::filesystem::path& b);
+}
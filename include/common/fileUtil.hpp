@@ -1,15 +1,39 @@
-
 #pragma once
 
 #include <string>
 #include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <vector>
 
 #include "types.h"
 
 namespace rsnd {
+// "-" as a path selects stdin/stdout
+inline bool isStdio(const std::filesystem::path& path) { return path == "-"; }
+
 void* readBinary(const std::filesystem::path& path, size_t& size);
 void writeBinary(const std::filesystem::path& path, void* data, size_t size);
 
+std::istream& openStdin();
+std::ostream& openBinaryOutput(const std::filesystem::path& path, std::ofstream& file);
+bool readExact(std::istream& in, void* dst, size_t size);
+void* readRemaining(std::istream& in, const void* prefix, size_t prefixSize, size_t& size);
+
+struct WaveFileData {
+  u32 sampleRate;
+  u8 channelCount;
+  u32 sampleCount;
+  // interleaved
+  std::vector<s16> pcm;
+  // first loop of the smpl chunk, loopEnd is exclusive
+  bool loop;
+  u32 loopStart;
+  u32 loopEnd;
+};
+
+// Reads an integer PCM (8 to 32 bit) or 32 bit float WAVE file, converted to s16. Exits on unsupported files
+WaveFileData readWaveFile(const std::filesystem::path& path);
+void writeWaveHeader(std::ostream& out, int numSamples, int sampleRate, int numChannels);
 void createWaveFile(const std::filesystem::path& filepath, void* pcm, int numSamples, int sampleRate, int numChannels);
-}
\ No newline at end of file
+}
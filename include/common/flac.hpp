@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "types.h"
+#include "common/pcmSink.hpp"
+
+namespace rsnd {
+// Writes a 16 bit FLAC file. Frames are encoded in parallel batches and written in order;
+// STREAMINFO is written up front from the frame count given to begin(), so the output does not need to be seekable
+class FlacFileSink : public PcmSink {
+private:
+  static const u32 BLOCK_SIZE = 4096;
+
+  std::filesystem::path path;
+  std::ofstream file;
+  std::ostream* out;
+  u8 channelCount;
+  u32 frameNumber;
+  // interleaved samples waiting to be encoded
+  std::vector<s16> pending;
+  size_t batchFrames;
+
+  void encodePending(bool final);
+
+public:
+  FlacFileSink(const std::filesystem::path& path) : path(path), out(nullptr), channelCount(0), frameNumber(0), batchFrames(0) {}
+
+  void begin(u32 sampleRate, u8 channelCount, u32 frameCount) override;
+  void write(const s16* frames, u32 frameCount) override;
+  void end() override;
+};
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "types.h"
+
+namespace rsnd {
+// Writes to an existing file that take effect as a whole. commit() saves the bytes the writes replace
+// (and the file size) to path.journal before touching the file, so an edit interrupted by a crash is
+// rolled back the next time the file is opened for editing
+class JournaledEdit {
+private:
+  struct Write {
+    u64 offset;
+    u64 size;
+    // either data, or a range of the file itself to copy
+    std::vector<u8> data;
+    u64 copyOffset;
+  };
+
+  std::filesystem::path filePath;
+  std::filesystem::path journalPath;
+  std::vector<Write> writes;
+
+public:
+  // rolls back an earlier interrupted edit of path first
+  explicit JournaledEdit(const std::filesystem::path& path);
+
+  void write(u64 offset, std::vector<u8> data);
+  // the source range must not be changed by any write of this edit
+  void copy(u64 sourceOffset, u64 offset, u64 size);
+  void commit();
+};
+}
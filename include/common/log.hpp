@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <string_view>
+
+// Highest log level compiled in, from the RSND_LOG_LEVEL CMake option. Logging above it generates no code
+#ifndef RSND_LOG_LEVEL
+#define RSND_LOG_LEVEL 3
+#endif
+
+namespace rsnd {
+enum LogLevel {
+  LOG_OFF = 0,
+  LOG_WARN = 1,
+  LOG_INFO = 2,
+  LOG_TRACE = 3,
+};
+
+enum LogCategory {
+  // reading file structures and sequence data
+  LOG_PARSE,
+  // decoding samples
+  LOG_DECODE,
+  // reading and writing files
+  LOG_IO,
+  // building MIDI files
+  LOG_MIDI,
+  LOG_CATEGORY_COUNT
+};
+
+// level enabled at runtime for each category, warnings only by default. Only set before any threads start
+inline LogLevel logLevels[LOG_CATEGORY_COUNT] = {LOG_WARN, LOG_WARN, LOG_WARN, LOG_WARN};
+
+inline bool logEnabled(LogLevel level, LogCategory category) {
+  return level <= logLevels[category];
+}
+
+// category named name, e.g. "midi". False if there is none
+bool findLogCategory(const std::string& name, LogCategory& category);
+
+// Adds a line to the log on stderr. The log is buffered and written in chunks (and at exit), warnings are
+// written right away
+void writeLog(LogLevel level, LogCategory category, std::string_view message);
+// writes out what is buffered
+void flushLog();
+}
+
+// message is anything that can be streamed, e.g. "note " << key. It is only formatted when the level is
+// compiled in and enabled for category
+#define RSND_LOG(level, category, message)                         \
+  do {                                                             \
+    if constexpr ((level) <= RSND_LOG_LEVEL) {                     \
+      if (::rsnd::logEnabled((level), (category))) {               \
+        std::ostringstream rsndLogLine;                            \
+        rsndLogLine << message;                                    \
+        ::rsnd::writeLog((level), (category), rsndLogLine.view()); \
+      }                                                            \
+    }                                                              \
+  } while (0)
+
+#define RSND_WARN(category, message) RSND_LOG(::rsnd::LOG_WARN, category, message)
+#define RSND_INFO(category, message) RSND_LOG(::rsnd::LOG_INFO, category, message)
+#define RSND_TRACE(category, message) RSND_LOG(::rsnd::LOG_TRACE, category, message)
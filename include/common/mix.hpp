@@ -0,0 +1,10 @@
+#pragma once
+
+#include "types.h"
+
+namespace rsnd {
+// acc[i] += gain * src[i]
+void mixAccumulate(float* acc, const s16* src, u32 count, float gain);
+// Interleaves the planar float channels into s16 frames, rounding and saturating
+void mixToPcm16(const float* const* channels, u8 channelCount, u32 count, s16* out);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace rsnd {
+inline unsigned workerCount() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// set on the threads running a parallelFor, nested loops run on the calling thread
+inline thread_local bool inParallelFor = false;
+
+// Calls fn(i) for every i in [0, count) across the available cores. Indices are handed out one at a time,
+// so fn may take uneven amounts of time. Returns once every call has finished.
+template <typename F>
+void parallelFor(size_t count, F&& fn) {
+  const size_t threadCount = inParallelFor ? 1 : std::min<size_t>(count, workerCount());
+  if (threadCount <= 1) {
+    for (size_t i = 0; i < count; i++) fn(i);
+    return;
+  }
+
+  std::atomic<size_t> next = 0;
+  auto worker = [&]() {
+    inParallelFor = true;
+    for (size_t i = next++; i < count; i = next++) fn(i);
+    inParallelFor = false;
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < threadCount; t++) threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads) thread.join();
+}
+}
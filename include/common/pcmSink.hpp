@@ -0,0 +1,71 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "types.h"
+
+namespace rsnd {
+// Receives decoded audio as interleaved s16 frames, in order, chunk by chunk
+class PcmSink {
+public:
+  virtual ~PcmSink() = default;
+  // called once before any frames are written. frameCount is the exact number of frames that will follow
+  virtual void begin(u32 sampleRate, u8 channelCount, u32 frameCount) = 0;
+  virtual void write(const s16* frames, u32 frameCount) = 0;
+  virtual void end() {}
+};
+
+// Writes a WAVE file. The header is written up front, so the output does not need to be seekable
+class WaveFileSink : public PcmSink {
+private:
+  std::filesystem::path path;
+  std::ofstream file;
+  std::ostream* out;
+  u8 channelCount;
+
+public:
+  WaveFileSink(const std::filesystem::path& path) : path(path), out(nullptr), channelCount(0) {}
+
+  void begin(u32 sampleRate, u8 channelCount, u32 frameCount) override;
+  void write(const s16* frames, u32 frameCount) override;
+  void end() override;
+};
+
+// Copies everything written to it into a caller provided buffer of interleaved frames
+class BufferSink : public PcmSink {
+private:
+  s16* buffer;
+  u8 channelCount;
+
+public:
+  BufferSink(s16* buffer) : buffer(buffer), channelCount(0) {}
+
+  void begin(u32 sampleRate, u8 channelCount, u32 frameCount) override { this->channelCount = channelCount; }
+  void write(const s16* frames, u32 frameCount) override;
+};
+
+// Fades out the last fadeFrames frames linearly before forwarding them to the next sink
+class FadeOutSink : public PcmSink {
+private:
+  std::unique_ptr<PcmSink> next;
+  u32 fadeFrames;
+  u8 channelCount;
+  u32 frameCount;
+  u32 position;
+  std::vector<s16> faded;
+
+public:
+  FadeOutSink(std::unique_ptr<PcmSink> next, u32 fadeFrames) : next(std::move(next)), fadeFrames(fadeFrames), channelCount(0), frameCount(0), position(0) {}
+
+  void begin(u32 sampleRate, u8 channelCount, u32 frameCount) override;
+  void write(const s16* frames, u32 frameCount) override;
+  void end() override;
+};
+
+// Writes frameCount frames of the decoded pcm (interleaved, at least loopEnd frames) to the sink:
+// the frames up to loopEnd, then [loopStart, loopEnd) repeatedly
+void writeLoopedPcm(PcmSink& sink, const s16* pcm, u8 channelCount, u32 loopStart, u32 loopEnd, u32 frameCount);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "types.h"
+#include "common/pcmSink.hpp"
+
+namespace rsnd {
+enum ResampleQuality {
+  RESAMPLE_FAST,
+  RESAMPLE_NORMAL,
+  RESAMPLE_BEST,
+};
+
+// Converts the sample rate of everything written to it with a Kaiser windowed sinc polyphase filter
+// and forwards the result to the next sink. The rate ratio is reduced to up/down, so one filter phase
+// is kept per output position modulo up
+class ResamplerSink : public PcmSink {
+private:
+  std::unique_ptr<PcmSink> next;
+  u32 targetRate;
+  ResampleQuality quality;
+
+  bool passthrough;
+  u32 up;
+  u32 down;
+  u32 taps;
+  // up phases of taps coefficients each
+  std::vector<float> filters;
+
+  u8 channelCount;
+  // planar input, preceded by taps / 2 - 1 frames of silence. history[c][i] holds input frame historyBase + i - (taps / 2 - 1)
+  std::vector<std::vector<float>> history;
+  u64 historyBase;
+  u64 outputIndex;
+  u64 outputFrames;
+  std::vector<s16> outputBuffer;
+
+  void design(u32 sourceRate);
+  void produce();
+
+public:
+  ResamplerSink(std::unique_ptr<PcmSink> next, u32 targetRate, ResampleQuality quality = RESAMPLE_NORMAL)
+    : next(std::move(next)), targetRate(targetRate), quality(quality), passthrough(false), up(1), down(1), taps(0),
+      channelCount(0), historyBase(0), outputIndex(0), outputFrames(0) {}
+
+  void begin(u32 sampleRate, u8 channelCount, u32 frameCount) override;
+  void write(const s16* frames, u32 frameCount) override;
+  void end() override;
+};
+}
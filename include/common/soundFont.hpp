@@ -0,0 +1,50 @@
+#pragma once
+
+#include <bitset>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "vgmtrans/SF2File.h"
+
+namespace rsnd {
+// Generators of one preset or instrument zone
+struct SoundFontZone {
+  genAmountType amounts[endOper];
+  std::bitset<endOper> present;
+
+  bool has(SFGenerator gen) const { return gen < endOper && present[gen]; }
+  s16 get(SFGenerator gen, s16 fallback) const { return has(gen) ? amounts[gen].shAmount : fallback; }
+  // keyRange/velRange, 0-127 when absent
+  rangesType getRange(SFGenerator gen) const { return has(gen) ? amounts[gen].ranges : rangesType{0, 127}; }
+};
+
+struct SoundFontInstrument {
+  std::string name;
+  // generators every zone starts from
+  std::optional<SoundFontZone> global;
+  std::vector<SoundFontZone> zones;
+};
+
+struct SoundFontPreset {
+  std::string name;
+  u16 preset;
+  u16 bank;
+  std::optional<SoundFontZone> global;
+  std::vector<SoundFontZone> zones;
+};
+
+struct SoundFontData {
+  std::vector<SoundFontPreset> presets;
+  std::vector<SoundFontInstrument> instruments;
+  // without the terminal EOS record
+  std::vector<sfSample> samples;
+  // the smpl chunk, 16 bit mono samples that shdr entries point into
+  std::vector<s16> sampleData;
+};
+
+// Reads the presets, instruments and samples of an SF2 file. Modulators are ignored. Exits on malformed files
+SoundFontData readSoundFont(const std::filesystem::path& path);
+}
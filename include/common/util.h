@@ -50,6 +50,7 @@ enum RefType {
 struct DataRef {
   u8 refType;
   u8 dataType;
+  u16 _2;
   u32 value;
 
   void bswap();
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "common/types.h"
+#include "rsnd/soundCommon.hpp"
+
+namespace rsnd {
+enum AdpcmEncodeQuality {
+  // picks each frame's predictor from the unquantized prediction error and only quantizes with that one
+  ADPCM_ENCODE_FAST,
+  // quantizes every frame with all 8 predictors and keeps the one closest to the input
+  ADPCM_ENCODE_BEST,
+};
+
+// One DSP-ADPCM encoded channel, starting from zero history
+struct AdpcmChannel {
+  s16 coeffs[16];
+  // 8 byte frames of 14 samples each
+  std::vector<u8> data;
+  // what decoding data yields, for the predictor history at block starts and at the loop start
+  std::vector<s16> decoded;
+
+  u8 getPredictorScale(u32 sample) const { return data[sample / 14 * 8]; }
+  // decoded samples right before sample, as the decoder history at that point
+  s16 getYn1(u32 sample) const { return sample >= 1 ? decoded[sample - 1] : 0; }
+  s16 getYn2(u32 sample) const { return sample >= 2 ? decoded[sample - 2] : 0; }
+  // coefficients, initial and loop context. loopStart is ignored when loop is false
+  AdpcParams getAdpcParams(bool loop, u32 loopStart) const;
+};
+
+// filter of one frame, the coefficients are solved from those of every frame of a channel
+typedef std::array<double, 3> AdpcmRecord;
+
+// Appends the records of frames [firstFrame, lastFrame) of pcm, frames past sampleCount are zero padded.
+// Frame firstFrame - 1 is read as the history of the first one
+void collectAdpcmRecords(const s16* pcm, u32 sampleCount, u32 firstFrame, u32 lastFrame, std::vector<AdpcmRecord>& records);
+void solveAdpcmCoeffs(const std::vector<AdpcmRecord>& records, s16 coeffs[16]);
+
+// solveAdpcmCoeffs for records that are not all held at once: every pass adds all records of the channel, in the
+// same order each time, and gives the same coefficients
+class AdpcmCoeffSolver {
+public:
+  AdpcmCoeffSolver();
+  // true while the records are needed for another pass
+  bool needsPass() const { return pass < PASS_COUNT; }
+  void add(const AdpcmRecord& record);
+  void finishPass();
+  // once no more passes are needed
+  void getCoeffs(s16 coeffs[16]) const;
+
+private:
+  // the mean of the records, then two refinement passes each for 2, 4 and 8 predictors
+  static const int PASS_COUNT = 7;
+  int pass = 0;
+  int predictorCount = 1;
+  u64 recordCount = 0;
+  AdpcmRecord vecBest[8] = {};
+  // sum and number of the records closest to each predictor in this pass
+  AdpcmRecord sums[8] = {};
+  u64 counts[8] = {};
+};
+// Encodes count samples into (count + 13) / 14 frames, continuing from and updating the decoder history yn1/yn2
+void encodeAdpcmFrames(const s16* pcm, u32 count, s16& yn1, s16& yn2, const s16 coeffs[16], AdpcmEncodeQuality quality, u8* data, s16* decoded);
+// Fixes up frames encoded from the history speculativeYn1/speculativeYn2 that actually follow yn1/yn2, re-encoding
+// until the history matches. Afterwards they are what encodeAdpcmFrames from yn1/yn2 would have made
+void reencodeAdpcmFrames(const s16* pcm, u32 count, s16 yn1, s16 yn2, s16 speculativeYn1, s16 speculativeYn2, const s16 coeffs[16], AdpcmEncodeQuality quality,
+                         u8* data, s16* decoded);
+
+// Solves the 8 coefficient pairs of the standard DSP-ADPCM encoder for a channel
+void correlateAdpcmCoeffs(const s16* pcm, u32 sampleCount, s16 coeffs[16]);
+
+// Encodes interleaved pcm. Coefficients are solved per channel, and frames are encoded in chunks in parallel,
+// each chunk speculatively starting from the input samples before it. Chunks whose start history turns out
+// different are re-encoded until they converge, so the output is the same as encoding each channel in order
+std::vector<AdpcmChannel> encodeAdpcm(const s16* pcm, u8 channelCount, u32 sampleCount, AdpcmEncodeQuality quality);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "common/types.h"
+
+namespace rsnd {
+class SoundWave;
+
+struct AdpcmCheckpoint {
+  s16 yn1;
+  s16 yn2;
+};
+
+// header of the sidecar file, followed by channelCount * checkpointCount AdpcmCheckpoints (little endian)
+struct AdpcmSeekIndexHeader {
+  char magic[4];
+  u16 version;
+  u8 channelCount;
+  u8 _pad;
+  u32 interval;
+  u32 sampleCount;
+  u64 dataHash;
+};
+
+// Predictor history of a monolithic ADPCM wave every `interval` ADPCM frames (14 samples each),
+// so decoding can start at the nearest checkpoint instead of at sample 0
+class AdpcmSeekIndex {
+private:
+  u32 interval;
+  u32 sampleCount;
+  u64 dataHash;
+  std::vector<std::vector<AdpcmCheckpoint>> checkpoints;
+
+  static u64 hashWaveData(const SoundWave& soundWave);
+
+public:
+  static const u32 DEFAULT_INTERVAL = 256;
+  static constexpr char MAGIC[4] = {'R', 'S', 'K', 'I'};
+  static const u16 VERSION = 1;
+
+  AdpcmSeekIndex() : interval(0), sampleCount(0), dataHash(0) {}
+
+  // the sidecar file for an input file, e.g. foo.brwav.seek
+  static std::filesystem::path sidecarPath(const std::filesystem::path& inputPath);
+
+  // decodes every channel once, recording the history at each checkpoint
+  void build(const SoundWave& soundWave, u32 interval = DEFAULT_INTERVAL);
+  // false if the file is missing, malformed or was built for different wave data
+  bool load(const std::filesystem::path& path, const SoundWave& soundWave);
+  bool save(const std::filesystem::path& path) const;
+
+  // finds the last checkpoint at or before sample, returns the sample it starts at
+  u32 seek(u8 channelIdx, u32 sample, s16& yn1, s16& yn2) const;
+  u32 getIntervalSamples() const { return interval * 14; }
+};
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "common/types.h"
+#include "rsnd/SeqProgram.hpp"
+
+namespace rsnd {
+// What a sequence does when played from one offset
+struct SeqAnalysis {
+  // until the last track ends or the last note stops
+  u32 durationTicks;
+  // the same following MML_TEMPO and MML_TIMEBASE
+  double durationSeconds;
+  // track numbers, in the order they were opened
+  std::vector<u8> tracks;
+  // MML_OPEN_TRACK, from the opening track number to the opened one
+  std::vector<std::pair<u8, u8>> openedTracks;
+  // MML_PRG, sorted
+  std::vector<u32> programs;
+  // most notes sounding at once over all tracks
+  u32 maxPolyphony;
+};
+
+// Plays the sequence from offset through the interpreter without generating any events
+SeqAnalysis analyzeSequence(const SoundSequence& seq, u32 offset, const SeqPlayLimits& limits);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+
+#include "common/types.h"
+#include "rsnd/SoundSequence.hpp"
+
+namespace rsnd {
+// What an instruction does, indexes the interpreter's dispatch table
+enum SeqOp : u8 {
+  SEQ_OP_NOTE,
+  SEQ_OP_WAIT,
+  SEQ_OP_OPEN_TRACK,
+  SEQ_OP_JUMP,
+  SEQ_OP_CALL,
+  SEQ_OP_RET,
+  SEQ_OP_FIN,
+  SEQ_OP_NOTE_WAIT,
+  SEQ_OP_LOOP_START,
+  SEQ_OP_LOOP_END,
+  // MmlEx MML_SETVAR to MML_MODVAR
+  SEQ_OP_VAR,
+  // MmlEx MML_CMP_EQ to MML_CMP_NE
+  SEQ_OP_CMP,
+  // continues at target, where decoding ran into code that was already decoded
+  SEQ_OP_GOTO,
+  // any other command, handed to the sink
+  SEQ_OP_COMMAND,
+  // an unknown command, skipped
+  SEQ_OP_NOP,
+  // a truncated command or the end of the sequence data
+  SEQ_OP_INVALID,
+  SEQ_OP_COUNT
+};
+
+// An operand as resolved by the predecoder. U8, S16 and VMIDI operands are constants, a RANDOM operand is the
+// range [value, max] and a VARIABLE operand the variable number in value
+struct SeqOperand {
+  SeqArgType type;
+  s32 value;
+  s16 max;
+};
+
+// One command with the prefix commands before it (MML_RANDOM, MML_VARIABLE, MML_IF, MML_TIME*) folded in
+struct SeqInstr {
+  SeqOp op;
+  // the Mml command, the key of a note
+  u8 cmd;
+  // the MmlEx command of MML_EX_COMMAND
+  u8 exCmd;
+  // velocity of a note, track number of MML_OPEN_TRACK, variable number of an MmlEx command
+  u8 byteArg;
+  // MML_IF, only runs when the track's compare flag is set
+  bool conditional;
+  // the last operand, the one MML_RANDOM and MML_VARIABLE apply to. SEQ_ARG_NONE if the command has none
+  SeqOperand arg;
+  // extra operand of MML_TIME*, SEQ_ARG_NONE without one
+  SeqOperand time;
+  // instruction index of the jump, call or opened track target
+  u32 target;
+  // of the command (its first prefix) in the sequence data
+  u32 offset;
+};
+
+// The code of a sequence decoded once into instructions, following jumps, calls and opened tracks from the
+// entry points. Only reachable code is decoded, so data between tracks is never misread as commands. Unknown
+// commands are skipped by the operand length of their command range, with a warning
+class SeqProgram {
+private:
+  // instruction index of every decoded offset, NO_INSTR elsewhere
+  std::vector<u32> instrAt;
+
+public:
+  static const u32 NO_INSTR = 0xffffffff;
+
+  std::vector<SeqInstr> instrs;
+
+  SeqProgram(const u8* data, u32 dataSize, const std::vector<u32>& entryOffsets);
+  SeqProgram(const SoundSequence& seq, const std::vector<u32>& entryOffsets);
+
+  // NO_INSTR if offset was not decoded
+  u32 indexOf(u32 offset) const { return offset < instrAt.size() ? instrAt[offset] : NO_INSTR; }
+};
+
+// Receives what a running track does. Control flow, variables, prefix commands and note wait are handled by the
+// interpreter
+class SeqTrackSink {
+public:
+  virtual ~SeqTrackSink() = default;
+
+  virtual void note(u8 key, u8 velocity, s32 duration) = 0;
+  virtual void wait(s32 duration) = 0;
+  // MML_OPEN_TRACK, returns the sink of the opened track or nullptr to not run it
+  virtual SeqTrackSink* openTrack(u8 trackNo) = 0;
+  // any other command, value is its last operand
+  virtual void command(const SeqInstr& instr, s32 value) = 0;
+};
+
+// How far sequences that never end are played
+struct SeqPlayLimits {
+  // times a jump back or an endless MML_LOOP_START loop goes round before its track ends
+  u32 loopCount = 1;
+  // ticks after which every track ends, 0 for no limit
+  u32 maxTicks = 0;
+};
+
+// Plays a SeqProgram, dispatching on SeqOp through a table. Like the console's sequence player, tracks run
+// interleaved in tick order and share the player's variables, with a compare flag, variables and a call and
+// loop stack of their own
+class SeqInterpreter {
+private:
+  const SeqProgram& program;
+  SeqPlayLimits limits;
+
+public:
+  explicit SeqInterpreter(const SeqProgram& program, const SeqPlayLimits& limits = {}) : program(program), limits(limits) {}
+
+  // Plays from instruction pc until every track has finished, the first track reporting to sink
+  void run(u32 pc, SeqTrackSink& sink) const;
+};
+}
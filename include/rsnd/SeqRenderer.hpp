@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "common/types.h"
+#include "common/pcmSink.hpp"
+#include "rsnd/SeqProgram.hpp"
+#include "rsnd/SoundBank.hpp"
+#include "rsnd/SoundSequence.hpp"
+
+namespace rsnd {
+// The waves of a bank decoded once, by wave index. The bank's own WAVE block or a BRWAR, whichever waveData is.
+// Read only once built, so songs using the same bank can render from it in parallel
+class BankWaves {
+public:
+  struct Wave {
+    u32 sampleRate;
+    bool loop;
+    u32 loopStart;
+    // frames, the loop end for looped waves
+    u32 frameCount;
+    u8 channelCount;
+    // planar, one frame longer than frameCount: the loop start again for looped waves, silence otherwise, so
+    // interpolation never reads past the end
+    std::vector<s16> channels[2];
+  };
+
+  std::vector<Wave> waves;
+
+  BankWaves(const SoundBank& bank, void* waveData, size_t waveSize);
+};
+
+// Plays a sequence through a software synthesizer, like the console does with its DSP voices: each note starts a
+// voice playing the wave of its key and velocity region, pitch shifted from the region's original key, with the
+// region's volume, pan and ADSR envelope
+class SeqRenderer {
+private:
+  const SoundBank& bank;
+  const BankWaves& waves;
+  SeqPlayLimits limits;
+
+public:
+  static const u32 SAMPLE_RATE = 32000;
+
+  // bank needs its lookup table built (SoundBank::buildLookupTable) to be shared between threads
+  SeqRenderer(const SoundBank& bank, const BankWaves& waves, const SeqPlayLimits& limits = {}) : bank(bank), waves(waves), limits(limits) {}
+
+  // Renders the sequence played from offset as stereo frames at SAMPLE_RATE, until the last track ends and the
+  // notes still sounding have been released
+  void render(const SoundSequence& seq, u32 offset, PcmSink& sink) const;
+};
+}
@@ -91,6 +91,17 @@ struct SoundInfoEntry {
   void bswap();
 };
 
+struct Sound3DParam {
+  u32 flags;
+  u8 decayCurve;
+  u8 decayRatio;
+  u8 dopplerFactor;
+  u8 _7;
+  u32 _8;
+
+  void bswap();
+};
+
 struct SeqSoundInfo {
   u32 offset;
   u32 bankIdx;
@@ -253,7 +264,11 @@ public:
 
   SoundArchive(void* fileData, size_t fileSize);
 
+  u16 getVersion() const { return static_cast<const SoundArchiveHeader*>(data)->version; }
+
   const char* getString(s32 idx) const { return idx > 0 ? static_cast<const char*>(getOffset(symbBase, stringTable->elems[idx])) : nullptr; }
+  // index of the sound named name in the sound string tree, -1 if there is none
+  s32 findSound(const char* name) const;
   const SoundInfoEntry* getSoundInfo(u32 idx) const { return static_cast<SoundInfoEntry*>(soundTable->elems[idx].getAddr(infoBase)); }
 
   const FileInfo* getFileInfo(u32 idx) const { return static_cast<FileInfo*>(fileTable->elems[idx].getAddr(infoBase)); }
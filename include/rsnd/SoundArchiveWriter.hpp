@@ -0,0 +1,67 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common/filePlan.hpp"
+#include "rsnd/SoundArchive.hpp"
+
+namespace rsnd {
+// Everything in a BRSAR besides the layout. References between the structs are rebuilt on packing,
+// only their plain fields are kept
+struct ManifestSound {
+  SoundInfoEntry info;
+  std::optional<Sound3DParam> param3d;
+  // the one matching info.soundType is used
+  SeqSoundInfo seqInfo;
+  StrmSoundInfo strmInfo;
+  WsdSoundInfo wsdInfo;
+};
+
+struct ManifestFile {
+  // sizes are refreshed from the group items for internal files
+  FileInfo info;
+  std::optional<std::string> external;
+};
+
+struct ManifestGroupItem {
+  // offsets and sizes are recomputed for internal groups
+  GroupItemInfo info;
+  // empty for no data
+  std::filesystem::path filePath;
+  std::filesystem::path wavePath;
+};
+
+struct ManifestGroup {
+  GroupInfo info;
+  std::optional<std::string> external;
+  std::vector<ManifestGroupItem> items;
+};
+
+struct SoundArchiveManifest {
+  u16 version;
+  std::vector<std::string> strings;
+  std::vector<ManifestSound> sounds;
+  std::vector<BankInfo> banks;
+  std::vector<PlayerInfo> players;
+  std::vector<ManifestFile> files;
+  std::vector<ManifestGroup> groups;
+  SoundCountTable counts;
+};
+
+// item paths are left empty
+SoundArchiveManifest getArchiveManifest(const SoundArchive& soundArchive);
+// Line based text, item paths are written relative to the manifest's directory
+void writeArchiveManifest(const std::filesystem::path& path, const SoundArchiveManifest& manifest);
+SoundArchiveManifest readArchiveManifest(const std::filesystem::path& path);
+
+// Lays out a BRSAR in one pass. Group item files are only sized (and hashed when sizes collide, identical
+// items of a group share their data) so the returned plan copies them straight from disk
+FilePlan planSoundArchive(const SoundArchiveManifest& manifest);
+// BRWAR from RWAV files, an empty path makes an empty entry. Identical files share their data
+FilePlan planSoundWaveArchive(const std::vector<std::filesystem::path>& waves);
+// BRWAR from RWAV files built in memory, laid out like planSoundWaveArchive
+std::vector<u8> buildSoundWaveArchive(const std::vector<std::vector<u8>>& waves);
+}
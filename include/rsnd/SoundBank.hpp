@@ -7,6 +7,8 @@
 
 #include <cstddef>
 #include <filesystem>
+#include <span>
+#include <unordered_set>
 #include <vector>
 
 #include "common/util.h"
@@ -47,6 +49,12 @@ struct InstrInfo {
   void bswap();
 };
 
+// The volume envelope of an InstrInfo: attack and hold in milliseconds, decay and release as the rate the level
+// falls in decibels per millisecond (negative)
+f64 envelopeAttackMs(s8 attack);
+f64 envelopeHoldMs(s8 hold);
+f64 envelopeFallRate(s8 decay);
+
 enum RegionSet {
   REGIONSET_DIRECT = 1,
   REGIONSET_RANGE = 2,
@@ -89,6 +97,7 @@ struct SoundBankWave : public BinaryBlockHeader {
 class SoundBank {
 private:
   struct Subregion {
+    s16 low;
     s16 high;
     const DataRef* ref;
   };
@@ -96,9 +105,6 @@ private:
   void* data;
   size_t dataSize;
 
-  void bswapRegionsRecurse(DataRef& regionRef);
-  std::vector<Subregion> getSubregions(const DataRef* ref) const;
-
 public:
   struct InstrumentRegion {
     s16 keyLo;
@@ -109,6 +115,24 @@ public:
     InstrInfo* instrInfo;
   };
 
+private:
+  // the regions of every program back to back, those of program i are [regionStarts[i], regionStarts[i + 1])
+  std::vector<InstrumentRegion> regions;
+  std::vector<u32> regionStarts;
+  // first region (in program order) of each wave index, -1 for waves no region plays
+  std::vector<s32> waveRegions;
+  // optional, see buildLookupTable(). Region of each program, key and velocity relative to the program's first
+  // region, NO_REGION where nothing plays
+  std::vector<u16> lookupTable;
+  static constexpr u16 NO_REGION = 0xffff;
+
+  // tables and InstrInfos can be shared, swapped holds the offsets of those already swapped
+  void bswapRegionsRecurse(DataRef& regionRef, std::unordered_set<u32>& swapped);
+  std::vector<Subregion> getSubregions(const DataRef* ref) const;
+  void buildRegionTable();
+
+public:
+
   SoundBankData* bankData;
   SoundBankWave* bankWave;
 
@@ -121,8 +145,19 @@ public:
 
   DataRef* getSubregionRef(const DataRef* ref, int idx) const;
   u32 getInstrCount() const { return bankData->instrs.size; }
-  InstrInfo* getInstrInfo(int progIdx, int key, int velocity);
-  std::vector<InstrumentRegion> getInstrRegions(int progIdx) const;
+  // Walks the program's key and velocity tables, or a single load from the lookup table once it is built
+  InstrInfo* getInstrInfo(int progIdx, int key, int velocity) const;
+  // Precomputes the region of every key and velocity (32KB per program) for lookups at note rate. Call it before
+  // sharing the bank between threads, lookups only read it
+  void buildLookupTable();
+  // key/velocity regions of a program that have an InstrInfo, keys first
+  std::span<const InstrumentRegion> getInstrRegions(int progIdx) const {
+    return std::span(regions).subspan(regionStarts[progIdx], regionStarts[progIdx + 1] - regionStarts[progIdx]);
+  }
+  // the first region playing a wave, nullptr if there is none
+  const InstrumentRegion* getWaveRegion(u32 waveIdx) const {
+    return waveIdx < waveRegions.size() && waveRegions[waveIdx] >= 0 ? &regions[waveRegions[waveIdx]] : nullptr;
+  }
 
   const WaveInfo* getWaveInfo(int i) const { return bankWave->waveInfos.elems[i].getAddr<WaveInfo>(waveBase); }
   int getWaveInfoCount() const { return bankWave->waveInfos.size; }
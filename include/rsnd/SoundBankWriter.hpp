@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+#include "common/types.h"
+#include "rsnd/SoundBank.hpp"
+
+namespace rsnd {
+// InstrInfo played for a key and velocity range, inclusive
+struct BankRegion {
+  u8 keyLo;
+  u8 keyHi;
+  u8 velLo;
+  u8 velHi;
+  // the references to LFO, envelope and randomizer tables are written as null
+  InstrInfo info;
+};
+
+// BRBNK of instruments (programs) referring to waves of a separate BRWAR by index. Where regions overlap
+// the first one wins. Key and velocity splits become RANGE or INDEX tables, whichever is smaller, identical
+// InstrInfos are written once
+std::vector<u8> buildSoundBank(const std::vector<std::vector<BankRegion>>& instruments);
+}
@@ -160,8 +160,11 @@ public:
 
   SoundSequence(void* fileData, size_t fileSize);
 
+  u32 getLabelCount() const { return label->labelOffs.size; }
   const SeqLabel* getSeqLabel(u32 i) const { return getOffsetT<SeqLabel>(labelBase, label->labelOffs.elems[i]); }
   const void* getSeqData() const { return getOffsetT<const void>(dataBase, 0); }
+  // bytes of sequence data, clamped to the file
+  u32 getSeqDataSize() const;
   const u32 getLabelOffset(const SeqLabel* label) const { return label->dataOffset; }
 };
 }
\ No newline at end of file
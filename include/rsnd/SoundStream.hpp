@@ -1,10 +1,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <filesystem>
+#include <istream>
 
 #include "common/types.h"
 #include "common/util.h"
+#include "common/pcmSink.hpp"
 
 #include "rsnd/soundCommon.hpp"
 
@@ -120,10 +124,10 @@ class SoundStream {
 private:
   void* data;
   size_t dataSize;
+  // false when only the blocks preceding the stream data were loaded, e.g. when reading from a pipe
+  bool hasBlockData;
 
-  void decodeChannelPcm8(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
-  void decodeChannelPcm16(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
-  void decodeChannelAdpcm(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
+  void decodeTrackRow(const u8* channelIndices, u8 channelCount, u32 blockIdx, const u8* rowData, s16* buffer) const;
 public:
   SoundStreamHead* strmHead;
   SoundStreamData* strmData;
@@ -138,12 +142,33 @@ public:
   const u8 getTrackInfoType() const { return trackTable->trackInfoType; };
   const TrackInfoExtended* getTrackInfoExtended(u8 trackIdx) const;
   const TrackInfoSimple* getTrackInfoSimple(u8 trackIdx) const;
+  const u8* getTrackChannels(u8 trackIdx, u8& channelCount) const;
   const AdpcParams* getAdpcParams(u8 channelIdx) const;
-  const AdpcEntry* getAdpcEntry(u8 b, u8 c) const;
+  const AdpcEntry* getAdpcEntry(u32 b, u8 c) const;
   const u32 getBlockSize(u32 b) const { return b + 1 == strmDataInfo->blockCount ? strmDataInfo->finalBlockSize : strmDataInfo->blockSize; }
+  const u32 getBlockSamples(u32 b) const { return b + 1 == strmDataInfo->blockCount ? strmDataInfo->finalBlockSamples : strmDataInfo->blockSamples; }
+  // size of block b of every channel, as laid out in the DATA block
+  const u32 getBlockRowSize(u32 b) const { return strmDataInfo->channelCount * (b + 1 == strmDataInfo->blockCount ? strmDataInfo->finalBlockPaddedSize : strmDataInfo->blockSize); }
   const u32 getSampleCount() const;
-  const u8* getBlockData(u8 channelIdx, u8 blockIdx) const;
+  bool isLooped() const { return strmDataInfo->loop && getLoopStart() < getLoopEnd(); }
+  u32 getLoopStart() const { return strmDataInfo->loopStart; }
+  u32 getLoopEnd() const { return strmDataInfo->loopEnd == 0 ? getSampleCount() : std::min(strmDataInfo->loopEnd, getSampleCount()); }
+  const u8* getBlockData(u8 channelIdx, u32 blockIdx) const;
+  void bswapBlockRow(u8* rowData, u32 blockIdx) const;
+  void decodeBlock(u8 channelIdx, u32 blockIdx, const u8* blockData, s16* buffer, u8 stride = 1) const;
   void decodeChannel(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
+  // frameCount 0 decodes the whole track once. Otherwise looped streams play up to the loop end and then keep playing the loop
+  void decodeTrack(u8 trackIdx, PcmSink& sink, u32 frameCount = 0) const;
+  void decodeTracks(std::istream& blockRows, PcmSink* const* trackSinks) const;
+  // Decodes count samples from firstSample on of the given channels, interleaved. Only the blocks overlapping the
+  // range are decoded, each seeded from its ADPC entry. The range is clamped to the sample count
+  void decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, PcmSink& sink) const;
+  void decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, s16* out) const;
+  // Gain of every stream channel into each of the outputChannelCount (1 or 2) mixdown channels,
+  // from the track volume and pan. gains[channelIdx * outputChannelCount + outputChannel]
+  void getMixGains(u8 outputChannelCount, float* gains) const;
+  // Mixes all tracks into a single mono or stereo signal, one block at a time
+  void decodeMixdown(u8 outputChannelCount, PcmSink& sink) const;
   s16* getChannelPcm(u8 channelIdx) const;
   s16* getTrackPcm(u8 trackIdx, u8& channelCount) const;
   void trackToWaveFile(u8 trackIdx, std::filesystem::path wavePath) const;
@@ -5,7 +5,9 @@
 #include <filesystem>
 
 #include "common/util.h"
+#include "common/pcmSink.hpp"
 #include "rsnd/soundCommon.hpp"
+#include "rsnd/AdpcmSeekIndex.hpp"
 
 namespace rsnd {
 struct SoundWaveHeader : public BinaryFileHeader {
@@ -27,6 +29,7 @@ class SoundWave {
 private:
   void* data;
   size_t dataSize;
+  const AdpcmSeekIndex* seekIndex;
 
 public:
   SoundWaveInfo* info;
@@ -54,14 +57,23 @@ public:
     return getOffsetT<const u8>(waveBase2, getChannelInfo(idx)->dataOffset);
   }
   void decodeChannel(u8 channelIdx, s16* buffer, u8 offset = 0, u8 stride = 1) const;
+  // lets ranged ADPCM decodes start at the nearest checkpoint instead of the start of the wave
+  void setSeekIndex(const AdpcmSeekIndex* seekIndex) { this->seekIndex = seekIndex; }
+  void decodeChannelRange(u8 channelIdx, u32 firstSample, u32 count, s16* buffer, u8 stride = 1) const;
+  // Decodes count samples from firstSample on of the given channels, interleaved. The range is clamped to the sample count
+  void decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, PcmSink& sink) const;
+  void decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, s16* out) const;
   s16* getChannelPcm(u8 channelIdx) const;
   u8 getChannelCount() const { return info->channelCount; }
+  bool isLooped() const { return info->loop && getLoopStart() < getLoopEnd(); }
   u32 getLoopStart() const;
   u32 getLoopEnd() const;
   u32 getTrackSampleCount() const;
   u32 getTrackSampleRate() const { return info->sampleRate; }
   u32 getTrackSampleBufferSize() const { return getChannelCount() * getTrackSampleCount() * sizeof(s16); }
   s16* getTrackPcm() const;
+  // frameCount 0 decodes the whole wave once. Otherwise looped waves play up to the loop end and then keep playing the loop
+  void decode(PcmSink& sink, u32 frameCount = 0) const;
   void toWaveFile(std::filesystem::path wavePath) const;
 };
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "common/types.h"
+#include "rsnd/AdpcmEncoder.hpp"
+#include "rsnd/SoundStream.hpp"
+
+namespace rsnd {
+// Loop and format of encoded channels to be written out
+struct EncodedSound {
+  u32 sampleRate;
+  u32 sampleCount;
+  bool loop;
+  u32 loopStart;
+  std::vector<AdpcmChannel> channels;
+};
+
+struct StreamTrack {
+  // only written for TrackTable::EXTENDED
+  u8 volume;
+  u8 pan;
+  std::vector<u8> channels;
+};
+
+// Writes a BRSTM one block row at a time. The HEAD and ADPC blocks come before the block data but are only
+// complete once every block is encoded, so their space is reserved up front and finish() fills them in
+class SoundStreamWriter {
+private:
+  std::ostream& out;
+  StreamDataInfo info;
+  u8 trackInfoType;
+  std::vector<StreamTrack> tracks;
+  std::vector<AdpcParams> adpcParams;
+  std::vector<AdpcEntry> adpcEntries;
+  u32 headSize;
+  u32 adpcSize;
+  u32 dataOffset;
+  u32 nextBlock;
+
+  std::vector<u8> buildHead() const;
+
+public:
+  // info needs format, loop, channelCount, sampleRate, loopStart, loopEnd and blockSize, the block counts and sizes
+  // follow from sampleCount
+  SoundStreamWriter(std::ostream& out, const StreamDataInfo& info, u32 sampleCount, u8 trackInfoType, std::vector<StreamTrack> tracks);
+
+  static u32 getFormatBlockSamples(u8 format, u32 blockSize);
+  const StreamDataInfo& getInfo() const { return info; }
+  u32 getBlockSamples(u32 b) const { return b + 1 == info.blockCount ? info.finalBlockSamples : info.blockSamples; }
+  // channel data in block b, without the final block padding
+  u32 getBlockSize(u32 b) const { return b + 1 == info.blockCount ? info.finalBlockSize : info.blockSize; }
+
+  // the next block of every channel, getBlockSize() big endian bytes each
+  void writeBlockRow(const u8* const* channelData);
+  void setAdpcParams(u8 channelIdx, const AdpcParams& params) { adpcParams[channelIdx] = params; }
+  // decoder history at the start of block b
+  void setAdpcEntry(u32 b, u8 channelIdx, s16 yn1, s16 yn2) { adpcEntries[b * info.channelCount + channelIdx] = {yn1, yn2}; }
+  void finish();
+};
+
+// BRWAV with all channel data in one DATA block
+std::vector<u8> buildSoundWave(const EncodedSound& sound);
+// BRSTM with the standard 0x2000 byte blocks. Channels are paired into stereo tracks, an odd last channel gets a mono track
+std::vector<u8> buildSoundStream(const EncodedSound& sound);
+}
@@ -4,6 +4,7 @@
 #include <filesystem>
 
 #include "common/util.h"
+#include "common/pcmSink.hpp"
 #include "rsnd/soundCommon.hpp"
 
 namespace rsnd {
@@ -153,6 +154,7 @@ public:
   }
   const AdpcParams* getAdpcParams(const WaveInfo* waveInfo, const SoundWaveChannelInfo* chInfo) const { return getOffsetT<AdpcParams>(waveInfo, chInfo->adpcmOffset); }
 
+  void decodeTrack(u8 trackIdx, void* waveData, PcmSink& sink) const;
   void trackToWaveFile(u8 trackIdx, void* waveData, std::filesystem::path wavePath) const;
 };
 }
\ No newline at end of file
@@ -72,6 +72,19 @@ inline u32 dspAddressToSamples(u32 value) {
   return value / 16 * 14 + (value % 16 - 2);
 }
 
+// inverse of dspAddressToSamples
+inline u32 samplesToDspAddress(u32 sample) {
+  return sample / 14 * 16 + sample % 14 + 2;
+}
+
+// WaveInfo loop points are addresses, nibbles for ADPCM and samples for PCM, and loopEnd is the address of the
+// wave's last sample. In samples: where the loop starts, and the end of the wave (one past its last sample)
+u32 waveLoopStart(const WaveInfo* info);
+u32 waveLoopEnd(const WaveInfo* info);
+// the inverse, loop point addresses of a wave in format
+u32 waveLoopStartAddress(u8 format, u32 loopStart);
+u32 waveLoopEndAddress(u8 format, u32 end);
+
 void decodePcm8Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride);
 void decodePcm16Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride);
 void decodeAdpcmBlock(const u8* blockData, u32 sampleCount, const s16 coeffs[16], s16 yn1, s16 yn2, s16* buffer, u8 stride);
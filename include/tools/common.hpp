@@ -1,8 +1,16 @@
 
 #pragma once
 
+#include <set>
 #include <string>
 
+#include "common/types.h"
+
 namespace rsnd {
 std::string magicLowercase(void* fileData);
+
+// A name read from a file made safe to use as one file name in the output directory: path separators, control
+// characters and characters Windows rejects become '_', and a name that is empty or only dots becomes idx. If
+// usedNames already holds it, _idx is appended. The result is added to usedNames
+std::string uniqueFileName(std::set<std::string>& usedNames, const std::string& name, u32 idx);
 }
\ No newline at end of file
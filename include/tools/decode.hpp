@@ -1,8 +1,18 @@
 
 #pragma once
 
+#include <filesystem>
+#include <memory>
+
 #include "common/cli.h"
+#include "common/pcmSink.hpp"
 
 namespace rsnd {
+// file extension of decoded audio for the selected output format, e.g. ".wav"
+const char* audioExtension(const CliOpts& cliOpts);
+// output sink for decoded audio with the stages selected in cliOpts, fading out the last fadeFrames frames
+std::unique_ptr<PcmSink> openAudioSink(const std::filesystem::path& path, const CliOpts& cliOpts, u32 fadeFrames = 0);
+// Reads the wave data kept next to a bank file, exits if it is missing. Free the returned data
+void* readBankWaveData(const std::filesystem::path& bankPath, const void* bankData, size_t& waveSize);
 void rsndDecode(CliOpts& cliOpts);
 }
\ No newline at end of file
@@ -2,5 +2,12 @@
 #pragma once
 
 namespace rsnd {
+class SoundSequence;
+struct SeqPlayLimits;
+
 void rsndExtract(const CliOpts& cliOpts);
+// SF2 of a BRBNK, waveData is its BRWAR unless the bank has its own WAVE block
+void extract_rbnk_sf2(const std::filesystem::path filepath, void* fileData, size_t fileSize, void* waveData, size_t waveSize);
+// One MIDI per label of a BRSEQ in dirPath, named after the label. The labels are converted in parallel
+void extract_rseq_midis(const std::filesystem::path dirPath, const SoundSequence& soundSeq, const SeqPlayLimits& limits);
 }
\ No newline at end of file
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "common/cli.h"
+
+namespace rsnd {
+void rsndRender(CliOpts& cliOpts);
+}
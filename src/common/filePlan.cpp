@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "common/filePlan.hpp"
+
+namespace rsnd {
+u64 FilePlan::addBytes(std::vector<u8> bytes) {
+  u64 offset = planSize;
+  planSize += bytes.size();
+  pieces.push_back({static_cast<s32>(buffers.size()), {}, 0, bytes.size()});
+  buffers.push_back(std::move(bytes));
+  return offset;
+}
+
+u64 FilePlan::addFile(const std::filesystem::path& source, u64 sourceOffset, u64 size) {
+  u64 offset = planSize;
+  planSize += size;
+  pieces.push_back({-1, source, sourceOffset, size});
+  return offset;
+}
+
+u64 FilePlan::addFile(const std::filesystem::path& source) {
+  std::error_code error;
+  u64 size = std::filesystem::file_size(source, error);
+  if (error) {
+    std::cerr << "Failed to open file " << source << std::endl;
+    exit(-1);
+  }
+  return addFile(source, 0, size);
+}
+
+void FilePlan::align(u32 alignment) {
+  u64 padding = (alignment - planSize % alignment) % alignment;
+  if (padding > 0) addBytes(std::vector<u8>(padding));
+}
+
+#ifndef _WIN32
+static void writeFailed(const std::filesystem::path& path) {
+  std::cerr << "Error writing file " << path << std::endl;
+  exit(-1);
+}
+
+// writes all of iov, resuming after partial writes
+static void writeAll(int fd, std::vector<iovec>& iov, const std::filesystem::path& path) {
+  size_t first = 0;
+  while (first < iov.size()) {
+    int count = std::min<size_t>(iov.size() - first, IOV_MAX);
+    ssize_t written = writev(fd, iov.data() + first, count);
+    if (written < 0) writeFailed(path);
+    while (first < iov.size() && static_cast<size_t>(written) >= iov[first].iov_len) {
+      written -= iov[first].iov_len;
+      first++;
+    }
+    if (written > 0) {
+      iov[first].iov_base = static_cast<u8*>(iov[first].iov_base) + written;
+      iov[first].iov_len -= written;
+    }
+  }
+  iov.clear();
+}
+
+static void copyRange(const std::filesystem::path& source, u64 sourceOffset, u64 size, int out, const std::filesystem::path& path) {
+  int in = open(source.c_str(), O_RDONLY);
+  if (in < 0) {
+    std::cerr << "Failed to open file " << source << std::endl;
+    exit(-1);
+  }
+
+  off_t offset = sourceOffset;
+  u64 remaining = size;
+#ifdef __linux__
+  // in-kernel copy, falls back to reading below if the filesystems do not support it
+  while (remaining > 0) {
+    ssize_t copied = copy_file_range(in, &offset, out, nullptr, remaining, 0);
+    if (copied <= 0) break;
+    remaining -= copied;
+  }
+#endif
+
+  std::vector<u8> buffer(std::min<u64>(remaining, 1 << 20));
+  while (remaining > 0) {
+    ssize_t count = pread(in, buffer.data(), std::min<u64>(remaining, buffer.size()), offset);
+    if (count <= 0) {
+      std::cerr << "Unexpected end of file " << source << std::endl;
+      exit(-1);
+    }
+    std::vector<iovec> iov = {{buffer.data(), static_cast<size_t>(count)}};
+    writeAll(out, iov, path);
+    offset += count;
+    remaining -= count;
+  }
+  close(in);
+}
+
+void FilePlan::write(const std::filesystem::path& path) const {
+  int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    std::cerr << "Error opening file " << path << " for writing!" << std::endl;
+    exit(-1);
+  }
+
+  std::vector<iovec> iov;
+  for (const auto& piece : pieces) {
+    if (piece.buffer >= 0) {
+      const auto& bytes = buffers[piece.buffer];
+      if (!bytes.empty()) iov.push_back({const_cast<u8*>(bytes.data()), bytes.size()});
+    } else {
+      writeAll(out, iov, path);
+      copyRange(piece.source, piece.sourceOffset, piece.size, out, path);
+    }
+  }
+  writeAll(out, iov, path);
+  if (close(out) != 0) writeFailed(path);
+}
+#else
+void FilePlan::write(const std::filesystem::path& path) const {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    std::cerr << "Error opening file " << path << " for writing!" << std::endl;
+    exit(-1);
+  }
+
+  std::vector<char> buffer;
+  for (const auto& piece : pieces) {
+    if (piece.buffer >= 0) {
+      const auto& bytes = buffers[piece.buffer];
+      out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+      continue;
+    }
+
+    std::ifstream in(piece.source, std::ios::binary);
+    in.seekg(piece.sourceOffset);
+    buffer.resize(std::min<u64>(piece.size, 1 << 20));
+    for (u64 remaining = piece.size; remaining > 0;) {
+      u64 count = std::min<u64>(remaining, buffer.size());
+      if (!in.read(buffer.data(), count)) {
+        std::cerr << "Unexpected end of file " << piece.source << std::endl;
+        exit(-1);
+      }
+      out.write(buffer.data(), count);
+      remaining -= count;
+    }
+  }
+  if (!out.flush()) {
+    std::cerr << "Error writing file " << path << std::endl;
+    exit(-1);
+  }
+}
+#endif
+
+u64 hashFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open file " << path << std::endl;
+    exit(-1);
+  }
+
+  u64 hash = 0xcbf29ce484222325;
+  std::vector<char> buffer(1 << 16);
+  while (file) {
+    file.read(buffer.data(), buffer.size());
+    for (std::streamsize i = 0; i < file.gcount(); i++) {
+      hash ^= static_cast<u8>(buffer[i]);
+      hash *= 0x100000001b3;
+    }
+  }
+  return hash;
+}
+
+bool sameFileContents(const std::filesystem::path& a, const std::filesystem::path& b) {
+  std::ifstream fileA(a, std::ios::binary);
+  std::ifstream fileB(b, std::ios::binary);
+  if (!fileA.is_open() || !fileB.is_open()) {
+    std::cerr << "Failed to open file " << (fileA.is_open() ? b : a) << std::endl;
+    exit(-1);
+  }
+
+  std::vector<char> bufferA(1 << 16);
+  std::vector<char> bufferB(1 << 16);
+  while (fileA && fileB) {
+    fileA.read(bufferA.data(), bufferA.size());
+    fileB.read(bufferB.data(), bufferB.size());
+    if (fileA.gcount() != fileB.gcount() || !std::equal(bufferA.begin(), bufferA.begin() + fileA.gcount(), bufferB.begin())) return false;
+  }
+  return !fileA && !fileB;
+}
+}
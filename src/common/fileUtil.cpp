@@ -1,12 +1,24 @@
-
 #include <iostream>
 #include <bit>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #include "common/fileUtil.hpp"
 #include "common/util.h"
+#include "vgmtrans/RiffFile.h"
 
 namespace rsnd {
 void* readBinary(const std::filesystem::path& filepath, size_t& size) {
+  if (isStdio(filepath)) {
+    return readRemaining(openStdin(), nullptr, 0, size);
+  }
+
   std::ifstream file(filepath, std::ios::binary | std::ios::ate);
   if (!file.is_open()) {
       std::cerr << "Failed to open file " << filepath << std::endl;
@@ -29,45 +41,183 @@ void* readBinary(const std::filesystem::path& filepath, size_t& size) {
 }
 
 void writeBinary(const std::filesystem::path& filepath, void* data, size_t size) {
-  std::ofstream outFile(filepath, std::ios::out | std::ios::binary);
-  if (!outFile) {
+  std::ofstream outFile;
+  std::ostream& out = openBinaryOutput(filepath, outFile);
+  out.write(reinterpret_cast<const char*>(data), size);
+  out.flush();
+}
+
+std::istream& openStdin() {
+#ifdef _WIN32
+  _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  return std::cin;
+}
+
+std::ostream& openBinaryOutput(const std::filesystem::path& filepath, std::ofstream& file) {
+  if (isStdio(filepath)) {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    return std::cout;
+  }
+
+  if (!file.is_open()) file.open(filepath, std::ios::out | std::ios::binary);
+  if (!file) {
     std::cerr << "Error opening file " << filepath << " for writing!" << std::endl;
     exit(-1);
   }
+  return file;
+}
+
+bool readExact(std::istream& in, void* dst, size_t size) {
+  in.read(static_cast<char*>(dst), size);
+  return static_cast<size_t>(in.gcount()) == size;
+}
+
+void* readRemaining(std::istream& in, const void* prefix, size_t prefixSize, size_t& size) {
+  // input may be a pipe, so grow the buffer until EOF instead of asking for the size
+  size_t capacity = std::max<size_t>(prefixSize * 2, 1 << 16);
+  u8* buffer = static_cast<u8*>(malloc(capacity));
+  if (!buffer) {
+    std::cerr << "Failed to allocate memory for input" << std::endl;
+    exit(-1);
+  }
+  if (prefixSize > 0) memcpy(buffer, prefix, prefixSize);
+  size = prefixSize;
+
+  while (in) {
+    if (size == capacity) {
+      capacity *= 2;
+      u8* grown = static_cast<u8*>(realloc(buffer, capacity));
+      if (!grown) {
+        free(buffer);
+        std::cerr << "Failed to allocate memory for input" << std::endl;
+        exit(-1);
+      }
+      buffer = grown;
+    }
+    in.read(reinterpret_cast<char*>(buffer + size), capacity - size);
+    size += in.gcount();
+  }
+
+  return buffer;
+}
+
+WaveFileData readWaveFile(const std::filesystem::path& filepath) {
+  size_t fileSize;
+  u8* fileData = static_cast<u8*>(readBinary(filepath, fileSize));
+  if (fileSize < 12 || memcmp(fileData, "RIFF", 4) != 0 || memcmp(fileData + 8, "WAVE", 4) != 0) {
+    std::cerr << filepath << " is not a WAVE file" << std::endl;
+    exit(-1);
+  }
+
+  WaveFileData wave = {};
+  u16 audioFormat = 0;
+  u16 bitsPerSample = 0;
+  const u8* samples = nullptr;
+  u32 samplesSize = 0;
+  // chunks are word aligned, RIFF is little endian like the hosts we run on
+  for (size_t offset = 12; offset + 8 <= fileSize;) {
+    const u8* chunk = fileData + offset;
+    u32 chunkSize;
+    memcpy(&chunkSize, chunk + 4, 4);
+    chunkSize = std::min<size_t>(chunkSize, fileSize - offset - 8);
+    const u8* chunkData = chunk + 8;
+
+    if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16) {
+      memcpy(&audioFormat, chunkData, 2);
+      u16 channelCount;
+      memcpy(&channelCount, chunkData + 2, 2);
+      memcpy(&wave.sampleRate, chunkData + 4, 4);
+      memcpy(&bitsPerSample, chunkData + 14, 2);
+      // WAVE_FORMAT_EXTENSIBLE keeps the actual format at the start of the sub format GUID
+      if (audioFormat == 0xfffe && chunkSize >= 26) memcpy(&audioFormat, chunkData + 24, 2);
+      if (channelCount == 0 || channelCount > 255) {
+        std::cerr << "Unsupported channel count " << channelCount << " in " << filepath << std::endl;
+        exit(-1);
+      }
+      wave.channelCount = channelCount;
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      samples = chunkData;
+      samplesSize = chunkSize;
+    } else if (memcmp(chunk, "smpl", 4) == 0 && chunkSize >= 36 + 24) {
+      u32 loopCount;
+      memcpy(&loopCount, chunkData + 28, 4);
+      if (loopCount > 0) {
+        wave.loop = true;
+        memcpy(&wave.loopStart, chunkData + 36 + 8, 4);
+        memcpy(&wave.loopEnd, chunkData + 36 + 12, 4);
+        // the smpl loop end is the last sample played
+        wave.loopEnd++;
+      }
+    }
+    offset += 8 + chunkSize + (chunkSize & 1);
+  }
 
-  outFile.write(reinterpret_cast<const char*>(data), size);
-  outFile.close();
+  const bool integerPcm = audioFormat == 1 && bitsPerSample >= 8 && bitsPerSample <= 32 && bitsPerSample % 8 == 0;
+  const bool floatPcm = audioFormat == 3 && bitsPerSample == 32;
+  if (!samples || wave.channelCount == 0 || (!integerPcm && !floatPcm)) {
+    std::cerr << "Unsupported WAVE format in " << filepath << ", expected 8 to 32 bit integer or 32 bit float PCM" << std::endl;
+    exit(-1);
+  }
+
+  const u32 bytesPerSample = bitsPerSample / 8;
+  wave.sampleCount = samplesSize / (bytesPerSample * wave.channelCount);
+  wave.pcm.resize(wave.sampleCount * wave.channelCount);
+  for (size_t i = 0; i < wave.pcm.size(); i++) {
+    const u8* sample = samples + i * bytesPerSample;
+    if (floatPcm) {
+      f32 value;
+      memcpy(&value, sample, 4);
+      wave.pcm[i] = static_cast<s16>(std::clamp(std::lround(value * 32768.0f), -32768l, 32767l));
+    } else if (bytesPerSample == 1) {
+      // 8 bit WAVE is unsigned
+      wave.pcm[i] = static_cast<s16>((sample[0] - 128) * 256);
+    } else {
+      // keep the top 16 bits
+      wave.pcm[i] = static_cast<s16>(sample[bytesPerSample - 1] << 8 | sample[bytesPerSample - 2]);
+    }
+  }
+  free(fileData);
+  return wave;
+}
+
+void writeWaveHeader(std::ostream& wavFile, int numSamples, int sampleRate, int numChannels) {
+  struct {
+    u16 audioFormat;
+    u16 channelCount;
+    u32 sampleRate;
+    u32 byteRate;
+    u16 blockAlign;
+    u16 bitsPerSample;
+  } format = {1, static_cast<u16>(numChannels), static_cast<u32>(sampleRate), static_cast<u32>(sampleRate * numChannels * sizeof(s16)),
+              static_cast<u16>(numChannels * sizeof(s16)), 8 * sizeof(s16)};
+
+  // the samples follow the data chunk header
+  RiffFile wave("", "WAVE");
+  wave.AddChildChunk(new Chunk("fmt "))->BorrowData(&format, sizeof(format));
+  wave.AddChildChunk(new TrailingChunk("data", numSamples * numChannels * sizeof(s16)));
+  RiffStreamSink sink(wavFile);
+  wave.Write(sink);
 }
 
 void createWaveFile(const std::filesystem::path& filepath, void* pcmData, int numSamples, int sampleRate, int numChannels) {
-  std::ofstream wavFile(filepath, std::ios::binary);
-  if (!wavFile.is_open()) {
-    std::cerr << "Failed to create WAV file: " << filepath << std::endl;
-    return;
+  std::ofstream file;
+  if (!isStdio(filepath)) {
+    file.open(filepath, std::ios::binary);
+    if (!file.is_open()) {
+      std::cerr << "Failed to create WAV file: " << filepath << std::endl;
+      return;
+    }
   }
+  std::ostream& wavFile = openBinaryOutput(filepath, file);
 
   // Write WAV header
-  const int bitsPerSample = 8 * sizeof(s16);
-  const int byteRate = sampleRate * numChannels * sizeof(s16);
-  const int blockAlign = numChannels * sizeof(s16);
-  const int dataSectionSize = numSamples * numChannels * sizeof(s16);
-  const int fileSize = dataSectionSize + 36;
-
-  wavFile.write("RIFF", 4);                                  // RIFF header
-  wavFile.write(reinterpret_cast<const char*>(&fileSize), 4);  // File size
-  wavFile.write("WAVE", 4);                                  // WAVE header
-  wavFile.write("fmt ", 4);                                  // fmt subchunk header
-  wavFile.write(reinterpret_cast<const char*>("\x10\x00\x00\x00"), 4);  // Subchunk size (16 for PCM)
-  wavFile.write(reinterpret_cast<const char*>("\x01\x00"), 2);  // Audio format (PCM)
-  wavFile.write(reinterpret_cast<const char*>(&numChannels), 2);  // Number of channels
-  wavFile.write(reinterpret_cast<const char*>(&sampleRate), 4);   // Sample rate
-  wavFile.write(reinterpret_cast<const char*>(&byteRate), 4);      // Byte rate
-  wavFile.write(reinterpret_cast<const char*>(&blockAlign), 2);    // Block align
-  wavFile.write(reinterpret_cast<const char*>(&bitsPerSample), 2); // Bits per sample
-  wavFile.write("data", 4);                                  // Data subchunk header
-  wavFile.write(reinterpret_cast<const char*>(&dataSectionSize), 4);  // Data size
+  writeWaveHeader(wavFile, numSamples, sampleRate, numChannels);
 
   // WAV data
-  wavFile.write(reinterpret_cast<const char*>(pcmData), dataSectionSize);
+  wavFile.write(reinterpret_cast<const char*>(pcmData), numSamples * numChannels * sizeof(s16));
+  wavFile.flush();
+}
 }
-}
\ No newline at end of file
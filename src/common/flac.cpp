@@ -0,0 +1,495 @@
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numbers>
+
+#include "common/flac.hpp"
+#include "common/fileUtil.hpp"
+#include "common/parallel.hpp"
+
+namespace rsnd {
+namespace {
+const int MAX_FIXED_ORDER = 4;
+const int MAX_LPC_ORDER = 12;
+const int LPC_PRECISION = 12;
+const int MAX_PARTITION_ORDER = 8;
+const int MAX_RICE_PARAM = 14;
+
+constexpr std::array<u8, 256> makeCrc8Table() {
+  std::array<u8, 256> table{};
+  for (int i = 0; i < 256; i++) {
+    u8 crc = i;
+    for (int j = 0; j < 8; j++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr std::array<u16, 256> makeCrc16Table() {
+  std::array<u16, 256> table{};
+  for (int i = 0; i < 256; i++) {
+    u16 crc = i << 8;
+    for (int j = 0; j < 8; j++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr auto CRC8_TABLE = makeCrc8Table();
+constexpr auto CRC16_TABLE = makeCrc16Table();
+
+u8 crc8(const u8* data, size_t size) {
+  u8 crc = 0;
+  for (size_t i = 0; i < size; i++) crc = CRC8_TABLE[crc ^ data[i]];
+  return crc;
+}
+
+u16 crc16(const u8* data, size_t size) {
+  u16 crc = 0;
+  for (size_t i = 0; i < size; i++) crc = (crc << 8) ^ CRC16_TABLE[(crc >> 8) ^ data[i]];
+  return crc;
+}
+
+class BitWriter {
+private:
+  std::vector<u8>& buf;
+  u64 acc = 0;
+  int bits = 0;
+
+public:
+  BitWriter(std::vector<u8>& buf) : buf(buf) {}
+
+  // n <= 32
+  void put(u32 value, int n) {
+    if (n == 0) return;
+    acc = (acc << n) | (n == 32 ? value : value & ((1u << n) - 1));
+    bits += n;
+    while (bits >= 8) {
+      bits -= 8;
+      buf.push_back(static_cast<u8>(acc >> bits));
+    }
+  }
+
+  void putSigned(s32 value, int n) { put(static_cast<u32>(value), n); }
+
+  void putRice(s32 value, int k) {
+    u32 u = (static_cast<u32>(value) << 1) ^ static_cast<u32>(value >> 31);
+    u32 q = u >> k;
+    while (q >= 32) {
+      put(0, 32);
+      q -= 32;
+    }
+    u32 low = k == 0 ? 0 : u & ((1u << k) - 1);
+    if (q + 1 + k <= 32) {
+      put((1u << k) | low, q + 1 + k);
+    } else {
+      put(1, q + 1);
+      put(low, k);
+    }
+  }
+
+  void align() {
+    if (bits > 0) put(0, 8 - bits);
+  }
+};
+
+struct RiceCoding {
+  int partitionOrder = 0;
+  u8 params[1 << MAX_PARTITION_ORDER];
+  u64 bits = 0;
+};
+
+struct Subframe {
+  static const u8 CONSTANT = 0;
+  static const u8 VERBATIM = 1;
+  static const u8 FIXED = 8;
+  static const u8 LPC = 32;
+
+  u8 type;
+  int order = 0;
+  int shift = 0;
+  s32 coeffs[MAX_LPC_ORDER];
+  std::vector<s32> residual;
+  RiceCoding rice;
+  u64 bits;
+};
+
+// Picks the partition order and rice parameters, estimating the cost of a partition with parameter k as
+// count * (k + 1) + (sum >> k), where sum is the sum of the zigzagged residuals
+void chooseRice(const s32* residual, u32 n, int predOrder, RiceCoding& rice) {
+  int maxOrder = 0;
+  while (maxOrder < MAX_PARTITION_ORDER && (n >> (maxOrder + 1) << (maxOrder + 1)) == n && (n >> (maxOrder + 1)) > static_cast<u32>(predOrder)) {
+    maxOrder++;
+  }
+
+  u64 sums[1 << MAX_PARTITION_ORDER];
+  u32 counts[1 << MAX_PARTITION_ORDER];
+  u32 partitionSize = n >> maxOrder;
+  for (int p = 0; p < (1 << maxOrder); p++) {
+    u32 start = p == 0 ? predOrder : p * partitionSize;
+    u32 end = (p + 1) * partitionSize;
+    u64 sum = 0;
+    for (u32 i = start; i < end; i++) {
+      sum += (static_cast<u32>(residual[i]) << 1) ^ static_cast<u32>(residual[i] >> 31);
+    }
+    sums[p] = sum;
+    counts[p] = end - start;
+  }
+
+  rice.bits = UINT64_MAX;
+  for (int order = maxOrder; order >= 0; order--) {
+    u64 bits = 2 + 4;
+    u8 params[1 << MAX_PARTITION_ORDER];
+    for (int p = 0; p < (1 << order); p++) {
+      u64 best = UINT64_MAX;
+      for (int k = 0; k <= MAX_RICE_PARAM; k++) {
+        u64 cost = static_cast<u64>(counts[p]) * (k + 1) + (sums[p] >> k);
+        if (cost < best) {
+          best = cost;
+          params[p] = k;
+        }
+      }
+      bits += 4 + best;
+    }
+    if (bits < rice.bits) {
+      rice.bits = bits;
+      rice.partitionOrder = order;
+      memcpy(rice.params, params, 1 << order);
+    }
+
+    // merge neighbouring partitions for the next lower order
+    for (int p = 0; p < (1 << order) / 2; p++) {
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+      counts[p] = counts[2 * p] + counts[2 * p + 1];
+    }
+  }
+}
+
+void fixedResidual(const s32* x, u32 n, int order, s32* residual) {
+  for (u32 i = order; i < n; i++) {
+    s64 r;
+    switch (order) {
+    case 0: r = x[i]; break;
+    case 1: r = static_cast<s64>(x[i]) - x[i - 1]; break;
+    case 2: r = static_cast<s64>(x[i]) - 2 * static_cast<s64>(x[i - 1]) + x[i - 2]; break;
+    case 3: r = static_cast<s64>(x[i]) - 3 * static_cast<s64>(x[i - 1]) + 3 * static_cast<s64>(x[i - 2]) - x[i - 3]; break;
+    default: r = static_cast<s64>(x[i]) - 4 * static_cast<s64>(x[i - 1]) + 6 * static_cast<s64>(x[i - 2]) - 4 * static_cast<s64>(x[i - 3]) + x[i - 4]; break;
+    }
+    residual[i] = static_cast<s32>(r);
+  }
+}
+
+void lpcResidual(const s32* x, u32 n, int order, const s32* coeffs, int shift, s32* residual) {
+  for (u32 i = order; i < n; i++) {
+    s64 sum = 0;
+    for (int j = 0; j < order; j++) sum += static_cast<s64>(coeffs[j]) * x[i - j - 1];
+    residual[i] = static_cast<s32>(x[i] - (sum >> shift));
+  }
+}
+
+// Finds the best LPC order from the Levinson-Durbin prediction errors and quantizes its coefficients.
+// Returns 0 if LPC does not apply to this signal
+int computeLpc(const s32* x, u32 n, int bps, s32* coeffs, int& shift) {
+  int maxOrder = std::min<int>(MAX_LPC_ORDER, n - 1);
+  if (maxOrder < 1 || n < 32) return 0;
+
+  // tukey(0.5) window
+  std::vector<double> windowed(n);
+  const u32 taper = n / 4;
+  for (u32 i = 0; i < n; i++) {
+    double w = 1.0;
+    if (i < taper) w = 0.5 - 0.5 * std::cos(std::numbers::pi * i / taper);
+    else if (i >= n - taper) w = 0.5 - 0.5 * std::cos(std::numbers::pi * (n - 1 - i) / taper);
+    windowed[i] = x[i] * w;
+  }
+
+  double autoc[MAX_LPC_ORDER + 1];
+  for (int lag = 0; lag <= maxOrder; lag++) {
+    double sum = 0;
+    for (u32 i = lag; i < n; i++) sum += windowed[i] * windowed[i - lag];
+    autoc[lag] = sum;
+  }
+  if (autoc[0] == 0) return 0;
+
+  // Levinson-Durbin recursion, keeping the coefficients of every order
+  double lpc[MAX_LPC_ORDER][MAX_LPC_ORDER];
+  double error[MAX_LPC_ORDER];
+  double cur[MAX_LPC_ORDER] = {};
+  double prev[MAX_LPC_ORDER];
+  double err = autoc[0];
+  for (int i = 0; i < maxOrder; i++) {
+    double acc = autoc[i + 1];
+    for (int j = 0; j < i; j++) acc -= cur[j] * autoc[i - j];
+    double k = acc / err;
+
+    memcpy(prev, cur, sizeof(prev));
+    cur[i] = k;
+    for (int j = 0; j < i; j++) cur[j] = prev[j] - k * prev[i - 1 - j];
+    err *= 1.0 - k * k;
+
+    for (int j = 0; j <= i; j++) lpc[i][j] = cur[j];
+    error[i] = err;
+  }
+
+  int bestOrder = 0;
+  double bestBits = 1e300;
+  for (int i = 0; i < maxOrder; i++) {
+    double bitsPerSample = error[i] > 0 ? std::max(0.0, 0.5 * std::log2(0.5 * error[i] / n)) : 0.0;
+    double bits = bitsPerSample * (n - i - 1) + (i + 1) * (LPC_PRECISION + bps);
+    if (bits < bestBits) {
+      bestBits = bits;
+      bestOrder = i + 1;
+    }
+  }
+
+  const double* lp = lpc[bestOrder - 1];
+  double cmax = 0;
+  for (int i = 0; i < bestOrder; i++) cmax = std::max(cmax, std::fabs(lp[i]));
+  if (cmax <= 0) return 0;
+
+  int log2cmax;
+  std::frexp(cmax, &log2cmax);
+  shift = LPC_PRECISION - 1 - log2cmax;
+  if (shift < 0) return 0;
+  shift = std::min(shift, 15);
+
+  const s32 qmax = (1 << (LPC_PRECISION - 1)) - 1;
+  const s32 qmin = -(1 << (LPC_PRECISION - 1));
+  double quantError = 0;
+  for (int i = 0; i < bestOrder; i++) {
+    quantError += lp[i] * (1 << shift);
+    s32 q = static_cast<s32>(std::lround(quantError));
+    q = std::clamp(q, qmin, qmax);
+    quantError -= q;
+    coeffs[i] = q;
+  }
+  return bestOrder;
+}
+
+void analyzeSubframe(const s32* x, u32 n, int bps, Subframe& subframe) {
+  bool constant = true;
+  for (u32 i = 1; i < n && constant; i++) constant = x[i] == x[0];
+  if (constant) {
+    subframe.type = Subframe::CONSTANT;
+    subframe.bits = 8 + bps;
+    return;
+  }
+
+  subframe.type = Subframe::VERBATIM;
+  subframe.bits = 8 + static_cast<u64>(n) * bps;
+  subframe.residual.resize(n);
+
+  std::vector<s32> residual(n);
+  RiceCoding rice;
+  for (int order = 0; order <= std::min<int>(MAX_FIXED_ORDER, n - 1); order++) {
+    fixedResidual(x, n, order, residual.data());
+    chooseRice(residual.data(), n, order, rice);
+    u64 bits = 8 + order * bps + rice.bits;
+    if (bits < subframe.bits) {
+      subframe.type = Subframe::FIXED;
+      subframe.order = order;
+      subframe.bits = bits;
+      subframe.rice = rice;
+      subframe.residual.swap(residual);
+      residual.resize(n);
+    }
+  }
+
+  s32 coeffs[MAX_LPC_ORDER];
+  int shift;
+  int order = computeLpc(x, n, bps, coeffs, shift);
+  if (order > 0) {
+    lpcResidual(x, n, order, coeffs, shift, residual.data());
+    chooseRice(residual.data(), n, order, rice);
+    u64 bits = 8 + order * bps + 4 + 5 + order * LPC_PRECISION + rice.bits;
+    if (bits < subframe.bits) {
+      subframe.type = Subframe::LPC;
+      subframe.order = order;
+      subframe.shift = shift;
+      memcpy(subframe.coeffs, coeffs, sizeof(coeffs));
+      subframe.bits = bits;
+      subframe.rice = rice;
+      subframe.residual.swap(residual);
+    }
+  }
+}
+
+void writeSubframe(BitWriter& bw, const s32* x, u32 n, int bps, const Subframe& subframe) {
+  switch (subframe.type) {
+  case Subframe::CONSTANT:
+    bw.put(Subframe::CONSTANT << 1, 8);
+    bw.putSigned(x[0], bps);
+    return;
+
+  case Subframe::VERBATIM:
+    bw.put(Subframe::VERBATIM << 1, 8);
+    for (u32 i = 0; i < n; i++) bw.putSigned(x[i], bps);
+    return;
+
+  case Subframe::FIXED:
+    bw.put((Subframe::FIXED | subframe.order) << 1, 8);
+    break;
+
+  default:
+    bw.put((Subframe::LPC | (subframe.order - 1)) << 1, 8);
+    break;
+  }
+
+  for (int i = 0; i < subframe.order; i++) bw.putSigned(x[i], bps);
+  if (subframe.type == Subframe::LPC) {
+    bw.put(LPC_PRECISION - 1, 4);
+    bw.putSigned(subframe.shift, 5);
+    for (int i = 0; i < subframe.order; i++) bw.putSigned(subframe.coeffs[i], LPC_PRECISION);
+  }
+
+  const RiceCoding& rice = subframe.rice;
+  bw.put(0, 2); // 4 bit rice parameters
+  bw.put(rice.partitionOrder, 4);
+  u32 partitionSize = n >> rice.partitionOrder;
+  for (int p = 0; p < (1 << rice.partitionOrder); p++) {
+    int k = rice.params[p];
+    bw.put(k, 4);
+    u32 start = p == 0 ? subframe.order : p * partitionSize;
+    for (u32 i = start; i < (p + 1) * partitionSize; i++) bw.putRice(subframe.residual[i], k);
+  }
+}
+
+void putUtf8(BitWriter& bw, u32 value) {
+  if (value < 0x80) {
+    bw.put(value, 8);
+    return;
+  }
+  int extra = value < 0x800 ? 1 : value < 0x10000 ? 2 : value < 0x200000 ? 3 : value < 0x4000000 ? 4 : 5;
+  bw.put(((0xFF00 >> (extra + 1)) & 0xFF) | (value >> (6 * extra)), 8);
+  for (int i = extra - 1; i >= 0; i--) bw.put(0x80 | ((value >> (6 * i)) & 0x3F), 8);
+}
+
+void encodeFrame(const s16* samples, u32 n, u8 channelCount, u32 frameNumber, u32 blockSize, std::vector<u8>& out) {
+  std::vector<std::vector<s32>> channels(channelCount, std::vector<s32>(n));
+  for (u32 i = 0; i < n; i++) {
+    for (int c = 0; c < channelCount; c++) channels[c][i] = samples[i * channelCount + c];
+  }
+
+  std::vector<Subframe> subframes(channelCount);
+  for (int c = 0; c < channelCount; c++) analyzeSubframe(channels[c].data(), n, 16, subframes[c]);
+
+  // channel assignment: 0-7 independent, 8 left/side, 9 side/right, 10 mid/side
+  u8 assignment = channelCount - 1;
+  std::vector<s32> mid, side;
+  Subframe midFrame, sideFrame;
+  const s32* coded[2];
+  const Subframe* codedFrames[2];
+  int codedBps[2] = {16, 16};
+  if (channelCount == 2) {
+    mid.resize(n);
+    side.resize(n);
+    for (u32 i = 0; i < n; i++) {
+      mid[i] = (channels[0][i] + channels[1][i]) >> 1;
+      side[i] = channels[0][i] - channels[1][i];
+    }
+    analyzeSubframe(mid.data(), n, 16, midFrame);
+    analyzeSubframe(side.data(), n, 17, sideFrame);
+
+    const u64 left = subframes[0].bits, right = subframes[1].bits;
+    u64 best = left + right;
+    coded[0] = channels[0].data(); codedFrames[0] = &subframes[0];
+    coded[1] = channels[1].data(); codedFrames[1] = &subframes[1];
+    if (left + sideFrame.bits < best) {
+      best = left + sideFrame.bits;
+      assignment = 8;
+      coded[1] = side.data(); codedFrames[1] = &sideFrame; codedBps[1] = 17;
+    }
+    if (sideFrame.bits + right < best) {
+      best = sideFrame.bits + right;
+      assignment = 9;
+      coded[0] = side.data(); codedFrames[0] = &sideFrame; codedBps[0] = 17;
+      coded[1] = channels[1].data(); codedFrames[1] = &subframes[1]; codedBps[1] = 16;
+    }
+    if (midFrame.bits + sideFrame.bits < best) {
+      assignment = 10;
+      coded[0] = mid.data(); codedFrames[0] = &midFrame; codedBps[0] = 16;
+      coded[1] = side.data(); codedFrames[1] = &sideFrame; codedBps[1] = 17;
+    }
+  }
+
+  const size_t frameStart = out.size();
+  BitWriter bw(out);
+  bw.put(0xFFF8, 16); // sync code, fixed block size
+  u8 blockSizeCode = n == blockSize ? 12 : n <= 256 ? 6 : 7; // 12 is 4096
+  bw.put(blockSizeCode, 4);
+  bw.put(0, 4); // sample rate from STREAMINFO
+  bw.put(assignment, 4);
+  bw.put(4, 3); // 16 bits per sample
+  bw.put(0, 1);
+  putUtf8(bw, frameNumber);
+  if (blockSizeCode == 6) bw.put(n - 1, 8);
+  else if (blockSizeCode == 7) bw.put(n - 1, 16);
+  bw.put(crc8(out.data() + frameStart, out.size() - frameStart), 8);
+
+  for (int c = 0; c < channelCount; c++) {
+    if (channelCount == 2) {
+      writeSubframe(bw, coded[c], n, codedBps[c], *codedFrames[c]);
+    } else {
+      writeSubframe(bw, channels[c].data(), n, 16, subframes[c]);
+    }
+  }
+  bw.align();
+  u16 crc = crc16(out.data() + frameStart, out.size() - frameStart);
+  bw.put(crc, 16);
+}
+}
+
+void FlacFileSink::begin(u32 sampleRate, u8 channelCount, u32 frameCount) {
+  if (channelCount < 1 || channelCount > 8) {
+    std::cerr << "FLAC does not support " << (int)channelCount << " channels\n";
+    exit(-1);
+  }
+  this->channelCount = channelCount;
+  frameNumber = 0;
+  batchFrames = BLOCK_SIZE * workerCount() * 4;
+  pending.clear();
+  out = &openBinaryOutput(path, file);
+
+  std::vector<u8> header;
+  BitWriter bw(header);
+  bw.put(0x664C6143, 32); // fLaC
+  bw.put(0x80, 8); // last metadata block, STREAMINFO
+  bw.put(34, 24);
+  bw.put(BLOCK_SIZE, 16);
+  bw.put(BLOCK_SIZE, 16);
+  bw.put(0, 24); // frame sizes unknown
+  bw.put(0, 24);
+  bw.put(sampleRate, 20);
+  bw.put(channelCount - 1, 3);
+  bw.put(16 - 1, 5);
+  bw.put(0, 4); // upper bits of the 36 bit sample count
+  bw.put(frameCount, 32);
+  for (int i = 0; i < 4; i++) bw.put(0, 32); // MD5 not computed
+  out->write(reinterpret_cast<const char*>(header.data()), header.size());
+}
+
+void FlacFileSink::encodePending(bool final) {
+  const u32 pendingFrames = pending.size() / channelCount;
+  const u32 blockCount = final ? (pendingFrames + BLOCK_SIZE - 1) / BLOCK_SIZE : pendingFrames / BLOCK_SIZE;
+  std::vector<std::vector<u8>> encoded(blockCount);
+  parallelFor(blockCount, [&](size_t i) {
+    u32 n = std::min<u32>(BLOCK_SIZE, pendingFrames - i * BLOCK_SIZE);
+    encodeFrame(pending.data() + i * BLOCK_SIZE * channelCount, n, channelCount, frameNumber + i, BLOCK_SIZE, encoded[i]);
+  });
+
+  for (auto& frame : encoded) out->write(reinterpret_cast<const char*>(frame.data()), frame.size());
+  frameNumber += blockCount;
+  pending.erase(pending.begin(), pending.begin() + std::min<size_t>(pending.size(), static_cast<size_t>(blockCount) * BLOCK_SIZE * channelCount));
+}
+
+void FlacFileSink::write(const s16* frames, u32 frameCount) {
+  pending.insert(pending.end(), frames, frames + frameCount * channelCount);
+  if (pending.size() >= batchFrames * channelCount) encodePending(false);
+}
+
+void FlacFileSink::end() {
+  encodePending(true);
+  out->flush();
+}
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "common/journal.hpp"
+#include "common/log.hpp"
+
+namespace rsnd {
+namespace {
+const char JOURNAL_MAGIC[8] = {'M', 'R', 'S', 'T', 'J', 'R', 'N', 'L'};
+
+// unbuffered reads and writes at offsets, exits on any error
+class RawFile {
+private:
+  std::filesystem::path path;
+  int fd;
+
+  [[noreturn]] void fail(const char* action) const {
+    std::cerr << "Error " << action << " file " << path << std::endl;
+    exit(-1);
+  }
+
+public:
+  RawFile(const std::filesystem::path& path, bool create) : path(path) {
+#ifdef _WIN32
+    fd = _wopen(path.c_str(), _O_RDWR | _O_BINARY | (create ? _O_CREAT | _O_TRUNC : 0), _S_IREAD | _S_IWRITE);
+#else
+    fd = open(path.c_str(), O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+#endif
+    if (fd < 0) fail("opening");
+  }
+  ~RawFile() {
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+  }
+  RawFile(const RawFile&) = delete;
+  RawFile& operator=(const RawFile&) = delete;
+
+  u64 size() const {
+    std::error_code error;
+    u64 size = std::filesystem::file_size(path, error);
+    if (error) fail("reading");
+    return size;
+  }
+
+  void read(u64 offset, void* dst, u64 size) {
+    u8* out = static_cast<u8*>(dst);
+    while (size > 0) {
+#ifdef _WIN32
+      if (_lseeki64(fd, offset, SEEK_SET) < 0) fail("reading");
+      long count = _read(fd, out, std::min<u64>(size, 1 << 30));
+#else
+      ssize_t count = pread(fd, out, size, offset);
+#endif
+      if (count <= 0) fail("reading");
+      out += count;
+      offset += count;
+      size -= count;
+    }
+  }
+
+  void write(u64 offset, const void* src, u64 size) {
+    const u8* in = static_cast<const u8*>(src);
+    while (size > 0) {
+#ifdef _WIN32
+      if (_lseeki64(fd, offset, SEEK_SET) < 0) fail("writing");
+      long count = _write(fd, in, std::min<u64>(size, 1 << 30));
+#else
+      ssize_t count = pwrite(fd, in, size, offset);
+#endif
+      if (count <= 0) fail("writing");
+      in += count;
+      offset += count;
+      size -= count;
+    }
+  }
+
+  // the ranges must not overlap
+  void copy(u64 sourceOffset, u64 offset, u64 size) {
+#ifdef __linux__
+    off_t in = sourceOffset;
+    off_t out = offset;
+    while (size > 0) {
+      ssize_t copied = copy_file_range(fd, &in, fd, &out, size, 0);
+      if (copied <= 0) break;
+      size -= copied;
+    }
+    sourceOffset = in;
+    offset = out;
+#endif
+    std::vector<u8> buffer(std::min<u64>(size, 1 << 20));
+    while (size > 0) {
+      u64 count = std::min<u64>(size, buffer.size());
+      read(sourceOffset, buffer.data(), count);
+      write(offset, buffer.data(), count);
+      sourceOffset += count;
+      offset += count;
+      size -= count;
+    }
+  }
+
+  void truncate(u64 size) {
+#ifdef _WIN32
+    if (_chsize_s(fd, size) != 0) fail("resizing");
+#else
+    if (ftruncate(fd, size) != 0) fail("resizing");
+#endif
+  }
+
+  void sync() {
+#ifdef _WIN32
+    if (_commit(fd) != 0) fail("syncing");
+#else
+    if (fsync(fd) != 0) fail("syncing");
+#endif
+  }
+};
+
+// FNV-1a, marks a journal as completely written
+u64 journalHash(const u8* data, size_t size) {
+  u64 hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+template <typename T>
+void append(std::vector<u8>& out, T value) {
+  out.resize(out.size() + sizeof(T));
+  memcpy(out.data() + out.size() - sizeof(T), &value, sizeof(T));
+}
+
+template <typename T>
+T consume(const std::vector<u8>& in, size_t& pos) {
+  T value;
+  memcpy(&value, in.data() + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+// journal: magic, original file size, entry count, (offset, size, original bytes) per entry, hash of all of that
+void rollBack(const std::filesystem::path& filePath, const std::filesystem::path& journalPath) {
+  std::vector<u8> journal;
+  {
+    RawFile journalFile(journalPath, false);
+    journal.resize(journalFile.size());
+    journalFile.read(0, journal.data(), journal.size());
+  }
+
+  const size_t headerSize = sizeof(JOURNAL_MAGIC) + sizeof(u64) + sizeof(u32);
+  bool complete = journal.size() >= headerSize + sizeof(u64) && memcmp(journal.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) == 0;
+  if (complete) {
+    size_t hashPos = journal.size() - sizeof(u64);
+    complete = consume<u64>(journal, hashPos) == journalHash(journal.data(), journal.size() - sizeof(u64));
+  }
+
+  // an incomplete journal means the crash happened before the file was touched
+  if (complete) {
+    size_t pos = sizeof(JOURNAL_MAGIC);
+    const u64 originalSize = consume<u64>(journal, pos);
+    const u32 entryCount = consume<u32>(journal, pos);
+    RawFile file(filePath, false);
+    for (u32 i = 0; i < entryCount; i++) {
+      const u64 offset = consume<u64>(journal, pos);
+      const u64 size = consume<u64>(journal, pos);
+      file.write(offset, journal.data() + pos, size);
+      pos += size;
+    }
+    file.truncate(originalSize);
+    file.sync();
+    RSND_WARN(LOG_IO, "rolled back an interrupted edit of " << filePath);
+  }
+  std::filesystem::remove(journalPath);
+}
+}
+
+JournaledEdit::JournaledEdit(const std::filesystem::path& path) : filePath(path), journalPath(path.string() + ".journal") {
+  if (std::filesystem::exists(journalPath)) rollBack(filePath, journalPath);
+}
+
+void JournaledEdit::write(u64 offset, std::vector<u8> data) {
+  const u64 size = data.size();
+  writes.push_back({offset, size, std::move(data), 0});
+}
+
+void JournaledEdit::copy(u64 sourceOffset, u64 offset, u64 size) {
+  writes.push_back({offset, size, {}, sourceOffset});
+}
+
+void JournaledEdit::commit() {
+  RawFile file(filePath, false);
+  const u64 originalSize = file.size();
+
+  std::vector<u8> journal(JOURNAL_MAGIC, JOURNAL_MAGIC + sizeof(JOURNAL_MAGIC));
+  append<u64>(journal, originalSize);
+  u32 entryCount = 0;
+  const size_t entryCountPos = journal.size();
+  append<u32>(journal, 0);
+  for (const auto& write : writes) {
+    // anything past the original end is undone by truncating
+    if (write.offset >= originalSize) continue;
+    const u64 size = std::min(write.size, originalSize - write.offset);
+    append<u64>(journal, write.offset);
+    append<u64>(journal, size);
+    journal.resize(journal.size() + size);
+    file.read(write.offset, journal.data() + journal.size() - size, size);
+    entryCount++;
+  }
+  memcpy(journal.data() + entryCountPos, &entryCount, sizeof(u32));
+  append<u64>(journal, journalHash(journal.data(), journal.size()));
+
+  {
+    RawFile journalFile(journalPath, true);
+    journalFile.write(0, journal.data(), journal.size());
+    journalFile.sync();
+  }
+
+  for (const auto& write : writes) {
+    if (write.data.empty()) {
+      file.copy(write.copyOffset, write.offset, write.size);
+    } else {
+      file.write(write.offset, write.data.data(), write.size);
+    }
+  }
+  file.sync();
+  std::filesystem::remove(journalPath);
+  writes.clear();
+}
+}
@@ -0,0 +1,70 @@
+#include <cstdio>
+#include <mutex>
+
+#include "common/log.hpp"
+
+namespace rsnd {
+namespace {
+const char* const categoryNames[LOG_CATEGORY_COUNT] = {"parse", "decode", "io", "midi"};
+// bytes buffered before they are written out
+const size_t FLUSH_SIZE = 1 << 16;
+
+class LogSink {
+private:
+  std::mutex mutex;
+  std::string buffer;
+
+  void flushLocked() {
+    fwrite(buffer.data(), 1, buffer.size(), stderr);
+    fflush(stderr);
+    buffer.clear();
+  }
+
+public:
+  // runs at exit too, so nothing buffered is lost
+  ~LogSink() { flush(); }
+
+  void write(LogLevel level, LogCategory category, std::string_view message) {
+    std::lock_guard lock(mutex);
+    if (level == LOG_WARN) {
+      buffer += "Warning: ";
+    } else {
+      buffer += '[';
+      buffer += categoryNames[category];
+      buffer += "] ";
+    }
+    buffer += message;
+    buffer += '\n';
+    if (level == LOG_WARN || buffer.size() >= FLUSH_SIZE) flushLocked();
+  }
+
+  void flush() {
+    std::lock_guard lock(mutex);
+    flushLocked();
+  }
+};
+
+LogSink& logSink() {
+  static LogSink sink;
+  return sink;
+}
+}
+
+bool findLogCategory(const std::string& name, LogCategory& category) {
+  for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+    if (name == categoryNames[i]) {
+      category = static_cast<LogCategory>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void writeLog(LogLevel level, LogCategory category, std::string_view message) {
+  logSink().write(level, category, message);
+}
+
+void flushLog() {
+  logSink().flush();
+}
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RSND_X86_DISPATCH
+#endif
+
+#include "common/mix.hpp"
+
+namespace rsnd {
+namespace {
+void mixAccumulateScalar(float* acc, const s16* src, u32 count, float gain) {
+  for (u32 i = 0; i < count; i++) acc[i] += gain * src[i];
+}
+
+void mixToPcm16Scalar(const float* const* channels, u8 channelCount, u32 count, s16* out) {
+  for (u32 i = 0; i < count; i++) {
+    for (int c = 0; c < channelCount; c++) {
+      out[i * channelCount + c] = static_cast<s16>(std::clamp(std::nearbyint(channels[c][i]), -32768.0f, 32767.0f));
+    }
+  }
+}
+
+#ifdef RSND_X86_DISPATCH
+__attribute__((target("avx2,fma")))
+void mixAccumulateAvx2(float* acc, const s16* src, u32 count, float gain) {
+  const __m256 g = _mm256_set1_ps(gain);
+  u32 i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(g, x, _mm256_loadu_ps(acc + i)));
+  }
+  mixAccumulateScalar(acc + i, src + i, count - i, gain);
+}
+
+__attribute__((target("avx2")))
+void mixToPcm16Avx2(const float* const* channels, u8 channelCount, u32 count, s16* out) {
+  if (channelCount > 2) {
+    mixToPcm16Scalar(channels, channelCount, count, out);
+    return;
+  }
+
+  u32 i = 0;
+  for (; i + 8 <= count; i += 8) {
+    // cvtps rounds to nearest even like nearbyint, packs saturates to s16
+    __m256i a = _mm256_cvtps_epi32(_mm256_loadu_ps(channels[0] + i));
+    if (channelCount == 1) {
+      __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    } else {
+      __m256i b = _mm256_cvtps_epi32(_mm256_loadu_ps(channels[1] + i));
+      // interleave to L R L R pairs, then saturate
+      __m256i lo = _mm256_unpacklo_epi32(a, b);
+      __m256i hi = _mm256_unpackhi_epi32(a, b);
+      __m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+      __m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(first, second), 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 2), packed);
+    }
+  }
+
+  const float* rest[2] = {channels[0] + i, channelCount == 2 ? channels[1] + i : nullptr};
+  mixToPcm16Scalar(rest, channelCount, count - i, out + i * channelCount);
+}
+
+bool hasAvx2() {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#endif
+}
+
+void mixAccumulate(float* acc, const s16* src, u32 count, float gain) {
+#ifdef RSND_X86_DISPATCH
+  static const bool avx2 = hasAvx2();
+  if (avx2) return mixAccumulateAvx2(acc, src, count, gain);
+#endif
+  mixAccumulateScalar(acc, src, count, gain);
+}
+
+void mixToPcm16(const float* const* channels, u8 channelCount, u32 count, s16* out) {
+#ifdef RSND_X86_DISPATCH
+  static const bool avx2 = hasAvx2();
+  if (avx2) return mixToPcm16Avx2(channels, channelCount, count, out);
+#endif
+  mixToPcm16Scalar(channels, channelCount, count, out);
+}
+}
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cmath>
+
+#include "common/pcmSink.hpp"
+#include "common/fileUtil.hpp"
+
+namespace rsnd {
+void WaveFileSink::begin(u32 sampleRate, u8 channelCount, u32 frameCount) {
+  this->channelCount = channelCount;
+  out = &openBinaryOutput(path, file);
+  writeWaveHeader(*out, frameCount, sampleRate, channelCount);
+}
+
+void WaveFileSink::write(const s16* frames, u32 frameCount) {
+  out->write(reinterpret_cast<const char*>(frames), frameCount * channelCount * sizeof(s16));
+}
+
+void WaveFileSink::end() {
+  out->flush();
+}
+
+void BufferSink::write(const s16* frames, u32 frameCount) {
+  std::copy(frames, frames + frameCount * channelCount, buffer);
+  buffer += frameCount * channelCount;
+}
+
+void FadeOutSink::begin(u32 sampleRate, u8 channelCount, u32 frameCount) {
+  this->channelCount = channelCount;
+  this->frameCount = frameCount;
+  fadeFrames = std::min(fadeFrames, frameCount);
+  position = 0;
+  next->begin(sampleRate, channelCount, frameCount);
+}
+
+void FadeOutSink::write(const s16* frames, u32 frameCount) {
+  const u32 fadeStart = this->frameCount - fadeFrames;
+  if (position + frameCount <= fadeStart) {
+    position += frameCount;
+    next->write(frames, frameCount);
+    return;
+  }
+
+  faded.assign(frames, frames + frameCount * channelCount);
+  for (u32 i = 0; i < frameCount; i++) {
+    u32 framePosition = position + i;
+    if (framePosition < fadeStart) continue;
+    // gain goes from 1 at the fade start to 0 after the last frame
+    float gain = static_cast<float>(this->frameCount - framePosition) / fadeFrames;
+    for (int c = 0; c < channelCount; c++) {
+      s16& sample = faded[i * channelCount + c];
+      sample = static_cast<s16>(std::lround(sample * gain));
+    }
+  }
+  position += frameCount;
+  next->write(faded.data(), frameCount);
+}
+
+void FadeOutSink::end() {
+  next->end();
+}
+
+void writeLoopedPcm(PcmSink& sink, const s16* pcm, u8 channelCount, u32 loopStart, u32 loopEnd, u32 frameCount) {
+  u32 start = 0;
+  for (u32 written = 0; written < frameCount;) {
+    u32 count = std::min(loopEnd - start, frameCount - written);
+    sink.write(pcm + start * channelCount, count);
+    written += count;
+    start = loopStart;
+  }
+}
+}
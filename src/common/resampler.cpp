@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <numbers>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RSND_X86_DISPATCH
+#endif
+
+#include "common/resampler.hpp"
+
+namespace rsnd {
+namespace {
+struct QualityPreset {
+  u32 taps;
+  double beta;
+  // passband edge relative to the lower of the two nyquist frequencies
+  double rolloff;
+};
+
+const QualityPreset QUALITY_PRESETS[] = {
+  {16, 6.0, 0.85},  // RESAMPLE_FAST
+  {32, 8.6, 0.92},  // RESAMPLE_NORMAL
+  {64, 10.0, 0.96}, // RESAMPLE_BEST
+};
+
+const u32 OUTPUT_CHUNK_FRAMES = 4096;
+
+double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
+
+float dotScalar(const float* a, const float* b, u32 n) {
+  float sum = 0;
+  for (u32 i = 0; i < n; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+#ifdef RSND_X86_DISPATCH
+__attribute__((target("avx2,fma")))
+float dotAvx2(const float* a, const float* b, u32 n) {
+  // n is a multiple of 8
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  u32 i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  for (; i < n; i += 8) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+  }
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+#endif
+
+using DotFn = float (*)(const float*, const float*, u32);
+
+DotFn selectDot() {
+#ifdef RSND_X86_DISPATCH
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return dotAvx2;
+#endif
+  return dotScalar;
+}
+
+const DotFn dot = selectDot();
+}
+
+void ResamplerSink::design(u32 sourceRate) {
+  const QualityPreset& preset = QUALITY_PRESETS[quality];
+  u32 divisor = std::gcd(sourceRate, targetRate);
+  up = targetRate / divisor;
+  down = sourceRate / divisor;
+
+  // when downsampling the filter has to be stretched to keep the same transition band
+  double ratio = std::min(1.0, static_cast<double>(up) / down);
+  taps = static_cast<u32>(std::ceil(preset.taps / ratio / 8)) * 8;
+  const double cutoff = preset.rolloff * ratio;
+  const double halfWidth = taps / 2.0;
+  const double windowScale = 1.0 / besselI0(preset.beta);
+
+  filters.resize(static_cast<size_t>(up) * taps);
+  for (u32 p = 0; p < up; p++) {
+    float* phase = filters.data() + static_cast<size_t>(p) * taps;
+    const double frac = static_cast<double>(p) / up;
+    double sum = 0;
+    for (u32 j = 0; j < taps; j++) {
+      // distance in input frames from the tap to the output position
+      double d = static_cast<double>(j) - (taps / 2 - 1) - frac;
+      double x = cutoff * d;
+      double sinc = x == 0 ? 1.0 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+      double w = d / halfWidth;
+      double window = std::fabs(w) >= 1 ? 0.0 : besselI0(preset.beta * std::sqrt(1 - w * w)) * windowScale;
+      phase[j] = static_cast<float>(sinc * window);
+      sum += phase[j];
+    }
+    // unity gain at DC for every phase
+    for (u32 j = 0; j < taps; j++) phase[j] = static_cast<float>(phase[j] / sum);
+  }
+}
+
+void ResamplerSink::begin(u32 sampleRate, u8 channelCount, u32 frameCount) {
+  this->channelCount = channelCount;
+  passthrough = sampleRate == targetRate;
+  if (passthrough) {
+    next->begin(sampleRate, channelCount, frameCount);
+    return;
+  }
+
+  design(sampleRate);
+  outputIndex = 0;
+  outputFrames = (static_cast<u64>(frameCount) * up + down - 1) / down;
+  historyBase = 0;
+  history.assign(channelCount, std::vector<float>(taps / 2 - 1, 0.0f));
+  outputBuffer.clear();
+  outputBuffer.reserve(OUTPUT_CHUNK_FRAMES * channelCount);
+  next->begin(targetRate, channelCount, outputFrames);
+}
+
+void ResamplerSink::produce() {
+  const u64 available = historyBase + history[0].size();
+  while (outputIndex < outputFrames) {
+    const u64 position = outputIndex * down;
+    const u64 start = position / up;
+    if (start + taps > available) break;
+
+    const float* phase = filters.data() + (position % up) * taps;
+    for (int c = 0; c < channelCount; c++) {
+      float sample = std::round(dot(phase, history[c].data() + (start - historyBase), taps));
+      outputBuffer.push_back(static_cast<s16>(std::clamp(sample, -32768.0f, 32767.0f)));
+    }
+    outputIndex++;
+
+    if (outputBuffer.size() >= OUTPUT_CHUNK_FRAMES * channelCount) {
+      next->write(outputBuffer.data(), outputBuffer.size() / channelCount);
+      outputBuffer.clear();
+    }
+  }
+
+  // drop input no longer reachable by the next output position
+  const u64 keepFrom = std::min(outputIndex * down / up, available);
+  if (keepFrom > historyBase) {
+    for (auto& channel : history) channel.erase(channel.begin(), channel.begin() + (keepFrom - historyBase));
+    historyBase = keepFrom;
+  }
+}
+
+void ResamplerSink::write(const s16* frames, u32 frameCount) {
+  if (passthrough) {
+    next->write(frames, frameCount);
+    return;
+  }
+
+  for (int c = 0; c < channelCount; c++) {
+    auto& channel = history[c];
+    size_t offset = channel.size();
+    channel.resize(offset + frameCount);
+    for (u32 i = 0; i < frameCount; i++) channel[offset + i] = frames[i * channelCount + c];
+  }
+  produce();
+}
+
+void ResamplerSink::end() {
+  if (!passthrough) {
+    // the final outputs look past the end of the input, which is silence
+    for (auto& channel : history) channel.resize(channel.size() + taps, 0.0f);
+    produce();
+    if (!outputBuffer.empty()) next->write(outputBuffer.data(), outputBuffer.size() / channelCount);
+    outputBuffer.clear();
+  }
+  next->end();
+}
+}
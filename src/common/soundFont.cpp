@@ -0,0 +1,146 @@
+#include <cstring>
+#include <iostream>
+
+#include "common/soundFont.hpp"
+#include "common/fileUtil.hpp"
+
+namespace rsnd {
+namespace {
+struct RiffChunk {
+  const u8* data;
+  u32 size;
+};
+
+[[noreturn]] void malformed(const std::filesystem::path& path, const char* what) {
+  std::cerr << path << " is not a valid SF2 file, " << what << std::endl;
+  exit(-1);
+}
+
+// Finds the chunks of a RIFF/LIST body by id, LIST chunks by their list type
+void findChunks(const u8* data, size_t size, std::vector<std::pair<std::string, RiffChunk>>& chunks) {
+  // chunks are word aligned, RIFF is little endian like the hosts we run on
+  for (size_t offset = 0; offset + 8 <= size;) {
+    u32 chunkSize;
+    memcpy(&chunkSize, data + offset + 4, 4);
+    chunkSize = std::min<size_t>(chunkSize, size - offset - 8);
+    const u8* chunkData = data + offset + 8;
+    if (memcmp(data + offset, "LIST", 4) == 0 && chunkSize >= 4) {
+      chunks.push_back({std::string(reinterpret_cast<const char*>(chunkData), 4), {chunkData + 4, chunkSize - 4}});
+    } else {
+      chunks.push_back({std::string(reinterpret_cast<const char*>(data + offset), 4), {chunkData, chunkSize}});
+    }
+    offset += 8 + chunkSize + (chunkSize & 1);
+  }
+}
+
+template <typename T>
+std::vector<T> readRecords(const std::vector<std::pair<std::string, RiffChunk>>& chunks, const char* id, const std::filesystem::path& path) {
+  for (const auto& [chunkId, chunk] : chunks) {
+    if (chunkId != id) continue;
+    std::vector<T> records(chunk.size / sizeof(T));
+    // the last record only terminates the list
+    if (records.empty()) malformed(path, "empty pdta list");
+    memcpy(records.data(), chunk.data, records.size() * sizeof(T));
+    return records;
+  }
+  malformed(path, "missing pdta list");
+}
+
+std::string recordName(const char* name) {
+  return std::string(name, strnlen(name, 20));
+}
+
+// Zones [bag, nextBag) of one preset or instrument. A first zone not ending in terminalGen is the global zone
+template <typename Bag, typename Gen>
+void readZones(const std::vector<Bag>& bags, const std::vector<Gen>& gens, u16 bag, u16 nextBag, SFGenerator terminalGen,
+               std::optional<SoundFontZone>& global, std::vector<SoundFontZone>& zones, const std::filesystem::path& path) {
+  if (nextBag < bag || nextBag >= bags.size()) malformed(path, "bag index out of range");
+  for (u16 b = bag; b < nextBag; b++) {
+    const u16 firstGen = bags[b].wInstGenNdx;
+    const u16 lastGen = bags[b + 1].wInstGenNdx;
+    if (lastGen < firstGen || lastGen >= gens.size()) malformed(path, "generator index out of range");
+
+    SoundFontZone zone = {};
+    for (u16 g = firstGen; g < lastGen; g++) {
+      if (gens[g].sfGenOper >= endOper) continue;
+      zone.amounts[gens[g].sfGenOper] = gens[g].genAmount;
+      zone.present.set(gens[g].sfGenOper);
+    }
+    if (zone.has(terminalGen)) {
+      zones.push_back(zone);
+    } else if (b == bag) {
+      global = zone;
+    }
+  }
+}
+
+// sfPresetBag and sfInstBag have the same layout
+struct SoundFontBag {
+  u16 wInstGenNdx;
+  u16 wInstModNdx;
+};
+}
+
+SoundFontData readSoundFont(const std::filesystem::path& path) {
+  size_t fileSize;
+  u8* fileData = static_cast<u8*>(readBinary(path, fileSize));
+  if (fileSize < 12 || memcmp(fileData, "RIFF", 4) != 0 || memcmp(fileData + 8, "sfbk", 4) != 0) {
+    std::cerr << path << " is not an SF2 file" << std::endl;
+    exit(-1);
+  }
+
+  std::vector<std::pair<std::string, RiffChunk>> lists;
+  findChunks(fileData + 12, fileSize - 12, lists);
+  std::vector<std::pair<std::string, RiffChunk>> sdta;
+  std::vector<std::pair<std::string, RiffChunk>> pdta;
+  for (const auto& [id, chunk] : lists) {
+    if (id == "sdta") findChunks(chunk.data, chunk.size, sdta);
+    if (id == "pdta") findChunks(chunk.data, chunk.size, pdta);
+  }
+
+  SoundFontData soundFont;
+  for (const auto& [id, chunk] : sdta) {
+    if (id != "smpl") continue;
+    soundFont.sampleData.resize(chunk.size / sizeof(s16));
+    memcpy(soundFont.sampleData.data(), chunk.data, soundFont.sampleData.size() * sizeof(s16));
+  }
+
+  const auto presetHeaders = readRecords<sfPresetHeader>(pdta, "phdr", path);
+  const auto presetBags = readRecords<SoundFontBag>(pdta, "pbag", path);
+  const auto presetGens = readRecords<sfGenList>(pdta, "pgen", path);
+  const auto instHeaders = readRecords<sfInst>(pdta, "inst", path);
+  const auto instBags = readRecords<SoundFontBag>(pdta, "ibag", path);
+  const auto instGens = readRecords<sfInstGenList>(pdta, "igen", path);
+  soundFont.samples = readRecords<sfSample>(pdta, "shdr", path);
+  soundFont.samples.pop_back();
+
+  for (size_t i = 0; i + 1 < presetHeaders.size(); i++) {
+    SoundFontPreset preset;
+    preset.name = recordName(presetHeaders[i].achPresetName);
+    preset.preset = presetHeaders[i].wPreset;
+    preset.bank = presetHeaders[i].wBank;
+    readZones(presetBags, presetGens, presetHeaders[i].wPresetBagNdx, presetHeaders[i + 1].wPresetBagNdx, instrument, preset.global, preset.zones, path);
+    for (const auto& zone : preset.zones) {
+      if (zone.amounts[instrument].wAmount + 1 >= instHeaders.size()) malformed(path, "instrument index out of range");
+    }
+    soundFont.presets.push_back(std::move(preset));
+  }
+
+  for (size_t i = 0; i + 1 < instHeaders.size(); i++) {
+    SoundFontInstrument instr;
+    instr.name = recordName(instHeaders[i].achInstName);
+    readZones(instBags, instGens, instHeaders[i].wInstBagNdx, instHeaders[i + 1].wInstBagNdx, sampleID, instr.global, instr.zones, path);
+    for (const auto& zone : instr.zones) {
+      if (zone.amounts[sampleID].wAmount >= soundFont.samples.size()) malformed(path, "sample index out of range");
+    }
+    soundFont.instruments.push_back(std::move(instr));
+  }
+
+  for (const auto& sample : soundFont.samples) {
+    if (sample.dwStart > sample.dwEnd || sample.dwEnd > soundFont.sampleData.size()) malformed(path, "sample out of the smpl chunk");
+  }
+
+  free(fileData);
+  return soundFont;
+}
+}
@@ -3,19 +3,30 @@
 #include <fstream>
 #include <filesystem>
 #include <vector>
+#include <sstream>
 #include <cstring>
 #include <unordered_set>
 #include <random>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 
 #include "rsnd/SoundWaveArchive.hpp"
 #include "rsnd/SoundArchive.hpp"
 #include "rsnd/SoundWave.hpp"
+#include "rsnd/SoundStream.hpp"
 #include "common/util.h"
 #include "common/fileUtil.hpp"
 #include "common/cli.h"
+#include "common/log.hpp"
 #include "tools/extract.hpp"
 #include "tools/decode.hpp"
 #include "tools/list.hpp"
+#include "tools/encode.hpp"
+#include "tools/archive.hpp"
+#include "tools/patch.hpp"
+#include "tools/transcode.hpp"
+#include "tools/render.hpp"
 
 void printUsage() {
   std::cout << "Usage: mrst [SUBCOMMAND] (opts) inputFile\n";
@@ -26,6 +37,40 @@ void printUsageExit() {
   exit(-1);
 }
 
+void invalidValueExit(const char* flag, const std::string& value) {
+  std::cerr << "Invalid value for " << flag << ": " << value << '\n';
+  exit(-1);
+}
+
+// value of flag as a whole number up to max, base 0 also takes 0x prefixed hex
+u64 parseUnsigned(const char* flag, const std::string& value, u64 max, int base = 10) {
+  if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) invalidValueExit(flag, value);
+  size_t end = 0;
+  u64 number = 0;
+  try {
+    number = std::stoull(value, &end, base);
+  } catch (const std::exception&) {
+    invalidValueExit(flag, value);
+  }
+  if (end != value.size() || number > max) invalidValueExit(flag, value);
+  return number;
+}
+
+// value of flag as a finite number, e.g. seconds
+double parseNumber(const char* flag, const std::string& value) {
+  size_t end = 0;
+  double number = 0;
+  try {
+    number = std::stod(value, &end);
+  } catch (const std::exception&) {
+    invalidValueExit(flag, value);
+  }
+  if (end != value.size() || !std::isfinite(number)) invalidValueExit(flag, value);
+  return number;
+}
+
+using namespace rsnd;
+
 CliOpts parseArgs(int argc, char** argv) {
   if (argc < 3) {
     printUsageExit();
@@ -41,6 +86,21 @@ CliOpts parseArgs(int argc, char** argv) {
   cliOpts.listOpts.groups = false;
   cliOpts.listOpts.sounds = false;
   cliOpts.listOpts.banks = false;
+  cliOpts.listOpts.analyze = false;
+  cliOpts.decodeOpts.format = AUDIO_WAV;
+  cliOpts.decodeOpts.resampleRate = 0;
+  cliOpts.decodeOpts.resampleQuality = rsnd::RESAMPLE_NORMAL;
+  cliOpts.decodeOpts.loops = 1;
+  cliOpts.decodeOpts.fadeSeconds = 0;
+  cliOpts.decodeOpts.startSeconds = 0;
+  cliOpts.decodeOpts.durationSeconds = -1;
+  cliOpts.decodeOpts.seekIndex = false;
+  cliOpts.decodeOpts.mixdownChannels = 0;
+  cliOpts.decodeOpts.allLabels = false;
+  cliOpts.encodeOpts.quality = rsnd::ADPCM_ENCODE_BEST;
+  cliOpts.patchOpts.fileIdx = -1;
+  cliOpts.transcodeOpts.format = -1;
+  cliOpts.transcodeOpts.blockSize = 0;
   /// default values
     
   cliOpts.subcommand = argv[1];
@@ -61,12 +121,160 @@ CliOpts parseArgs(int argc, char** argv) {
       } else {
         std::cout << "Unknown extraction style " << extractStyle << '\n';
       }
+    } else if (strcmp(argv[i], "--format") == 0) {
+      if (i == argc - 1) printUsageExit();
+      std::string format = argv[++i];
+      if (format == "wav") {
+        cliOpts.decodeOpts.format = AUDIO_WAV;
+      } else if (format == "flac") {
+        cliOpts.decodeOpts.format = AUDIO_FLAC;
+      } else {
+        std::cerr << "Unknown audio format " << format << '\n';
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--resample") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.resampleRate = parseUnsigned("--resample", argv[++i], UINT32_MAX);
+    } else if (strcmp(argv[i], "--resample-quality") == 0) {
+      if (i == argc - 1) printUsageExit();
+      std::string quality = argv[++i];
+      if (quality == "fast") {
+        cliOpts.decodeOpts.resampleQuality = rsnd::RESAMPLE_FAST;
+      } else if (quality == "normal") {
+        cliOpts.decodeOpts.resampleQuality = rsnd::RESAMPLE_NORMAL;
+      } else if (quality == "best") {
+        cliOpts.decodeOpts.resampleQuality = rsnd::RESAMPLE_BEST;
+      } else {
+        std::cerr << "Unknown resample quality " << quality << '\n';
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--loops") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.loops = parseUnsigned("--loops", argv[++i], UINT32_MAX);
+      if (cliOpts.decodeOpts.loops == 0) {
+        std::cerr << "--loops must be at least 1\n";
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--fade") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.fadeSeconds = parseNumber("--fade", argv[++i]);
+      if (cliOpts.decodeOpts.fadeSeconds < 0) {
+        std::cerr << "--fade must not be negative\n";
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--start") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.startSeconds = parseNumber("--start", argv[++i]);
+      if (!(cliOpts.decodeOpts.startSeconds >= 0)) {
+        std::cerr << "--start must not be negative\n";
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--duration") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.durationSeconds = parseNumber("--duration", argv[++i]);
+      if (!(cliOpts.decodeOpts.durationSeconds >= 0)) {
+        std::cerr << "--duration must not be negative\n";
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--channels") == 0) {
+      if (i == argc - 1) printUsageExit();
+      // comma separated channel indices, e.g. 0,1
+      std::stringstream channels(argv[++i]);
+      std::string channel;
+      while (std::getline(channels, channel, ',')) {
+        // channel indices are u8, the file's channel count is checked when decoding
+        cliOpts.decodeOpts.channels.push_back(parseUnsigned("--channels", channel, UINT8_MAX));
+      }
+    } else if (strcmp(argv[i], "--seek-index") == 0) {
+      cliOpts.decodeOpts.seekIndex = true;
+    } else if (strcmp(argv[i], "--mixdown") == 0) {
+      if (i == argc - 1) printUsageExit();
+      std::string mixdown = argv[++i];
+      if (mixdown == "stereo") {
+        cliOpts.decodeOpts.mixdownChannels = 2;
+      } else if (mixdown == "mono") {
+        cliOpts.decodeOpts.mixdownChannels = 1;
+      } else {
+        std::cerr << "Unknown mixdown " << mixdown << '\n';
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--all-labels") == 0) {
+      cliOpts.decodeOpts.allLabels = true;
+    } else if (strcmp(argv[i], "--loop-count") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.seqLimits.loopCount = parseUnsigned("--loop-count", argv[++i], UINT32_MAX);
+    } else if (strcmp(argv[i], "--max-ticks") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.decodeOpts.seqLimits.maxTicks = parseUnsigned("--max-ticks", argv[++i], UINT32_MAX);
+    } else if (strcmp(argv[i], "--quality") == 0) {
+      if (i == argc - 1) printUsageExit();
+      std::string quality = argv[++i];
+      if (quality == "fast") {
+        cliOpts.encodeOpts.quality = rsnd::ADPCM_ENCODE_FAST;
+      } else if (quality == "best") {
+        cliOpts.encodeOpts.quality = rsnd::ADPCM_ENCODE_BEST;
+      } else {
+        std::cerr << "Unknown encode quality " << quality << '\n';
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--file") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.patchOpts.fileIdx = parseUnsigned("--file", argv[++i], INT32_MAX);
+    } else if (strcmp(argv[i], "--sound") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.patchOpts.soundName = cliOpts.renderOpts.soundName = argv[++i];
+    } else if (strcmp(argv[i], "--bank") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.renderOpts.bankPath = argv[++i];
+    } else if (strcmp(argv[i], "--wave") == 0) {
+      if (i == argc - 1) printUsageExit();
+      cliOpts.patchOpts.wavePath = argv[++i];
+    } else if (strcmp(argv[i], "--stream-format") == 0) {
+      if (i == argc - 1) printUsageExit();
+      std::string format = argv[++i];
+      if (format == "adpcm") {
+        cliOpts.transcodeOpts.format = rsnd::StreamDataInfo::FORMAT_ADPCM;
+      } else if (format == "pcm16") {
+        cliOpts.transcodeOpts.format = rsnd::StreamDataInfo::FORMAT_PCM16;
+      } else if (format == "pcm8") {
+        cliOpts.transcodeOpts.format = rsnd::StreamDataInfo::FORMAT_PCM8;
+      } else {
+        std::cerr << "Unknown stream format " << format << '\n';
+        exit(-1);
+      }
+    } else if (strcmp(argv[i], "--block-size") == 0) {
+      if (i == argc - 1) printUsageExit();
+      // decimal or 0x prefixed hex
+      cliOpts.transcodeOpts.blockSize = parseUnsigned("--block-size", argv[++i], UINT32_MAX, 0);
     } else if (strcmp(argv[i], "--groups") == 0) {
       cliOpts.listOpts.groups = true;
     } else if (strcmp(argv[i], "--banks") == 0) {
       cliOpts.listOpts.banks = true;
     } else if (strcmp(argv[i], "--sounds") == 0) {
       cliOpts.listOpts.sounds = true;
+    } else if (strcmp(argv[i], "--analyze") == 0) {
+      cliOpts.listOpts.analyze = true;
+    } else if (strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0) {
+      for (LogLevel& level : logLevels) level = std::max(level, LOG_INFO);
+    } else if (strcmp(argv[i], "--trace") == 0) {
+      if (i == argc - 1) printUsageExit();
+      // comma separated categories, e.g. parse,midi, or all
+      std::stringstream categories(argv[++i]);
+      std::string name;
+      while (std::getline(categories, name, ',')) {
+        LogCategory category;
+        if (name == "all") {
+          for (LogLevel& level : logLevels) level = LOG_TRACE;
+        } else if (findLogCategory(name, category)) {
+          logLevels[category] = LOG_TRACE;
+        } else {
+          std::cerr << "Unknown trace category " << name << '\n';
+          exit(-1);
+        }
+      }
+    } else if (cliOpts.subcommand == "patch" && !cliOpts.inputFile.empty()) {
+      // mrst patch archive.brsar --file IDX new.file
+      cliOpts.patchOpts.filePath = argv[i];
     } else {
       cliOpts.inputFile = argv[i];
     }
@@ -96,7 +304,6 @@ void printBytesHex(void* ptr, int N) {
     }
 }
 
-using namespace rsnd;
 namespace fs = std::filesystem;
 
 int main(int argc, char** argv) {
@@ -106,8 +313,18 @@ int main(int argc, char** argv) {
     rsndExtract(cliOpts);
   } else if (cliOpts.subcommand == "decode") {
     rsndDecode(cliOpts);
+  } else if (cliOpts.subcommand == "encode") {
+    rsndEncode(cliOpts);
+  } else if (cliOpts.subcommand == "archive") {
+    rsndArchive(cliOpts);
+  } else if (cliOpts.subcommand == "patch") {
+    rsndPatch(cliOpts);
+  } else if (cliOpts.subcommand == "transcode") {
+    rsndTranscode(cliOpts);
   } else if (cliOpts.subcommand == "list") {
     rsndList(cliOpts);
+  } else if (cliOpts.subcommand == "render") {
+    rsndRender(cliOpts);
   } else {
     std::cerr << "Unknown subcommand " << cliOpts.subcommand << '\n';
     printUsageExit();
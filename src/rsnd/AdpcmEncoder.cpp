@@ -0,0 +1,539 @@
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RSND_X86_DISPATCH
+#endif
+
+#include "rsnd/AdpcmEncoder.hpp"
+#include "common/parallel.hpp"
+
+// Coefficient solve and frame encoding follow the reference DSPADPCM encoder
+// (https://github.com/jackoalan/gc-dspadpcm-encode)
+namespace rsnd {
+namespace {
+typedef double tvec[3];
+
+// frames encoded by one task, the same as the samples of one BRSTM ADPCM block
+const u32 CHUNK_FRAMES = 1024;
+
+// pcm points at the current 14 samples, preceded by the previous 14
+void innerProductMerge(tvec vecOut, const s16* pcm) {
+  for (int i = 0; i <= 2; i++) {
+    vecOut[i] = 0.0;
+    for (int x = 0; x < 14; x++) vecOut[i] -= pcm[x - i] * pcm[x];
+  }
+}
+
+void outerProductMerge(tvec mtxOut[3], const s16* pcm) {
+  for (int x = 1; x <= 2; x++) {
+    for (int y = 1; y <= 2; y++) {
+      mtxOut[x][y] = 0.0;
+      for (int z = 0; z < 14; z++) mtxOut[x][y] += pcm[z - x] * pcm[z - y];
+    }
+  }
+}
+
+// LU decomposition with partial pivoting, true if the matrix is singular
+bool analyzeRanges(tvec mtx[3], int* vecIdxsOut) {
+  double recips[3];
+  double val, tmp, min, max;
+
+  for (int x = 1; x <= 2; x++) {
+    val = std::max(std::fabs(mtx[x][1]), std::fabs(mtx[x][2]));
+    if (val < DBL_EPSILON) return true;
+    recips[x] = 1.0 / val;
+  }
+
+  int maxIndex = 0;
+  for (int i = 1; i <= 2; i++) {
+    for (int x = 1; x < i; x++) {
+      tmp = mtx[x][i];
+      for (int y = 1; y < x; y++) tmp -= mtx[x][y] * mtx[y][i];
+      mtx[x][i] = tmp;
+    }
+
+    val = 0.0;
+    for (int x = i; x <= 2; x++) {
+      tmp = mtx[x][i];
+      for (int y = 1; y < i; y++) tmp -= mtx[x][y] * mtx[y][i];
+      mtx[x][i] = tmp;
+      tmp = std::fabs(tmp) * recips[x];
+      if (tmp >= val) {
+        val = tmp;
+        maxIndex = x;
+      }
+    }
+
+    if (maxIndex != i) {
+      for (int y = 1; y <= 2; y++) std::swap(mtx[maxIndex][y], mtx[i][y]);
+      recips[maxIndex] = recips[i];
+    }
+
+    vecIdxsOut[i] = maxIndex;
+    if (mtx[i][i] == 0.0) return true;
+
+    if (i != 2) {
+      tmp = 1.0 / mtx[i][i];
+      for (int x = i + 1; x <= 2; x++) mtx[x][i] *= tmp;
+    }
+  }
+
+  min = 1.0e10;
+  max = 0.0;
+  for (int i = 1; i <= 2; i++) {
+    tmp = std::fabs(mtx[i][i]);
+    min = std::min(min, tmp);
+    max = std::max(max, tmp);
+  }
+  return min / max < 1.0e-10;
+}
+
+void bidirectionalFilter(tvec mtx[3], const int* vecIdxs, tvec vecOut) {
+  double tmp;
+  for (int i = 1, x = 0; i <= 2; i++) {
+    int index = vecIdxs[i];
+    tmp = vecOut[index];
+    vecOut[index] = vecOut[i];
+    if (x != 0) {
+      for (int y = x; y <= i - 1; y++) tmp -= vecOut[y] * mtx[i][y];
+    } else if (tmp != 0.0) {
+      x = i;
+    }
+    vecOut[i] = tmp;
+  }
+
+  for (int i = 2; i > 0; i--) {
+    tmp = vecOut[i];
+    for (int y = i + 1; y <= 2; y++) tmp -= vecOut[y] * mtx[i][y];
+    vecOut[i] = tmp / mtx[i][i];
+  }
+  vecOut[0] = 1.0;
+}
+
+// true if the filter is unstable
+bool quadraticMerge(tvec inOutVec) {
+  double v2 = inOutVec[2];
+  double tmp = 1.0 - (v2 * v2);
+  if (tmp == 0.0) return true;
+
+  double v0 = (inOutVec[0] - (v2 * v2)) / tmp;
+  double v1 = (inOutVec[1] - (inOutVec[1] * v2)) / tmp;
+  inOutVec[0] = v0;
+  inOutVec[1] = v1;
+  return std::fabs(v1) > 1.0;
+}
+
+void finishRecord(tvec in, tvec out) {
+  for (int z = 1; z <= 2; z++) {
+    if (in[z] >= 1.0) {
+      in[z] = 0.9999999999;
+    } else if (in[z] <= -1.0) {
+      in[z] = -0.9999999999;
+    }
+  }
+  out[0] = 1.0;
+  out[1] = (in[2] * in[1]) + in[1];
+  out[2] = in[2];
+}
+
+void matrixFilter(const tvec src, tvec dst) {
+  tvec mtx[3];
+  mtx[2][0] = 1.0;
+  for (int i = 1; i <= 2; i++) mtx[2][i] = -src[i];
+
+  for (int i = 2; i > 0; i--) {
+    double val = 1.0 - (mtx[i][i] * mtx[i][i]);
+    for (int y = 1; y <= i; y++) mtx[i - 1][y] = ((mtx[i][i] * mtx[i][y]) + mtx[i][y]) / val;
+  }
+
+  dst[0] = 1.0;
+  for (int i = 1; i <= 2; i++) {
+    dst[i] = 0.0;
+    for (int y = 1; y <= i; y++) dst[i] += mtx[i][y] * dst[i - y];
+  }
+}
+
+void mergeFinishRecord(const tvec src, tvec dst) {
+  tvec tmp;
+  double val = src[0];
+
+  dst[0] = 1.0;
+  for (int i = 1; i <= 2; i++) {
+    double v2 = 0.0;
+    for (int y = 1; y < i; y++) v2 += dst[y] * src[i - y];
+
+    dst[i] = val > 0.0 ? -(v2 + src[i]) / val : 0.0;
+    tmp[i] = dst[i];
+    for (int y = 1; y < i; y++) dst[y] += dst[i] * dst[i - y];
+    val *= 1.0 - (dst[i] * dst[i]);
+  }
+
+  finishRecord(tmp, dst);
+}
+
+double contrastVectors(const tvec source1, const tvec source2) {
+  double val = (source2[2] * source2[1] + -source2[1]) / (1.0 - source2[2] * source2[2]);
+  double val1 = (source1[0] * source1[0]) + (source1[1] * source1[1]) + (source1[2] * source1[2]);
+  double val2 = (source1[0] * source1[1]) + (source1[1] * source1[2]);
+  double val3 = source1[0] * source1[2];
+  return val1 + (2.0 * val * val2) + (2.0 * (-source2[1] * val + -source2[2]) * val3);
+}
+
+// k-means style refinement of the exp best vectors over all records
+// pcm holds yn2, yn1 and then the frame. For each predictor, finds the unquantized prediction residual with the
+// largest magnitude and the residual energy (/16 so 14 samples fit in s32)
+void predictionErrorsScalar(const s16 pcm[16], u32 count, const s16 coeffs[16], s32 distance[8], s32 energy[8]) {
+  for (int i = 0; i < 8; i++) {
+    s32 maxResidual = 0;
+    s32 residualEnergy = 0;
+    for (u32 s = 0; s < count; s++) {
+      s32 prediction = (pcm[s] * coeffs[i * 2 + 1] + pcm[s + 1] * coeffs[i * 2]) / 2048;
+      s32 residual = std::clamp(pcm[s + 2] - prediction, -32768, 32767);
+      if (std::abs(residual) > std::abs(maxResidual)) maxResidual = residual;
+      residualEnergy += (residual * residual) >> 4;
+    }
+    distance[i] = maxResidual;
+    energy[i] = residualEnergy;
+  }
+}
+
+#ifdef RSND_X86_DISPATCH
+// one predictor per lane
+__attribute__((target("avx2")))
+void predictionErrorsAvx2(const s16 pcm[16], u32 count, const s16 coeffs[16], s32 distance[8], s32 energy[8]) {
+  const __m256i c0 = _mm256_setr_epi32(coeffs[0], coeffs[2], coeffs[4], coeffs[6], coeffs[8], coeffs[10], coeffs[12], coeffs[14]);
+  const __m256i c1 = _mm256_setr_epi32(coeffs[1], coeffs[3], coeffs[5], coeffs[7], coeffs[9], coeffs[11], coeffs[13], coeffs[15]);
+  const __m256i roundToZero = _mm256_set1_epi32(2047);
+  const __m256i sampleMax = _mm256_set1_epi32(32767);
+  const __m256i sampleMin = _mm256_set1_epi32(-32768);
+
+  __m256i maxResidual = _mm256_setzero_si256();
+  __m256i residualEnergy = _mm256_setzero_si256();
+  for (u32 s = 0; s < count; s++) {
+    __m256i prediction = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(pcm[s]), c1), _mm256_mullo_epi32(_mm256_set1_epi32(pcm[s + 1]), c0));
+    // / 2048 truncating towards zero like the scalar division
+    prediction = _mm256_srai_epi32(_mm256_add_epi32(prediction, _mm256_and_si256(_mm256_srai_epi32(prediction, 31), roundToZero)), 11);
+    __m256i residual = _mm256_sub_epi32(_mm256_set1_epi32(pcm[s + 2]), prediction);
+    residual = _mm256_max_epi32(_mm256_min_epi32(residual, sampleMax), sampleMin);
+
+    __m256i larger = _mm256_cmpgt_epi32(_mm256_abs_epi32(residual), _mm256_abs_epi32(maxResidual));
+    maxResidual = _mm256_blendv_epi8(maxResidual, residual, larger);
+    residualEnergy = _mm256_add_epi32(residualEnergy, _mm256_srai_epi32(_mm256_mullo_epi32(residual, residual), 4));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(distance), maxResidual);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(energy), residualEnergy);
+}
+
+bool hasAvx2() {
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+void predictionErrors(const s16 pcm[16], u32 count, const s16 coeffs[16], s32 distance[8], s32 energy[8]) {
+#ifdef RSND_X86_DISPATCH
+  static const bool avx2 = hasAvx2();
+  if (avx2) return predictionErrorsAvx2(pcm, count, coeffs, distance, energy);
+#endif
+  predictionErrorsScalar(pcm, count, coeffs, distance, energy);
+}
+
+// Quantizes the frame in pcm (see predictionErrors) with one predictor, starting from the scale its largest residual
+// needs and growing it while samples clip. Returns the squared error of decoded against pcm
+double quantizeFrame(const s16 pcm[16], u32 count, s16 c0, s16 c1, s32 distance, s32 nibbles[14], s32 decoded[16], int& scale) {
+  for (scale = 0; scale <= 12 && (distance > 7 || distance < -8); scale++, distance /= 2) {}
+  scale = scale <= 1 ? -1 : scale - 2;
+
+  double error;
+  int index;
+  decoded[0] = pcm[0];
+  decoded[1] = pcm[1];
+  do {
+    scale++;
+    error = 0;
+    index = 0;
+
+    for (u32 s = 0; s < count; s++) {
+      s32 v1 = decoded[s] * c1 + decoded[s + 1] * c0;
+      s32 v2 = ((pcm[s + 2] << 11) - v1) / 2048;
+      s32 v3 = v2 > 0 ? static_cast<s32>(static_cast<double>(v2) / (1 << scale) + 0.4999999f)
+                      : static_cast<s32>(static_cast<double>(v2) / (1 << scale) - 0.4999999f);
+
+      // clamp to a nibble, remembering how far out of range it was
+      if (v3 < -8) {
+        index = std::max(index, -8 - v3);
+        v3 = -8;
+      } else if (v3 > 7) {
+        index = std::max(index, v3 - 7);
+        v3 = 7;
+      }
+      nibbles[s] = v3;
+
+      // decode like decodeAdpcmBlock
+      v1 = (v1 + ((v3 * (1 << scale)) << 11) + 1024) >> 11;
+      decoded[s + 2] = std::clamp(v1, -32768, 32767);
+      double diff = pcm[s + 2] - decoded[s + 2];
+      error += diff * diff;
+    }
+
+    for (int x = index + 8; x > 256; x >>= 1) {
+      if (++scale >= 12) scale = 11;
+    }
+  } while (scale < 12 && index > 1);
+
+  return error;
+}
+
+// Encodes up to 14 samples into an 8 byte frame, continuing from and updating the decoder history yn1/yn2
+void encodeFrame(const s16* input, u32 count, s16& yn1, s16& yn2, const s16 coeffs[16], AdpcmEncodeQuality quality, u8 out[8], s16* decodedOut) {
+  s16 pcm[16] = {};
+  pcm[0] = yn2;
+  pcm[1] = yn1;
+  std::copy(input, input + count, pcm + 2);
+
+  s32 distance[8];
+  s32 energy[8];
+  predictionErrors(pcm, count, coeffs, distance, energy);
+
+  s32 nibbles[8][14] = {};
+  s32 decoded[8][16];
+  int scale[8];
+  double error[8];
+  int bestIndex = 0;
+  if (quality == ADPCM_ENCODE_FAST) {
+    bestIndex = std::min_element(energy, energy + 8) - energy;
+    quantizeFrame(pcm, count, coeffs[bestIndex * 2], coeffs[bestIndex * 2 + 1], distance[bestIndex], nibbles[bestIndex], decoded[bestIndex], scale[bestIndex]);
+  } else {
+    for (int i = 0; i < 8; i++) {
+      error[i] = quantizeFrame(pcm, count, coeffs[i * 2], coeffs[i * 2 + 1], distance[i], nibbles[i], decoded[i], scale[i]);
+    }
+    bestIndex = std::min_element(error, error + 8) - error;
+  }
+
+  out[0] = (bestIndex << 4) | (scale[bestIndex] & 0xf);
+  for (int i = 0; i < 7; i++) {
+    out[i + 1] = (nibbles[bestIndex][i * 2] << 4) | (nibbles[bestIndex][i * 2 + 1] & 0xf);
+  }
+  for (u32 s = 0; s < count; s++) {
+    decodedOut[s] = decoded[bestIndex][s + 2];
+  }
+  yn1 = decoded[bestIndex][count + 1];
+  yn2 = decoded[bestIndex][count];
+}
+}
+
+void collectAdpcmRecords(const s16* pcm, u32 sampleCount, u32 firstFrame, u32 lastFrame, std::vector<AdpcmRecord>& records) {
+  // previous frame followed by the current one
+  s16 history[28] = {};
+  auto loadFrame = [&](u32 frame, s16* out) {
+    for (u32 i = 0; i < 14; i++) {
+      u32 sample = frame * 14 + i;
+      out[i] = sample < sampleCount ? pcm[sample] : 0;
+    }
+  };
+  if (firstFrame > 0) loadFrame(firstFrame - 1, history + 14);
+
+  tvec vec1;
+  tvec mtx[3];
+  int vecIdxs[3];
+  for (u32 frame = firstFrame; frame < lastFrame; frame++) {
+    memcpy(history, history + 14, 14 * sizeof(s16));
+    loadFrame(frame, history + 14);
+
+    innerProductMerge(vec1, history + 14);
+    if (std::fabs(vec1[0]) > 10.0) {
+      outerProductMerge(mtx, history + 14);
+      if (!analyzeRanges(mtx, vecIdxs)) {
+        bidirectionalFilter(mtx, vecIdxs, vec1);
+        if (!quadraticMerge(vec1)) {
+          AdpcmRecord record;
+          finishRecord(vec1, record.data());
+          records.push_back(record);
+        }
+      }
+    }
+  }
+}
+
+void solveAdpcmCoeffs(const std::vector<AdpcmRecord>& records, s16 coeffs[16]) {
+  AdpcmCoeffSolver solver;
+  while (solver.needsPass()) {
+    for (const auto& record : records) solver.add(record);
+    solver.finishPass();
+  }
+  solver.getCoeffs(coeffs);
+}
+
+AdpcmCoeffSolver::AdpcmCoeffSolver() {
+  sums[0][0] = 1.0;
+}
+
+void AdpcmCoeffSolver::add(const AdpcmRecord& record) {
+  tvec filtered;
+  matrixFilter(record.data(), filtered);
+  if (pass == 0) {
+    for (int y = 1; y <= 2; y++) sums[0][y] += filtered[y];
+    recordCount++;
+    return;
+  }
+
+  int index = 0;
+  double value = 1.0e30;
+  for (int i = 0; i < predictorCount; i++) {
+    double tempVal = contrastVectors(vecBest[i].data(), record.data());
+    if (tempVal < value) {
+      value = tempVal;
+      index = i;
+    }
+  }
+  counts[index]++;
+  for (int i = 0; i <= 2; i++) sums[index][i] += filtered[i];
+}
+
+void AdpcmCoeffSolver::finishPass() {
+  if (pass == 0) {
+    if (recordCount == 0) {
+      // silence, any predictor works
+      pass = PASS_COUNT;
+      return;
+    }
+    for (int y = 1; y <= 2; y++) sums[0][y] /= recordCount;
+    mergeFinishRecord(sums[0].data(), vecBest[0].data());
+  } else {
+    for (int i = 0; i < predictorCount; i++) {
+      if (counts[i] > 0) {
+        for (int y = 0; y <= 2; y++) sums[i][y] /= counts[i];
+      }
+      mergeFinishRecord(sums[i].data(), vecBest[i].data());
+    }
+  }
+  pass++;
+
+  // split every vector in two and refine, 1 -> 2 -> 4 -> 8
+  if (pass < PASS_COUNT && pass % 2 == 1) {
+    const double split[3] = {0.0, -1.0, 0.0};
+    for (int i = 0; i < predictorCount; i++) {
+      for (int y = 0; y <= 2; y++) vecBest[predictorCount + i][y] = (0.01 * split[y]) + vecBest[i][y];
+    }
+    predictorCount *= 2;
+  }
+  for (int i = 0; i < predictorCount; i++) {
+    sums[i] = {};
+    counts[i] = 0;
+  }
+}
+
+void AdpcmCoeffSolver::getCoeffs(s16 coeffs[16]) const {
+  if (recordCount == 0) {
+    std::fill(coeffs, coeffs + 16, 0);
+    return;
+  }
+  for (int z = 0; z < 8; z++) {
+    for (int i = 0; i < 2; i++) {
+      double d = -vecBest[z][i + 1] * 2048.0;
+      coeffs[z * 2 + i] = static_cast<s16>(std::clamp(std::lround(d), -32768l, 32767l));
+    }
+  }
+}
+
+AdpcParams AdpcmChannel::getAdpcParams(bool loop, u32 loopStart) const {
+  AdpcParams adpcParams = {};
+  std::copy(coeffs, coeffs + 16, adpcParams.params.coeffs);
+  adpcParams.params.predictorScale = data.empty() ? 0 : data[0];
+  if (loop) {
+    adpcParams.paramsLoop.predictorScale = getPredictorScale(loopStart);
+    adpcParams.paramsLoop.yn1 = getYn1(loopStart);
+    adpcParams.paramsLoop.yn2 = getYn2(loopStart);
+  }
+  return adpcParams;
+}
+
+void encodeAdpcmFrames(const s16* pcm, u32 count, s16& yn1, s16& yn2, const s16 coeffs[16], AdpcmEncodeQuality quality, u8* data, s16* decoded) {
+  for (u32 start = 0, f = 0; start < count; start += 14, f++) {
+    encodeFrame(pcm + start, std::min(14u, count - start), yn1, yn2, coeffs, quality, data + f * 8, decoded + start);
+  }
+}
+
+void reencodeAdpcmFrames(const s16* pcm, u32 count, s16 yn1, s16 yn2, s16 speculativeYn1, s16 speculativeYn2, const s16 coeffs[16], AdpcmEncodeQuality quality,
+                         u8* data, s16* decoded) {
+  // encoding only depends on the history and the input, so once a re-encoded frame ends with the history the
+  // earlier encoding had, the rest is already right
+  for (u32 start = 0, f = 0; start < count; start += 14, f++) {
+    if (yn1 == speculativeYn1 && yn2 == speculativeYn2) break;
+
+    u32 frameCount = std::min(14u, count - start);
+    // history after this frame in the earlier encoding, before it gets overwritten
+    speculativeYn2 = frameCount >= 2 ? decoded[start + frameCount - 2] : speculativeYn1;
+    speculativeYn1 = decoded[start + frameCount - 1];
+    encodeFrame(pcm + start, frameCount, yn1, yn2, coeffs, quality, data + f * 8, decoded + start);
+  }
+}
+
+void correlateAdpcmCoeffs(const s16* pcm, u32 sampleCount, s16 coeffs[16]) {
+  std::vector<AdpcmRecord> records;
+  collectAdpcmRecords(pcm, sampleCount, 0, (sampleCount + 13) / 14, records);
+  solveAdpcmCoeffs(records, coeffs);
+}
+
+std::vector<AdpcmChannel> encodeAdpcm(const s16* pcm, u8 channelCount, u32 sampleCount, AdpcmEncodeQuality quality) {
+  const u32 frameCount = (sampleCount + 13) / 14;
+  const u32 chunkCount = (frameCount + CHUNK_FRAMES - 1) / CHUNK_FRAMES;
+  const u32 chunkSamples = CHUNK_FRAMES * 14;
+
+  std::vector<std::vector<s16>> planar(channelCount, std::vector<s16>(sampleCount));
+  for (u32 i = 0; i < sampleCount; i++) {
+    for (int c = 0; c < channelCount; c++) planar[c][i] = pcm[i * channelCount + c];
+  }
+
+  std::vector<AdpcmChannel> channels(channelCount);
+  for (auto& channel : channels) {
+    channel.data.resize(frameCount * 8);
+    channel.decoded.resize(sampleCount);
+  }
+
+  // filter records of every chunk, then the coefficients of every channel
+  std::vector<std::vector<AdpcmRecord>> records(channelCount * chunkCount);
+  parallelFor(records.size(), [&](size_t task) {
+    u32 c = task / chunkCount;
+    u32 k = task % chunkCount;
+    collectAdpcmRecords(planar[c].data(), sampleCount, k * CHUNK_FRAMES, std::min(frameCount, (k + 1) * CHUNK_FRAMES), records[task]);
+  });
+  parallelFor(channelCount, [&](size_t c) {
+    std::vector<AdpcmRecord> channelRecords;
+    for (u32 k = 0; k < chunkCount; k++) {
+      const auto& chunkRecords = records[c * chunkCount + k];
+      channelRecords.insert(channelRecords.end(), chunkRecords.begin(), chunkRecords.end());
+    }
+    solveAdpcmCoeffs(channelRecords, channels[c].coeffs);
+  });
+
+  // speculative pass: every chunk starts from the input samples before it instead of the decoded ones
+  parallelFor(channelCount * chunkCount, [&](size_t task) {
+    u32 c = task / chunkCount;
+    u32 k = task % chunkCount;
+    u32 start = k * chunkSamples;
+    u32 count = std::min(chunkSamples, sampleCount - start);
+    s16 yn1 = start >= 1 ? planar[c][start - 1] : 0;
+    s16 yn2 = start >= 2 ? planar[c][start - 2] : 0;
+    encodeAdpcmFrames(planar[c].data() + start, count, yn1, yn2, channels[c].coeffs, quality, channels[c].data.data() + k * CHUNK_FRAMES * 8, channels[c].decoded.data() + start);
+  });
+
+  // fix up each chunk in order with the real history
+  parallelFor(channelCount, [&](size_t c) {
+    AdpcmChannel& channel = channels[c];
+    for (u32 k = 1; k < chunkCount; k++) {
+      u32 start = k * chunkSamples;
+      u32 count = std::min(chunkSamples, sampleCount - start);
+      reencodeAdpcmFrames(planar[c].data() + start, count, channel.decoded[start - 1], channel.decoded[start - 2], planar[c][start - 1], planar[c][start - 2],
+                          channel.coeffs, quality, channel.data.data() + k * CHUNK_FRAMES * 8, channel.decoded.data() + start);
+    }
+  });
+
+  return channels;
+}
+}
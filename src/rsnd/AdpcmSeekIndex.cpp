@@ -0,0 +1,102 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "rsnd/AdpcmSeekIndex.hpp"
+#include "rsnd/SoundWave.hpp"
+
+namespace rsnd {
+std::filesystem::path AdpcmSeekIndex::sidecarPath(const std::filesystem::path& inputPath) {
+  return inputPath.string() + ".seek";
+}
+
+u64 AdpcmSeekIndex::hashWaveData(const SoundWave& soundWave) {
+  // FNV-1a over the ADPCM data and its parameters
+  u64 hash = 0xcbf29ce484222325;
+  auto mix = [&hash](const void* data, size_t size) {
+    const u8* bytes = static_cast<const u8*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3;
+    }
+  };
+
+  const u32 sampleCount = soundWave.getTrackSampleCount();
+  const size_t channelDataSize = (sampleCount + 13) / 14 * 8;
+  for (int c = 0; c < soundWave.getChannelCount(); c++) {
+    mix(soundWave.getChannelAdpcmParam(c), sizeof(AdpcmParam));
+    mix(soundWave.getChannelData(c), channelDataSize);
+  }
+  return hash;
+}
+
+void AdpcmSeekIndex::build(const SoundWave& soundWave, u32 interval) {
+  this->interval = interval;
+  sampleCount = soundWave.getTrackSampleCount();
+  dataHash = hashWaveData(soundWave);
+
+  const u32 intervalSamples = getIntervalSamples();
+  const u32 checkpointCount = sampleCount / intervalSamples + 1;
+  checkpoints.assign(soundWave.getChannelCount(), {});
+  std::vector<s16> pcm(sampleCount);
+  for (int c = 0; c < soundWave.getChannelCount(); c++) {
+    soundWave.decodeChannel(c, pcm.data());
+    const AdpcmParam& params = soundWave.getChannelAdpcmParam(c)->params;
+
+    auto& channelCheckpoints = checkpoints[c];
+    channelCheckpoints.push_back({params.yn1, params.yn2});
+    for (u32 i = 1; i < checkpointCount; i++) {
+      u32 sample = i * intervalSamples;
+      channelCheckpoints.push_back({pcm[sample - 1], pcm[sample - 2]});
+    }
+  }
+}
+
+bool AdpcmSeekIndex::load(const std::filesystem::path& path, const SoundWave& soundWave) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) return false;
+
+  AdpcmSeekIndexHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.interval == 0) return false;
+  if (header.channelCount != soundWave.getChannelCount() || header.sampleCount != soundWave.getTrackSampleCount()) return false;
+  if (header.dataHash != hashWaveData(soundWave)) return false;
+
+  interval = header.interval;
+  sampleCount = header.sampleCount;
+  dataHash = header.dataHash;
+  const u32 intervalSamples = getIntervalSamples();
+  const u32 checkpointCount = sampleCount / intervalSamples + 1;
+  checkpoints.assign(header.channelCount, std::vector<AdpcmCheckpoint>(checkpointCount));
+  for (auto& channelCheckpoints : checkpoints) {
+    if (!file.read(reinterpret_cast<char*>(channelCheckpoints.data()), checkpointCount * sizeof(AdpcmCheckpoint))) return false;
+  }
+  return true;
+}
+
+bool AdpcmSeekIndex::save(const std::filesystem::path& path) const {
+  std::ofstream file(path, std::ios::binary);
+  if (!file.is_open()) return false;
+
+  AdpcmSeekIndexHeader header = {};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.channelCount = checkpoints.size();
+  header.interval = interval;
+  header.sampleCount = sampleCount;
+  header.dataHash = dataHash;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const auto& channelCheckpoints : checkpoints) {
+    file.write(reinterpret_cast<const char*>(channelCheckpoints.data()), channelCheckpoints.size() * sizeof(AdpcmCheckpoint));
+  }
+  return static_cast<bool>(file);
+}
+
+u32 AdpcmSeekIndex::seek(u8 channelIdx, u32 sample, s16& yn1, s16& yn2) const {
+  const auto& channelCheckpoints = checkpoints[channelIdx];
+  u32 i = std::min<u32>(sample / getIntervalSamples(), channelCheckpoints.size() - 1);
+  yn1 = channelCheckpoints[i].yn1;
+  yn2 = channelCheckpoints[i].yn2;
+  return i * getIntervalSamples();
+}
+}
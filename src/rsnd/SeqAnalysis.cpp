@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <deque>
+
+#include "rsnd/SeqAnalysis.hpp"
+
+namespace rsnd {
+namespace {
+const u32 DEFAULT_TIMEBASE = 48;
+const s32 DEFAULT_TEMPO = 120;
+
+// timing changes are player wide, whichever track makes them
+struct TimingChange {
+  u32 tick;
+  bool timebase;
+  s32 value;
+};
+
+struct AnalysisState {
+  SeqAnalysis analysis = {};
+  std::vector<TimingChange> timing;
+  // [start, end) ticks of every note
+  std::vector<std::pair<u32, u32>> notes;
+};
+
+class AnalysisSink : public SeqTrackSink {
+private:
+  AnalysisState& state;
+  std::deque<AnalysisSink>& sinks;
+  u8 trackNo;
+  u32 tick;
+  // MML_MONOPHONIC, a note cuts off the notes of the track still sounding like SeqRenderer releases them
+  bool monophonic = false;
+  // indices in state.notes of the track's notes that may still be sounding
+  std::vector<size_t> sounding;
+
+public:
+  AnalysisSink(AnalysisState& state, std::deque<AnalysisSink>& sinks, u8 trackNo, u32 tick) : state(state), sinks(sinks), trackNo(trackNo), tick(tick) {
+    state.analysis.tracks.push_back(trackNo);
+  }
+
+  u32 getTick() const { return tick; }
+
+  void note(u8, u8, s32 duration) override {
+    std::erase_if(sounding, [&](size_t i) { return state.notes[i].second <= tick; });
+    if (monophonic) {
+      for (size_t i : sounding) state.notes[i].second = tick;
+      sounding.clear();
+    }
+    if (duration > 0) {
+      sounding.push_back(state.notes.size());
+      state.notes.push_back({tick, tick + duration});
+    }
+  }
+
+  void wait(s32 duration) override {
+    tick += duration;
+  }
+
+  SeqTrackSink* openTrack(u8 openedNo) override {
+    state.analysis.openedTracks.push_back({trackNo, openedNo});
+    return &sinks.emplace_back(state, sinks, openedNo, tick);
+  }
+
+  void command(const SeqInstr& instr, s32 value) override {
+    switch (instr.cmd) {
+    case MML_PRG:
+      state.analysis.programs.push_back(value);
+      break;
+    case MML_TEMPO:
+      state.timing.push_back({tick, false, static_cast<s16>(value)});
+      break;
+    case MML_TIMEBASE:
+      state.timing.push_back({tick, true, value});
+      break;
+    case MML_MONOPHONIC:
+      monophonic = value != 0;
+      break;
+    }
+  }
+};
+
+double ticksToSeconds(std::vector<TimingChange>& timing, u32 ticks) {
+  std::stable_sort(timing.begin(), timing.end(), [](const TimingChange& a, const TimingChange& b) { return a.tick < b.tick; });
+  double seconds = 0;
+  u32 tick = 0;
+  s32 timebase = DEFAULT_TIMEBASE;
+  s32 tempo = DEFAULT_TEMPO;
+  auto advance = [&](u32 until) {
+    until = std::min(until, ticks);
+    // a tempo of 0 stops the sequence, it never gets past here
+    if (until > tick && tempo > 0 && timebase > 0) seconds += (until - tick) * 60.0 / (static_cast<double>(tempo) * timebase);
+    tick = std::max(tick, until);
+  };
+  for (const TimingChange& change : timing) {
+    advance(change.tick);
+    (change.timebase ? timebase : tempo) = change.value;
+  }
+  advance(ticks);
+  return seconds;
+}
+
+u32 maxPolyphony(std::vector<std::pair<u32, u32>>& notes) {
+  // +1 at each start, -1 at each end, ends first where they meet
+  std::vector<std::pair<u32, int>> edges;
+  edges.reserve(notes.size() * 2);
+  for (const auto& [start, end] : notes) {
+    edges.push_back({start, 1});
+    edges.push_back({end, -1});
+  }
+  std::sort(edges.begin(), edges.end());
+  int sounding = 0;
+  int most = 0;
+  for (const auto& [tick, delta] : edges) {
+    sounding += delta;
+    most = std::max(most, sounding);
+  }
+  return most;
+}
+}
+
+SeqAnalysis analyzeSequence(const SoundSequence& seq, u32 offset, const SeqPlayLimits& limits) {
+  const SeqProgram program(seq, {offset});
+  AnalysisState state;
+  std::deque<AnalysisSink> sinks;
+  SeqInterpreter(program, limits).run(program.indexOf(offset), sinks.emplace_back(state, sinks, 0, 0));
+
+  SeqAnalysis& analysis = state.analysis;
+  for (const AnalysisSink& sink : sinks) analysis.durationTicks = std::max(analysis.durationTicks, sink.getTick());
+  for (const auto& [start, end] : state.notes) analysis.durationTicks = std::max(analysis.durationTicks, end);
+  analysis.durationSeconds = ticksToSeconds(state.timing, analysis.durationTicks);
+  std::sort(analysis.programs.begin(), analysis.programs.end());
+  analysis.programs.erase(std::unique(analysis.programs.begin(), analysis.programs.end()), analysis.programs.end());
+  analysis.maxPolyphony = maxPolyphony(state.notes);
+  return analysis;
+}
+}
@@ -0,0 +1,534 @@
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <unordered_map>
+
+#include "common/log.hpp"
+#include "rsnd/SeqProgram.hpp"
+
+namespace rsnd {
+namespace {
+// operands of each command byte, in the order they follow it
+enum CmdLayout : u8 {
+  LAYOUT_NONE,
+  // u8 velocity, VMIDI duration
+  LAYOUT_NOTE,
+  LAYOUT_VMIDI,
+  LAYOUT_U8,
+  LAYOUT_S16,
+  LAYOUT_U16,
+  // u8 track number, u24 offset
+  LAYOUT_OPEN_TRACK,
+  // u24 offset
+  LAYOUT_ADDRESS,
+  // u8 MmlEx command and its operands
+  LAYOUT_EX
+};
+
+// By command range like the console's parser, so unknown commands can be skipped too
+constexpr std::array<CmdLayout, 256> makeCmdLayouts() {
+  std::array<CmdLayout, 256> layouts = {};
+  for (int cmd = 0; cmd < 0x80; cmd++) layouts[cmd] = LAYOUT_NOTE;
+  for (int cmd = 0x80; cmd < 0xb0; cmd++) layouts[cmd] = LAYOUT_NONE;
+  for (int cmd = 0xb0; cmd < 0xe0; cmd++) layouts[cmd] = LAYOUT_U8;
+  for (int cmd = 0xe0; cmd < 0xf0; cmd++) layouts[cmd] = LAYOUT_S16;
+  for (int cmd = 0xf0; cmd < 0x100; cmd++) layouts[cmd] = LAYOUT_NONE;
+  layouts[MML_WAIT] = LAYOUT_VMIDI;
+  layouts[MML_PRG] = LAYOUT_VMIDI;
+  layouts[MML_OPEN_TRACK] = LAYOUT_OPEN_TRACK;
+  layouts[MML_JUMP] = LAYOUT_ADDRESS;
+  layouts[MML_CALL] = LAYOUT_ADDRESS;
+  layouts[MML_EX_COMMAND] = LAYOUT_EX;
+  layouts[MML_ALLOC_TRACK] = LAYOUT_U16;
+  return layouts;
+}
+
+constexpr std::array<bool, 256> makeKnownCmds() {
+  std::array<bool, 256> known = {};
+  for (int cmd = 0; cmd < 0x80; cmd++) known[cmd] = true;
+  for (int cmd : {MML_WAIT, MML_PRG, MML_OPEN_TRACK, MML_JUMP, MML_CALL, MML_TIMEBASE, MML_ENV_HOLD, MML_MONOPHONIC,
+                  MML_VELOCITY_RANGE, MML_BIQUAD_TYPE, MML_BIQUAD_VALUE, MML_MOD_DELAY, MML_TEMPO, MML_SWEEP_PITCH,
+                  MML_EX_COMMAND, MML_ENV_RESET, MML_LOOP_END, MML_RET, MML_ALLOC_TRACK, MML_FIN}) {
+    known[cmd] = true;
+  }
+  for (int cmd = MML_PAN; cmd <= MML_DAMPER; cmd++) known[cmd] = true;
+  return known;
+}
+
+const std::array<CmdLayout, 256> cmdLayouts = makeCmdLayouts();
+const std::array<bool, 256> knownCmds = makeKnownCmds();
+
+class Decoder {
+private:
+  const u8* data;
+  u32 dataSize;
+  SeqProgram& program;
+  std::vector<u32>& instrAt;
+  // offsets still to decode from
+  std::vector<u32> pending;
+  // instructions whose target is an offset, resolved once everything is decoded
+  std::vector<std::pair<u32, u32>> targets;
+
+  bool has(u32 offset, u32 count) const { return static_cast<u64>(offset) + count <= dataSize; }
+
+  u32 readBe(u32& offset, u32 bytes) const {
+    u32 value = 0;
+    for (u32 i = 0; i < bytes; i++) value = (value << 8) | data[offset++];
+    return value;
+  }
+
+  bool readVarLen(u32& offset, u32& value) const {
+    value = 0;
+    for (int i = 0; i < 5; i++) {
+      if (!has(offset, 1)) return false;
+      const u8 c = data[offset++];
+      value = (value << 7) + (c & 0x7f);
+      if ((c & 0x80) == 0) break;
+    }
+    return true;
+  }
+
+  bool readOperand(SeqArgType type, u32& offset, SeqOperand& operand) const {
+    operand = {type, 0, 0};
+    switch (type) {
+    case SEQ_ARG_U8:
+    case SEQ_ARG_VARIABLE:
+      if (!has(offset, 1)) return false;
+      operand.value = data[offset++];
+      return true;
+    case SEQ_ARG_S16:
+      if (!has(offset, 2)) return false;
+      operand.value = static_cast<s16>(readBe(offset, 2));
+      return true;
+    case SEQ_ARG_VMIDI: {
+      u32 value;
+      if (!readVarLen(offset, value)) return false;
+      operand.value = value;
+      return true;
+    }
+    case SEQ_ARG_RANDOM:
+      if (!has(offset, 4)) return false;
+      operand.value = static_cast<s16>(readBe(offset, 2));
+      operand.max = static_cast<s16>(readBe(offset, 2));
+      return true;
+    default:
+      return true;
+    }
+  }
+
+  void unknown(SeqInstr& instr) const {
+    if (instr.cmd == MML_EX_COMMAND) {
+      RSND_WARN(LOG_PARSE, "skipping unknown MML command 0x" << std::hex << (int)instr.cmd << " 0x" << (int)instr.exCmd << " at 0x" << instr.offset);
+    } else {
+      RSND_WARN(LOG_PARSE, "skipping unknown MML command 0x" << std::hex << (int)instr.cmd << " at 0x" << instr.offset);
+    }
+    instr.op = SEQ_OP_NOP;
+  }
+
+  // Decodes the command at offset with its prefixes. False if it runs past the data
+  bool decode(u32& offset, SeqInstr& instr) {
+    SeqArgType argType = SEQ_ARG_NONE;
+    SeqArgType timeType = SEQ_ARG_NONE;
+    for (;;) {
+      if (!has(offset, 1)) return false;
+      instr.cmd = data[offset++];
+      if (instr.cmd == MML_IF) instr.conditional = true;
+      else if (instr.cmd == MML_RANDOM) argType = SEQ_ARG_RANDOM;
+      else if (instr.cmd == MML_VARIABLE) argType = SEQ_ARG_VARIABLE;
+      else if (instr.cmd == MML_TIME) timeType = SEQ_ARG_S16;
+      else if (instr.cmd == MML_TIME_RANDOM) timeType = SEQ_ARG_RANDOM;
+      else if (instr.cmd == MML_TIME_VARIABLE) timeType = SEQ_ARG_VARIABLE;
+      else break;
+    }
+    auto operandType = [argType](SeqArgType defaultType) { return argType == SEQ_ARG_NONE ? defaultType : argType; };
+
+    instr.op = SEQ_OP_COMMAND;
+    switch (cmdLayouts[instr.cmd]) {
+    case LAYOUT_NOTE:
+      instr.op = SEQ_OP_NOTE;
+      if (!has(offset, 1)) return false;
+      instr.byteArg = data[offset++];
+      if (!readOperand(operandType(SEQ_ARG_VMIDI), offset, instr.arg)) return false;
+      break;
+    case LAYOUT_VMIDI:
+      if (instr.cmd == MML_WAIT) instr.op = SEQ_OP_WAIT;
+      if (!readOperand(operandType(SEQ_ARG_VMIDI), offset, instr.arg)) return false;
+      break;
+    case LAYOUT_U8:
+      if (instr.cmd == MML_NOTE_WAIT) instr.op = SEQ_OP_NOTE_WAIT;
+      if (instr.cmd == MML_LOOP_START) instr.op = SEQ_OP_LOOP_START;
+      if (!readOperand(operandType(SEQ_ARG_U8), offset, instr.arg)) return false;
+      break;
+    case LAYOUT_S16:
+      if (!readOperand(operandType(SEQ_ARG_S16), offset, instr.arg)) return false;
+      break;
+    case LAYOUT_U16:
+      if (!has(offset, 2)) return false;
+      instr.arg = {SEQ_ARG_S16, static_cast<s32>(readBe(offset, 2)), 0};
+      break;
+    case LAYOUT_OPEN_TRACK:
+      instr.op = SEQ_OP_OPEN_TRACK;
+      if (!has(offset, 4)) return false;
+      instr.byteArg = data[offset++];
+      targets.push_back({program.instrs.size(), readBe(offset, 3)});
+      break;
+    case LAYOUT_ADDRESS:
+      instr.op = instr.cmd == MML_JUMP ? SEQ_OP_JUMP : SEQ_OP_CALL;
+      if (!has(offset, 3)) return false;
+      targets.push_back({program.instrs.size(), readBe(offset, 3)});
+      break;
+    case LAYOUT_NONE:
+      if (instr.cmd == MML_RET) instr.op = SEQ_OP_RET;
+      if (instr.cmd == MML_FIN) instr.op = SEQ_OP_FIN;
+      if (instr.cmd == MML_LOOP_END) instr.op = SEQ_OP_LOOP_END;
+      break;
+    case LAYOUT_EX:
+      if (!has(offset, 1)) return false;
+      instr.exCmd = data[offset++];
+      // variable commands take a variable number and an s16, user procedures a u16, the rest nothing
+      if (instr.exCmd >= 0x80 && instr.exCmd < 0xa0) {
+        if (instr.exCmd >= MML_SETVAR && instr.exCmd <= MML_MODVAR) instr.op = SEQ_OP_VAR;
+        else if (instr.exCmd >= MML_CMP_EQ && instr.exCmd <= MML_CMP_NE) instr.op = SEQ_OP_CMP;
+        else unknown(instr);
+        if (!has(offset, 1)) return false;
+        instr.byteArg = data[offset++];
+        if (!readOperand(operandType(SEQ_ARG_S16), offset, instr.arg)) return false;
+      } else if ((instr.exCmd & 0xf0) == MML_USERPROC) {
+        if (instr.exCmd != MML_USERPROC) unknown(instr);
+        if (!has(offset, 2)) return false;
+        instr.arg = {SEQ_ARG_S16, static_cast<s32>(readBe(offset, 2)), 0};
+      } else {
+        unknown(instr);
+      }
+      break;
+    }
+    if (!knownCmds[instr.cmd]) unknown(instr);
+    return timeType == SEQ_ARG_NONE || readOperand(timeType, offset, instr.time);
+  }
+
+  // Decodes straight-line code from offset until it ends or runs into code decoded before
+  void decodeRun(u32 offset) {
+    for (;;) {
+      offset = std::min(offset, dataSize);
+      SeqInstr instr = {};
+      instr.offset = offset;
+      instr.target = SeqProgram::NO_INSTR;
+      if (instrAt[offset] != SeqProgram::NO_INSTR) {
+        instr.op = SEQ_OP_GOTO;
+        instr.target = instrAt[offset];
+        program.instrs.push_back(instr);
+        return;
+      }
+
+      instrAt[offset] = program.instrs.size();
+      u32 next = offset;
+      if (offset == dataSize || !decode(next, instr)) {
+        instr.op = SEQ_OP_INVALID;
+        if (!targets.empty() && targets.back().first == program.instrs.size()) targets.pop_back();
+      }
+      program.instrs.push_back(instr);
+      if (instr.op == SEQ_OP_OPEN_TRACK || instr.op == SEQ_OP_JUMP || instr.op == SEQ_OP_CALL) pending.push_back(targets.back().second);
+
+      const bool ends = instr.op == SEQ_OP_JUMP || instr.op == SEQ_OP_RET || instr.op == SEQ_OP_FIN;
+      if (instr.op == SEQ_OP_INVALID || (ends && !instr.conditional)) return;
+      offset = next;
+    }
+  }
+
+public:
+  Decoder(const u8* data, u32 dataSize, SeqProgram& program, std::vector<u32>& instrAt)
+      : data(data), dataSize(dataSize), program(program), instrAt(instrAt) {}
+
+  void run(const std::vector<u32>& entryOffsets) {
+    // offsets past the data share the instruction at dataSize
+    instrAt.assign(static_cast<size_t>(dataSize) + 1, SeqProgram::NO_INSTR);
+    pending = entryOffsets;
+    while (!pending.empty()) {
+      const u32 offset = std::min(pending.back(), dataSize);
+      pending.pop_back();
+      if (instrAt[offset] == SeqProgram::NO_INSTR) decodeRun(offset);
+    }
+    for (const auto& [instr, offset] : targets) program.instrs[instr].target = instrAt[std::min(offset, dataSize)];
+    RSND_INFO(LOG_PARSE, "decoded " << program.instrs.size() << " instructions from " << entryOffsets.size() << " entry points");
+  }
+};
+
+const int VARIABLE_COUNT = 16;
+// calls and loops together, as on the console
+const size_t CALL_STACK_DEPTH = 3;
+// commands a track may run without time passing before it is considered stuck
+const u32 MAX_COMMANDS_PER_TICK = 1 << 20;
+
+// a call (returning to pc) or a loop (going back to pc)
+struct StackFrame {
+  u32 pc;
+  bool loop;
+  // loops left, 0 for an endless loop
+  u32 loopCount;
+};
+
+struct PlayerState;
+
+struct TrackState {
+  PlayerState& player;
+  SeqTrackSink& sink;
+  u32 pc;
+  u32 tick;
+  bool running = true;
+  bool noteWait = false;
+  bool cmpFlag = true;
+  std::array<s16, VARIABLE_COUNT> vars;
+  std::vector<StackFrame> callStack;
+  // times each jump back or endless loop went round, by instruction
+  std::unordered_map<u32, u32> loopsTaken;
+  // variables when each conditional jump back was last taken, by instruction
+  std::unordered_map<u32, std::array<s16, 3 * VARIABLE_COUNT>> jumpStates;
+
+  TrackState(PlayerState& player, SeqTrackSink& sink, u32 pc, u32 tick) : player(player), sink(sink), pc(pc), tick(tick) { vars.fill(-1); }
+
+  s16* variable(u8 varNo);
+  s32 resolve(const SeqOperand& operand);
+  void advance(s32 duration);
+  // False once the loop ending at the current instruction went round often enough
+  bool takeLoop();
+  // A conditional jump back that goes round with every variable unchanged never ends by itself
+  bool repeatsState();
+};
+
+struct PlayerState {
+  const SeqProgram& program;
+  const SeqPlayLimits& limits;
+  // variables 0-15 are the player's, 16-31 global and 32-47 the track's
+  std::array<s16, VARIABLE_COUNT> localVars;
+  std::array<s16, VARIABLE_COUNT> globalVars;
+  // stable addresses, tracks open more tracks while running
+  std::deque<TrackState> tracks;
+};
+
+s16* TrackState::variable(u8 varNo) {
+  if (varNo < VARIABLE_COUNT) return &player.localVars[varNo];
+  if (varNo < 2 * VARIABLE_COUNT) return &player.globalVars[varNo - VARIABLE_COUNT];
+  if (varNo < 3 * VARIABLE_COUNT) return &vars[varNo - 2 * VARIABLE_COUNT];
+  return nullptr;
+}
+
+s32 TrackState::resolve(const SeqOperand& operand) {
+  switch (operand.type) {
+  case SEQ_ARG_RANDOM:
+    // to be consistent, the average of the range
+    return (operand.value + operand.max) / 2;
+  case SEQ_ARG_VARIABLE: {
+    const s16* var = variable(operand.value);
+    return var ? *var : 0;
+  }
+  default:
+    return operand.value;
+  }
+}
+
+void TrackState::advance(s32 duration) {
+  u32 ticks = std::max(duration, 0);
+  const u32 maxTicks = player.limits.maxTicks;
+  if (maxTicks != 0 && tick + static_cast<u64>(ticks) >= maxTicks) {
+    ticks = maxTicks - std::min(tick, maxTicks);
+    running = false;
+  }
+  if (ticks == 0) return;
+  sink.wait(ticks);
+  tick += ticks;
+}
+
+bool TrackState::takeLoop() {
+  return loopsTaken[pc]++ < player.limits.loopCount;
+}
+
+bool TrackState::repeatsState() {
+  std::array<s16, 3 * VARIABLE_COUNT> state;
+  std::copy(player.localVars.begin(), player.localVars.end(), state.begin());
+  std::copy(player.globalVars.begin(), player.globalVars.end(), state.begin() + VARIABLE_COUNT);
+  std::copy(vars.begin(), vars.end(), state.begin() + 2 * VARIABLE_COUNT);
+  auto [it, first] = jumpStates.try_emplace(pc, state);
+  if (first) return false;
+  const bool repeats = it->second == state;
+  it->second = state;
+  return repeats;
+}
+
+void execNote(TrackState& track, const SeqInstr& instr) {
+  const s32 duration = std::max(track.resolve(instr.arg), 0);
+  track.sink.note(instr.cmd, instr.byteArg, duration);
+  if (track.noteWait) track.advance(duration);
+}
+
+void execWait(TrackState& track, const SeqInstr& instr) {
+  track.advance(track.resolve(instr.arg));
+}
+
+void execOpenTrack(TrackState& track, const SeqInstr& instr) {
+  SeqTrackSink* sink = track.sink.openTrack(instr.byteArg);
+  if (sink) track.player.tracks.emplace_back(track.player, *sink, instr.target, track.tick);
+}
+
+void execJump(TrackState& track, const SeqInstr& instr) {
+  // a jump back is how songs loop forever, conditional ones only when nothing changes between rounds. Past the
+  // limit a conditional jump falls through, after an unconditional one the track ends
+  const bool back = track.player.program.instrs[instr.target].offset <= instr.offset;
+  if (back && (!instr.conditional || track.repeatsState()) && !track.takeLoop()) {
+    track.running = instr.conditional;
+    return;
+  }
+  RSND_TRACE(LOG_PARSE, "jump 0x" << std::hex << instr.offset << " -> 0x" << track.player.program.instrs[instr.target].offset);
+  track.pc = instr.target;
+}
+
+void execCall(TrackState& track, const SeqInstr& instr) {
+  if (track.callStack.size() == CALL_STACK_DEPTH) {
+    RSND_WARN(LOG_PARSE, "MML_CALL at 0x" << std::hex << instr.offset << " nests too deep, skipping it");
+    return;
+  }
+  RSND_TRACE(LOG_PARSE, "call 0x" << std::hex << instr.offset << " -> 0x" << track.player.program.instrs[instr.target].offset);
+  track.callStack.push_back({track.pc, false, 0});
+  track.pc = instr.target;
+}
+
+void execRet(TrackState& track, const SeqInstr&) {
+  // loops left by returning from inside them are dropped
+  while (!track.callStack.empty() && track.callStack.back().loop) track.callStack.pop_back();
+  if (track.callStack.empty()) {
+    track.running = false;
+    return;
+  }
+  track.pc = track.callStack.back().pc;
+  track.callStack.pop_back();
+  RSND_TRACE(LOG_PARSE, "return -> 0x" << std::hex << track.player.program.instrs[track.pc].offset);
+}
+
+void execFin(TrackState& track, const SeqInstr&) {
+  track.running = false;
+}
+
+void execNoteWait(TrackState& track, const SeqInstr& instr) {
+  track.noteWait = track.resolve(instr.arg) != 0;
+}
+
+void execLoopStart(TrackState& track, const SeqInstr& instr) {
+  if (track.callStack.size() == CALL_STACK_DEPTH) {
+    RSND_WARN(LOG_PARSE, "MML_LOOP_START at 0x" << std::hex << instr.offset << " nests too deep, skipping it");
+    return;
+  }
+  track.callStack.push_back({track.pc, true, static_cast<u32>(track.resolve(instr.arg) & 0xff)});
+}
+
+void execLoopEnd(TrackState& track, const SeqInstr&) {
+  if (track.callStack.empty() || !track.callStack.back().loop) return;
+  StackFrame& frame = track.callStack.back();
+  if (frame.loopCount == 0) {
+    if (!track.takeLoop()) {
+      track.running = false;
+      return;
+    }
+  } else if (--frame.loopCount == 0) {
+    track.callStack.pop_back();
+    return;
+  }
+  track.pc = frame.pc;
+}
+
+void execVar(TrackState& track, const SeqInstr& instr) {
+  s16* var = track.variable(instr.byteArg);
+  if (!var) return;
+  const s32 value = track.resolve(instr.arg);
+  s32 result = *var;
+  switch (instr.exCmd) {
+  case MML_SETVAR: result = value; break;
+  case MML_ADDVAR: result += value; break;
+  case MML_SUBVAR: result -= value; break;
+  case MML_MULVAR: result *= value; break;
+  case MML_DIVVAR: if (value != 0) result /= value; break;
+  case MML_SHIFTVAR: result = value >= 0 ? result << std::min(value, 16) : result >> std::min(-value, 16); break;
+  // a random value in [0, value], to be consistent its middle
+  case MML_RANDVAR: result = value / 2; break;
+  case MML_ANDVAR: result &= value; break;
+  case MML_ORVAR: result |= value; break;
+  case MML_XORVAR: result ^= value; break;
+  case MML_NOTVAR: result = ~value; break;
+  case MML_MODVAR: if (value != 0) result %= value; break;
+  }
+  *var = static_cast<s16>(result);
+}
+
+void execCmp(TrackState& track, const SeqInstr& instr) {
+  const s16* var = track.variable(instr.byteArg);
+  const s32 lhs = var ? *var : 0;
+  const s32 rhs = track.resolve(instr.arg);
+  switch (instr.exCmd) {
+  case MML_CMP_EQ: track.cmpFlag = lhs == rhs; break;
+  case MML_CMP_GE: track.cmpFlag = lhs >= rhs; break;
+  case MML_CMP_GT: track.cmpFlag = lhs > rhs; break;
+  case MML_CMP_LE: track.cmpFlag = lhs <= rhs; break;
+  case MML_CMP_LT: track.cmpFlag = lhs < rhs; break;
+  case MML_CMP_NE: track.cmpFlag = lhs != rhs; break;
+  }
+}
+
+void execGoto(TrackState& track, const SeqInstr& instr) {
+  track.pc = instr.target;
+}
+
+void execCommand(TrackState& track, const SeqInstr& instr) {
+  track.sink.command(instr, track.resolve(instr.arg));
+}
+
+void execNop(TrackState&, const SeqInstr&) {}
+
+void execInvalid(TrackState& track, const SeqInstr& instr) {
+  RSND_WARN(LOG_PARSE, "sequence data ends inside a command at 0x" << std::hex << instr.offset << ", ending the track");
+  track.running = false;
+}
+
+using Handler = void (*)(TrackState&, const SeqInstr&);
+
+// indexed by SeqOp
+constexpr std::array<Handler, SEQ_OP_COUNT> handlers = {
+  execNote, execWait, execOpenTrack, execJump, execCall, execRet, execFin, execNoteWait, execLoopStart, execLoopEnd,
+  execVar, execCmp, execGoto, execCommand, execNop, execInvalid,
+};
+}
+
+SeqProgram::SeqProgram(const u8* data, u32 dataSize, const std::vector<u32>& entryOffsets) {
+  Decoder(data, dataSize, *this, instrAt).run(entryOffsets);
+}
+
+SeqProgram::SeqProgram(const SoundSequence& seq, const std::vector<u32>& entryOffsets)
+    : SeqProgram(static_cast<const u8*>(seq.getSeqData()), seq.getSeqDataSize(), entryOffsets) {}
+
+void SeqInterpreter::run(u32 pc, SeqTrackSink& sink) const {
+  PlayerState player = {program, limits};
+  player.localVars.fill(-1);
+  player.globalVars.fill(-1);
+  player.tracks.emplace_back(player, sink, pc, 0);
+
+  const SeqInstr* instrs = program.instrs.data();
+  for (;;) {
+    // the running track furthest behind goes next, the first opened on ties
+    TrackState* track = nullptr;
+    for (TrackState& candidate : player.tracks) {
+      if (candidate.running && (!track || candidate.tick < track->tick)) track = &candidate;
+    }
+    if (!track) break;
+
+    // until it waits or ends
+    const u32 tick = track->tick;
+    for (u32 commands = 0; track->running && track->tick == tick; commands++) {
+      if (commands == MAX_COMMANDS_PER_TICK) {
+        RSND_WARN(LOG_PARSE, "track stuck in a loop without waits at 0x" << std::hex << instrs[track->pc].offset << ", ending it");
+        track->running = false;
+        break;
+      }
+      const SeqInstr& instr = instrs[track->pc++];
+      if (instr.conditional && !track->cmpFlag) continue;
+      handlers[instr.op](*track, instr);
+    }
+  }
+}
+}
@@ -0,0 +1,536 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <numbers>
+
+#include "common/log.hpp"
+#include "common/mix.hpp"
+#include "rsnd/SeqRenderer.hpp"
+#include "rsnd/SoundWave.hpp"
+#include "rsnd/SoundWaveArchive.hpp"
+
+namespace rsnd {
+BankWaves::BankWaves(const SoundBank& bank, void* waveData, size_t waveSize) {
+  if (bank.containsWaves) {
+    waves.resize(bank.getWaveInfoCount());
+    for (int i = 0; i < bank.getWaveInfoCount(); i++) {
+      const WaveInfo* waveInfo = bank.getWaveInfo(i);
+      Wave& wave = waves[i];
+      wave.sampleRate = waveInfo->sampleRate;
+      wave.loop = waveInfo->loop;
+      wave.loopStart = waveLoopStart(waveInfo);
+      wave.frameCount = waveLoopEnd(waveInfo);
+      wave.channelCount = std::min<u8>(waveInfo->channelCount, 2);
+      for (int c = 0; c < wave.channelCount; c++) {
+        const SoundWaveChannelInfo* chInfo = bank.getChannelInfo(waveInfo, c);
+        const u8* blockData = static_cast<const u8*>(waveData) + waveInfo->dataLoc + chInfo->dataOffset;
+        wave.channels[c].resize(wave.frameCount + 1);
+        decodeBlock(blockData, wave.frameCount, wave.channels[c].data(), 1, waveInfo->format, bank.getAdpcParams(waveInfo, chInfo));
+      }
+    }
+  } else {
+    SoundWaveArchive waveArchive(waveData, waveSize);
+    waves.resize(waveArchive.getWaveCount());
+    for (u32 i = 0; i < waveArchive.getWaveCount(); i++) {
+      size_t rwavSize;
+      void* rwavData = waveArchive.getWaveFile(i, rwavSize);
+      Wave& wave = waves[i];
+      wave.frameCount = 0;
+      wave.channelCount = 0;
+      if (rwavSize == 0) continue;
+      const SoundWave soundWave(rwavData, rwavSize);
+      wave.sampleRate = soundWave.getTrackSampleRate();
+      wave.loop = soundWave.isLooped();
+      wave.loopStart = soundWave.getLoopStart();
+      wave.frameCount = soundWave.getLoopEnd();
+      wave.channelCount = std::min<u8>(soundWave.getChannelCount(), 2);
+      for (int c = 0; c < wave.channelCount; c++) {
+        wave.channels[c].resize(std::max(soundWave.getTrackSampleCount(), wave.frameCount + 1));
+        soundWave.decodeChannel(c, wave.channels[c].data());
+        wave.channels[c].resize(wave.frameCount + 1);
+      }
+    }
+  }
+
+  for (Wave& wave : waves) {
+    if (wave.loop && wave.loopStart >= wave.frameCount) wave.loop = false;
+    for (int c = 0; c < wave.channelCount; c++) wave.channels[c][wave.frameCount] = wave.loop ? wave.channels[c][wave.loopStart] : 0;
+  }
+}
+
+namespace {
+// as many as the console's DSP plays at once
+const u32 MAX_VOICES = 96;
+// 1ms, envelopes and gains change between blocks
+const u32 BLOCK_FRAMES = 32;
+// frames handed to the sink at once
+const u32 CHUNK_FRAMES = 4096;
+const u32 NO_TICK = 0xffffffff;
+// the envelope's floor, a voice released this far down has ended
+const f64 SILENT_DB = -90.25;
+// longest a note may take to fade out after the sequence ends
+const f64 MAX_RELEASE_MS = 5000;
+const s32 DEFAULT_TIMEBASE = 48;
+const s32 DEFAULT_TEMPO = 120;
+
+// A note or a command of one track
+struct RenderEvent {
+  u32 tick;
+  u16 track;
+  bool note;
+  // the key of a note, the Mml command otherwise
+  u8 cmd;
+  u8 velocity;
+  // the duration of a note, the command's last operand otherwise
+  s32 value;
+};
+
+// Records what a track does. The interpreter runs the track furthest behind first, so events of all tracks arrive
+// in tick order
+class EventSink : public SeqTrackSink {
+private:
+  std::vector<RenderEvent>& events;
+  std::deque<EventSink>& sinks;
+  u16 track;
+  u32 tick;
+
+public:
+  EventSink(std::vector<RenderEvent>& events, std::deque<EventSink>& sinks, u16 track, u32 tick) : events(events), sinks(sinks), track(track), tick(tick) {}
+
+  u32 getTick() const { return tick; }
+
+  void note(u8 key, u8 velocity, s32 duration) override {
+    events.push_back({tick, track, true, key, velocity, duration});
+  }
+
+  void wait(s32 duration) override {
+    tick += duration;
+  }
+
+  SeqTrackSink* openTrack(u8) override {
+    return &sinks.emplace_back(events, sinks, static_cast<u16>(sinks.size()), tick);
+  }
+
+  void command(const SeqInstr& instr, s32 value) override {
+    events.push_back({tick, track, false, instr.cmd, 0, value});
+  }
+};
+
+// Output frame of every tick following MML_TEMPO and MML_TIMEBASE. Only depends on where the tempo changed, so
+// both passes over the events agree on it to the frame
+class TickClock {
+private:
+  u32 changeTick = 0;
+  f64 changeFrame = 0;
+  s32 tempo = DEFAULT_TEMPO;
+  s32 timebase = DEFAULT_TIMEBASE;
+
+  f64 framesPerTick() const {
+    // a tempo of 0 stops the sequence, no time passes
+    return tempo > 0 && timebase > 0 ? SeqRenderer::SAMPLE_RATE * 60.0 / (static_cast<f64>(tempo) * timebase) : 0;
+  }
+  f64 frameAt(u32 tick) const { return changeFrame + (tick - changeTick) * framesPerTick(); }
+
+public:
+  u64 framesAt(u32 tick) const { return static_cast<u64>(frameAt(tick)); }
+
+  void apply(const RenderEvent& event) {
+    if (event.note || (event.cmd != MML_TEMPO && event.cmd != MML_TIMEBASE)) return;
+    changeFrame = frameAt(event.tick);
+    changeTick = event.tick;
+    (event.cmd == MML_TEMPO ? tempo : timebase) = event.cmd == MML_TEMPO ? static_cast<s16>(event.value) : event.value;
+  }
+};
+
+// 0-127 to a gain, squared like MIDI volumes
+f32 volumeGain(s32 value) {
+  const f32 gain = std::clamp(value, 0, 127) / 127.0f;
+  return gain * gain;
+}
+
+struct TrackParams {
+  u32 program = 0;
+  f32 volume = 1;
+  f32 volume2 = 1;
+  // from the center, -64 to 63
+  s32 pan = 0;
+  s32 transpose = 0;
+  s8 bend = 0;
+  u8 bendRange = 2;
+  bool monophonic = false;
+  // MML_ATTACK, MML_DECAY, MML_SUSTAIN, MML_RELEASE and MML_ENV_HOLD, -1 plays the instrument's
+  s16 attack = -1;
+  s16 decay = -1;
+  s16 sustain = -1;
+  s16 release = -1;
+  s16 hold = -1;
+
+  void apply(u8 cmd, s32 value) {
+    switch (cmd) {
+    case MML_PRG: program = value; break;
+    case MML_VOLUME: volume = volumeGain(value); break;
+    case MML_VOLUME2: volume2 = volumeGain(value); break;
+    case MML_PAN: pan = std::clamp(value, 0, 127) - 64; break;
+    case MML_TRANSPOSE: transpose = static_cast<s8>(value); break;
+    case MML_PITCH_BEND: bend = static_cast<s8>(value); break;
+    case MML_BEND_RANGE: bendRange = value; break;
+    case MML_MONOPHONIC: monophonic = value != 0; break;
+    case MML_ATTACK: attack = value & 0x7f; break;
+    case MML_DECAY: decay = value & 0x7f; break;
+    case MML_SUSTAIN: sustain = value & 0x7f; break;
+    case MML_RELEASE: release = value & 0x7f; break;
+    case MML_ENV_HOLD: hold = value & 0x7f; break;
+    case MML_ENV_RESET: attack = decay = sustain = release = hold = -1; break;
+    }
+  }
+
+  s8 envelopeValue(s16 override, s8 instrValue) const { return override >= 0 ? override : instrValue; }
+
+  // the instrument region a note plays, nullptr if there is none. key is the note's key after transposing
+  const InstrInfo* instrument(const SoundBank& bank, u8 noteKey, u8 velocity, u8& key) const {
+    key = std::clamp(noteKey + transpose, 0, 127);
+    if (program >= bank.getInstrCount() || velocity > 127) return nullptr;
+    return bank.getInstrInfo(program, key, velocity);
+  }
+
+  // milliseconds a note of instr takes to fade out completely from full volume
+  f64 releaseMs(const InstrInfo& instr) const {
+    return SILENT_DB / envelopeFallRate(envelopeValue(release, instr.release));
+  }
+};
+
+// Attack, hold, decay to the sustain level and release, in decibels like the console's envelope generator. The
+// attack rises linearly in amplitude
+class Envelope {
+private:
+  enum Stage : u8 { ATTACK, HOLD, DECAY, RELEASE, DONE };
+
+  Stage stage;
+  f64 attackMs;
+  f64 holdMs;
+  f64 decayRate;
+  f64 sustainDb;
+  f64 releaseRate;
+  // time in the attack or hold stage
+  f64 stageMs;
+  f64 db;
+
+public:
+  void start(const InstrInfo& instr, const TrackParams& track) {
+    attackMs = envelopeAttackMs(track.envelopeValue(track.attack, instr.attack));
+    holdMs = envelopeHoldMs(track.envelopeValue(track.hold, instr.hold));
+    decayRate = envelopeFallRate(track.envelopeValue(track.decay, instr.decay));
+    const s8 sustain = track.envelopeValue(track.sustain, instr.sustain);
+    sustainDb = sustain > 0 ? std::max(40 * std::log10(sustain / 127.0), SILENT_DB) : SILENT_DB;
+    releaseRate = envelopeFallRate(track.envelopeValue(track.release, instr.release));
+    stage = ATTACK;
+    stageMs = 0;
+    db = 0;
+  }
+
+  f32 amplitude() const {
+    switch (stage) {
+    case ATTACK: return attackMs > stageMs ? static_cast<f32>(stageMs / attackMs) : 1;
+    case DONE: return 0;
+    default: return static_cast<f32>(std::pow(10.0, db / 20));
+    }
+  }
+
+  bool done() const { return stage == DONE; }
+
+  void release() {
+    if (stage == ATTACK) db = std::max(20 * std::log10(std::max<f64>(amplitude(), 1e-5)), SILENT_DB);
+    if (stage != DONE) stage = RELEASE;
+  }
+
+  void advance(f64 ms) {
+    switch (stage) {
+    case ATTACK:
+    case HOLD:
+      stageMs += ms;
+      if (stage == ATTACK && stageMs >= attackMs) {
+        stage = HOLD;
+        stageMs = 0;
+      }
+      if (stage == HOLD && stageMs >= holdMs) stage = DECAY;
+      break;
+    case DECAY:
+      db = std::max(db + decayRate * ms, sustainDb);
+      // decayed to silence, nothing left to release
+      if (db <= SILENT_DB) stage = DONE;
+      break;
+    case RELEASE:
+      db += releaseRate * ms;
+      if (db <= SILENT_DB) stage = DONE;
+      break;
+    case DONE:
+      break;
+    }
+  }
+};
+
+struct Voice {
+  const BankWaves::Wave* wave;
+  u16 track;
+  // wave frames per output frame at the note's key, before pitch bend
+  f64 step;
+  // velocity and instrument volume
+  f32 gain;
+  u8 pan;
+  // 32.32 fixed point frames into the wave
+  u64 position;
+  // tick the note ends, NO_TICK once released
+  u32 offTick;
+  // order voices started in, the oldest is taken over when all are playing
+  u64 started;
+  Envelope envelope;
+};
+
+// Left and right gain of a pan position, 0 dB in the center and on the loud side
+std::pair<f32, f32> panGains(s32 pan) {
+  const f64 angle = std::clamp(pan, 0, 127) / 127.0 * std::numbers::pi / 2;
+  return {static_cast<f32>(std::min(1.0, std::numbers::sqrt2 * std::cos(angle))), static_cast<f32>(std::min(1.0, std::numbers::sqrt2 * std::sin(angle)))};
+}
+
+class Synth {
+private:
+  const SoundBank& bank;
+  const BankWaves& waves;
+  PcmSink& sink;
+  std::vector<TrackParams> tracks;
+  f32 mainVolume = 1;
+
+  // the pool, voices are taken from freeVoices and returned when they end
+  std::array<Voice, MAX_VOICES> voices;
+  std::vector<u16> freeVoices;
+  std::vector<u16> activeVoices;
+  u64 voicesStarted = 0;
+
+  // frames the sink still expects
+  u64 framesLeft;
+  // planar mix of the current chunk
+  std::vector<f32> left;
+  std::vector<f32> right;
+  u32 buffered = 0;
+  std::vector<s16> pcm;
+  // one block of a voice, resampled
+  std::array<s16, BLOCK_FRAMES> voicePcm[2];
+
+  u16 takeVoice() {
+    if (freeVoices.empty()) {
+      // the quietest released voice, or else the oldest
+      auto quieter = [this](u16 a, u16 b) {
+        const Voice& va = voices[a];
+        const Voice& vb = voices[b];
+        if ((va.offTick == NO_TICK) != (vb.offTick == NO_TICK)) return va.offTick == NO_TICK;
+        return va.offTick == NO_TICK ? va.envelope.amplitude() < vb.envelope.amplitude() : va.started < vb.started;
+      };
+      auto taken = std::min_element(activeVoices.begin(), activeVoices.end(), quieter);
+      RSND_TRACE(LOG_DECODE, "all " << MAX_VOICES << " voices playing, taking over voice " << *taken);
+      freeVoices.push_back(*taken);
+      *taken = activeVoices.back();
+      activeVoices.pop_back();
+    }
+    const u16 voice = freeVoices.back();
+    freeVoices.pop_back();
+    activeVoices.push_back(voice);
+    return voice;
+  }
+
+  void noteOn(const RenderEvent& event) {
+    const TrackParams& track = tracks[event.track];
+    if (track.monophonic) releaseTrack(event.track);
+    u8 key;
+    const InstrInfo* instr = track.instrument(bank, event.cmd, event.velocity, key);
+    if (!instr || instr->waveIdx >= waves.waves.size() || waves.waves[instr->waveIdx].frameCount == 0) {
+      RSND_TRACE(LOG_DECODE, "nothing plays key " << (int)key << " of program " << track.program);
+      return;
+    }
+    const BankWaves::Wave& wave = waves.waves[instr->waveIdx];
+    const f64 pitch = std::isfinite(instr->pitch) && instr->pitch > 0 ? instr->pitch : 1;
+
+    Voice& voice = voices[takeVoice()];
+    voice.wave = &wave;
+    voice.track = event.track;
+    voice.step = static_cast<f64>(wave.sampleRate) / SeqRenderer::SAMPLE_RATE * pitch * std::exp2((key - instr->originalKey) / 12.0);
+    voice.gain = volumeGain(event.velocity) * volumeGain(instr->volume);
+    voice.pan = instr->pan;
+    voice.position = 0;
+    voice.offTick = event.tick + std::max(event.value, 0);
+    voice.started = voicesStarted++;
+    voice.envelope.start(*instr, track);
+  }
+
+  void releaseTrack(u16 track) {
+    for (u16 v : activeVoices) {
+      if (voices[v].track == track && voices[v].offTick != NO_TICK) {
+        voices[v].offTick = NO_TICK;
+        voices[v].envelope.release();
+      }
+    }
+  }
+
+  // Resamples up to count frames of the voice's wave into voicePcm, linearly interpolated. Fewer once a wave
+  // without a loop ends
+  u32 resample(Voice& voice, u64 step, u32 count) {
+    const BankWaves::Wave& wave = *voice.wave;
+    const u64 end = static_cast<u64>(wave.frameCount) << 32;
+    const u64 loopStart = static_cast<u64>(wave.loopStart) << 32;
+    for (u32 i = 0; i < count; i++) {
+      if (voice.position >= end) {
+        if (!wave.loop) return i;
+        voice.position = loopStart + (voice.position - loopStart) % (end - loopStart);
+      }
+      const u32 index = voice.position >> 32;
+      // 15 bits, so the products below fit
+      const s32 frac = (voice.position >> 17) & 0x7fff;
+      for (int c = 0; c < wave.channelCount; c++) {
+        const s16* samples = wave.channels[c].data() + index;
+        voicePcm[c][i] = static_cast<s16>(samples[0] + (((samples[1] - samples[0]) * frac) >> 15));
+      }
+      voice.position += step;
+    }
+    return count;
+  }
+
+  // Mixes count frames of the voice into the chunk at offset. False once it has ended
+  bool playVoice(Voice& voice, u32 offset, u32 count) {
+    const TrackParams& track = tracks[voice.track];
+    f64 step = voice.step;
+    if (track.bend != 0) step *= std::exp2(track.bend / 128.0 * track.bendRange / 12);
+    const u32 played = resample(voice, static_cast<u64>(step * 4294967296.0), count);
+
+    // the level at the end of the block, so that notes without attack start right away
+    voice.envelope.advance(count * 1000.0 / SeqRenderer::SAMPLE_RATE);
+    const f32 gain = voice.envelope.amplitude() * voice.gain * track.volume * track.volume2 * mainVolume;
+    if (gain > 0) {
+      const auto [leftGain, rightGain] = panGains(voice.pan + track.pan);
+      mixAccumulate(left.data() + offset, voicePcm[0].data(), played, gain * leftGain);
+      mixAccumulate(right.data() + offset, voicePcm[voice.wave->channelCount - 1].data(), played, gain * rightGain);
+    }
+    return played == count && !voice.envelope.done();
+  }
+
+  void mixBlock(u32 offset, u32 count) {
+    for (size_t i = 0; i < activeVoices.size();) {
+      if (playVoice(voices[activeVoices[i]], offset, count)) {
+        i++;
+        continue;
+      }
+      freeVoices.push_back(activeVoices[i]);
+      activeVoices[i] = activeVoices.back();
+      activeVoices.pop_back();
+    }
+  }
+
+public:
+  Synth(const SoundBank& bank, const BankWaves& waves, size_t trackCount, PcmSink& sink, u64 frameCount)
+      : bank(bank), waves(waves), sink(sink), tracks(trackCount), framesLeft(frameCount), left(CHUNK_FRAMES), right(CHUNK_FRAMES), pcm(CHUNK_FRAMES * 2) {
+    for (u16 v = MAX_VOICES; v-- > 0;) freeVoices.push_back(v);
+  }
+
+  void play(const RenderEvent& event) {
+    if (event.note) {
+      noteOn(event);
+    } else if (event.cmd == MML_MAIN_VOLUME) {
+      mainVolume = volumeGain(event.value);
+    } else {
+      tracks[event.track].apply(event.cmd, event.value);
+    }
+  }
+
+  // the first tick a playing note ends, NO_TICK if none
+  u32 nextNoteOff() const {
+    u32 tick = NO_TICK;
+    for (u16 v : activeVoices) tick = std::min(tick, voices[v].offTick);
+    return tick;
+  }
+
+  // notes ending by tick, or all notes
+  void releaseNotes(u32 tick = NO_TICK) {
+    for (u16 v : activeVoices) {
+      if (voices[v].offTick <= tick) {
+        voices[v].offTick = NO_TICK;
+        voices[v].envelope.release();
+      }
+    }
+  }
+
+  void render(u64 frames) {
+    frames = std::min(frames, framesLeft);
+    framesLeft -= frames;
+    while (frames > 0) {
+      const u32 count = std::min<u64>({frames, BLOCK_FRAMES, CHUNK_FRAMES - buffered});
+      mixBlock(buffered, count);
+      buffered += count;
+      frames -= count;
+      if (buffered == CHUNK_FRAMES) flush();
+    }
+  }
+
+  void flush() {
+    const f32* channels[2] = {left.data(), right.data()};
+    mixToPcm16(channels, 2, buffered, pcm.data());
+    sink.write(pcm.data(), buffered);
+    std::fill(left.begin(), left.begin() + buffered, 0.0f);
+    std::fill(right.begin(), right.begin() + buffered, 0.0f);
+    buffered = 0;
+  }
+};
+}
+
+void SeqRenderer::render(const SoundSequence& seq, u32 offset, PcmSink& sink) const {
+  const SeqProgram program(seq, {offset});
+  std::vector<RenderEvent> events;
+  std::deque<EventSink> sinks;
+  SeqInterpreter(program, limits).run(program.indexOf(offset), sinks.emplace_back(events, sinks, 0, 0));
+
+  // the length has to be known up front: until the last track ends or note stops, then the longest release
+  u32 endTick = 0;
+  for (const EventSink& track : sinks) endTick = std::max(endTick, track.getTick());
+  TickClock clock;
+  std::vector<TrackParams> tracks(sinks.size());
+  f64 releaseMs = 0;
+  for (const RenderEvent& event : events) {
+    clock.apply(event);
+    if (!event.note) {
+      tracks[event.track].apply(event.cmd, event.value);
+      continue;
+    }
+    endTick = std::max<u32>(endTick, event.tick + std::max(event.value, 0));
+    u8 key;
+    const InstrInfo* instr = tracks[event.track].instrument(bank, event.cmd, event.velocity, key);
+    if (instr) releaseMs = std::max(releaseMs, tracks[event.track].releaseMs(*instr));
+  }
+  const u64 endFrame = clock.framesAt(endTick);
+  const u64 fullLength = endFrame + static_cast<u64>(std::min(releaseMs, MAX_RELEASE_MS) * SAMPLE_RATE / 1000);
+  if (fullLength > UINT32_MAX) RSND_WARN(LOG_DECODE, "sequence plays for " << fullLength / SAMPLE_RATE << "s, cut to the first " << UINT32_MAX / SAMPLE_RATE << "s, see --max-ticks");
+  const u32 frameCount = std::min<u64>(fullLength, UINT32_MAX);
+  RSND_INFO(LOG_DECODE, "rendering " << events.size() << " events of " << sinks.size() << " tracks into " << frameCount << " frames");
+
+  sink.begin(SAMPLE_RATE, 2, frameCount);
+  Synth synth(bank, waves, sinks.size(), sink, frameCount);
+  TickClock playClock;
+  u64 rendered = 0;
+  size_t next = 0;
+  // up to each tick something happens at, notes ending before notes starting
+  for (;;) {
+    const u32 tick = std::min(next < events.size() ? events[next].tick : NO_TICK, synth.nextNoteOff());
+    if (tick == NO_TICK) break;
+    const u64 frame = playClock.framesAt(tick);
+    synth.render(frame - rendered);
+    rendered = frame;
+    synth.releaseNotes(tick);
+    for (; next < events.size() && events[next].tick == tick; next++) {
+      playClock.apply(events[next]);
+      synth.play(events[next]);
+    }
+  }
+  synth.render(endFrame - rendered);
+  synth.releaseNotes();
+  synth.render(frameCount);
+  synth.flush();
+  sink.end();
+}
+}
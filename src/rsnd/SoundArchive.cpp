@@ -1,8 +1,9 @@
 
 #include <bit>
-#include <iostream>
+#include <cstring>
 
 #include "rsnd/SoundArchive.hpp"
+#include "common/log.hpp"
 
 namespace rsnd {
 void SoundArchiveHeader::bswap() {
@@ -61,6 +62,11 @@ void SoundInfoEntry::bswap() {
   _24 = std::byteswap(_24);
 }
 
+void Sound3DParam::bswap() {
+  flags = std::byteswap(flags);
+  _8 = std::byteswap(_8);
+}
+
 void SeqSoundInfo::bswap() {
   offset = std::byteswap(offset);
   bankIdx = std::byteswap(bankIdx);
@@ -246,12 +252,32 @@ SoundArchive::SoundArchive(void* fileData, size_t fileSize) {
       break;
     
     } default:
-      std::cerr << "Warning: Unknown sound type " << soundInfoEntry->soundType << '\n';
+      RSND_WARN(LOG_PARSE, "Unknown sound type " << soundInfoEntry->soundType);
       break;
     }
   }
 }
 
+s32 SoundArchive::findSound(const char* name) const {
+  const StringTree* tree = soundStringTree;
+  if (tree->rootIdx >= tree->nodes.size) return -1;
+
+  // walk down the patricia tree by the bits of name, then check the leaf is really name
+  const size_t length = strlen(name);
+  const StringTreeNode* node = &tree->nodes.elems[tree->rootIdx];
+  while (!(node->flags & StringTreeNode::FLAG_LEAF)) {
+    const size_t pos = node->bit >> 3;
+    const bool bit = pos < length && (static_cast<u8>(name[pos]) & (0x80 >> (node->bit & 7)));
+    const u32 nodeIdx = bit ? node->rightIdx : node->leftIdx;
+    if (nodeIdx >= tree->nodes.size) return -1;
+    node = &tree->nodes.elems[nodeIdx];
+  }
+
+  if (node->strIdx < 0 || static_cast<u32>(node->strIdx) >= stringTable->size) return -1;
+  const char* leafName = static_cast<const char*>(getOffset(symbBase, stringTable->elems[node->strIdx]));
+  return strcmp(leafName, name) == 0 ? node->id : -1;
+}
+
 const FileGroup* SoundArchive::getFileGroup(u32 fileIdx, u32 fileGroupIdx) const {
   const FileGroupInfo* fileGroupInfo = getFileGroupInfo(fileIdx);
   return static_cast<FileGroup*>(fileGroupInfo->elems[fileGroupIdx].getAddr(infoBase));
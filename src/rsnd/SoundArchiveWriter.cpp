@@ -0,0 +1,714 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <sstream>
+
+#include "rsnd/SoundArchiveWriter.hpp"
+#include "rsnd/SoundWaveArchive.hpp"
+#include "common/binaryWriter.hpp"
+#include "common/log.hpp"
+
+namespace rsnd {
+namespace {
+const u32 FILE_ALIGNMENT = 0x20;
+
+u64 alignUp(u64 value, u32 alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool isNullRef(const DataRef& ref) {
+  return ref.refType == REFTYPE_ADDRESS && ref.value == 0;
+}
+
+// ==== manifest text ====
+template <typename... T>
+void writeFields(std::ostream& out, const char* keyword, const T&... fields) {
+  out << keyword;
+  ((out << ' ' << static_cast<s64>(fields)), ...);
+}
+
+template <typename T>
+void readField(std::istream& in, T& field) {
+  s64 value = 0;
+  in >> value;
+  field = static_cast<T>(value);
+}
+
+template <typename... T>
+void readFields(std::istream& in, T&... fields) {
+  (readField(in, fields), ...);
+}
+
+// quoted, or - when absent
+void writeOptionalString(std::ostream& out, const std::optional<std::string>& value) {
+  if (value) {
+    out << ' ' << std::quoted(*value);
+  } else {
+    out << " -";
+  }
+}
+
+std::optional<std::string> readOptionalString(std::istream& in) {
+  in >> std::ws;
+  if (in.peek() == '-') {
+    in.get();
+    return std::nullopt;
+  }
+  std::string value;
+  in >> std::quoted(value);
+  return value;
+}
+
+std::optional<std::string> relativePath(const std::filesystem::path& path, const std::filesystem::path& base) {
+  if (path.empty()) return std::nullopt;
+  return path.lexically_relative(base).generic_string();
+}
+
+std::filesystem::path resolvePath(const std::optional<std::string>& path, const std::filesystem::path& base) {
+  return path ? base / *path : std::filesystem::path();
+}
+
+// ==== SYMB ====
+struct TreeEntry {
+  const std::string* name;
+  s32 strIdx;
+  s32 id;
+};
+
+bool testBit(const std::string& str, u32 bit) {
+  u32 pos = bit >> 3;
+  return pos < str.size() && (static_cast<u8>(str[pos]) & (0x80 >> (bit & 7)));
+}
+
+// Patricia tree over names sorted bytewise. All names in a sorted range share the prefix before the
+// first bit where its first and last name differ, so that bit splits the range in two
+u32 buildTree(std::vector<StringTreeNode>& nodes, std::span<const TreeEntry> entries) {
+  const u32 nodeIdx = nodes.size();
+  nodes.push_back({});
+
+  const std::string& first = *entries.front().name;
+  const std::string& last = *entries.back().name;
+  size_t pos = 0;
+  const size_t length = std::max(first.size(), last.size());
+  auto byteAt = [](const std::string& str, size_t i) -> u8 { return i < str.size() ? str[i] : 0; };
+  while (pos < length && byteAt(first, pos) == byteAt(last, pos)) pos++;
+
+  StringTreeNode node = {};
+  if (pos == length) {
+    if (entries.size() > 1) RSND_WARN(LOG_IO, "duplicate name " << first << " in string tree");
+    node.flags = StringTreeNode::FLAG_LEAF;
+    node.leftIdx = -1;
+    node.rightIdx = -1;
+    node.strIdx = entries.front().strIdx;
+    node.id = entries.front().id;
+  } else {
+    const u32 bit = pos * 8 + std::countl_zero(static_cast<u8>(byteAt(first, pos) ^ byteAt(last, pos)));
+    auto split = std::partition_point(entries.begin(), entries.end(), [&](const TreeEntry& entry) { return !testBit(*entry.name, bit); });
+    node.bit = bit;
+    node.leftIdx = buildTree(nodes, {entries.begin(), split});
+    node.rightIdx = buildTree(nodes, {split, entries.end()});
+    node.strIdx = -1;
+    node.id = -1;
+  }
+  nodes[nodeIdx] = node;
+  return nodeIdx;
+}
+
+// entries are (strIdx, id) pairs, names outside the string table are skipped
+u32 writeStringTree(BinaryWriter& out, const std::vector<std::string>& strings, const std::vector<std::pair<s32, s32>>& names) {
+  std::vector<TreeEntry> entries;
+  for (const auto& [strIdx, id] : names) {
+    if (strIdx >= 0 && static_cast<u32>(strIdx) < strings.size()) entries.push_back({&strings[strIdx], strIdx, id});
+  }
+  std::stable_sort(entries.begin(), entries.end(), [](const TreeEntry& a, const TreeEntry& b) { return *a.name < *b.name; });
+
+  std::vector<StringTreeNode> nodes;
+  const u32 rootIdx = entries.empty() ? 0xffffffff : buildTree(nodes, entries);
+
+  out.align(4);
+  const u32 treeOffset = out.writeInt<u32>(rootIdx);
+  out.writeInt<u32>(nodes.size());
+  for (const auto& node : nodes) out.writeStruct(node);
+  return treeOffset;
+}
+
+void writeSymb(BinaryWriter& out, const SoundArchiveManifest& manifest) {
+  const u32 symbOffset = out.tell();
+  SymbHeader symb = {};
+  memcpy(symb.magic, "SYMB", 4);
+  out.writeStruct(symb);
+  const u32 symbBase = symbOffset + sizeof(BinaryBlockHeader);
+
+  symb.nameTableOffset = out.writeInt<u32>(manifest.strings.size()) - symbBase;
+  const u32 stringOffsets = out.tell();
+  for (size_t i = 0; i < manifest.strings.size(); i++) out.writeInt<u32>(0);
+  for (size_t i = 0; i < manifest.strings.size(); i++) {
+    out.patchInt<u32>(stringOffsets + i * sizeof(u32), out.tell() - symbBase);
+    out.write(manifest.strings[i].c_str(), manifest.strings[i].size() + 1);
+  }
+
+  std::vector<std::pair<s32, s32>> names;
+  for (size_t i = 0; i < manifest.sounds.size(); i++) names.push_back({manifest.sounds[i].info.fileNameIdx, i});
+  symb.soundTreeOffset = writeStringTree(out, manifest.strings, names) - symbBase;
+  names.clear();
+  for (size_t i = 0; i < manifest.players.size(); i++) names.push_back({manifest.players[i].fileNameIdx, i});
+  symb.playerTreeOffset = writeStringTree(out, manifest.strings, names) - symbBase;
+  names.clear();
+  for (size_t i = 0; i < manifest.groups.size(); i++) names.push_back({manifest.groups[i].info.nameIdx, i});
+  symb.groupTreeOffset = writeStringTree(out, manifest.strings, names) - symbBase;
+  names.clear();
+  for (size_t i = 0; i < manifest.banks.size(); i++) names.push_back({manifest.banks[i].fileNameIdx, i});
+  symb.bankTreeOffset = writeStringTree(out, manifest.strings, names) - symbBase;
+
+  symb.length = finishBlock(out, symbOffset);
+  out.patchStruct(symbOffset, symb);
+}
+
+// ==== FILE ====
+struct FilePiece {
+  std::filesystem::path path;
+  u64 offset;
+  u64 size;
+  std::optional<u64> hash;
+
+  u64 getHash() {
+    if (!hash) hash = hashFile(path);
+    return *hash;
+  }
+};
+
+// Group item data laid out back to back from the start of the FILE block data. A file identical to
+// one already in the current region (same hash, then same bytes) reuses its offset, regions stay contiguous as GroupInfo only has
+// one offset and size for each
+class FileLayout {
+private:
+  size_t regionPiece = 0;
+  u64 regionStart = 0;
+
+public:
+  std::vector<FilePiece> pieces;
+  u64 end = 0;
+
+  void beginRegion() {
+    end = alignUp(end, FILE_ALIGNMENT);
+    regionPiece = pieces.size();
+    regionStart = end;
+  }
+
+  // offset in the region
+  u64 place(const std::filesystem::path& path, u64& size) {
+    size = 0;
+    if (path.empty()) return end - regionStart;
+    std::error_code error;
+    size = std::filesystem::file_size(path, error);
+    if (error) {
+      std::cerr << "Failed to open file " << path << std::endl;
+      exit(-1);
+    }
+    if (size == 0) return end - regionStart;
+
+    FilePiece piece = {path, 0, size, std::nullopt};
+    for (size_t i = regionPiece; i < pieces.size(); i++) {
+      FilePiece& other = pieces[i];
+      if (other.size != size) continue;
+      if (other.path == path || (other.getHash() == piece.getHash() && sameFileContents(other.path, path))) return other.offset - regionStart;
+    }
+
+    end = alignUp(end, FILE_ALIGNMENT);
+    piece.offset = end;
+    pieces.push_back(piece);
+    end += size;
+    return piece.offset - regionStart;
+  }
+
+  u64 regionSize() const { return alignUp(end, FILE_ALIGNMENT) - regionStart; }
+};
+
+u32 checkedOffset(u64 offset) {
+  if (offset > 0xffffffff) {
+    std::cerr << "Archive would be larger than 4GB\n";
+    exit(-1);
+  }
+  return offset;
+}
+
+// ==== INFO ====
+u32 writeRefTable(BinaryWriter& out, u32 count) {
+  out.align(4);
+  const u32 tableOffset = out.writeInt<u32>(count);
+  for (u32 i = 0; i < count; i++) out.writeStruct(DataRef{});
+  return tableOffset;
+}
+
+void patchRef(BinaryWriter& out, u32 tableOffset, u32 idx, DataRef ref) {
+  out.patchStruct(tableOffset + sizeof(u32) + idx * sizeof(DataRef), ref);
+}
+
+// null terminated and 4 byte aligned, a null ref when absent
+DataRef writeOptionalName(BinaryWriter& out, u32 infoBase, const std::optional<std::string>& name) {
+  if (!name) return DataRef{};
+  const u32 offset = out.tell();
+  out.write(name->c_str(), name->size() + 1);
+  out.align(4);
+  return offsetRef(offset - infoBase);
+}
+}
+
+SoundArchiveManifest getArchiveManifest(const SoundArchive& soundArchive) {
+  SoundArchiveManifest manifest;
+  manifest.version = soundArchive.getVersion();
+
+  for (u32 i = 0; i < soundArchive.stringTable->size; i++) {
+    manifest.strings.push_back(static_cast<const char*>(getOffset(soundArchive.symbBase, soundArchive.stringTable->elems[i])));
+  }
+
+  for (int i = 0; i < soundArchive.soundTable->size; i++) {
+    ManifestSound sound = {};
+    sound.info = *soundArchive.getSoundInfo(i);
+    if (!isNullRef(sound.info.sound3dParam)) {
+      // left big endian by SoundArchive
+      Sound3DParam param3d;
+      memcpy(&param3d, sound.info.sound3dParam.getAddr(soundArchive.infoBase), sizeof(Sound3DParam));
+      param3d.bswap();
+      sound.param3d = param3d;
+    }
+    switch (sound.info.soundType) {
+    case SoundInfoEntry::TYPE_SEQ:
+      sound.seqInfo = *soundArchive.getSeqSoundInfo(&sound.info);
+      break;
+    case SoundInfoEntry::TYPE_STRM:
+      sound.strmInfo = *soundArchive.getStrmSoundInfo(&sound.info);
+      break;
+    case SoundInfoEntry::TYPE_WAVE:
+      sound.wsdInfo = *soundArchive.getWsdSoundInfo(&sound.info);
+      break;
+    }
+    manifest.sounds.push_back(sound);
+  }
+
+  for (int i = 0; i < soundArchive.bankTable->size; i++) manifest.banks.push_back(*soundArchive.getBankInfo(i));
+  for (int i = 0; i < soundArchive.playerTable->size; i++) {
+    manifest.players.push_back(*static_cast<PlayerInfo*>(soundArchive.playerTable->elems[i].getAddr(soundArchive.infoBase)));
+  }
+
+  for (int i = 0; i < soundArchive.fileTable->size; i++) {
+    ManifestFile file = {*soundArchive.getFileInfo(i), std::nullopt};
+    if (soundArchive.isFileExternal(i)) file.external = soundArchive.getFileExternalPath(i);
+    manifest.files.push_back(file);
+  }
+
+  for (int i = 0; i < soundArchive.groupTable->size; i++) {
+    const GroupInfo* groupInfo = soundArchive.getGroupInfo(i);
+    ManifestGroup group = {*groupInfo, std::nullopt, {}};
+    if (soundArchive.isGroupExternal(i)) group.external = soundArchive.getGroupExternalPath(i);
+    for (int j = 0; j < soundArchive.getGroupSize(groupInfo); j++) {
+      group.items.push_back({*soundArchive.getGroupItemInfo(i, j), {}, {}});
+    }
+    manifest.groups.push_back(group);
+  }
+
+  manifest.counts = *soundArchive.soundCountTable;
+  return manifest;
+}
+
+void writeArchiveManifest(const std::filesystem::path& path, const SoundArchiveManifest& manifest) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cerr << "Error opening file " << path << " for writing!" << std::endl;
+    exit(-1);
+  }
+  const std::filesystem::path base = path.parent_path();
+
+  out << "# mrst archive manifest, item paths are relative to this file\n";
+  out << "rsar 0x" << std::hex << std::setw(4) << std::setfill('0') << manifest.version << std::dec << '\n';
+  for (const auto& str : manifest.strings) out << "string " << std::quoted(str) << '\n';
+
+  for (const auto& sound : manifest.sounds) {
+    const SoundInfoEntry& info = sound.info;
+    writeFields(out, "sound", info.fileNameIdx, info.fileIdx, info.playerId, info.volume, info.playerPriority, info.soundType,
+                info.remoteFilter, info._20, info._24, info.panMode, info.panCurve, info.actorPlayerId, info._2a);
+    out << '\n';
+    if (sound.param3d) {
+      const Sound3DParam& param3d = *sound.param3d;
+      writeFields(out, "3d", param3d.flags, param3d.decayCurve, param3d.decayRatio, param3d.dopplerFactor, param3d._7, param3d._8);
+      out << '\n';
+    }
+    switch (info.soundType) {
+    case SoundInfoEntry::TYPE_SEQ:
+      writeFields(out, "seq", sound.seqInfo.offset, sound.seqInfo.bankIdx, sound.seqInfo._8, sound.seqInfo._c, sound.seqInfo._d, sound.seqInfo._10);
+      out << '\n';
+      break;
+    case SoundInfoEntry::TYPE_STRM:
+      writeFields(out, "strm", sound.strmInfo.startPos, sound.strmInfo._4, sound.strmInfo._6, sound.strmInfo._8);
+      out << '\n';
+      break;
+    case SoundInfoEntry::TYPE_WAVE:
+      writeFields(out, "wsd", sound.wsdInfo.idx, sound.wsdInfo._4, sound.wsdInfo._8, sound.wsdInfo._9, sound.wsdInfo._c);
+      out << '\n';
+      break;
+    }
+  }
+
+  for (const auto& bank : manifest.banks) {
+    writeFields(out, "bank", bank.fileNameIdx, bank.fileIdx, bank._c);
+    out << '\n';
+  }
+  for (const auto& player : manifest.players) {
+    writeFields(out, "player", player.fileNameIdx, player.soundCount, player._8);
+    out << '\n';
+  }
+  for (const auto& file : manifest.files) {
+    writeFields(out, "file", file.info.fileSize, file.info.waveDataSize, file.info._8);
+    writeOptionalString(out, file.external);
+    out << '\n';
+  }
+  for (const auto& group : manifest.groups) {
+    const GroupInfo& info = group.info;
+    writeFields(out, "group", info.nameIdx, info.fileOffset, info.fileSize, info.waveDataOffset, info.waveDataSize);
+    writeOptionalString(out, group.external);
+    out << '\n';
+    for (const auto& item : group.items) {
+      writeFields(out, "item", item.info.fileIdx, item.info.fileOffset, item.info.fileSize, item.info.waveDataOffset, item.info.waveDataSize, item.info._14);
+      writeOptionalString(out, relativePath(item.filePath, base));
+      writeOptionalString(out, relativePath(item.wavePath, base));
+      out << '\n';
+    }
+  }
+
+  const SoundCountTable& counts = manifest.counts;
+  writeFields(out, "counts", counts.seqSoundCount, counts.seqTrackCount, counts.strmSoundCount, counts.strmTrackCount,
+              counts.strmChannelCount, counts.waveSoundCount, counts.waveTrackCount, counts._e, counts._10);
+  out << '\n';
+}
+
+SoundArchiveManifest readArchiveManifest(const std::filesystem::path& path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Failed to open file " << path << std::endl;
+    exit(-1);
+  }
+  const std::filesystem::path base = path.parent_path();
+
+  SoundArchiveManifest manifest = {};
+  manifest.version = 0x0104;
+  std::string line;
+  for (int lineNum = 1; std::getline(in, line); lineNum++) {
+    std::istringstream fields(line);
+    std::string keyword;
+    fields >> keyword;
+    if (keyword.empty() || keyword[0] == '#') continue;
+
+    auto fail = [&](const char* reason) {
+      std::cerr << path.string() << ":" << lineNum << ": " << reason << '\n';
+      exit(-1);
+    };
+
+    if (keyword == "rsar") {
+      fields >> std::hex >> manifest.version >> std::dec;
+    } else if (keyword == "string") {
+      std::string str;
+      fields >> std::quoted(str);
+      manifest.strings.push_back(str);
+    } else if (keyword == "sound") {
+      ManifestSound sound = {};
+      SoundInfoEntry& info = sound.info;
+      readFields(fields, info.fileNameIdx, info.fileIdx, info.playerId, info.volume, info.playerPriority, info.soundType,
+                 info.remoteFilter, info._20, info._24, info.panMode, info.panCurve, info.actorPlayerId, info._2a);
+      manifest.sounds.push_back(sound);
+    } else if (keyword == "3d" || keyword == "seq" || keyword == "strm" || keyword == "wsd") {
+      if (manifest.sounds.empty()) fail("sound details before any sound");
+      ManifestSound& sound = manifest.sounds.back();
+      if (keyword == "3d") {
+        Sound3DParam param3d = {};
+        readFields(fields, param3d.flags, param3d.decayCurve, param3d.decayRatio, param3d.dopplerFactor, param3d._7, param3d._8);
+        sound.param3d = param3d;
+      } else if (keyword == "seq") {
+        readFields(fields, sound.seqInfo.offset, sound.seqInfo.bankIdx, sound.seqInfo._8, sound.seqInfo._c, sound.seqInfo._d, sound.seqInfo._10);
+      } else if (keyword == "strm") {
+        readFields(fields, sound.strmInfo.startPos, sound.strmInfo._4, sound.strmInfo._6, sound.strmInfo._8);
+      } else {
+        readFields(fields, sound.wsdInfo.idx, sound.wsdInfo._4, sound.wsdInfo._8, sound.wsdInfo._9, sound.wsdInfo._c);
+      }
+    } else if (keyword == "bank") {
+      BankInfo bank = {};
+      readFields(fields, bank.fileNameIdx, bank.fileIdx, bank._c);
+      manifest.banks.push_back(bank);
+    } else if (keyword == "player") {
+      PlayerInfo player = {};
+      readFields(fields, player.fileNameIdx, player.soundCount, player._8);
+      manifest.players.push_back(player);
+    } else if (keyword == "file") {
+      ManifestFile file = {};
+      readFields(fields, file.info.fileSize, file.info.waveDataSize, file.info._8);
+      file.external = readOptionalString(fields);
+      manifest.files.push_back(file);
+    } else if (keyword == "group") {
+      ManifestGroup group = {};
+      GroupInfo& info = group.info;
+      readFields(fields, info.nameIdx, info.fileOffset, info.fileSize, info.waveDataOffset, info.waveDataSize);
+      group.external = readOptionalString(fields);
+      manifest.groups.push_back(group);
+    } else if (keyword == "item") {
+      if (manifest.groups.empty()) fail("item before any group");
+      ManifestGroupItem item = {};
+      readFields(fields, item.info.fileIdx, item.info.fileOffset, item.info.fileSize, item.info.waveDataOffset, item.info.waveDataSize, item.info._14);
+      item.filePath = resolvePath(readOptionalString(fields), base);
+      item.wavePath = resolvePath(readOptionalString(fields), base);
+      if (item.info.fileIdx >= manifest.files.size()) fail("item file index out of range");
+      manifest.groups.back().items.push_back(item);
+    } else if (keyword == "counts") {
+      SoundCountTable& counts = manifest.counts;
+      readFields(fields, counts.seqSoundCount, counts.seqTrackCount, counts.strmSoundCount, counts.strmTrackCount,
+                 counts.strmChannelCount, counts.waveSoundCount, counts.waveTrackCount, counts._e, counts._10);
+    } else {
+      fail("unknown entry");
+    }
+
+    if (fields.fail()) fail("malformed entry");
+  }
+  return manifest;
+}
+
+FilePlan planSoundArchive(const SoundArchiveManifest& manifest) {
+  // lay out the FILE block first, INFO only needs the final offsets
+  std::vector<ManifestGroup> groups = manifest.groups;
+  std::vector<ManifestFile> files = manifest.files;
+  std::vector<bool> fileSized(files.size());
+  FileLayout layout;
+  for (auto& group : groups) {
+    if (group.external) continue;
+
+    layout.beginRegion();
+    group.info.fileOffset = checkedOffset(layout.end);
+    for (auto& item : group.items) {
+      u64 size;
+      item.info.fileOffset = layout.place(item.filePath, size);
+      item.info.fileSize = size;
+    }
+    group.info.fileSize = layout.regionSize();
+
+    layout.beginRegion();
+    group.info.waveDataOffset = checkedOffset(layout.end);
+    for (auto& item : group.items) {
+      u64 size;
+      item.info.waveDataOffset = layout.place(item.wavePath, size);
+      item.info.waveDataSize = size;
+      if (!fileSized[item.info.fileIdx] && !files[item.info.fileIdx].external) {
+        files[item.info.fileIdx].info.fileSize = item.info.fileSize;
+        files[item.info.fileIdx].info.waveDataSize = item.info.waveDataSize;
+        fileSized[item.info.fileIdx] = true;
+      }
+    }
+    group.info.waveDataSize = layout.regionSize();
+  }
+
+  // the groups each file is in
+  std::vector<std::vector<FileGroup>> fileGroups(files.size());
+  for (u32 g = 0; g < groups.size(); g++) {
+    for (u32 i = 0; i < groups[g].items.size(); i++) fileGroups[groups[g].items[i].info.fileIdx].push_back({g, i});
+  }
+
+  BinaryWriter out;
+  out.write(std::vector<u8>(0x40).data(), 0x40);
+
+  const u32 symbOffset = out.tell();
+  writeSymb(out, manifest);
+  const u32 symbSize = out.tell() - symbOffset;
+
+  const u32 infoOffset = out.tell();
+  SoundArchiveInfo info = {};
+  memcpy(info.magic, "INFO", 4);
+  out.writeStruct(info);
+  const u32 infoBase = infoOffset + sizeof(BinaryBlockHeader);
+
+  const u32 soundTable = writeRefTable(out, manifest.sounds.size());
+  info.soundTable = offsetRef(soundTable - infoBase);
+  for (u32 i = 0; i < manifest.sounds.size(); i++) {
+    const ManifestSound& sound = manifest.sounds[i];
+    const u32 entryOffset = out.writeStruct(sound.info);
+    patchRef(out, soundTable, i, offsetRef(entryOffset - infoBase));
+
+    SoundInfoEntry entry = sound.info;
+    entry.sound3dParam = DataRef{};
+    entry.extendedInfoRef = DataRef{};
+    if (sound.param3d) entry.sound3dParam = offsetRef(out.writeStruct(*sound.param3d) - infoBase);
+    switch (sound.info.soundType) {
+    case SoundInfoEntry::TYPE_SEQ:
+      entry.extendedInfoRef = offsetRef(out.writeStruct(sound.seqInfo) - infoBase, entry.soundType);
+      break;
+    case SoundInfoEntry::TYPE_STRM:
+      entry.extendedInfoRef = offsetRef(out.writeStruct(sound.strmInfo) - infoBase, entry.soundType);
+      break;
+    case SoundInfoEntry::TYPE_WAVE:
+      entry.extendedInfoRef = offsetRef(out.writeStruct(sound.wsdInfo) - infoBase, entry.soundType);
+      break;
+    }
+    out.patchStruct(entryOffset, entry);
+  }
+
+  const u32 bankTable = writeRefTable(out, manifest.banks.size());
+  info.bankTable = offsetRef(bankTable - infoBase);
+  for (u32 i = 0; i < manifest.banks.size(); i++) {
+    patchRef(out, bankTable, i, offsetRef(out.writeStruct(manifest.banks[i]) - infoBase));
+  }
+
+  const u32 playerTable = writeRefTable(out, manifest.players.size());
+  info.playerTable = offsetRef(playerTable - infoBase);
+  for (u32 i = 0; i < manifest.players.size(); i++) {
+    patchRef(out, playerTable, i, offsetRef(out.writeStruct(manifest.players[i]) - infoBase));
+  }
+
+  const u32 fileTable = writeRefTable(out, files.size());
+  info.fileTable = offsetRef(fileTable - infoBase);
+  for (u32 i = 0; i < files.size(); i++) {
+    const u32 fileInfoOffset = out.writeStruct(files[i].info);
+    patchRef(out, fileTable, i, offsetRef(fileInfoOffset - infoBase));
+
+    FileInfo fileInfo = files[i].info;
+    fileInfo.externalFileName = writeOptionalName(out, infoBase, files[i].external);
+    const u32 fileGroupTable = writeRefTable(out, fileGroups[i].size());
+    fileInfo.fileGroupInfo = offsetRef(fileGroupTable - infoBase);
+    for (u32 j = 0; j < fileGroups[i].size(); j++) {
+      patchRef(out, fileGroupTable, j, offsetRef(out.writeStruct(fileGroups[i][j]) - infoBase));
+    }
+    out.patchStruct(fileInfoOffset, fileInfo);
+  }
+
+  // internal group offsets are relative to the FILE data until its position is known
+  std::vector<std::pair<u32, GroupInfo>> groupInfos;
+  const u32 groupTable = writeRefTable(out, groups.size());
+  info.groupTable = offsetRef(groupTable - infoBase);
+  for (u32 i = 0; i < groups.size(); i++) {
+    const u32 groupInfoOffset = out.writeStruct(groups[i].info);
+    patchRef(out, groupTable, i, offsetRef(groupInfoOffset - infoBase));
+
+    GroupInfo groupInfo = groups[i].info;
+    groupInfo.entryNum = groups[i].items.size();
+    groupInfo.externalFileName = writeOptionalName(out, infoBase, groups[i].external);
+    const u32 itemTable = writeRefTable(out, groups[i].items.size());
+    groupInfo.groupItemTable = offsetRef(itemTable - infoBase);
+    for (u32 j = 0; j < groups[i].items.size(); j++) {
+      patchRef(out, itemTable, j, offsetRef(out.writeStruct(groups[i].items[j].info) - infoBase));
+    }
+    groupInfos.push_back({groupInfoOffset, groupInfo});
+  }
+
+  info.soundCountTable = offsetRef(out.writeStruct(manifest.counts) - infoBase);
+  const u32 infoSize = finishBlock(out, infoOffset);
+  info.length = infoSize;
+  out.patchStruct(infoOffset, info);
+
+  const u32 fileOffset = out.tell();
+  writeBlockHeader(out, "FILE");
+  out.align(FILE_ALIGNMENT);
+  const u32 fileDataOffset = out.tell();
+  const u32 fileSize = checkedOffset(fileDataOffset + alignUp(layout.end, FILE_ALIGNMENT)) - fileOffset;
+  out.patchInt<u32>(fileOffset + offsetof(BinaryBlockHeader, length), fileSize);
+
+  for (u32 i = 0; i < groups.size(); i++) {
+    auto& [groupInfoOffset, groupInfo] = groupInfos[i];
+    if (!groups[i].external) {
+      groupInfo.fileOffset = checkedOffset(u64(fileDataOffset) + groupInfo.fileOffset);
+      groupInfo.waveDataOffset = checkedOffset(u64(fileDataOffset) + groupInfo.waveDataOffset);
+    }
+    out.patchStruct(groupInfoOffset, groupInfo);
+  }
+
+  SoundArchiveHeader header = {};
+  initFileHeader(header, "RSAR", manifest.version, fileOffset + fileSize, 0x40, 3);
+  header.symbBlockOffset = symbOffset;
+  header.symbBlockSize = symbSize;
+  header.infoBlockOffset = infoOffset;
+  header.infoBlockSize = infoSize;
+  header.fileBlockOffset = fileOffset;
+  header.fileBlockSize = fileSize;
+  out.patchStruct(0, header);
+
+  FilePlan plan;
+  plan.addBytes(out.getBytes());
+  for (const auto& piece : layout.pieces) {
+    plan.addBytes(std::vector<u8>(fileDataOffset + piece.offset - plan.size()));
+    plan.addFile(piece.path, 0, piece.size);
+  }
+  plan.align(FILE_ALIGNMENT);
+  return plan;
+}
+
+namespace {
+// Header and TABL of a BRWAR whose wave data is laid out as `entries` (offset and size from the start of the wave
+// data) in dataSize bytes. dataBlockOffset is where the DATA block starts, its header is the end of the returned bytes
+std::vector<u8> writeWaveArchiveHeader(const std::vector<std::pair<u64, u64>>& entries, u64 dataSize, u32& dataBlockOffset) {
+  BinaryWriter out;
+  out.write(std::vector<u8>(sizeof(SoundWaveArchiveHeader)).data(), sizeof(SoundWaveArchiveHeader));
+
+  const u32 tableOffset = out.tell();
+  writeBlockHeader(out, "TABL");
+  out.writeInt<u32>(entries.size());
+  dataBlockOffset = alignUp(out.tell() + entries.size() * sizeof(SoundWaveArchiveEntry), FILE_ALIGNMENT);
+  // wave data starts 0x20 bytes into DATA, entry refs are relative to the DATA block
+  const u32 dataStart = FILE_ALIGNMENT;
+  for (const auto& [offset, size] : entries) {
+    SoundWaveArchiveEntry entry = {offsetRef(checkedOffset(dataStart + offset)), static_cast<u32>(size)};
+    out.writeStruct(entry);
+  }
+  const u32 tableLength = finishBlock(out, tableOffset);
+
+  writeBlockHeader(out, "DATA");
+  out.align(FILE_ALIGNMENT);
+  const u32 dataLength = checkedOffset(dataStart + alignUp(dataSize, FILE_ALIGNMENT));
+  out.patchInt<u32>(dataBlockOffset + offsetof(BinaryBlockHeader, length), dataLength);
+
+  SoundWaveArchiveHeader header = {};
+  initFileHeader(header, "RWAR", 0x0100, checkedOffset(u64(dataBlockOffset) + dataLength), sizeof(SoundWaveArchiveHeader), 2);
+  header.tableOffset = tableOffset;
+  header.tableLength = tableLength;
+  header.waveDataOffset = dataBlockOffset;
+  header.waveDataLength = dataLength;
+  out.patchStruct(0, header);
+  return out.getBytes();
+}
+}
+
+FilePlan planSoundWaveArchive(const std::vector<std::filesystem::path>& waves) {
+  FileLayout layout;
+  layout.beginRegion();
+  std::vector<std::pair<u64, u64>> entries;
+  for (const auto& wave : waves) {
+    u64 size;
+    u64 offset = layout.place(wave, size);
+    entries.push_back({offset, size});
+  }
+
+  u32 dataBlockOffset;
+  FilePlan plan;
+  plan.addBytes(writeWaveArchiveHeader(entries, layout.end, dataBlockOffset));
+  for (const auto& piece : layout.pieces) {
+    plan.addBytes(std::vector<u8>(dataBlockOffset + FILE_ALIGNMENT + piece.offset - plan.size()));
+    plan.addFile(piece.path, 0, piece.size);
+  }
+  plan.align(FILE_ALIGNMENT);
+  return plan;
+}
+
+std::vector<u8> buildSoundWaveArchive(const std::vector<std::vector<u8>>& waves) {
+  std::vector<std::pair<u64, u64>> entries;
+  u64 dataSize = 0;
+  for (const auto& wave : waves) {
+    dataSize = alignUp(dataSize, FILE_ALIGNMENT);
+    entries.push_back({dataSize, wave.size()});
+    dataSize += wave.size();
+  }
+
+  u32 dataBlockOffset;
+  std::vector<u8> bytes = writeWaveArchiveHeader(entries, dataSize, dataBlockOffset);
+  bytes.resize(dataBlockOffset + FILE_ALIGNMENT + alignUp(dataSize, FILE_ALIGNMENT));
+  for (size_t i = 0; i < waves.size(); i++) {
+    std::copy(waves[i].begin(), waves[i].end(), bytes.begin() + dataBlockOffset + FILE_ALIGNMENT + entries[i].first);
+  }
+  return bytes;
+}
+}
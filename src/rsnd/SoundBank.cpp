@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <iostream>
 
 #include "rsnd/SoundBank.hpp"
@@ -15,6 +16,19 @@ static int roundUp(int numToRound, int multiple) {
 }
 
 namespace rsnd {
+namespace {
+// as the SF2 conversion has always read them, mostly taken from https://github.com/soneek/3DSUSoundArchiveTool
+const f64 attackTable[128] = {13122, 6546, 4356, 3261, 2604, 2163, 1851, 1617, 1434, 1287, 1167, 1068, 984, 912, 849, 795, 747, 702, 666, 630, 600, 570, 543, 519, 498, 477, 459, 441, 426, 411, 396, 384, 372, 360, 348, 336, 327, 318, 309, 300, 294, 285, 279, 270, 264, 258, 252, 246, 240, 234, 231, 225, 219, 216, 210, 207, 201, 198, 195, 192, 186, 183, 180, 177, 174, 171, 168, 165, 162, 159, 156, 153.5, 153, 150, 147, 144, 141.5, 141, 138, 135.5, 135, 132, 129.5, 129, 126, 123.5, 123, 120.5, 120, 117, 114.5, 114, 111.5, 111, 108.5, 108, 105.7, 105.35, 105, 102.5, 102, 99.5, 99, 96.7, 96.35, 96, 93.5, 93, 90, 87, 81, 75, 72, 69, 63, 60, 54, 48, 45, 39, 36, 30, 24, 21, 15, 12, 9, 6.1e-6};
+const f64 holdTable[128] = {6e-6, 1, 2, 4, 6, 9, 12, 16, 20, 25, 30, 36, 42, 49, 56, 64, 72, 81, 90, 100, 110, 121, 132, 144, 156, 169, 182, 196, 210, 225, 240, 256, 272, 289, 306, 324, 342, 361, 380, 400, 420, 441, 462, 484, 506, 529, 552, 576, 600, 625, 650, 676, 702, 729, 756, 784, 812, 841, 870, 900, 930, 961, 992, 1024, 1056, 1089, 1122, 1156, 1190, 1225, 1260, 1296, 1332, 1369, 1406, 1444, 1482, 1521, 1560, 1600, 1640, 1681, 1722, 1764, 1806, 1849, 1892, 1936, 1980, 2025, 2070, 2116, 2162, 2209, 2256, 2304, 2352, 2401, 2450, 2500, 2550, 2601, 2652, 2704, 2756, 2809, 2862, 2916, 2970, 3025, 3080, 3136, 3192, 3249, 3306, 3364, 3422, 3481, 3540, 3600, 3660, 3721, 3782, 3844, 3906, 3969, 4032, 4096};
+const f64 fallRateTable[128] = {-0.00016, -0.00047, -0.00078, -0.00109, -0.00141, -0.00172, -0.00203, -0.00234, -0.00266, -0.00297, -0.00328, -0.00359, -0.00391, -0.00422, -0.00453, -0.00484, -0.00516, -0.00547, -0.00578, -0.00609, -0.00641, -0.00672, -0.00703, -0.00734, -0.00766, -0.00797, -0.00828, -0.00859, -0.00891, -0.00922, -0.00953, -0.00984, -0.01016, -0.01047, -0.01078, -0.01109, -0.01141, -0.01172, -0.01203, -0.01234, -0.01266, -0.01297, -0.01328, -0.01359, -0.01391, -0.01422, -0.01453, -0.01484, -0.01516, -0.01547, -0.01579, -0.016, -0.01622, -0.01644, -0.01667, -0.0169, -0.01714, -0.01739, -0.01765, -0.01791, -0.01818, -0.01846, -0.01875, -0.01905, -0.01935, -0.01967, -0.02, -0.02034, -0.02069, -0.02105, -0.02143, -0.02182, -0.02222, -0.02264, -0.02308, -0.02353, -0.024, -0.02449, -0.025, -0.02553, -0.02609, -0.02667, -0.02727, -0.02791, -0.02857, -0.02927, -0.03, -0.03077, -0.03158, -0.03243, -0.03333, -0.03429, -0.03529, -0.03636, -0.0375, -0.03871, -0.04, -0.04138, -0.04286, -0.04444, -0.04615, -0.048, -0.05, -0.05217, -0.05455, -0.05714, -0.06, -0.06316, -0.06667, -0.07059, -0.075, -0.08, -0.08571, -0.09231, -1, -0.10909, -0.12, -0.13333, -0.15, -0.17143, -2, -2.4, -3, -4, -6, -12, -24, -65535};
+
+int envelopeIndex(s8 value) { return std::clamp<int>(value, 0, 127); }
+}
+
+f64 envelopeAttackMs(s8 attack) { return attackTable[envelopeIndex(attack)]; }
+f64 envelopeHoldMs(s8 hold) { return holdTable[envelopeIndex(hold)]; }
+f64 envelopeFallRate(s8 decay) { return fallRateTable[envelopeIndex(decay)]; }
+
 void SoundBankHeader::bswap() {
   this->BinaryFileHeader::bswap();
   dataOffset = std::byteswap(dataOffset);
@@ -34,7 +48,8 @@ void InstrInfo::bswap() {
 
 void IndexRegion::bswap() {
   _2 = std::byteswap(_2);
-  for (int i = 0; i < max - min; i++) {
+  // max is inclusive
+  for (int i = 0; i <= max - min; i++) {
     regionRefs[i].bswap();
   }
 }
@@ -85,7 +100,7 @@ SoundBank::SoundBank(void* fileData, size_t fileSize, void* waveData) {
         if (falseEndian && waveInfo->format == WaveInfo::FORMAT_PCM16 && waveData != nullptr) {
           // audio samples also need byteswap in this case
           s16* blockData = reinterpret_cast<s16*>((u8*)waveData + waveInfo->dataLoc + chInfo->dataOffset);
-          u32 sampleCount = dspAddressToSamples(waveInfo->loopEnd);
+          u32 sampleCount = waveLoopEnd(waveInfo);
           for (int sample = 0; sample < sampleCount; sample++) {
             blockData[sample] = std::byteswap(blockData[sample]);
           }
@@ -98,14 +113,18 @@ SoundBank::SoundBank(void* fileData, size_t fileSize, void* waveData) {
 
   // Each instrument has a region for note and a subregion for velocity
   // i is the index of the instrument. Regions are followed according to chosen key+velocity to get to InstrInfo
+  std::unordered_set<u32> swapped;
   for (int i = 0; i < bankData->instrs.size; i++) {
     auto& regionRef = bankData->instrs.elems[i];
-    bswapRegionsRecurse(regionRef);
+    bswapRegionsRecurse(regionRef, swapped);
   }
+
+  buildRegionTable();
 }
 
-void SoundBank::bswapRegionsRecurse(DataRef& regionRef) {
+void SoundBank::bswapRegionsRecurse(DataRef& regionRef, std::unordered_set<u32>& swapped) {
   RegionSet regionType = static_cast<RegionSet>(regionRef.dataType);
+  if (regionType != REGIONSET_NONE && !swapped.insert(regionRef.value).second) return;
   switch (regionType) {
   case REGIONSET_RANGE: {
     RangeTable* rangeTable = regionRef.getAddr<RangeTable>(dataBase);
@@ -113,14 +132,14 @@ void SoundBank::bswapRegionsRecurse(DataRef& regionRef) {
     for (int i = 0; i < rangeTable->rangeCount; i++) {
       DataRef* dataRef = getSubregionRef(&regionRef, rangeTable->key[i]);
       dataRef->bswap();
-      bswapRegionsRecurse(*dataRef);
+      bswapRegionsRecurse(*dataRef, swapped);
     }
     break;
   } case REGIONSET_INDEX: {
     IndexRegion* indexRegion = regionRef.getAddr<IndexRegion>(dataBase);
     indexRegion->bswap();
-    for (int i = indexRegion->min; i < indexRegion->max; i++) {
-      bswapRegionsRecurse(*getSubregionRef(&regionRef, i));
+    for (int i = indexRegion->min; i <= indexRegion->max; i++) {
+      bswapRegionsRecurse(*getSubregionRef(&regionRef, i), swapped);
     }
     break;
   } case REGIONSET_DIRECT: {
@@ -141,13 +160,16 @@ DataRef* SoundBank::getSubregionRef(const DataRef* ref, int idx) const {
   case REGIONSET_RANGE: {
     RangeTable* rangeTable = ref->getAddr<RangeTable>(dataBase);
     u8 i = 0;
-    while (idx > rangeTable->key[i]) {
+    while (i < rangeTable->rangeCount && idx > rangeTable->key[i]) {
       i++;
     }
+    // above the last range
+    if (i == rangeTable->rangeCount) return nullptr;
     int offset = roundUp(sizeof(rangeTable->rangeCount) + rangeTable->rangeCount, 4) + sizeof(DataRef) * i;
     return getOffsetT<DataRef>(rangeTable, offset);
   } case REGIONSET_INDEX: {
     IndexRegion* indexRegion = ref->getAddr<IndexRegion>(dataBase);
+    if (idx < indexRegion->min || idx > indexRegion->max) return nullptr;
     return &indexRegion->regionRefs[idx - indexRegion->min];
   } case REGIONSET_DIRECT: {
     return const_cast<DataRef*>(ref);
@@ -160,21 +182,17 @@ DataRef* SoundBank::getSubregionRef(const DataRef* ref, int idx) const {
   return nullptr;
 }
 
-InstrInfo* SoundBank::getInstrInfo(int progIdx, int key, int velocity) {
-  // programs -> keys -> velocities
-  DataRef* ref = &bankData->instrs.elems[progIdx];
-
-  if (ref->dataType == REGIONSET_NONE) return nullptr;
-  if (ref->dataType != REGIONSET_DIRECT) {
-    ref = getSubregionRef(ref, key);
-  }
-
-  if (ref->dataType == REGIONSET_NONE) return nullptr;
-  if (ref->dataType != REGIONSET_DIRECT) {
-    ref = getSubregionRef(ref, velocity);
+InstrInfo* SoundBank::getInstrInfo(int progIdx, int key, int velocity) const {
+  if (!lookupTable.empty()) {
+    const u16 region = lookupTable[(progIdx * 128 + key) * 128 + velocity];
+    return region == NO_REGION ? nullptr : regions[regionStarts[progIdx] + region].instrInfo;
   }
 
-  return ref->getAddr<InstrInfo>(dataBase);
+  // programs -> keys -> velocities
+  const DataRef* ref = &bankData->instrs.elems[progIdx];
+  if (ref->dataType != REGIONSET_DIRECT) ref = getSubregionRef(ref, key);
+  if (ref && ref->dataType != REGIONSET_DIRECT) ref = getSubregionRef(ref, velocity);
+  return ref && ref->dataType == REGIONSET_DIRECT ? ref->getAddr<InstrInfo>(dataBase) : nullptr;
 }
 
 std::vector<SoundBank::Subregion> SoundBank::getSubregions(const DataRef* regionRef) const {
@@ -185,22 +203,22 @@ std::vector<SoundBank::Subregion> SoundBank::getSubregions(const DataRef* region
     std::vector<SoundBank::Subregion> subregions;
     for (int i = 0; i < rangeTable->rangeCount; i++) {
       DataRef* dataRef = getSubregionRef(regionRef, rangeTable->key[i]);
-      Subregion region = {rangeTable->key[i], dataRef};
+      Subregion region = {static_cast<s16>(i > 0 ? rangeTable->key[i - 1] + 1 : 0), rangeTable->key[i], dataRef};
       subregions.push_back(region);
     }
     return subregions;
   } case REGIONSET_INDEX: {
     IndexRegion* indexRegion = regionRef->getAddr<IndexRegion>(dataBase);
     std::vector<SoundBank::Subregion> subregions;
-    for (u8 i = indexRegion->min; i < indexRegion->max; i++) {
+    for (int i = indexRegion->min; i <= indexRegion->max; i++) {
       DataRef* dataRef = getSubregionRef(regionRef, i);
-      Subregion region = {i, dataRef};
+      Subregion region = {static_cast<s16>(i), static_cast<s16>(i), dataRef};
       subregions.push_back(region);
     }
     return subregions;
   } case REGIONSET_DIRECT: {
     InstrInfo* instrInfo = regionRef->getAddr<InstrInfo>(dataBase);
-    return { { 0x7F, regionRef } };
+    return { { 0, 0x7F, regionRef } };
   } case REGIONSET_NONE: {
     return {};
   } default:
@@ -209,33 +227,43 @@ std::vector<SoundBank::Subregion> SoundBank::getSubregions(const DataRef* region
   }
 }
 
-std::vector<SoundBank::InstrumentRegion> SoundBank::getInstrRegions(int progIdx) const {
-  std::vector<SoundBank::InstrumentRegion> instrRegions;
-  DataRef* ref = &bankData->instrs.elems[progIdx];
-
-  // key ranges
-  std::vector<SoundBank::Subregion> keyRegions = getSubregions(ref);
-  for (int i = 0; i < keyRegions.size(); i++) {
-    u8 keyLo = (i > 0) ? keyRegions[i - 1].high + 1 : 0;
-    u8 keyHi = keyRegions[i].high;
-
-    // velocity ranges
-    std::vector<SoundBank::Subregion> velRegions = getSubregions(keyRegions[i].ref);
-    for (int j = 0; j < velRegions.size(); j++) {
-      u8 velLo = (j > 0) ? velRegions[j - 1].high + 1 : 0;
-      u8 velHi = velRegions[j].high;
-      InstrInfo* instrInfo = velRegions[j].ref->getAddr<InstrInfo>(dataBase);
-
-      InstrumentRegion instrRegion;
-      instrRegion.keyLo = keyLo;
-      instrRegion.keyHi = keyHi;
-      instrRegion.velLo = velLo;
-      instrRegion.velHi = velHi;
-      instrRegion.instrInfo = instrInfo;
-      instrRegions.push_back(instrRegion);
+void SoundBank::buildLookupTable() {
+  if (!lookupTable.empty()) return;
+  lookupTable.assign(getInstrCount() * 128 * 128, NO_REGION);
+  for (u32 progIdx = 0; progIdx < getInstrCount(); progIdx++) {
+    auto progRegions = getInstrRegions(progIdx);
+    // regions of the same program do not overlap
+    for (u32 i = 0; i < progRegions.size(); i++) {
+      const InstrumentRegion& region = progRegions[i];
+      for (int key = region.keyLo; key <= std::min<int>(region.keyHi, 127); key++) {
+        u16* row = &lookupTable[(progIdx * 128 + key) * 128];
+        std::fill(row + region.velLo, row + std::min<int>(region.velHi, 127) + 1, i);
+      }
     }
   }
+}
+
+void SoundBank::buildRegionTable() {
+  for (int progIdx = 0; progIdx < bankData->instrs.size; progIdx++) {
+    regionStarts.push_back(regions.size());
+    DataRef* ref = &bankData->instrs.elems[progIdx];
+
+    // key ranges
+    std::vector<SoundBank::Subregion> keyRegions = getSubregions(ref);
+    for (int i = 0; i < keyRegions.size(); i++) {
+      // velocity ranges
+      std::vector<SoundBank::Subregion> velRegions = getSubregions(keyRegions[i].ref);
+      for (int j = 0; j < velRegions.size(); j++) {
+        // velocities without an instrument
+        if (velRegions[j].ref->dataType != REGIONSET_DIRECT) continue;
+        InstrInfo* instrInfo = velRegions[j].ref->getAddr<InstrInfo>(dataBase);
 
-  return instrRegions;
+        if (instrInfo->waveIdx >= waveRegions.size()) waveRegions.resize(instrInfo->waveIdx + 1, -1);
+        if (waveRegions[instrInfo->waveIdx] < 0) waveRegions[instrInfo->waveIdx] = regions.size();
+        regions.push_back({keyRegions[i].low, keyRegions[i].high, velRegions[j].low, velRegions[j].high, instrInfo});
+      }
+    }
+  }
+  regionStarts.push_back(regions.size());
+}
 }
-}
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "rsnd/SoundBankWriter.hpp"
+#include "common/binaryWriter.hpp"
+
+namespace rsnd {
+namespace {
+const int KEY_COUNT = 128;
+
+// values [lo, hi] of a key or velocity split, all mapping to the same child
+struct Split {
+  u8 lo;
+  u8 hi;
+  DataRef ref;
+};
+
+DataRef noneRef() {
+  DataRef ref = {};
+  ref.dataType = REGIONSET_NONE;
+  return ref;
+}
+
+bool isNone(const DataRef& ref) {
+  return ref.dataType == REGIONSET_NONE;
+}
+
+// Writes the DATA block contents of one instrument. Offsets are relative to the DATA block contents (dataBase)
+class InstrumentWriter {
+private:
+  BinaryWriter& out;
+  u32 base;
+  const std::vector<BankRegion>& regions;
+  // region covering each key and velocity, -1 for none
+  std::vector<std::array<int, KEY_COUNT>> regionAt;
+  // InstrInfos written so far in the bank and their offsets, identical ones are shared
+  std::vector<std::pair<InstrInfo, u32>>& writtenInfos;
+
+  DataRef infoRef(int region) {
+    if (region < 0) return noneRef();
+    InstrInfo info = regions[region].info;
+    info.lfoTable = {};
+    info.graphEnvTable = {};
+    info.randomizerTable = {};
+    info._res = 0;
+    for (const auto& [written, offset] : writtenInfos) {
+      if (memcmp(&written, &info, sizeof(InstrInfo)) == 0) return offsetRef(offset, REGIONSET_DIRECT);
+    }
+    out.align(4);
+    writtenInfos.push_back({info, out.writeStruct(info) - base});
+    return offsetRef(writtenInfos.back().second, REGIONSET_DIRECT);
+  }
+
+  // A whole range maps to its child directly. Otherwise a RANGE table keyed by the split ends, or an INDEX
+  // table with one entry per value between the first and last split that has a child, whichever is smaller
+  DataRef tableRef(const std::vector<Split>& splits) {
+    if (splits.size() == 1) return splits[0].ref;
+
+    auto first = std::find_if(splits.begin(), splits.end(), [](const Split& split) { return !isNone(split.ref); });
+    if (first == splits.end()) return noneRef();
+    auto last = std::find_if(splits.rbegin(), splits.rend(), [](const Split& split) { return !isNone(split.ref); });
+    const u32 indexMin = first->lo;
+    const u32 indexMax = last->hi;
+    const u32 rangeSize = (1 + splits.size() + 3) / 4 * 4 + splits.size() * sizeof(DataRef);
+    const u32 indexSize = 4 + (indexMax - indexMin + 1) * sizeof(DataRef);
+
+    out.align(4);
+    const u32 tableOffset = out.tell() - base;
+    if (indexSize < rangeSize) {
+      out.writeInt<u8>(indexMin);
+      out.writeInt<u8>(indexMax);
+      out.writeInt<u16>(0);
+      for (const Split& split : splits) {
+        for (u32 v = std::max<u32>(split.lo, indexMin); v <= std::min<u32>(split.hi, indexMax); v++) out.writeStruct(split.ref);
+      }
+      return offsetRef(tableOffset, REGIONSET_INDEX);
+    }
+
+    out.writeInt<u8>(splits.size());
+    for (const Split& split : splits) out.writeInt<u8>(split.hi);
+    out.align(4);
+    for (const Split& split : splits) out.writeStruct(split.ref);
+    return offsetRef(tableOffset, REGIONSET_RANGE);
+  }
+
+public:
+  InstrumentWriter(BinaryWriter& out, u32 base, const std::vector<BankRegion>& regions, std::vector<std::pair<InstrInfo, u32>>& writtenInfos)
+      : out(out), base(base), regions(regions), writtenInfos(writtenInfos) {
+    std::array<int, KEY_COUNT> noRegions;
+    noRegions.fill(-1);
+    regionAt.assign(KEY_COUNT, noRegions);
+    // earlier regions take precedence
+    for (int r = regions.size() - 1; r >= 0; r--) {
+      const BankRegion& region = regions[r];
+      for (int key = region.keyLo; key <= std::min<int>(region.keyHi, KEY_COUNT - 1); key++) {
+        for (int vel = region.velLo; vel <= std::min<int>(region.velHi, KEY_COUNT - 1); vel++) regionAt[key][vel] = r;
+      }
+    }
+  }
+
+  DataRef write() {
+    // keys with the same regions at every velocity share a key split
+    std::vector<Split> keySplits;
+    for (int key = 0; key < KEY_COUNT;) {
+      int end = key + 1;
+      while (end < KEY_COUNT && regionAt[end] == regionAt[key]) end++;
+
+      std::vector<Split> velSplits;
+      for (int vel = 0; vel < KEY_COUNT;) {
+        int velEnd = vel + 1;
+        while (velEnd < KEY_COUNT && regionAt[key][velEnd] == regionAt[key][vel]) velEnd++;
+        velSplits.push_back({static_cast<u8>(vel), static_cast<u8>(velEnd - 1), infoRef(regionAt[key][vel])});
+        vel = velEnd;
+      }
+      keySplits.push_back({static_cast<u8>(key), static_cast<u8>(end - 1), tableRef(velSplits)});
+      key = end;
+    }
+    return tableRef(keySplits);
+  }
+};
+}
+
+std::vector<u8> buildSoundBank(const std::vector<std::vector<BankRegion>>& instruments) {
+  BinaryWriter out;
+  out.write(std::vector<u8>(sizeof(SoundBankHeader)).data(), sizeof(SoundBankHeader));
+
+  // DATA: a reference per instrument to its key split, velocity split or InstrInfo
+  const u32 dataOffset = out.tell();
+  writeBlockHeader(out, "DATA");
+  const u32 base = out.tell();
+  out.writeInt<u32>(instruments.size());
+  const u32 instrRefsOffset = out.tell();
+  for (size_t i = 0; i < instruments.size(); i++) out.writeStruct(DataRef{});
+  std::vector<std::pair<InstrInfo, u32>> writtenInfos;
+  for (size_t i = 0; i < instruments.size(); i++) {
+    InstrumentWriter writer(out, base, instruments[i], writtenInfos);
+    out.patchStruct(instrRefsOffset + i * sizeof(DataRef), writer.write());
+  }
+  const u32 dataLength = finishBlock(out, dataOffset);
+
+  // no WAVE block, the waves are in a BRWAR
+  SoundBankHeader header = {};
+  initFileHeader(header, "RBNK", 0x0101, out.tell(), sizeof(SoundBankHeader), 1);
+  header.dataOffset = dataOffset;
+  header.dataLength = dataLength;
+  out.patchStruct(0, header);
+  return out.getBytes();
+}
+}
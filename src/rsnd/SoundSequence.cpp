@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <bit>
 
 #include "rsnd/SoundSequence.hpp"
@@ -53,4 +54,11 @@ SoundSequence::SoundSequence(void* fileData, size_t fileSize) {
     if (falseEndian) seqLabel->bswap();
   }
 }
-}
\ No newline at end of file
+
+u32 SoundSequence::getSeqDataSize() const {
+  const u8* file = static_cast<const u8*>(data);
+  const size_t start = static_cast<const u8*>(dataBase) - file;
+  const size_t end = std::min<size_t>(reinterpret_cast<const u8*>(seqData) - file + seqData->length, dataSize);
+  return end > start ? end - start : 0;
+}
+}
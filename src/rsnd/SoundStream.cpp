@@ -6,10 +6,15 @@
 #include <cstring>
 #include <iostream>
 #include <filesystem>
+#include <vector>
+#include <cmath>
+#include <numbers>
 
 #include "rsnd/SoundStream.hpp"
 #include "rsnd/soundCommon.hpp"
 #include "common/fileUtil.hpp"
+#include "common/log.hpp"
+#include "common/mix.hpp"
 
 namespace rsnd {
 void SoundStreamHeader::bswap() {
@@ -111,15 +116,10 @@ SoundStream::SoundStream(void* fileData, size_t fileSize) {
     adpcParams->bswap();
   }
 
-  if (strmDataInfo->format == StreamDataInfo::FORMAT_PCM16) {
-    for (int c = 0; c < strmDataInfo->channelCount; c++) {
-      for (int b = 0; b < strmDataInfo->blockCount; b++) {
-        s16* blockData = reinterpret_cast<s16*>(const_cast<u8*>(getBlockData(c, b)));
-        u32 blockSamples = b + 1 == strmDataInfo->blockCount ? strmDataInfo->finalBlockSamples : strmDataInfo->blockSamples;
-        for (int i = 0; i < blockSamples; i++) {
-          blockData[i] = std::byteswap(blockData[i]);
-        }
-      }
+  hasBlockData = dataSize > static_cast<size_t>(getBlockData(0, 0) - static_cast<u8*>(data));
+  if (hasBlockData) {
+    for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
+      bswapBlockRow(const_cast<u8*>(getBlockData(0, b)), b);
     }
   }
 }
@@ -141,7 +141,25 @@ const AdpcParams* SoundStream::getAdpcParams(u8 channelIdx) const {
   return reinterpret_cast<AdpcParams*>(chInfo->adpcParams.getAddr((u8*)strmHead + sizeof(BinaryBlockHeader)));
 }
 
-const AdpcEntry* SoundStream::getAdpcEntry(u8 b, u8 c) const {
+const u8* SoundStream::getTrackChannels(u8 trackIdx, u8& channelCount) const {
+  switch (trackTable->trackInfoType) {
+  case TrackTable::SIMPLE: {
+    const TrackInfoSimple* trackInfoSimple = getTrackInfoSimple(trackIdx);
+    channelCount = trackInfoSimple->channelCount;
+    return trackInfoSimple->channelIndices;
+
+  } case TrackTable::EXTENDED: {
+    const TrackInfoExtended* trackInfoExtended = getTrackInfoExtended(trackIdx);
+    channelCount = trackInfoExtended->channelCount;
+    return trackInfoExtended->channelIndices;
+  
+  } default:
+    RSND_WARN(LOG_PARSE, "Invalid track info type value " << (int)trackTable->trackInfoType);
+    exit(-1);
+  }
+}
+
+const AdpcEntry* SoundStream::getAdpcEntry(u32 b, u8 c) const {
   return reinterpret_cast<AdpcEntry*>((u8*)strmAdpc + sizeof(BinaryBlockHeader) + (b * strmDataInfo->channelCount + c) * sizeof(AdpcEntry));
 }
 
@@ -149,13 +167,12 @@ const u32 SoundStream::getSampleCount() const {
   return (strmDataInfo->blockCount - 1) * strmDataInfo->blockSamples + strmDataInfo->finalBlockSamples;
 }
 
-const u8* SoundStream::getBlockData(u8 channelIdx, u8 blockIdx) const {
+const u8* SoundStream::getBlockData(u8 channelIdx, u32 blockIdx) const {
   u8 c = channelIdx;
-  u8 b = blockIdx;
+  u32 b = blockIdx;
   u32 blockCount = strmDataInfo->blockCount;
   u8 channelCount = strmDataInfo->channelCount;
   u32 blockSize = strmDataInfo->blockSize;
-  u32 finalBlockSize = strmDataInfo->finalBlockSize;
   u32 finalBlockPaddedSize = strmDataInfo->finalBlockPaddedSize;
 
   const u32 rawDataOffset =
@@ -163,90 +180,218 @@ const u8* SoundStream::getBlockData(u8 channelIdx, u8 blockIdx) const {
     c != 0 && b + 1 == blockCount
       ? b * channelCount * blockSize + c * finalBlockPaddedSize
       : (b * channelCount + c) * blockSize;
-  const u32 rawDataEnd =
-    b + 1 == blockCount
-      ? rawDataOffset + finalBlockSize
-      : rawDataOffset + blockSize;
   return reinterpret_cast<u8*>(strmData) + sizeof(BinaryBlockHeader) + strmData->dataOffset + rawDataOffset;
 }
 
-void SoundStream::decodeChannelPcm8(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  u32 blockCount = strmDataInfo->blockCount;
-  u32 usualBlockSize = strmDataInfo->blockSize;
-  u32 finalBlockSize = strmDataInfo->finalBlockSize;
-  u32 usualBlockSamples = strmDataInfo->blockSamples;
-  u32 finalBlockSamples = strmDataInfo->finalBlockSamples;
+void SoundStream::bswapBlockRow(u8* rowData, u32 blockIdx) const {
+  if (strmDataInfo->format != StreamDataInfo::FORMAT_PCM16) return;
 
-  for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
-    const u8* blockData = getBlockData(channelIdx, b);
-    u32 blockSize = b + 1 == blockCount ? finalBlockSize : usualBlockSize;
-    u32 blockSamples = b + 1 == blockCount ? finalBlockSamples : usualBlockSamples;
+  u32 channelStride = getBlockRowSize(blockIdx) / strmDataInfo->channelCount;
+  u32 blockSamples = getBlockSamples(blockIdx);
+  for (int c = 0; c < strmDataInfo->channelCount; c++) {
+    s16* blockData = reinterpret_cast<s16*>(rowData + c * channelStride);
+    for (u32 i = 0; i < blockSamples; i++) {
+      blockData[i] = std::byteswap(blockData[i]);
+    }
+  }
+}
 
-    s16* blockBuffer = buffer + b * usualBlockSamples * sampleStride + offset;
-    decodePcm8Block(blockData, blockSamples, blockBuffer, sampleStride);
+void SoundStream::decodeBlock(u8 channelIdx, u32 blockIdx, const u8* blockData, s16* buffer, u8 stride) const {
+  u32 blockSamples = getBlockSamples(blockIdx);
+
+  switch (strmDataInfo->format)
+  {
+  case StreamDataInfo::FORMAT_PCM16:
+    decodePcm16Block(blockData, blockSamples, buffer, stride);
+    break;
+  
+  case StreamDataInfo::FORMAT_PCM8:
+    decodePcm8Block(blockData, blockSamples, buffer, stride);
+    break;
+  
+  case StreamDataInfo::FORMAT_ADPCM: {
+    const AdpcParams* adpcParams = getAdpcParams(channelIdx);
+    const AdpcEntry* adpcEntry = getAdpcEntry(blockIdx, channelIdx);
+    decodeAdpcmBlock(blockData, blockSamples, adpcParams->params.coeffs, adpcEntry->yn1, adpcEntry->yn2, buffer, stride);
+    break;
+  
+  } default:
+    RSND_WARN(LOG_DECODE, "unknown track format " << (int)strmDataInfo->format);
+    break;
   }
 }
 
-void SoundStream::decodeChannelPcm16(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  u32 blockCount = strmDataInfo->blockCount;
-  u32 usualBlockSize = strmDataInfo->blockSize;
-  u32 finalBlockSize = strmDataInfo->finalBlockSize;
+void SoundStream::decodeChannel(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
   u32 usualBlockSamples = strmDataInfo->blockSamples;
-  u32 finalBlockSamples = strmDataInfo->finalBlockSamples;
 
   for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
-    const u8* blockData = getBlockData(channelIdx, b);
-    u32 blockSize = b + 1 == blockCount ? finalBlockSize : usualBlockSize;
-    u32 blockSamples = b + 1 == blockCount ? finalBlockSamples : usualBlockSamples;
-
     s16* blockBuffer = buffer + b * usualBlockSamples * sampleStride + offset;
-    decodePcm16Block(blockData, blockSamples, blockBuffer, sampleStride);
+    decodeBlock(channelIdx, b, getBlockData(channelIdx, b), blockBuffer, sampleStride);
   }
 }
 
-void SoundStream::decodeChannelAdpcm(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  u8 c = channelIdx;
-  u32 blockCount = strmDataInfo->blockCount;
-  u32 usualBlockSize = strmDataInfo->blockSize;
-  u32 finalBlockSize = strmDataInfo->finalBlockSize;
-  u32 usualBlockSamples = strmDataInfo->blockSamples;
-  u32 finalBlockSamples = strmDataInfo->finalBlockSamples;
+void SoundStream::decodeTrackRow(const u8* channelIndices, u8 channelCount, u32 blockIdx, const u8* rowData, s16* buffer) const {
+  u32 channelStride = getBlockRowSize(blockIdx) / strmDataInfo->channelCount;
+  for (int i = 0; i < channelCount; i++) {
+    u8 channelIdx = channelIndices[i];
+    decodeBlock(channelIdx, blockIdx, rowData + channelIdx * channelStride, buffer + i, channelCount);
+  }
+}
 
-  const AdpcParams* adpcParams = getAdpcParams(channelIdx);
+void SoundStream::decodeTrack(u8 trackIdx, PcmSink& sink, u32 frameCount) const {
+  u8 channelCount;
+  const u8* channelIndices = getTrackChannels(trackIdx, channelCount);
+
+  const u32 sampleCount = getSampleCount();
+  const bool looped = frameCount != 0 && isLooped();
+  if (!looped) frameCount = frameCount == 0 ? sampleCount : std::min(frameCount, sampleCount);
+  const u32 end = looped ? getLoopEnd() : sampleCount;
+  const u32 blockSamples = strmDataInfo->blockSamples;
+
+  sink.begin(strmDataInfo->sampleRate, channelCount, frameCount);
+  std::vector<s16> blockBuffer(blockSamples * channelCount);
+  u32 b = 0;
+  u32 skip = 0;
+  for (u32 written = 0; written < frameCount;) {
+    decodeTrackRow(channelIndices, channelCount, b, getBlockData(0, b), blockBuffer.data());
+    u32 count = std::min({getBlockSamples(b), end - b * blockSamples, skip + frameCount - written}) - skip;
+    sink.write(blockBuffer.data() + skip * channelCount, count);
+    written += count;
+
+    skip = 0;
+    b++;
+    if (b * blockSamples >= end) {
+      // back to the block holding the loop start, its ADPC entry re-seeds the decoder
+      b = getLoopStart() / blockSamples;
+      skip = getLoopStart() % blockSamples;
+    }
+  }
+  sink.end();
+}
+
+void SoundStream::decodeTracks(std::istream& blockRows, PcmSink* const* trackSinks) const {
+  const u8 trackCount = trackTable->trackCount;
+  u8 maxChannelCount = 0;
+  for (int t = 0; t < trackCount; t++) {
+    u8 channelCount;
+    getTrackChannels(t, channelCount);
+    maxChannelCount = std::max(maxChannelCount, channelCount);
+    if (trackSinks[t]) trackSinks[t]->begin(strmDataInfo->sampleRate, channelCount, getSampleCount());
+  }
 
+  std::vector<u8> rowData(getBlockRowSize(0));
+  std::vector<s16> blockBuffer(strmDataInfo->blockSamples * maxChannelCount);
   for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
-    const AdpcEntry* adpcEntry = getAdpcEntry(b, c);
-    s16 yn1 = adpcEntry->yn1;
-    s16 yn2 = adpcEntry->yn2;
+    // the final block's padding is not always present at the end of the file
+    u32 rowSize = b + 1 == strmDataInfo->blockCount ? (strmDataInfo->channelCount - 1) * strmDataInfo->finalBlockPaddedSize + strmDataInfo->finalBlockSize : getBlockRowSize(b);
+    if (!readExact(blockRows, rowData.data(), rowSize)) {
+      std::cerr << "Unexpected end of stream data at block " << b << '\n';
+      exit(-1);
+    }
+    bswapBlockRow(rowData.data(), b);
+
+    for (int t = 0; t < trackCount; t++) {
+      if (!trackSinks[t]) continue;
+      u8 channelCount;
+      const u8* channelIndices = getTrackChannels(t, channelCount);
+      decodeTrackRow(channelIndices, channelCount, b, rowData.data(), blockBuffer.data());
+      trackSinks[t]->write(blockBuffer.data(), getBlockSamples(b));
+    }
+  }
 
-    u32 blockSize = b + 1 == blockCount ? finalBlockSize : usualBlockSize;
-    u32 blockSamples = b + 1 == blockCount ? finalBlockSamples : usualBlockSamples;
-    const u8* blockData = getBlockData(c, b);
+  for (int t = 0; t < trackCount; t++) {
+    if (trackSinks[t]) trackSinks[t]->end();
+  }
+}
 
-    s16* blockBuffer = buffer + b * usualBlockSamples * sampleStride + offset;
-    decodeAdpcmBlock(blockData, blockSamples, adpcParams->params.coeffs, yn1, yn2, blockBuffer, sampleStride);
+void SoundStream::decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, PcmSink& sink) const {
+  const u32 sampleCount = getSampleCount();
+  firstSample = std::min(firstSample, sampleCount);
+  count = std::min(count, sampleCount - firstSample);
+
+  sink.begin(strmDataInfo->sampleRate, channelCount, count);
+  const u32 blockSamples = strmDataInfo->blockSamples;
+  std::vector<s16> blockBuffer(blockSamples * channelCount);
+  u32 skip = firstSample % blockSamples;
+  for (u32 b = firstSample / blockSamples, written = 0; written < count; b++) {
+    decodeTrackRow(channelIndices, channelCount, b, getBlockData(0, b), blockBuffer.data());
+    u32 blockCount = std::min(getBlockSamples(b) - skip, count - written);
+    sink.write(blockBuffer.data() + skip * channelCount, blockCount);
+    written += blockCount;
+    skip = 0;
   }
+  sink.end();
 }
 
-void SoundStream::decodeChannel(u8 channelIdx, s16* buffer, u8 offset, u8 sampleStride) const {
-  switch (strmDataInfo->format)
-  {
-  case StreamDataInfo::FORMAT_PCM16:
-    decodeChannelPcm16(channelIdx, buffer, offset, sampleStride);
-    break;
-  
-  case StreamDataInfo::FORMAT_PCM8:
-    decodeChannelPcm8(channelIdx, buffer, offset, sampleStride);
-    break;
-  
-  case StreamDataInfo::FORMAT_ADPCM:
-    decodeChannelAdpcm(channelIdx, buffer, offset, sampleStride);
-    break;
-  
-  default:
-    std::cerr << "Warning: unknown track format " << strmDataInfo->format << '\n';
-    break;
+void SoundStream::decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, s16* out) const {
+  BufferSink bufferSink(out);
+  decodeRange(channelIndices, channelCount, firstSample, count, bufferSink);
+}
+
+void SoundStream::getMixGains(u8 outputChannelCount, float* gains) const {
+  std::fill(gains, gains + strmDataInfo->channelCount * outputChannelCount, 0.0f);
+  for (int t = 0; t < trackTable->trackCount; t++) {
+    // simple track infos carry no volume/pan, so play them at full volume in the center
+    float volume = 1.0f;
+    float pan = 0.0f;
+    if (trackTable->trackInfoType == TrackTable::EXTENDED) {
+      const TrackInfoExtended* trackInfo = getTrackInfoExtended(t);
+      volume = trackInfo->volume / 127.0f;
+      pan = std::clamp((trackInfo->pan - 64) / 63.0f, -1.0f, 1.0f);
+    }
+
+    u8 channelCount;
+    const u8* channelIndices = getTrackChannels(t, channelCount);
+    for (int i = 0; i < channelCount; i++) {
+      float* channelGains = gains + channelIndices[i] * outputChannelCount;
+      if (outputChannelCount == 1) {
+        // mono: average the sides of multi-channel tracks
+        channelGains[0] += volume / (channelCount > 1 ? 2 : 1);
+      } else if (channelCount == 1) {
+        // constant power pan of a mono track
+        float angle = (pan + 1.0f) * std::numbers::pi_v<float> / 4;
+        channelGains[0] += volume * std::cos(angle);
+        channelGains[1] += volume * std::sin(angle);
+      } else {
+        // balance of a stereo track, even channels are left, odd channels are right
+        bool right = i & 1;
+        channelGains[right] += volume * std::min(1.0f, right ? 1.0f + pan : 1.0f - pan);
+      }
+    }
+  }
+}
+
+void SoundStream::decodeMixdown(u8 outputChannelCount, PcmSink& sink) const {
+  const u8 channelCount = strmDataInfo->channelCount;
+  std::vector<float> gains(channelCount * outputChannelCount);
+  getMixGains(outputChannelCount, gains.data());
+
+  const u32 blockSamples = strmDataInfo->blockSamples;
+  std::vector<s16> channelBuffer(blockSamples);
+  std::vector<std::vector<float>> mix(outputChannelCount, std::vector<float>(blockSamples));
+  std::vector<const float*> mixChannels;
+  for (const auto& channel : mix) mixChannels.push_back(channel.data());
+  std::vector<s16> outputBuffer(blockSamples * outputChannelCount);
+
+  sink.begin(strmDataInfo->sampleRate, outputChannelCount, getSampleCount());
+  for (u32 b = 0; b < strmDataInfo->blockCount; b++) {
+    const u32 samples = getBlockSamples(b);
+    for (auto& channel : mix) std::fill(channel.begin(), channel.end(), 0.0f);
+
+    for (int c = 0; c < channelCount; c++) {
+      const float* channelGains = gains.data() + c * outputChannelCount;
+      if (std::all_of(channelGains, channelGains + outputChannelCount, [](float gain) { return gain == 0.0f; })) continue;
+
+      decodeBlock(c, b, getBlockData(c, b), channelBuffer.data());
+      for (int o = 0; o < outputChannelCount; o++) {
+        if (channelGains[o] != 0.0f) mixAccumulate(mix[o].data(), channelBuffer.data(), samples, channelGains[o]);
+      }
+    }
+
+    mixToPcm16(mixChannels.data(), outputChannelCount, samples, outputBuffer.data());
+    sink.write(outputBuffer.data(), samples);
   }
+  sink.end();
 }
 
 s16* SoundStream::getChannelPcm(u8 channelIdx) const {
@@ -258,24 +403,7 @@ s16* SoundStream::getChannelPcm(u8 channelIdx) const {
 }
 
 s16* SoundStream::getTrackPcm(u8 trackIdx, u8& channelCount) const {
-  const u8* channelIndices;
-  switch (trackTable->trackInfoType) {
-  case TrackTable::SIMPLE: {
-    const TrackInfoSimple* trackInfoSimple = getTrackInfoSimple(trackIdx);
-    channelCount = trackInfoSimple->channelCount;
-    channelIndices = trackInfoSimple->channelIndices;
-    break;
-
-  } case TrackTable::EXTENDED: {
-    const TrackInfoExtended* trackInfoExtended = getTrackInfoExtended(trackIdx);
-    channelCount = trackInfoExtended->channelCount;
-    channelIndices = trackInfoExtended->channelIndices;
-    break;
-  
-  } default:
-    std::cout << "Invalid track info type value " << trackTable->trackInfoType << std::endl;
-    exit(-1);
-  }
+  const u8* channelIndices = getTrackChannels(trackIdx, channelCount);
 
   u32 sampleCount = getSampleCount();
   s16* pcmBuffer = static_cast<s16*>(malloc(channelCount * sampleCount * sizeof(s16)));
@@ -289,9 +417,7 @@ s16* SoundStream::getTrackPcm(u8 trackIdx, u8& channelCount) const {
 }
 
 void SoundStream::trackToWaveFile(u8 trackIdx, std::filesystem::path wavePath) const {
-  u8 channelCount;
-  void* data = getTrackPcm(trackIdx, channelCount);
-  createWaveFile(wavePath, data, getSampleCount(), strmDataInfo->sampleRate, channelCount);
-  free(data);
+  WaveFileSink waveSink(wavePath);
+  decodeTrack(trackIdx, waveSink);
 }
 }
\ No newline at end of file
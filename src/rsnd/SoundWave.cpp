@@ -1,10 +1,12 @@
 
+#include <algorithm>
 #include <bit>
 #include <cstdlib>
-#include <iostream>
+#include <vector>
 
 #include "rsnd/SoundWave.hpp"
 #include "common/fileUtil.hpp"
+#include "common/log.hpp"
 
 namespace rsnd {
 void SoundWaveHeader::bswap() {
@@ -23,6 +25,7 @@ void SoundWaveInfo::bswap() {
 SoundWave::SoundWave(void* fileData, size_t fileSize) {
   dataSize = fileSize;
   data = fileData;
+  seekIndex = nullptr;
 
   SoundWaveHeader* wavHdr = static_cast<SoundWaveHeader*>(fileData);
   bool falseEndian = wavHdr->byteOrder != 0xFEFF;
@@ -60,41 +63,12 @@ SoundWave::SoundWave(void* fileData, size_t fileSize) {
 }
 
 u32 SoundWave::getLoopStart() const {
-  switch (info->format)
-  {
-  case SoundWaveInfo::FORMAT_PCM8:
-    return info->loopStart;
-  
-  case SoundWaveInfo::FORMAT_PCM16:
-    return info->loopStart;
-  
-  // info->dataLoc or loopEnd playing a role here?
-  case SoundWaveInfo::FORMAT_ADPCM:
-    return (14*(info->loopStart-8)/8)/info->channelCount;
-  
-  default:
-    std::cerr << "Warning: unknown track format " << info->format << '\n';
-    return 0;
-  }
+  return waveLoopStart(info);
 }
 
+// no further than the decoded data
 u32 SoundWave::getLoopEnd() const {
-  switch (info->format)
-  {
-  case SoundWaveInfo::FORMAT_PCM8:
-    return info->loopEnd;
-  
-  case SoundWaveInfo::FORMAT_PCM16:
-    return info->loopEnd;
-  
-  // info->dataLoc or loopEnd playing a role here?
-  case SoundWaveInfo::FORMAT_ADPCM:
-    return (14*(info->loopEnd-8)/8)/info->channelCount;
-  
-  default:
-    std::cerr << "Warning: unknown track format " << info->format << '\n';
-    return 0;
-  }
+  return std::min(waveLoopEnd(info), getTrackSampleCount());
 }
 
 u32 SoundWave::getTrackSampleCount() const {
@@ -102,14 +76,14 @@ u32 SoundWave::getTrackSampleCount() const {
   {
   case SoundWaveInfo::FORMAT_PCM8:
   case SoundWaveInfo::FORMAT_PCM16:
-    return info->loopEnd;
+    return waveLoopEnd(info);
   
   // info->dataLoc or loopEnd playing a role here?
   case SoundWaveInfo::FORMAT_ADPCM:
     return (14*(waveData->length-8)/8)/info->channelCount;
   
   default:
-    std::cerr << "Warning: unknown track format " << info->format << '\n';
+    RSND_WARN(LOG_DECODE, "unknown track format " << info->format);
     return 0;
   }
 }
@@ -136,7 +110,59 @@ void SoundWave::decodeChannel(u8 channelIdx, s16* buffer, u8 offset, u8 stride)
     break;
   
   } default:
-    std::cerr << "Warning: unknown track format " << info->format << '\n';
+    RSND_WARN(LOG_DECODE, "unknown track format " << info->format);
+  }
+}
+
+void SoundWave::decodeChannelRange(u8 channelIdx, u32 firstSample, u32 count, s16* buffer, u8 stride) const {
+  const u8* blockData = getChannelData(channelIdx);
+
+  switch (info->format)
+  {
+  case SoundWaveInfo::FORMAT_PCM8:
+    decodePcm8Block(blockData + firstSample, count, buffer, stride);
+    break;
+  
+  case SoundWaveInfo::FORMAT_PCM16:
+    decodePcm16Block(blockData + firstSample * sizeof(s16), count, buffer, stride);
+    break;
+  
+  case SoundWaveInfo::FORMAT_ADPCM: {
+    // the predictor history is only known at the start (or at the checkpoints of the seek index),
+    // so decode from there up to the end of the range
+    const AdpcParams* adpcParams = getChannelAdpcmParam(channelIdx);
+    s16 yn1 = adpcParams->params.yn1;
+    s16 yn2 = adpcParams->params.yn2;
+    u32 startSample = seekIndex ? seekIndex->seek(channelIdx, firstSample, yn1, yn2) : 0;
+    std::vector<s16> pcm(firstSample - startSample + count);
+    decodeAdpcmBlock(blockData + startSample / 14 * 8, pcm.size(), adpcParams->params.coeffs, yn1, yn2, pcm.data(), 1);
+    for (u32 i = 0; i < count; i++) buffer[i * stride] = pcm[firstSample - startSample + i];
+    break;
+  
+  } default:
+    RSND_WARN(LOG_DECODE, "unknown track format " << info->format);
+  }
+}
+
+void SoundWave::decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, PcmSink& sink) const {
+  const u32 sampleCount = getTrackSampleCount();
+  firstSample = std::min(firstSample, sampleCount);
+  count = std::min(count, sampleCount - firstSample);
+
+  std::vector<s16> pcm(count * channelCount);
+  decodeRange(channelIndices, channelCount, firstSample, count, pcm.data());
+  sink.begin(info->sampleRate, channelCount, count);
+  sink.write(pcm.data(), count);
+  sink.end();
+}
+
+void SoundWave::decodeRange(const u8* channelIndices, u8 channelCount, u32 firstSample, u32 count, s16* out) const {
+  const u32 sampleCount = getTrackSampleCount();
+  firstSample = std::min(firstSample, sampleCount);
+  count = std::min(count, sampleCount - firstSample);
+
+  for (int i = 0; i < channelCount; i++) {
+    decodeChannelRange(channelIndices[i], firstSample, count, out + i, channelCount);
   }
 }
 
@@ -160,9 +186,21 @@ s16* SoundWave::getTrackPcm() const {
   return pcmBuffer;
 }
 
-void SoundWave::toWaveFile(std::filesystem::path wavePath) const {
-  void* data = getTrackPcm();
-  createWaveFile(wavePath, data, getTrackSampleCount(), info->sampleRate, info->channelCount);
+void SoundWave::decode(PcmSink& sink, u32 frameCount) const {
+  const u32 sampleCount = getTrackSampleCount();
+  const bool looped = frameCount != 0 && isLooped();
+  if (!looped) frameCount = frameCount == 0 ? sampleCount : std::min(frameCount, sampleCount);
+
+  // the whole wave is decoded anyway, so the loop body is replayed from the decoded pcm
+  s16* data = getTrackPcm();
+  sink.begin(info->sampleRate, info->channelCount, frameCount);
+  writeLoopedPcm(sink, data, info->channelCount, looped ? getLoopStart() : 0, looped ? getLoopEnd() : sampleCount, frameCount);
+  sink.end();
   free(data);
 }
+
+void SoundWave::toWaveFile(std::filesystem::path wavePath) const {
+  WaveFileSink waveSink(wavePath);
+  decode(waveSink);
+}
 }
\ No newline at end of file
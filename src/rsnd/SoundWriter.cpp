@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+
+#include "rsnd/SoundWriter.hpp"
+#include "rsnd/SoundWave.hpp"
+#include "common/binaryWriter.hpp"
+
+namespace rsnd {
+namespace {
+const u32 STREAM_BLOCK_SIZE = 0x2000;
+const u32 STREAM_BLOCK_SAMPLES = STREAM_BLOCK_SIZE / 8 * 14;
+
+u32 adpcmDataSize(u32 sampleCount) {
+  return (sampleCount + 13) / 14 * 8;
+}
+}
+
+std::vector<u8> buildSoundWave(const EncodedSound& sound) {
+  const u8 channelCount = sound.channels.size();
+  BinaryWriter out;
+  out.write(std::vector<u8>(sizeof(SoundWaveHeader)).data(), sizeof(SoundWaveHeader));
+
+  const u32 infoOffset = out.tell();
+  writeBlockHeader(out, "INFO");
+  const u32 infoBase = out.tell();
+
+  WaveInfo waveInfo = {};
+  waveInfo.format = WaveInfo::FORMAT_ADPCM;
+  waveInfo.loop = sound.loop;
+  waveInfo.channelCount = channelCount;
+  waveInfo.sampleRate24 = sound.sampleRate >> 16;
+  waveInfo.sampleRate = sound.sampleRate & 0xffff;
+  waveInfo.dataLocType = WaveInfo::LOC_OFFSET;
+  waveInfo.loopStart = waveLoopStartAddress(waveInfo.format, sound.loop ? sound.loopStart : 0);
+  waveInfo.loopEnd = waveLoopEndAddress(waveInfo.format, sound.sampleCount);
+  waveInfo.channelInfoTableOffset = sizeof(WaveInfo);
+  out.writeStruct(waveInfo);
+
+  const u32 channelTableOffset = out.tell();
+  for (int c = 0; c < channelCount; c++) out.writeInt<u32>(0);
+
+  // channel data is 32 byte aligned in the DATA block
+  const u32 channelDataSize = (adpcmDataSize(sound.sampleCount) + 0x1f) & ~0x1f;
+  for (int c = 0; c < channelCount; c++) {
+    out.align(4);
+    const u32 channelInfoOffset = out.tell() - infoBase;
+    out.patchInt(channelTableOffset + c * sizeof(u32), channelInfoOffset);
+
+    SoundWaveChannelInfo channelInfo = {};
+    channelInfo.dataOffset = c * channelDataSize;
+    channelInfo.adpcmOffset = channelInfoOffset + sizeof(SoundWaveChannelInfo);
+    out.writeStruct(channelInfo);
+    out.writeStruct(sound.channels[c].getAdpcParams(sound.loop, sound.loopStart));
+  }
+  const u32 infoLength = finishBlock(out, infoOffset);
+
+  const u32 dataOffset = out.tell();
+  writeBlockHeader(out, "DATA");
+  for (const auto& channel : sound.channels) {
+    std::vector<u8> channelData(channel.data);
+    channelData.resize(channelDataSize);
+    out.write(channelData.data(), channelData.size());
+  }
+  const u32 dataLength = finishBlock(out, dataOffset);
+
+  SoundWaveHeader header = {};
+  initFileHeader(header, "RWAV", 0x0102, out.tell(), sizeof(SoundWaveHeader), 2);
+  header.infoOffset = infoOffset;
+  header.infoLength = infoLength;
+  header.dataOffset = dataOffset;
+  header.dataLength = dataLength;
+  out.patchStruct(0, header);
+  return out.getBytes();
+}
+
+u32 SoundStreamWriter::getFormatBlockSamples(u8 format, u32 blockSize) {
+  switch (format) {
+  case StreamDataInfo::FORMAT_PCM8:
+    return blockSize;
+  case StreamDataInfo::FORMAT_PCM16:
+    return blockSize / 2;
+  default:
+    return blockSize / 8 * 14;
+  }
+}
+
+SoundStreamWriter::SoundStreamWriter(std::ostream& out, const StreamDataInfo& streamInfo, u32 sampleCount, u8 trackInfoType, std::vector<StreamTrack> tracks)
+    : out(out), info(streamInfo), trackInfoType(trackInfoType), tracks(std::move(tracks)), nextBlock(0) {
+  info.blockSamples = getFormatBlockSamples(info.format, info.blockSize);
+  info.blockCount = std::max(1u, (sampleCount + info.blockSamples - 1) / info.blockSamples);
+  info.finalBlockSamples = sampleCount - (info.blockCount - 1) * info.blockSamples;
+  switch (info.format) {
+  case StreamDataInfo::FORMAT_PCM8:
+    info.finalBlockSize = info.finalBlockSamples;
+    break;
+  case StreamDataInfo::FORMAT_PCM16:
+    info.finalBlockSize = info.finalBlockSamples * 2;
+    break;
+  default:
+    info.finalBlockSize = adpcmDataSize(info.finalBlockSamples);
+    break;
+  }
+  info.finalBlockPaddedSize = (info.finalBlockSize + 0x1f) & ~0x1f;
+  info.adpcmInterval = info.blockSamples;
+  info.adpcmDataSize = sizeof(AdpcEntry);
+
+  adpcParams.resize(info.channelCount);
+  adpcEntries.resize(info.blockCount * info.channelCount);
+
+  // HEAD only changes in values, so its size is known already
+  headSize = buildHead().size();
+  adpcSize = (sizeof(BinaryBlockHeader) + adpcEntries.size() * sizeof(AdpcEntry) + 0x1f) & ~0x1f;
+  dataOffset = 0x40 + headSize + adpcSize;
+  // the sample data starts 0x20 bytes into DATA
+  info.dataOffset = dataOffset + 0x20;
+
+  std::vector<u8> reserved(info.dataOffset);
+  out.write(reinterpret_cast<const char*>(reserved.data()), reserved.size());
+}
+
+std::vector<u8> SoundStreamWriter::buildHead() const {
+  // HEAD: references to the stream info, track table and channel table, relative to headBase
+  BinaryWriter out;
+  const u32 headOffset = out.tell();
+  writeBlockHeader(out, "HEAD");
+  const u32 headBase = out.tell();
+  const u32 headRefsOffset = out.tell();
+  for (int i = 0; i < 3; i++) out.writeStruct(DataRef{});
+
+  const u32 streamDataInfoOffset = out.writeStruct(info);
+
+  out.align(4);
+  const u32 trackTableOffset = out.tell();
+  out.writeInt<u8>(tracks.size());
+  out.writeInt<u8>(trackInfoType);
+  out.writeInt<u16>(0);
+  const u32 trackRefsOffset = out.tell();
+  for (size_t t = 0; t < tracks.size(); t++) out.writeStruct(DataRef{});
+  for (size_t t = 0; t < tracks.size(); t++) {
+    out.align(4);
+    out.patchStruct(trackRefsOffset + t * sizeof(DataRef), offsetRef(out.tell() - headBase, trackInfoType));
+    if (trackInfoType == TrackTable::EXTENDED) {
+      out.writeInt<u8>(tracks[t].volume);
+      out.writeInt<u8>(tracks[t].pan);
+      out.writeInt<u16>(0);
+      out.writeInt<u32>(0);
+    }
+    out.writeInt<u8>(tracks[t].channels.size());
+    out.write(tracks[t].channels.data(), tracks[t].channels.size());
+  }
+
+  out.align(4);
+  const u32 channelTableOffset = out.tell();
+  out.writeInt<u8>(info.channelCount);
+  out.write("\0\0\0", 3);
+  const u32 channelRefsOffset = out.tell();
+  for (int c = 0; c < info.channelCount; c++) out.writeStruct(DataRef{});
+  for (int c = 0; c < info.channelCount; c++) {
+    out.align(4);
+    const u32 channelInfoOffset = out.tell() - headBase;
+    out.patchStruct(channelRefsOffset + c * sizeof(DataRef), offsetRef(channelInfoOffset));
+    ChannelInfo channelInfo = {};
+    channelInfo.adpcParams = offsetRef(channelInfoOffset + sizeof(ChannelInfo));
+    out.writeStruct(channelInfo);
+    out.writeStruct(adpcParams[c]);
+  }
+
+  out.patchStruct(headRefsOffset, offsetRef(streamDataInfoOffset - headBase));
+  out.patchStruct(headRefsOffset + sizeof(DataRef), offsetRef(trackTableOffset - headBase));
+  out.patchStruct(headRefsOffset + 2 * sizeof(DataRef), offsetRef(channelTableOffset - headBase));
+  finishBlock(out, headOffset);
+  return out.getBytes();
+}
+
+void SoundStreamWriter::writeBlockRow(const u8* const* channelData) {
+  const bool finalBlock = nextBlock + 1 == info.blockCount;
+  const u32 size = getBlockSize(nextBlock);
+  // only the final block is shorter, each of its channels is padded to 32 bytes
+  const u32 stride = finalBlock ? info.finalBlockPaddedSize : info.blockSize;
+  std::vector<u8> padding(stride - size);
+  for (int c = 0; c < info.channelCount; c++) {
+    out.write(reinterpret_cast<const char*>(channelData[c]), size);
+    out.write(reinterpret_cast<const char*>(padding.data()), padding.size());
+  }
+  nextBlock++;
+}
+
+void SoundStreamWriter::finish() {
+  const u32 dataEnd = out.tellp();
+  const u32 fileSize = (dataEnd + 0x1f) & ~0x1f;
+  std::vector<u8> padding(fileSize - dataEnd);
+  out.write(reinterpret_cast<const char*>(padding.data()), padding.size());
+
+  BinaryWriter head;
+  head.write(std::vector<u8>(0x40).data(), 0x40);
+  std::vector<u8> headBlock = buildHead();
+  head.write(headBlock.data(), headBlock.size());
+
+  // ADPC: decoder history at the start of every block of every channel
+  const u32 adpcOffset = head.tell();
+  writeBlockHeader(head, "ADPC");
+  for (const auto& entry : adpcEntries) head.writeStruct(entry);
+  finishBlock(head, adpcOffset);
+
+  writeBlockHeader(head, "DATA");
+  head.writeInt<u32>(0x18);
+  head.align(0x20);
+  head.patchInt<u32>(dataOffset + offsetof(BinaryBlockHeader, length), fileSize - dataOffset);
+
+  SoundStreamHeader header = {};
+  initFileHeader(header, "RSTM", 0x0100, fileSize, 0x40, 3);
+  header.headOffset = 0x40;
+  header.headSize = headSize;
+  header.adpcOffset = adpcOffset;
+  header.adpcSize = adpcSize;
+  header.dataOffset = dataOffset;
+  header.dataSize = fileSize - dataOffset;
+  head.patchStruct(0, header);
+
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(head.getBytes().data()), head.getBytes().size());
+  out.seekp(fileSize);
+}
+
+std::vector<u8> buildSoundStream(const EncodedSound& sound) {
+  const u8 channelCount = sound.channels.size();
+  StreamDataInfo info = {};
+  info.format = StreamDataInfo::FORMAT_ADPCM;
+  info.loop = sound.loop;
+  info.channelCount = channelCount;
+  info.sampleRate = sound.sampleRate;
+  info.loopStart = sound.loop ? sound.loopStart : 0;
+  info.loopEnd = sound.sampleCount;
+  info.blockSize = STREAM_BLOCK_SIZE;
+
+  std::vector<StreamTrack> tracks;
+  for (int c = 0; c < channelCount; c += 2) {
+    StreamTrack track = {127, 64, {static_cast<u8>(c)}};
+    if (c + 1 < channelCount) track.channels.push_back(c + 1);
+    tracks.push_back(track);
+  }
+
+  std::ostringstream stream;
+  SoundStreamWriter writer(stream, info, sound.sampleCount, TrackTable::EXTENDED, tracks);
+  for (int c = 0; c < channelCount; c++) writer.setAdpcParams(c, sound.channels[c].getAdpcParams(sound.loop, sound.loopStart));
+
+  std::vector<const u8*> row(channelCount);
+  for (u32 b = 0; b < writer.getInfo().blockCount; b++) {
+    const u32 blockStart = b * STREAM_BLOCK_SAMPLES;
+    for (int c = 0; c < channelCount; c++) {
+      row[c] = sound.channels[c].data.data() + b * STREAM_BLOCK_SIZE;
+      writer.setAdpcEntry(b, c, sound.channels[c].getYn1(blockStart), sound.channels[c].getYn2(blockStart));
+    }
+    writer.writeBlockRow(row.data());
+  }
+  writer.finish();
+
+  const std::string bytes = stream.str();
+  return std::vector<u8>(bytes.begin(), bytes.end());
+}
+}
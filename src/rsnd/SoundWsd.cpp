@@ -114,7 +114,7 @@ SoundWsd::SoundWsd(void* fileData, size_t fileSize, void* waveData) {
         if (falseEndian && waveInfo->format == WaveInfo::FORMAT_PCM16 && waveData != nullptr) {
           // audio samples also need byteswap in this case
           s16* blockData = reinterpret_cast<s16*>((u8*)waveData + waveInfo->dataLoc + chInfo->dataOffset);
-          u32 sampleCount = dspAddressToSamples(waveInfo->loopEnd);
+          u32 sampleCount = waveLoopEnd(waveInfo);
           for (int sample = 0; sample < sampleCount; sample++) {
             blockData[sample] = std::byteswap(blockData[sample]);
           }
@@ -155,12 +155,12 @@ SoundWsd::SoundWsd(void* fileData, size_t fileSize, void* waveData) {
   }
 }
 
-void SoundWsd::trackToWaveFile(u8 trackIdx, void* waveData, std::filesystem::path wavePath) const {
+void SoundWsd::decodeTrack(u8 trackIdx, void* waveData, PcmSink& sink) const {
   const WaveInfo* waveInfo = getWaveInfo(trackIdx);
   u32 channelCount = waveInfo->channelCount;
     
-  u32 loopStart = dspAddressToSamples(waveInfo->loopStart);
-  u32 loopEnd = dspAddressToSamples(waveInfo->loopEnd);
+  u32 loopStart = waveLoopStart(waveInfo);
+  u32 loopEnd = waveLoopEnd(waveInfo);
   u32 sampleBufferSize = channelCount * loopEnd * sizeof(s16);
   s16* pcmBuffer = static_cast<s16*>(malloc(sampleBufferSize));
 
@@ -173,8 +173,15 @@ void SoundWsd::trackToWaveFile(u8 trackIdx, void* waveData, std::filesystem::pat
     decodeBlock(blockData, loopEnd, pcmBuffer + j, channelCount, waveInfo->format, adpcParams);
   }
 
-  createWaveFile(wavePath, pcmBuffer, loopEnd, waveInfo->sampleRate, channelCount);
+  sink.begin(waveInfo->sampleRate, channelCount, loopEnd);
+  sink.write(pcmBuffer, loopEnd);
+  sink.end();
 
   free(pcmBuffer);
 }
+
+void SoundWsd::trackToWaveFile(u8 trackIdx, void* waveData, std::filesystem::path wavePath) const {
+  WaveFileSink waveSink(wavePath);
+  decodeTrack(trackIdx, waveData, waveSink);
+}
 }
\ No newline at end of file
@@ -1,11 +1,11 @@
 
 #include <bit>
 #include <algorithm>
-#include <iostream>
 #include <cstring>
 
 #include "rsnd/soundCommon.hpp"
 #include "common/util.h"
+#include "common/log.hpp"
 
 namespace rsnd {
 void SoundWaveChannelInfo::bswap() {
@@ -49,7 +49,7 @@ void WaveInfo::bswap() {
 
 void decodePcm8Block(const u8* blockData, u32 sampleCount, s16* buffer, u8 stride) {
   for (u32 sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++) {
-    buffer[sampleIndex * stride] = (reinterpret_cast<const s8*>(blockData))[sampleIndex];
+    buffer[sampleIndex * stride] = (reinterpret_cast<const s8*>(blockData))[sampleIndex] * 256;
   }
 }
 
@@ -115,10 +115,26 @@ void decodeBlock(const u8* blockData, u32 sampleCount, s16* blockBuffer, u8 stri
     break;
   
   default:
-    std::cerr << "Warning: unknown track format " << format << '\n';
+    RSND_WARN(LOG_DECODE, "unknown track format " << format);
   }
 }
 
+u32 waveLoopStart(const WaveInfo* info) {
+  return info->format == WaveInfo::FORMAT_ADPCM ? dspAddressToSamples(info->loopStart) : info->loopStart;
+}
+
+u32 waveLoopEnd(const WaveInfo* info) {
+  return (info->format == WaveInfo::FORMAT_ADPCM ? dspAddressToSamples(info->loopEnd) : info->loopEnd) + 1;
+}
+
+u32 waveLoopStartAddress(u8 format, u32 loopStart) {
+  return format == WaveInfo::FORMAT_ADPCM ? samplesToDspAddress(loopStart) : loopStart;
+}
+
+u32 waveLoopEndAddress(u8 format, u32 end) {
+  return format == WaveInfo::FORMAT_ADPCM ? samplesToDspAddress(end - 1) : end - 1;
+}
+
 static constexpr u32 BRSAR_MAGIC = MAGIC_FOURCC({'R', 'S', 'A', 'R'});
 static constexpr u32 BRSTM_MAGIC = MAGIC_FOURCC({'R', 'S', 'T', 'M'});
 static constexpr u32 BRWAV_MAGIC = MAGIC_FOURCC({'R', 'W', 'A', 'V'});
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <map>
+#include <regex>
+
+#include "rsnd/SoundArchiveWriter.hpp"
+#include "common/filePlan.hpp"
+#include "tools/archive.hpp"
+
+namespace rsnd {
+// numbered RWAVs as written by extract, missing numbers become empty entries
+std::vector<std::filesystem::path> findWaveFiles(const std::filesystem::path& dir) {
+  static const std::regex wavePattern("([0-9]+)\\.brwav");
+  std::map<u32, std::filesystem::path> numbered;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    std::smatch match;
+    const std::string filename = entry.path().filename().string();
+    if (entry.is_regular_file() && std::regex_match(filename, match, wavePattern)) {
+      numbered[std::stoul(match[1])] = entry.path();
+    }
+  }
+
+  std::vector<std::filesystem::path> waves;
+  if (!numbered.empty()) waves.resize(numbered.rbegin()->first + 1);
+  for (const auto& [i, path] : numbered) waves[i] = path;
+  return waves;
+}
+
+void rsndArchive(CliOpts& cliOpts) {
+  const std::filesystem::path& inputDir = cliOpts.inputFile;
+  if (!std::filesystem::is_directory(inputDir)) {
+    std::cerr << inputDir << " is not a directory\n";
+    exit(-1);
+  }
+  const std::filesystem::path manifestPath = inputDir / "manifest.txt";
+  const bool soundArchive = std::filesystem::exists(manifestPath);
+
+  if (cliOpts.outputPath.empty()) {
+    // foo.brsar.d -> foo.packed.brsar
+    std::filesystem::path base = inputDir;
+    if (base.filename().empty()) base = base.parent_path();
+    if (base.extension() == ".d") base.replace_extension();
+    const std::string extension = base.has_extension() ? base.extension().string() : soundArchive ? ".brsar" : ".brwar";
+    base.replace_extension();
+    cliOpts.outputPath = base.string() + ".packed" + extension;
+  }
+
+  FilePlan plan;
+  if (soundArchive) {
+    plan = planSoundArchive(readArchiveManifest(manifestPath));
+  } else {
+    std::vector<std::filesystem::path> waves = findWaveFiles(inputDir);
+    if (waves.empty()) {
+      std::cerr << inputDir << " has no manifest.txt or numbered .brwav files to archive\n";
+      exit(-1);
+    }
+    plan = planSoundWaveArchive(waves);
+  }
+  plan.write(cliOpts.outputPath);
+}
+}
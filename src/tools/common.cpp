@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <cstring>
 
 #include "rsnd/soundCommon.hpp"
 #include "tools/common.hpp"
@@ -10,4 +11,14 @@ std::string magicLowercase(void* fileData) {
   std::transform(magic.begin(), magic.end(), magic.begin(), [](unsigned char c){ return std::tolower(c); });
   return magic;
 }
+
+std::string uniqueFileName(std::set<std::string>& usedNames, const std::string& name, u32 idx) {
+  std::string fileName = name;
+  for (char& c : fileName) {
+    if (static_cast<unsigned char>(c) < 0x20 || c == 0x7f || std::strchr("/\\:*?\"<>|", c)) c = '_';
+  }
+  if (fileName.find_first_not_of('.') == std::string::npos) fileName = std::to_string(idx);
+  while (!usedNames.insert(fileName).second) fileName += "_" + std::to_string(idx);
+  return fileName;
+}
 }
\ No newline at end of file
@@ -1,57 +1,253 @@
 
 #include <iostream>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 #include "rsnd/soundCommon.hpp"
 #include "rsnd/SoundWave.hpp"
+#include "rsnd/AdpcmSeekIndex.hpp"
 #include "rsnd/SoundStream.hpp"
 #include "rsnd/SoundSequence.hpp"
+#include "rsnd/SoundBank.hpp"
 #include "common/fileUtil.hpp"
+#include "common/pcmSink.hpp"
+#include "common/flac.hpp"
+#include "common/resampler.hpp"
+#include "common/log.hpp"
 #include "tools/decode.hpp"
+#include "tools/extract.hpp"
 #include "tools/common.hpp"
 #include "vgmtrans/MidiFile.h"
 
 namespace rsnd {
-void rsndDecodeWave(const SoundWave& soundWave, CliOpts& cliOpts) {
+const char* audioExtension(const CliOpts& cliOpts) {
+  return cliOpts.decodeOpts.format == AUDIO_FLAC ? ".flac" : ".wav";
+}
+
+std::unique_ptr<PcmSink> openAudioSink(const std::filesystem::path& path, const CliOpts& cliOpts, u32 fadeFrames) {
+  std::unique_ptr<PcmSink> sink;
+  switch (cliOpts.decodeOpts.format)
+  {
+  case AUDIO_FLAC:
+    sink = std::make_unique<FlacFileSink>(path);
+    break;
+
+  default:
+    sink = std::make_unique<WaveFileSink>(path);
+    break;
+  }
+
+  if (cliOpts.decodeOpts.resampleRate != 0) {
+    sink = std::make_unique<ResamplerSink>(std::move(sink), cliOpts.decodeOpts.resampleRate, cliOpts.decodeOpts.resampleQuality);
+  }
+  if (fadeFrames > 0) {
+    sink = std::make_unique<FadeOutSink>(std::move(sink), fadeFrames);
+  }
+  return sink;
+}
+
+static bool rendersLoops(const CliOpts& cliOpts) {
+  return cliOpts.decodeOpts.loops != 1 || cliOpts.decodeOpts.fadeSeconds > 0;
+}
+
+// Frames to render for a looped sound: the intro, the loop body `loops` times, then the fade
+static u32 loopedFrameCount(u32 loopStart, u32 loopEnd, u32 fadeFrames, const CliOpts& cliOpts) {
+  u64 frameCount = loopStart + static_cast<u64>(cliOpts.decodeOpts.loops) * (loopEnd - loopStart) + fadeFrames;
+  return static_cast<u32>(std::min<u64>(frameCount, UINT32_MAX));
+}
+
+static u32 fadeFrameCount(u32 sampleRate, const CliOpts& cliOpts) {
+  return static_cast<u32>(std::lround(cliOpts.decodeOpts.fadeSeconds * sampleRate));
+}
+
+static bool decodesRange(const CliOpts& cliOpts) {
+  return cliOpts.decodeOpts.startSeconds > 0 || cliOpts.decodeOpts.durationSeconds >= 0 || !cliOpts.decodeOpts.channels.empty();
+}
+
+// First sample and sample count selected by --start/--duration
+static void rangeSamples(u32 sampleRate, const CliOpts& cliOpts, u32& firstSample, u32& count) {
+  // both are checked to not be negative, and saturate past the end of any file
+  firstSample = static_cast<u32>(std::min<f64>(std::round(cliOpts.decodeOpts.startSeconds * sampleRate), UINT32_MAX));
+  count = cliOpts.decodeOpts.durationSeconds < 0 ? UINT32_MAX : static_cast<u32>(std::min<f64>(std::round(cliOpts.decodeOpts.durationSeconds * sampleRate), UINT32_MAX));
+}
+
+static void checkChannels(u8 channelCount, const CliOpts& cliOpts) {
+  for (u8 channelIdx : cliOpts.decodeOpts.channels) {
+    if (channelIdx >= channelCount) {
+      std::cerr << "Channel " << (int)channelIdx << " out of range, the file has " << (int)channelCount << " channels\n";
+      exit(-1);
+    }
+  }
+}
+
+// Loads the seek index sidecar of the input, (re)building it if it is missing or stale
+static void loadSeekIndex(SoundWave& soundWave, AdpcmSeekIndex& seekIndex, const CliOpts& cliOpts) {
+  if (soundWave.info->format != WaveInfo::FORMAT_ADPCM || isStdio(cliOpts.inputFile)) return;
+
+  const auto indexPath = AdpcmSeekIndex::sidecarPath(cliOpts.inputFile);
+  if (!seekIndex.load(indexPath, soundWave)) {
+    seekIndex.build(soundWave);
+    if (!seekIndex.save(indexPath)) {
+      RSND_WARN(LOG_IO, "could not write seek index " << indexPath);
+    }
+  }
+  soundWave.setSeekIndex(&seekIndex);
+}
+
+void rsndDecodeWave(SoundWave& soundWave, CliOpts& cliOpts) {
   if (cliOpts.outputPath.empty()) {
     auto tmp = cliOpts.inputFile;
-    tmp.replace_extension(".wav");
+    tmp.replace_extension(audioExtension(cliOpts));
     cliOpts.outputPath = tmp;
   }
-  soundWave.toWaveFile(cliOpts.outputPath);
+  AdpcmSeekIndex seekIndex;
+  if (cliOpts.decodeOpts.seekIndex) loadSeekIndex(soundWave, seekIndex, cliOpts);
+  if (decodesRange(cliOpts)) {
+    std::vector<u8> channels = cliOpts.decodeOpts.channels;
+    checkChannels(soundWave.getChannelCount(), cliOpts);
+    if (channels.empty()) {
+      for (int i = 0; i < soundWave.getChannelCount(); i++) channels.push_back(i);
+    }
+    u32 firstSample, count;
+    rangeSamples(soundWave.getTrackSampleRate(), cliOpts, firstSample, count);
+    soundWave.decodeRange(channels.data(), channels.size(), firstSample, count, *openAudioSink(cliOpts.outputPath, cliOpts));
+    return;
+  }
+
+  u32 frameCount = 0;
+  u32 fadeFrames = 0;
+  if (soundWave.isLooped() && rendersLoops(cliOpts)) {
+    fadeFrames = fadeFrameCount(soundWave.getTrackSampleRate(), cliOpts);
+    frameCount = loopedFrameCount(soundWave.getLoopStart(), soundWave.getLoopEnd(), fadeFrames, cliOpts);
+  }
+  soundWave.decode(*openAudioSink(cliOpts.outputPath, cliOpts, fadeFrames), frameCount);
 }
 
-void rsndDecodeStream(const SoundStream& soundStream, CliOpts& cliOpts) {
+// one file per track, or a single file with the channels picked by --channels or the --mixdown
+static int streamOutputCount(const SoundStream& soundStream, const CliOpts& cliOpts) {
+  return cliOpts.decodeOpts.channels.empty() && cliOpts.decodeOpts.mixdownChannels == 0 ? soundStream.trackTable->trackCount : 1;
+}
+
+static void prepareStreamOutput(const SoundStream& soundStream, CliOpts& cliOpts) {
+  const int outputCount = streamOutputCount(soundStream, cliOpts);
   if (cliOpts.outputPath.empty()) {
     auto tmp = cliOpts.inputFile;
-    if (soundStream.trackTable->trackCount > 1) {
+    if (outputCount > 1) {
       tmp.replace_extension(".d");
     } else {
-      tmp.replace_extension(".wav");
+      tmp.replace_extension(audioExtension(cliOpts));
     }
     cliOpts.outputPath = tmp;
   }
-  if (soundStream.trackTable->trackCount > 1) {
+  if (outputCount > 1) {
+    if (isStdio(cliOpts.outputPath)) {
+      std::cerr << "Cannot write " << outputCount << " tracks to stdout\n";
+      exit(-1);
+    }
     std::filesystem::create_directories(cliOpts.outputPath);
   }
+}
+
+static std::filesystem::path trackOutputPath(const SoundStream& soundStream, const CliOpts& cliOpts, int trackIdx) {
+  return streamOutputCount(soundStream, cliOpts) > 1 ? cliOpts.outputPath / (std::to_string(trackIdx) + audioExtension(cliOpts)) : cliOpts.outputPath;
+}
+
+void rsndDecodeStream(const SoundStream& soundStream, CliOpts& cliOpts) {
+  prepareStreamOutput(soundStream, cliOpts);
+  if (cliOpts.decodeOpts.mixdownChannels != 0) {
+    soundStream.decodeMixdown(cliOpts.decodeOpts.mixdownChannels, *openAudioSink(cliOpts.outputPath, cliOpts));
+    return;
+  }
+  if (decodesRange(cliOpts)) {
+    u32 firstSample, count;
+    rangeSamples(soundStream.strmDataInfo->sampleRate, cliOpts, firstSample, count);
+    const auto& channels = cliOpts.decodeOpts.channels;
+    if (!channels.empty()) {
+      checkChannels(soundStream.strmDataInfo->channelCount, cliOpts);
+      soundStream.decodeRange(channels.data(), channels.size(), firstSample, count, *openAudioSink(cliOpts.outputPath, cliOpts));
+      return;
+    }
+    for (int i = 0; i < soundStream.trackTable->trackCount; i++) {
+      u8 channelCount;
+      const u8* channelIndices = soundStream.getTrackChannels(i, channelCount);
+      soundStream.decodeRange(channelIndices, channelCount, firstSample, count, *openAudioSink(trackOutputPath(soundStream, cliOpts, i), cliOpts));
+    }
+    return;
+  }
+
+  u32 frameCount = 0;
+  u32 fadeFrames = 0;
+  if (soundStream.isLooped() && rendersLoops(cliOpts)) {
+    fadeFrames = fadeFrameCount(soundStream.strmDataInfo->sampleRate, cliOpts);
+    frameCount = loopedFrameCount(soundStream.getLoopStart(), soundStream.getLoopEnd(), fadeFrames, cliOpts);
+  }
   for (int i = 0; i < soundStream.trackTable->trackCount; i++) {
-    const std::filesystem::path outpath = soundStream.trackTable->trackCount > 0 ? cliOpts.outputPath / (std::to_string(i) + ".wav") : cliOpts.outputPath;
-    soundStream.trackToWaveFile(i, outpath);
+    soundStream.decodeTrack(i, *openAudioSink(trackOutputPath(soundStream, cliOpts, i), cliOpts, fadeFrames), frameCount);
+  }
+}
+
+// Decodes a BRSTM whose stream data has not been loaded, reading the block rows from `in`
+void rsndDecodeStreamRows(const SoundStream& soundStream, std::istream& in, CliOpts& cliOpts) {
+  prepareStreamOutput(soundStream, cliOpts);
+  const u8 trackCount = soundStream.trackTable->trackCount;
+  std::vector<std::unique_ptr<PcmSink>> audioSinks;
+  std::vector<PcmSink*> trackSinks;
+  for (int i = 0; i < trackCount; i++) {
+    audioSinks.push_back(openAudioSink(trackOutputPath(soundStream, cliOpts, i), cliOpts));
+    trackSinks.push_back(audioSinks.back().get());
   }
+  soundStream.decodeTracks(in, trackSinks.data());
 }
 
 void rsndDecodeSequence(const SoundSequence& soundSequence, CliOpts& cliOpts) {
   if (cliOpts.outputPath.empty()) {
     auto tmp = cliOpts.inputFile;
-    tmp.replace_extension(".mid");
+    tmp.replace_extension(cliOpts.decodeOpts.allLabels ? ".d" : ".mid");
     cliOpts.outputPath = tmp;
   }
-  MidiFile midiFile(&soundSequence);
+  if (cliOpts.decodeOpts.allLabels) {
+    if (isStdio(cliOpts.outputPath)) {
+      std::cerr << "Cannot write " << soundSequence.getLabelCount() << " labels to stdout\n";
+      exit(-1);
+    }
+    extract_rseq_midis(cliOpts.outputPath, soundSequence, cliOpts.decodeOpts.seqLimits);
+    return;
+  }
+  MidiFile midiFile(&soundSequence, cliOpts.decodeOpts.seqLimits);
   midiFile.SaveMidiFile(cliOpts.outputPath);
 }
 
-void rsndDecode(CliOpts& cliOpts) {
-  size_t inputSize;
-  void* inputData = readBinary(cliOpts.inputFile, inputSize);
+// The wave data of a bank is a separate file next to it: bank.brwar for banks referring to a BRWAR, the raw
+// wave data (as extracted from a BRSAR group) in bank.bin for banks with their own WAVE block
+void* readBankWaveData(const std::filesystem::path& bankPath, const void* bankData, size_t& waveSize) {
+  SoundBankHeader header = *static_cast<const SoundBankHeader*>(bankData);
+  header.bswap();
+  auto wavePath = bankPath;
+  wavePath.replace_extension(header.waveOffset != 0 ? ".bin" : ".brwar");
+  if (isStdio(bankPath) || !std::filesystem::exists(wavePath)) {
+    std::cerr << "The bank's wave data is a separate file, expected at " << wavePath << '\n';
+    exit(-1);
+  }
+  return readBinary(wavePath, waveSize);
+}
+
+void rsndDecodeBank(void* inputData, size_t inputSize, CliOpts& cliOpts) {
+  if (cliOpts.outputPath.empty()) {
+    auto tmp = cliOpts.inputFile;
+    tmp.replace_extension(".sf2");
+    cliOpts.outputPath = tmp;
+  }
+
+  size_t waveSize;
+  void* waveData = readBankWaveData(cliOpts.inputFile, inputData, waveSize);
+  extract_rbnk_sf2(cliOpts.outputPath, inputData, inputSize, waveData, waveSize);
+  free(waveData);
+}
+
+void rsndDecodeData(void* inputData, size_t inputSize, CliOpts& cliOpts) {
   FileFormat inputFormat = detectFileFormat(cliOpts.inputFile.filename().string(), inputData, inputSize);
   switch (inputFormat)
   {
@@ -70,11 +266,74 @@ void rsndDecode(CliOpts& cliOpts) {
     rsndDecodeSequence(soundSequence, cliOpts);
     break;
 
+  } case FMT_BRBNK: {
+    rsndDecodeBank(inputData, inputSize, cliOpts);
+    break;
+
   } default:
     std::cerr << cliOpts.inputFile << " file format decode not supported\n";
     exit(-1);
   }
+}
 
+// Reads `size` more bytes into the growing prefix buffer
+static bool readPrefix(std::istream& in, std::vector<u8>& prefix, size_t size) {
+  if (size <= prefix.size()) return true;
+  size_t offset = prefix.size();
+  prefix.resize(size);
+  in.read(reinterpret_cast<char*>(prefix.data() + offset), size - offset);
+  prefix.resize(offset + in.gcount());
+  return prefix.size() == size;
+}
+
+// Decodes from a pipe. BRSTM stream data is decoded as it arrives, only the preceding blocks are held in memory.
+// Other formats, BRSTMs laid out with the stream data before the other blocks, loop rendering
+// (which has to go back to the loop start), ranged decoding and mixdowns read the whole input first.
+void rsndDecodePipe(std::istream& in, CliOpts& cliOpts) {
+  std::vector<u8> prefix;
+  if (!readPrefix(in, prefix, sizeof(BinaryFileHeader))) {
+    std::cerr << "Unexpected end of input\n";
+    exit(-1);
+  }
+
+  if (!rendersLoops(cliOpts) && !decodesRange(cliOpts) && cliOpts.decodeOpts.mixdownChannels == 0 && detectFileFormat("", prefix.data(), prefix.size()) == FMT_BRSTM && readPrefix(in, prefix, sizeof(SoundStreamHeader))) {
+    SoundStreamHeader strmHdr = *reinterpret_cast<SoundStreamHeader*>(prefix.data());
+    strmHdr.bswap();
+
+    if (strmHdr.headOffset + strmHdr.headSize <= strmHdr.dataOffset && strmHdr.adpcOffset + strmHdr.adpcSize <= strmHdr.dataOffset
+        && readPrefix(in, prefix, strmHdr.dataOffset + sizeof(SoundStreamData))) {
+      SoundStreamData strmData = *reinterpret_cast<SoundStreamData*>(prefix.data() + strmHdr.dataOffset);
+      strmData.bswap();
+
+      if (readPrefix(in, prefix, strmHdr.dataOffset + sizeof(BinaryBlockHeader) + strmData.dataOffset)) {
+        SoundStream soundStream(prefix.data(), prefix.size());
+        rsndDecodeStreamRows(soundStream, in, cliOpts);
+        return;
+      }
+    }
+  }
+
+  size_t inputSize;
+  void* inputData = readRemaining(in, prefix.data(), prefix.size(), inputSize);
+  rsndDecodeData(inputData, inputSize, cliOpts);
   free(inputData);
 }
-}
\ No newline at end of file
+
+void rsndDecode(CliOpts& cliOpts) {
+  if (rendersLoops(cliOpts) + decodesRange(cliOpts) + (cliOpts.decodeOpts.mixdownChannels != 0) > 1) {
+    std::cerr << "--loops/--fade, --start/--duration/--channels and --mixdown cannot be combined\n";
+    exit(-1);
+  }
+
+  if (isStdio(cliOpts.inputFile)) {
+    if (cliOpts.outputPath.empty()) cliOpts.outputPath = "-";
+    rsndDecodePipe(openStdin(), cliOpts);
+    return;
+  }
+
+  size_t inputSize;
+  void* inputData = readBinary(cliOpts.inputFile, inputSize);
+  rsndDecodeData(inputData, inputSize, cliOpts);
+  free(inputData);
+}
+}
@@ -0,0 +1,290 @@
+#include <iostream>
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "rsnd/AdpcmEncoder.hpp"
+#include "rsnd/SoundWriter.hpp"
+#include "rsnd/SoundBankWriter.hpp"
+#include "rsnd/SoundArchiveWriter.hpp"
+#include "common/fileUtil.hpp"
+#include "common/log.hpp"
+#include "common/parallel.hpp"
+#include "common/soundFont.hpp"
+#include "tools/encode.hpp"
+
+namespace rsnd {
+namespace {
+// A sample as played by a zone, with the zone's address offsets applied
+struct BankWave {
+  u32 start;
+  u32 sampleCount;
+  bool loop;
+  u32 loopStart;
+  u32 sampleRate;
+  u64 hash;
+
+  bool operator==(const BankWave& other) const {
+    return sampleCount == other.sampleCount && loop == other.loop && loopStart == other.loopStart && sampleRate == other.sampleRate;
+  }
+};
+
+// the local zone's generators over the global zone's
+SoundFontZone mergeZone(const std::optional<SoundFontZone>& global, const SoundFontZone& local) {
+  SoundFontZone zone = global.value_or(SoundFontZone{});
+  for (int gen = 0; gen < endOper; gen++) {
+    if (!local.present[gen]) continue;
+    zone.amounts[gen] = local.amounts[gen];
+    zone.present.set(gen);
+  }
+  return zone;
+}
+
+bool intersectRange(rangesType& range, const rangesType& other) {
+  range.byLo = std::max(range.byLo, other.byLo);
+  range.byHi = std::min(range.byHi, other.byHi);
+  return range.byLo <= range.byHi;
+}
+
+// Inverse of envelopeFromInfo for one parameter: the value of field whose generator is closest to target.
+// Generators are compared the way SF2File stores them, wrapped to 16 bits
+s8 envelopeValue(InstrInfo& info, s8 InstrInfo::* field, double EnvelopeParams::* param, s16 target) {
+  s8 best = 0;
+  int bestDiff = INT32_MAX;
+  for (int value = 0; value < 128; value++) {
+    info.*field = value;
+    const s16 gen = static_cast<s16>(static_cast<s32>(envelopeFromInfo(&info).*param));
+    if (std::abs(gen - target) < bestDiff) {
+      best = value;
+      bestDiff = std::abs(gen - target);
+    }
+  }
+  info.*field = best;
+  return best;
+}
+
+// SF2 envelope defaults are the shortest times and no attenuation
+void setEnvelope(InstrInfo& info, const SoundFontZone& zone) {
+  // decay and release depend on the sustain level
+  envelopeValue(info, &InstrInfo::sustain, &EnvelopeParams::sustain_level, zone.get(sustainVolEnv, 0));
+  envelopeValue(info, &InstrInfo::attack, &EnvelopeParams::attack_time, zone.get(attackVolEnv, -12000));
+  envelopeValue(info, &InstrInfo::hold, &EnvelopeParams::hold_time, zone.get(holdVolEnv, -12000));
+  envelopeValue(info, &InstrInfo::decay, &EnvelopeParams::decay_time, zone.get(decayVolEnv, -12000));
+  envelopeValue(info, &InstrInfo::release, &EnvelopeParams::release_time, zone.get(releaseVolEnv, -12000));
+}
+
+class BankEncoder {
+private:
+  const SoundFontData& soundFont;
+  std::vector<BankWave> waves;
+  std::unordered_map<u64, std::vector<u32>> wavesByHash;
+
+  const s16* samplesOf(const BankWave& wave) const { return soundFont.sampleData.data() + wave.start; }
+
+  // index of the wave played by an instrument zone, identical waves are shared
+  u32 waveIndex(const SoundFontZone& zone) {
+    const sfSample& sample = soundFont.samples[zone.amounts[sampleID].wAmount];
+    auto address = [&](u32 base, SFGenerator fine, SFGenerator coarse) {
+      const s64 value = s64(base) + zone.get(fine, 0) + s64(zone.get(coarse, 0)) * 32768;
+      return static_cast<u32>(std::clamp<s64>(value, sample.dwStart, sample.dwEnd));
+    };
+    const u32 start = address(sample.dwStart, startAddrsOffset, startAddrsCoarseOffset);
+    const u32 end = std::max(start, address(sample.dwEnd, endAddrsOffset, endAddrsCoarseOffset));
+    const u32 loopStart = address(sample.dwStartloop, startloopAddrsOffset, startloopAddrCoarseOffset);
+    const u32 loopEnd = address(sample.dwEndloop, endloopAddrsOffset, endloopAddrsCoarseOffset);
+
+    BankWave wave = {start, end - start, (zone.get(sampleModes, 0) & 1) != 0, 0, sample.dwSampleRate, 0};
+    if (wave.loop && loopStart >= start && loopStart < std::min(loopEnd, end)) {
+      // nothing after the loop end is ever played
+      wave.loopStart = loopStart - start;
+      wave.sampleCount = std::min(loopEnd, end) - start;
+    } else if (wave.loop) {
+      RSND_WARN(LOG_PARSE, "ignoring loop " << loopStart << "-" << loopEnd << " outside of sample " << recordName(sample));
+      wave.loop = false;
+    }
+    if (wave.sampleCount == 0) {
+      std::cerr << "Sample " << recordName(sample) << " has no samples\n";
+      exit(-1);
+    }
+
+    // FNV-1a over the samples and their parameters
+    u64 hash = 0xcbf29ce484222325;
+    auto mix = [&hash](const void* data, size_t size) {
+      for (size_t i = 0; i < size; i++) hash = (hash ^ static_cast<const u8*>(data)[i]) * 0x100000001b3;
+    };
+    mix(samplesOf(wave), wave.sampleCount * sizeof(s16));
+    mix(&wave.sampleCount, sizeof(wave.sampleCount));
+    mix(&wave.loop, sizeof(wave.loop));
+    mix(&wave.loopStart, sizeof(wave.loopStart));
+    mix(&wave.sampleRate, sizeof(wave.sampleRate));
+    wave.hash = hash;
+
+    std::vector<u32>& candidates = wavesByHash[hash];
+    for (u32 idx : candidates) {
+      if (waves[idx] == wave && std::equal(samplesOf(wave), samplesOf(wave) + wave.sampleCount, samplesOf(waves[idx]))) return idx;
+    }
+    candidates.push_back(waves.size());
+    waves.push_back(wave);
+    return waves.size() - 1;
+  }
+
+  static std::string recordName(const sfSample& sample) { return std::string(sample.achSampleName, strnlen(sample.achSampleName, 20)); }
+
+  // Preset zone generators add to the instrument's for volume, pan and tuning. The rest is taken from the instrument zone
+  BankRegion makeRegion(const SoundFontZone& presetZone, const SoundFontZone& instrZone, const rangesType& keys, const rangesType& vels) {
+    const sfSample& sample = soundFont.samples[instrZone.amounts[sampleID].wAmount];
+    BankRegion region = {keys.byLo, keys.byHi, vels.byLo, vels.byHi, {}};
+    InstrInfo& info = region.info;
+    info.waveIdx = waveIndex(instrZone);
+
+    const int attenuation = instrZone.get(initialAttenuation, 0) + presetZone.get(initialAttenuation, 0);
+    info.volume = std::clamp(127 - attenuation, 0, 127);
+    const int panGen = instrZone.get(pan, 0) + presetZone.get(pan, 0);
+    info.pan = std::clamp<int>(std::lround(panGen * 64 / 500.0) + 64, 0, 127);
+    const int rootKey = instrZone.get(overridingRootKey, -1);
+    info.originalKey = rootKey >= 0 && rootKey < 128 ? rootKey : std::min<int>(sample.byOriginalKey, 127);
+    const int cents = (instrZone.get(coarseTune, 0) + presetZone.get(coarseTune, 0)) * 100 + instrZone.get(fineTune, 0) + presetZone.get(fineTune, 0)
+                      + sample.chCorrection;
+    info.pitch = std::pow(2.0, cents / 1200.0);
+    setEnvelope(info, instrZone);
+    return region;
+  }
+
+public:
+  BankEncoder(const SoundFontData& soundFont) : soundFont(soundFont) {}
+
+  // Regions of a preset, in zone order so that the first of overlapping zones is kept
+  std::vector<BankRegion> buildInstrument(const SoundFontPreset& preset) {
+    std::vector<BankRegion> regions;
+    bool warnedStereo = false;
+    bool warnedOverlap = false;
+    std::vector<std::bitset<128>> covered(128);
+    for (const SoundFontZone& presetLocal : preset.zones) {
+      const SoundFontZone presetZone = mergeZone(preset.global, presetLocal);
+      const SoundFontInstrument& instr = soundFont.instruments[presetLocal.amounts[instrument].wAmount];
+      for (const SoundFontZone& instrLocal : instr.zones) {
+        const SoundFontZone instrZone = mergeZone(instr.global, instrLocal);
+        rangesType keys = presetZone.getRange(keyRange);
+        rangesType vels = presetZone.getRange(velRange);
+        if (!intersectRange(keys, instrZone.getRange(keyRange)) || !intersectRange(vels, instrZone.getRange(velRange))) continue;
+
+        const sfSample& sample = soundFont.samples[instrZone.amounts[sampleID].wAmount];
+        if (!warnedStereo && (sample.sfSampleType & (leftSample | rightSample))) {
+          RSND_WARN(LOG_PARSE, "preset " << preset.name << " has stereo samples, only the first of each left/right pair is kept");
+          warnedStereo = true;
+        }
+        // zones hidden behind earlier ones are dropped along with their samples
+        bool overlaps = false;
+        bool hidden = true;
+        for (int key = keys.byLo; key <= keys.byHi; key++) {
+          for (int vel = vels.byLo; vel <= vels.byHi; vel++) {
+            overlaps |= covered[key][vel];
+            hidden &= covered[key][vel];
+            covered[key][vel] = true;
+          }
+        }
+        if (!warnedOverlap && overlaps) {
+          RSND_WARN(LOG_PARSE, "preset " << preset.name << " has overlapping zones, only the first is played where they overlap");
+          warnedOverlap = true;
+        }
+        if (hidden) continue;
+        regions.push_back(makeRegion(presetZone, instrZone, keys, vels));
+      }
+    }
+    return regions;
+  }
+
+  // every wave used by the instruments built so far, as RWAV files
+  std::vector<std::vector<u8>> encodeWaves(AdpcmEncodeQuality quality) const {
+    std::vector<std::vector<u8>> files(waves.size());
+    parallelFor(waves.size(), [&](size_t i) {
+      const BankWave& wave = waves[i];
+      EncodedSound sound;
+      sound.sampleRate = wave.sampleRate;
+      sound.sampleCount = wave.sampleCount;
+      sound.loop = wave.loop;
+      sound.loopStart = wave.loopStart;
+      sound.channels = encodeAdpcm(samplesOf(wave), 1, wave.sampleCount, quality);
+      files[i] = buildSoundWave(sound);
+    });
+    return files;
+  }
+};
+
+// SF2 to a BRBNK of its bank 0 presets (the preset number is the program) and a BRWAR of their samples
+void rsndEncodeBank(CliOpts& cliOpts) {
+  const SoundFontData soundFont = readSoundFont(cliOpts.inputFile);
+  if (cliOpts.outputPath.empty()) {
+    cliOpts.outputPath = cliOpts.inputFile;
+    cliOpts.outputPath.replace_extension(".brbnk");
+  }
+  std::filesystem::path warPath = cliOpts.outputPath;
+  warPath.replace_extension(".brwar");
+
+  std::vector<const SoundFontPreset*> programs;
+  for (const SoundFontPreset& preset : soundFont.presets) {
+    if (preset.bank != 0 || preset.preset >= 128) {
+      RSND_WARN(LOG_PARSE, "skipping preset " << preset.name << " (bank " << preset.bank << ", preset " << preset.preset << "), only bank 0 is encoded");
+      continue;
+    }
+    if (programs.size() <= preset.preset) programs.resize(preset.preset + 1);
+    if (programs[preset.preset]) {
+      RSND_WARN(LOG_PARSE, "skipping preset " << preset.name << ", program " << preset.preset << " is already used");
+      continue;
+    }
+    programs[preset.preset] = &preset;
+  }
+
+  BankEncoder encoder(soundFont);
+  std::vector<std::vector<BankRegion>> instruments(programs.size());
+  for (size_t i = 0; i < programs.size(); i++) {
+    if (programs[i]) instruments[i] = encoder.buildInstrument(*programs[i]);
+  }
+
+  std::vector<u8> bank = buildSoundBank(instruments);
+  std::vector<u8> war = buildSoundWaveArchive(encoder.encodeWaves(cliOpts.encodeOpts.quality));
+  writeBinary(cliOpts.outputPath, bank.data(), bank.size());
+  writeBinary(warPath, war.data(), war.size());
+}
+}
+
+void rsndEncode(CliOpts& cliOpts) {
+  if (cliOpts.inputFile.extension() == ".sf2") {
+    rsndEncodeBank(cliOpts);
+    return;
+  }
+
+  WaveFileData wave = readWaveFile(cliOpts.inputFile);
+  if (cliOpts.outputPath.empty()) {
+    cliOpts.outputPath = cliOpts.inputFile;
+    cliOpts.outputPath.replace_extension(".brstm");
+  }
+  const bool soundWave = cliOpts.outputPath.extension() == ".brwav";
+
+  if (wave.sampleCount == 0) {
+    std::cerr << cliOpts.inputFile << " has no samples\n";
+    exit(-1);
+  }
+  if (!soundWave && wave.sampleRate > 0xffff) {
+    std::cerr << "BRSTM sample rates are limited to 65535 Hz, got " << wave.sampleRate << '\n';
+    exit(-1);
+  }
+
+  EncodedSound sound;
+  sound.sampleRate = wave.sampleRate;
+  sound.sampleCount = wave.sampleCount;
+  sound.loop = wave.loop && wave.loopStart < std::min(wave.loopEnd, wave.sampleCount);
+  sound.loopStart = sound.loop ? wave.loopStart : 0;
+  if (wave.loop && !sound.loop) {
+    RSND_WARN(LOG_PARSE, "ignoring loop " << wave.loopStart << "-" << wave.loopEnd << " outside of the " << wave.sampleCount << " samples");
+  }
+  // nothing after the loop end is ever played
+  if (sound.loop) sound.sampleCount = std::min(wave.loopEnd, wave.sampleCount);
+
+  sound.channels = encodeAdpcm(wave.pcm.data(), wave.channelCount, sound.sampleCount, cliOpts.encodeOpts.quality);
+  std::vector<u8> file = soundWave ? buildSoundWave(sound) : buildSoundStream(sound);
+  writeBinary(cliOpts.outputPath, file.data(), file.size());
+}
+}
@@ -3,17 +3,22 @@
 #include <filesystem>
 #include <cstring>
 #include <algorithm>
+#include <set>
 
 #include "rsnd/SoundArchive.hpp"
+#include "rsnd/SoundArchiveWriter.hpp"
 #include "rsnd/SoundWaveArchive.hpp"
 #include "rsnd/SoundBank.hpp"
 #include "rsnd/SoundWsd.hpp"
+#include "rsnd/SoundSequence.hpp"
 #include "rsnd/soundCommon.hpp"
 #include "common/cli.h"
 #include "common/fileUtil.hpp"
+#include "common/parallel.hpp"
 #include "tools/common.hpp"
 #include "tools/decode.hpp"
 
+#include "vgmtrans/MidiFile.h"
 #include "vgmtrans/SF2File.h"
 #include "vgmtrans/WaveAudio.h"
 
@@ -54,33 +59,49 @@ void extract_brsar_sounds(const SoundArchive& soundArchive, const CliOpts& cliOp
 
 void extract_rbnk_sf2(const std::filesystem::path filepath, void* fileData, size_t fileSize, void* waveData, size_t waveSize) {
   SoundBank soundBank(fileData, fileSize, waveData);
-  std::vector<WaveAudio> waveAudios;
+  // the waves are only decoded one at a time as the SF2 is written
+  std::vector<WaveAudioSource> waveSources;
   if (soundBank.containsWaves) {
-    waveAudios = std::move(toWaveCollection(&soundBank, waveData));
+    waveSources = toWaveSources(&soundBank, waveData);
   } else {
     SoundWaveArchive waveArchive(waveData, waveSize);
     for (int i = 0; i < waveArchive.getWaveCount(); i++) {
       size_t rwavSize;
       void* rwavData = waveArchive.getWaveFile(i, rwavSize);
-      SoundWave rwav(rwavData, rwavSize);
-      waveAudios.push_back(toWaveAudio(&rwav));
+      waveSources.push_back(toWaveSource(SoundWave(rwavData, rwavSize)));
     }
   }
 
-  SF2File sf2file(&soundBank, waveAudios);
+  SF2File sf2file(&soundBank, waveSources);
   sf2file.SaveSF2File(filepath);
 }
 
-void extract_rwsd_embedded_wav(const std::filesystem::path filepath, const SoundWsd& soundWsd, void* waveData, size_t waveSize) {
+void extract_rseq_midis(const std::filesystem::path dirPath, const SoundSequence& soundSeq, const SeqPlayLimits& limits) {
+  std::filesystem::create_directories(dirPath);
+  // named up front, so no two workers write the same file
+  std::set<std::string> usedNames;
+  std::vector<std::string> fileNames;
+  for (u32 i = 0; i < soundSeq.getLabelCount(); i++) fileNames.push_back(uniqueFileName(usedNames, soundSeq.getSeqLabel(i)->nameStr(), i));
+  parallelFor(soundSeq.getLabelCount(), [&](size_t i) {
+    const SeqLabel* seqLabel = soundSeq.getSeqLabel(i);
+    MidiFile midiFile(&soundSeq, limits);
+    midiFile.SaveMidiFile(dirPath / (fileNames[i] + ".mid"), soundSeq.getLabelOffset(seqLabel));
+  });
+}
+
+void extract_rwsd_embedded_wav(const std::filesystem::path filepath, const SoundWsd& soundWsd, void* waveData, size_t waveSize, const CliOpts& cliOpts) {
   std::filesystem::create_directories(filepath);
 
   for (int i = 0; i < soundWsd.getWaveInfoCount(); i++) {
-    soundWsd.trackToWaveFile(i, waveData, filepath / (std::to_string(i) + ".wav"));
+    soundWsd.decodeTrack(i, waveData, *openAudioSink(filepath / (std::to_string(i) + audioExtension(cliOpts)), cliOpts));
   }
 }
 
 void extract_brsar_groups(const SoundArchive& soundArchive, const CliOpts& cliOpts) {
   auto contentsDir = cliOpts.outputPath;
+  // manifest for mrst archive, pointing at the extracted files
+  SoundArchiveManifest manifest = getArchiveManifest(soundArchive);
+  std::set<std::string> groupDirs;
 
   GroupTable* groupTable = soundArchive.groupTable;
   for (int i = 0; i < groupTable->size; i++) {
@@ -89,12 +110,14 @@ void extract_brsar_groups(const SoundArchive& soundArchive, const CliOpts& cliOp
     if (!name) name = "_anonymous_group_";
     if (soundArchive.isGroupExternal(i)) continue;
 
-    std::filesystem::path groupPath = contentsDir / name;
+    const std::string groupDir = uniqueFileName(groupDirs, name, i);
+    std::filesystem::path groupPath = contentsDir / groupDir;
     std::filesystem::create_directories(groupPath);
 
     const int groupSize = soundArchive.getGroupSize(groupInfo);
     for (int j = 0; j < groupSize; j++) {
       const GroupItemInfo* groupItemInfo = soundArchive.getGroupItemInfo(i, j);
+      ManifestGroupItem& manifestItem = manifest.groups[i].items[j];
     
       std::filesystem::path subGroupPath = groupPath / std::to_string(j);
       std::filesystem::create_directories(subGroupPath);
@@ -105,7 +128,8 @@ void extract_brsar_groups(const SoundArchive& soundArchive, const CliOpts& cliOp
       FileFormat fileFormat = detectFileFormat("", fileData, fileSize);
       if (fileSize > 0) {
         auto magic = magicLowercase(fileData);
-        writeBinary(subGroupPath / ("file.b" + magic), fileData, fileSize);
+        manifestItem.filePath = subGroupPath / ("file.b" + magic);
+        writeBinary(manifestItem.filePath, fileData, fileSize);
       }
 
       size_t waveSize;
@@ -116,16 +140,24 @@ void extract_brsar_groups(const SoundArchive& soundArchive, const CliOpts& cliOp
         extract_rbnk_sf2(subGroupPath / "soundfont.sf2", fileData, fileSize, waveData, waveSize);
       }
 
+      // MIDI for every label of a RSEQ, on a copy as the sequence is byte swapped in place
+      if (fileFormat == FMT_BRSEQ && cliOpts.extractOpts.decode) {
+        std::vector<u8> seqData(static_cast<u8*>(fileData), static_cast<u8*>(fileData) + fileSize);
+        SoundSequence soundSeq(seqData.data(), seqData.size());
+        extract_rseq_midis(subGroupPath / "midi", soundSeq, cliOpts.decodeOpts.seqLimits);
+      }
+
       // for RWSD files in the old RSAR format, extract any embedded wave files
       if (fileFormat == FMT_BRWSD && cliOpts.extractOpts.decode && detectFileFormat("", waveData, waveSize) != FMT_BRWAR && waveSize > 0) {
         SoundWsd soundWsd(fileData, fileSize, waveData);
-        extract_rwsd_embedded_wav(subGroupPath / "wave", soundWsd, waveData, waveSize);
+        extract_rwsd_embedded_wav(subGroupPath / "wave", soundWsd, waveData, waveSize, cliOpts);
       }
 
-      // write wave data
+      // write wave data, raw wave data (older RSARs) is kept as is for repacking
       if (waveSize > 0 && detectFileFormat("", waveData, waveSize) == FMT_BRWAR) {
         auto magic = magicLowercase(waveData);
         std::filesystem::path wavePath = subGroupPath / ("wave.b" + magic);
+        manifestItem.wavePath = wavePath;
         writeBinary(wavePath, waveData, waveSize);
 
         if (cliOpts.extractOpts.rsarExtractOpts.extractRwars) {
@@ -136,9 +168,14 @@ void extract_brsar_groups(const SoundArchive& soundArchive, const CliOpts& cliOp
           SoundWaveArchive waveArchive(waveData, waveSize);
           rsndExtractRwar(waveArchive, waveOpts);
         }
+      } else if (waveSize > 0) {
+        manifestItem.wavePath = subGroupPath / "wave.bin";
+        writeBinary(manifestItem.wavePath, waveData, waveSize);
       }
     }
   }
+
+  writeArchiveManifest(contentsDir / "manifest.txt", manifest);
 }
 
 void rsndExtractRsar(const SoundArchive& soundArchive, const CliOpts cliOpts) {
@@ -1,5 +1,9 @@
 
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
 
 #include "rsnd/soundCommon.hpp"
 #include "rsnd/SoundArchive.hpp"
@@ -9,7 +13,9 @@
 #include "rsnd/SoundWave.hpp"
 #include "rsnd/SoundWaveArchive.hpp"
 #include "rsnd/SoundWsd.hpp"
+#include "rsnd/SeqAnalysis.hpp"
 #include "common/fileUtil.hpp"
+#include "common/parallel.hpp"
 #include "tools/list.hpp"
 
 namespace rsnd {
@@ -119,7 +125,95 @@ void rsndListRsarSounds(const SoundArchive& soundArchive, CliOpts& cliOpts) {
   }
 }
 
+std::string jsonString(const std::string& str) {
+  std::ostringstream out;
+  out << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<u8>(c) < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+// the fields of a SeqAnalysis, to go into a JSON object
+std::string analysisJsonFields(const SeqAnalysis& analysis) {
+  std::ostringstream out;
+  out << "\"ticks\": " << analysis.durationTicks << ", \"seconds\": " << std::fixed << std::setprecision(3) << analysis.durationSeconds;
+  out << ", \"tracks\": [";
+  for (size_t i = 0; i < analysis.tracks.size(); i++) out << (i ? ", " : "") << (int)analysis.tracks[i];
+  out << "], \"openedTracks\": [";
+  for (size_t i = 0; i < analysis.openedTracks.size(); i++) {
+    out << (i ? ", " : "") << '[' << (int)analysis.openedTracks[i].first << ", " << (int)analysis.openedTracks[i].second << ']';
+  }
+  out << "], \"programs\": [";
+  for (size_t i = 0; i < analysis.programs.size(); i++) out << (i ? ", " : "") << analysis.programs[i];
+  out << "], \"maxPolyphony\": " << analysis.maxPolyphony;
+  return out.str();
+}
+
+// One JSON object per element of an array, key of the array in the top level object
+void printJsonArray(const char* key, const std::vector<std::string>& objects) {
+  std::cout << "{\n  \"" << key << "\": [";
+  for (size_t i = 0; i < objects.size(); i++) std::cout << (i ? ",\n    " : "\n    ") << objects[i];
+  std::cout << (objects.empty() ? "]\n}\n" : "\n  ]\n}\n");
+}
+
+// Duration, opened tracks, programs and polyphony of every SEQ sound, analyzed in parallel
+void rsndAnalyzeRsar(const SoundArchive& soundArchive, CliOpts& cliOpts) {
+  // sounds share sequence files, each is parsed (and byte swapped) once
+  struct SeqFile {
+    std::vector<u8> data;
+    std::unique_ptr<SoundSequence> seq;
+  };
+  std::map<u32, SeqFile> seqFiles;
+  std::vector<u32> seqSounds;
+  for (u32 i = 0; i < soundArchive.soundTable->size; i++) {
+    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(i);
+    if (soundInfo->soundType != SoundInfoEntry::TYPE_SEQ) continue;
+    seqSounds.push_back(i);
+    if (soundArchive.isFileExternal(soundInfo->fileIdx) || soundArchive.getFileGroupInfo(soundInfo->fileIdx)->size == 0 ||
+        seqFiles.contains(soundInfo->fileIdx)) {
+      continue;
+    }
+    const u8* fileData = static_cast<const u8*>(soundArchive.getInternalFileData(soundInfo->fileIdx));
+    if (!fileData) continue;
+    SeqFile& seqFile = seqFiles[soundInfo->fileIdx];
+    seqFile.data.assign(fileData, fileData + soundArchive.getFileInfo(soundInfo->fileIdx)->fileSize);
+    seqFile.seq = std::make_unique<SoundSequence>(seqFile.data.data(), seqFile.data.size());
+  }
+
+  std::vector<std::string> objects(seqSounds.size());
+  parallelFor(seqSounds.size(), [&](size_t i) {
+    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(seqSounds[i]);
+    const char* name = soundArchive.getString(soundInfo->fileNameIdx);
+    const u32 offset = soundArchive.getSeqSoundInfo(soundInfo)->offset;
+    std::ostringstream out;
+    out << "{\"index\": " << seqSounds[i] << ", \"name\": " << (name ? jsonString(name) : "null") << ", \"file\": " << soundInfo->fileIdx
+        << ", \"offset\": " << offset << ", ";
+    auto seqFile = seqFiles.find(soundInfo->fileIdx);
+    if (soundArchive.isFileExternal(soundInfo->fileIdx)) {
+      out << "\"external\": " << jsonString(soundArchive.getFileExternalPath(soundInfo->fileIdx)) << '}';
+    } else if (seqFile == seqFiles.end()) {
+      out << "\"external\": null}";
+    } else {
+      out << analysisJsonFields(analyzeSequence(*seqFile->second.seq, offset, cliOpts.decodeOpts.seqLimits)) << '}';
+    }
+    objects[i] = out.str();
+  });
+  printJsonArray("sounds", objects);
+}
+
 void rsndListRsar(const SoundArchive& soundArchive, CliOpts& cliOpts) {
+  if (cliOpts.listOpts.analyze) {
+    rsndAnalyzeRsar(soundArchive, cliOpts);
+    return;
+  }
   if (cliOpts.listOpts.groups) {
     rsndListRsarGroups(soundArchive, cliOpts);
   }
@@ -131,42 +225,16 @@ void rsndListRsar(const SoundArchive& soundArchive, CliOpts& cliOpts) {
   }
 }
 
-void printSubregionRecurse(const SoundBank& soundBank, DataRef* ref, int depth) {
-  switch (ref->dataType) {
-  case REGIONSET_DIRECT: {
-    for (int i = 0; i < depth; i++) std::cout << "    ";
-    InstrInfo* instrInfo = ref->getAddr<InstrInfo>(soundBank.dataBase);
-    std::cout << "sample #: " << std::to_string(instrInfo->waveIdx) << '\n';
-    break;
-  
-  } case REGIONSET_RANGE: {
-    RangeTable* rangeTable = ref->getAddr<RangeTable>(soundBank.dataBase);
-    for (int i = 0; i < rangeTable->rangeCount; i++) {
-      for (int i = 0; i < depth; i++) std::cout << "    ";
-      std::cout << "range: up to " << (int)rangeTable->key[i] << '\n';
-      DataRef* dataRef = const_cast<SoundBank&>(soundBank).getSubregionRef(ref, rangeTable->key[i]);
-      printSubregionRecurse(soundBank, dataRef, depth + 1);
-    }
-    
-    break;
-
-  } case REGIONSET_INDEX: {
-    IndexRegion* indexRegion = ref->getAddr<IndexRegion>(soundBank.dataBase);
-    for (int i = indexRegion->min; i < indexRegion->max; i++) {
-      for (int i = 0; i < depth; i++) std::cout << "    ";
-      std::cout << "index " << std::to_string(i) << '\n';
-      printSubregionRecurse(soundBank, const_cast<SoundBank&>(soundBank).getSubregionRef(ref, i), depth + 1);
-    }
-  
-    break;
-  
-  } case REGIONSET_NONE: {
-    for (int i = 0; i < depth; i++) std::cout << "    ";
-    std::cout << "sample: none" << '\n';
-
-    break;
-  } default:
-    break;
+// one line per key/velocity region of the program
+void printInstrRegions(const SoundBank& soundBank, int progIdx) {
+  auto regions = soundBank.getInstrRegions(progIdx);
+  if (regions.empty()) {
+    std::cout << "    sample: none\n";
+    return;
+  }
+  for (const auto& region : regions) {
+    std::cout << "    keys " << region.keyLo << "-" << region.keyHi << ", velocities " << region.velLo << "-" << region.velHi
+              << ": sample #: " << region.instrInfo->waveIdx << '\n';
   }
 }
 
@@ -176,7 +244,7 @@ void rsndListRbnk(const SoundBank& soundBank, CliOpts& cliOpts) {
 
   for (int i = 0; i < progCount; i++) {
     std::cout << "Program " << std::to_string(i) << '\n';
-    printSubregionRecurse(soundBank, &soundBank.bankData->instrs.elems[i], 1);
+    printInstrRegions(soundBank, i);
   }
 
   if (soundBank.containsWaves) {
@@ -211,7 +279,23 @@ void rsndListRwar(const SoundWaveArchive& soundArchive, CliOpts& cliOpts) {
   std::cout << "WAVE count: " << (int)soundArchive.getWaveCount() << '\n';
 }
 
+// Duration, opened tracks, programs and polyphony of every label, analyzed in parallel
+void rsndAnalyzeRseq(const SoundSequence& soundSeq, CliOpts& cliOpts) {
+  std::vector<std::string> objects(soundSeq.getLabelCount());
+  parallelFor(objects.size(), [&](size_t i) {
+    const SeqLabel* seqLabel = soundSeq.getSeqLabel(i);
+    const u32 offset = soundSeq.getLabelOffset(seqLabel);
+    objects[i] = "{\"name\": " + jsonString(seqLabel->nameStr()) + ", \"offset\": " + std::to_string(offset) + ", " +
+                 analysisJsonFields(analyzeSequence(soundSeq, offset, cliOpts.decodeOpts.seqLimits)) + '}';
+  });
+  printJsonArray("labels", objects);
+}
+
 void rsndListRseq(const SoundSequence& soundSeq, CliOpts& cliOpts) {
+  if (cliOpts.listOpts.analyze) {
+    rsndAnalyzeRseq(soundSeq, cliOpts);
+    return;
+  }
   const int labelCount = soundSeq.label->labelOffs.size;
   std::cout << "Label count: " << labelCount << '\n';
 
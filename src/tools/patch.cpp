@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+
+#include "rsnd/SoundArchive.hpp"
+#include "common/binaryWriter.hpp"
+#include "common/fileUtil.hpp"
+#include "common/journal.hpp"
+#include "tools/patch.hpp"
+
+namespace rsnd {
+namespace {
+const u32 FILE_ALIGNMENT = 0x20;
+
+u64 alignUp(u64 value, u32 alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+std::vector<u8> structBytes(const T& value) {
+  BinaryWriter out;
+  out.writeStruct(value);
+  return out.getBytes();
+}
+
+std::vector<u8> readReplacement(const std::filesystem::path& path) {
+  size_t size;
+  void* data = readBinary(path, size);
+  std::vector<u8> bytes(static_cast<u8*>(data), static_cast<u8*>(data) + size);
+  free(data);
+  return bytes;
+}
+
+// Either the file or the wave data offsets and sizes of groups and their items
+struct Region {
+  u32 GroupInfo::* groupOffset;
+  u32 GroupInfo::* groupSize;
+  u32 GroupItemInfo::* itemOffset;
+  u32 GroupItemInfo::* itemSize;
+  u32 FileInfo::* fileSize;
+};
+
+const Region FILE_REGION = {&GroupInfo::fileOffset, &GroupInfo::fileSize, &GroupItemInfo::fileOffset, &GroupItemInfo::fileSize, &FileInfo::fileSize};
+const Region WAVE_REGION = {&GroupInfo::waveDataOffset, &GroupInfo::waveDataSize, &GroupItemInfo::waveDataOffset, &GroupItemInfo::waveDataSize, &FileInfo::waveDataSize};
+}
+
+void rsndPatch(CliOpts& cliOpts) {
+  const PatchOpts& patchOpts = cliOpts.patchOpts;
+  const std::filesystem::path& archivePath = cliOpts.inputFile;
+  // rolls back any earlier interrupted patch before the archive is read
+  JournaledEdit edit(archivePath);
+
+  if (patchOpts.fileIdx < 0 && patchOpts.soundName.empty()) {
+    std::cerr << "patch needs the file to replace, --file IDX or --sound NAME\n";
+    exit(-1);
+  }
+  if (patchOpts.filePath.empty() && patchOpts.wavePath.empty()) {
+    std::cerr << "patch needs a new file and/or --wave new wave data\n";
+    exit(-1);
+  }
+
+  // only the blocks before the FILE data are read
+  std::ifstream archiveFile(archivePath, std::ios::binary);
+  SoundArchiveHeader header;
+  if (!archiveFile.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, "RSAR", 4) != 0) {
+    std::cerr << archivePath << " is not a BRSAR\n";
+    exit(-1);
+  }
+  header.bswap();
+  const u64 archiveSize = std::filesystem::file_size(archivePath);
+  const u64 prefixSize = std::max({u64(header.symbBlockOffset) + header.symbBlockSize, u64(header.infoBlockOffset) + header.infoBlockSize,
+                                   u64(header.fileBlockOffset) + sizeof(BinaryBlockHeader)});
+  if (prefixSize > archiveSize) {
+    std::cerr << archivePath << " is truncated\n";
+    exit(-1);
+  }
+  // appended data has to stay inside the FILE block
+  if (u64(header.fileBlockOffset) + header.fileBlockSize != archiveSize || header.fileSize != archiveSize) {
+    std::cerr << "The FILE block of " << archivePath << " does not end the file, repack it with mrst archive instead\n";
+    exit(-1);
+  }
+
+  std::vector<u8> prefix(prefixSize);
+  archiveFile.seekg(0);
+  archiveFile.read(reinterpret_cast<char*>(prefix.data()), prefixSize);
+  archiveFile.close();
+  SoundArchive soundArchive(prefix.data(), prefix.size());
+  auto positionOf = [&](const void* ptr) -> u64 { return static_cast<const u8*>(ptr) - prefix.data(); };
+
+  u32 fileIdx = patchOpts.fileIdx;
+  if (!patchOpts.soundName.empty()) {
+    s32 soundIdx = soundArchive.findSound(patchOpts.soundName.c_str());
+    if (soundIdx < 0) {
+      std::cerr << "No sound named " << patchOpts.soundName << " in " << archivePath << '\n';
+      exit(-1);
+    }
+    fileIdx = soundArchive.getSoundInfo(soundIdx)->fileIdx;
+  }
+  if (fileIdx >= soundArchive.fileTable->size) {
+    std::cerr << "File " << fileIdx << " is out of range, the archive has " << soundArchive.fileTable->size << " files\n";
+    exit(-1);
+  }
+  if (soundArchive.isFileExternal(fileIdx)) {
+    std::cerr << "File " << fileIdx << " is not stored in the archive, replace " << soundArchive.getFileExternalPath(fileIdx) << " instead\n";
+    exit(-1);
+  }
+
+  // internal groups holding the file
+  std::set<u32> groupIdxs;
+  const FileGroupInfo* fileGroupInfo = soundArchive.getFileGroupInfo(fileIdx);
+  for (int i = 0; i < fileGroupInfo->size; i++) {
+    u32 groupIdx = soundArchive.getFileGroup(fileIdx, i)->groupIdx;
+    if (!soundArchive.isGroupExternal(groupIdx)) groupIdxs.insert(groupIdx);
+  }
+  if (groupIdxs.empty()) {
+    std::cerr << "File " << fileIdx << " is only in external groups\n";
+    exit(-1);
+  }
+
+  // modified copies of the INFO entries, written back by position
+  std::map<u32, GroupInfo> groups;
+  std::map<std::pair<u32, u32>, GroupItemInfo> items;
+  FileInfo fileInfo = *soundArchive.getFileInfo(fileIdx);
+  for (u32 g = 0; g < soundArchive.groupTable->size; g++) groups[g] = *soundArchive.getGroupInfo(g);
+  for (u32 g = 0; g < soundArchive.groupTable->size; g++) {
+    for (int i = 0; i < soundArchive.getGroupSize(&groups[g]); i++) items[{g, i}] = *soundArchive.getGroupItemInfo(g, i);
+  }
+
+  u64 end = alignUp(archiveSize, FILE_ALIGNMENT);
+  auto replace = [&](const Region& region, const std::vector<u8>& data) {
+    for (u32 g : groupIdxs) {
+      GroupInfo& group = groups[g];
+      std::vector<GroupItemInfo*> targets;
+      for (int i = 0; i < soundArchive.getGroupSize(&group); i++) {
+        if (items[{g, i}].fileIdx == fileIdx) targets.push_back(&items[{g, i}]);
+      }
+
+      // an in place write must fit every slot and must not clobber other files sharing the bytes
+      bool inPlace = true;
+      for (const GroupItemInfo* target : targets) {
+        const u64 start = u64(group.*region.groupOffset) + target->*region.itemOffset;
+        const u64 stop = start + target->*region.itemSize;
+        if (data.size() > target->*region.itemSize) inPlace = false;
+        for (const auto& [key, other] : items) {
+          if (other.fileIdx == fileIdx || soundArchive.isGroupExternal(key.first) || other.*region.itemSize == 0) continue;
+          const u64 otherStart = u64(groups[key.first].*region.groupOffset) + other.*region.itemOffset;
+          if (otherStart < stop && start < otherStart + other.*region.itemSize) inPlace = false;
+        }
+      }
+
+      if (inPlace) {
+        for (GroupItemInfo* target : targets) {
+          if (!data.empty()) edit.write(u64(group.*region.groupOffset) + target->*region.itemOffset, data);
+          target->*region.itemSize = data.size();
+        }
+        continue;
+      }
+
+      // groups are loaded as one block, so the whole region moves to the end with the new data after it
+      const u64 regionOffset = end;
+      const u64 dataOffset = alignUp(regionOffset + group.*region.groupSize, FILE_ALIGNMENT);
+      end = alignUp(dataOffset + data.size(), FILE_ALIGNMENT);
+      if (end > 0xffffffff) {
+        std::cerr << "Archive would be larger than 4GB\n";
+        exit(-1);
+      }
+      edit.copy(group.*region.groupOffset, regionOffset, group.*region.groupSize);
+      std::vector<u8> padded(data);
+      padded.resize(end - dataOffset);
+      edit.write(dataOffset, padded);
+      for (GroupItemInfo* target : targets) {
+        target->*region.itemOffset = dataOffset - regionOffset;
+        target->*region.itemSize = data.size();
+      }
+      group.*region.groupOffset = regionOffset;
+      group.*region.groupSize = end - regionOffset;
+    }
+    fileInfo.*region.fileSize = data.size();
+  };
+
+  if (!patchOpts.filePath.empty()) replace(FILE_REGION, readReplacement(patchOpts.filePath));
+  if (!patchOpts.wavePath.empty()) replace(WAVE_REGION, readReplacement(patchOpts.wavePath));
+
+  edit.write(positionOf(soundArchive.getFileInfo(fileIdx)), structBytes(fileInfo));
+  for (u32 g : groupIdxs) {
+    edit.write(positionOf(soundArchive.getGroupInfo(g)), structBytes(groups[g]));
+    for (int i = 0; i < soundArchive.getGroupSize(&groups[g]); i++) {
+      edit.write(positionOf(soundArchive.getGroupItemInfo(g, i)), structBytes(items[{g, i}]));
+    }
+  }
+  if (end != alignUp(archiveSize, FILE_ALIGNMENT)) {
+    header.fileSize = end;
+    header.fileBlockSize = end - header.fileBlockOffset;
+    edit.write(0, structBytes(header));
+    BinaryBlockHeader fileBlock = *soundArchive.soundArchiveFile;
+    fileBlock.length = header.fileBlockSize;
+    edit.write(header.fileBlockOffset, structBytes(fileBlock));
+  }
+  edit.commit();
+}
+}
@@ -0,0 +1,203 @@
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "rsnd/SeqRenderer.hpp"
+#include "rsnd/SoundArchive.hpp"
+#include "rsnd/SoundBank.hpp"
+#include "rsnd/SoundSequence.hpp"
+#include "rsnd/soundCommon.hpp"
+#include "common/fileUtil.hpp"
+#include "common/log.hpp"
+#include "common/parallel.hpp"
+#include "tools/common.hpp"
+#include "tools/decode.hpp"
+#include "tools/render.hpp"
+
+namespace rsnd {
+namespace {
+// A bank parsed from its own copy of the file and wave data (both are byte swapped in place), with its waves
+// decoded. Read only once loaded, songs render from it in parallel
+struct RenderBank {
+  std::vector<u8> fileData;
+  std::vector<u8> waveData;
+  std::unique_ptr<SoundBank> bank;
+  std::unique_ptr<BankWaves> waves;
+
+  void load() {
+    bank = std::make_unique<SoundBank>(fileData.data(), fileData.size(), waveData.data());
+    bank->buildLookupTable();
+    waves = std::make_unique<BankWaves>(*bank, waveData.data(), waveData.size());
+  }
+};
+
+// a sequence file of a BRSAR, copied like the banks
+struct RenderSeq {
+  std::vector<u8> data;
+  std::unique_ptr<SoundSequence> seq;
+};
+
+void renderToFile(const SeqRenderer& renderer, const SoundSequence& seq, u32 offset, const std::filesystem::path& path, const CliOpts& cliOpts) {
+  RSND_INFO(LOG_IO, "rendering " << path);
+  renderer.render(seq, offset, *openAudioSink(path, cliOpts));
+}
+}
+
+// The bank comes from --bank. One file played from the start of the sequence data, or one per label
+void rsndRenderRseq(const SoundSequence& soundSeq, CliOpts& cliOpts) {
+  const auto& bankPath = cliOpts.renderOpts.bankPath;
+  if (bankPath.empty()) {
+    std::cerr << "Rendering a BRSEQ needs the bank it plays, given with --bank\n";
+    exit(-1);
+  }
+  RenderBank bank;
+  size_t size;
+  void* data = readBinary(bankPath, size);
+  bank.fileData.assign(static_cast<u8*>(data), static_cast<u8*>(data) + size);
+  free(data);
+  data = readBankWaveData(bankPath, bank.fileData.data(), size);
+  bank.waveData.assign(static_cast<u8*>(data), static_cast<u8*>(data) + size);
+  free(data);
+  bank.load();
+  const SeqRenderer renderer(*bank.bank, *bank.waves, cliOpts.decodeOpts.seqLimits);
+
+  if (cliOpts.outputPath.empty()) {
+    auto tmp = cliOpts.inputFile;
+    tmp.replace_extension(cliOpts.decodeOpts.allLabels ? ".d" : audioExtension(cliOpts));
+    cliOpts.outputPath = tmp;
+  }
+  if (!cliOpts.decodeOpts.allLabels) {
+    renderToFile(renderer, soundSeq, 0, cliOpts.outputPath, cliOpts);
+    return;
+  }
+  if (isStdio(cliOpts.outputPath)) {
+    std::cerr << "Cannot write " << soundSeq.getLabelCount() << " labels to stdout\n";
+    exit(-1);
+  }
+  std::filesystem::create_directories(cliOpts.outputPath);
+  // named up front, so no two workers write the same file
+  std::set<std::string> usedNames;
+  std::vector<std::string> fileNames;
+  for (u32 i = 0; i < soundSeq.getLabelCount(); i++) fileNames.push_back(uniqueFileName(usedNames, soundSeq.getSeqLabel(i)->nameStr(), i));
+  parallelFor(soundSeq.getLabelCount(), [&](size_t i) {
+    const SeqLabel* seqLabel = soundSeq.getSeqLabel(i);
+    renderToFile(renderer, soundSeq, soundSeq.getLabelOffset(seqLabel), cliOpts.outputPath / (fileNames[i] + audioExtension(cliOpts)), cliOpts);
+  });
+}
+
+// Every SEQ sound (or the one picked with --sound) with the bank of its sound info, one file each. Sequences and
+// banks shared by several sounds are loaded once
+void rsndRenderRsar(const SoundArchive& soundArchive, CliOpts& cliOpts) {
+  std::vector<u32> seqSounds;
+  if (!cliOpts.renderOpts.soundName.empty()) {
+    const s32 soundIdx = soundArchive.findSound(cliOpts.renderOpts.soundName.c_str());
+    if (soundIdx < 0 || soundArchive.getSoundInfo(soundIdx)->soundType != SoundInfoEntry::TYPE_SEQ) {
+      std::cerr << "No SEQ sound named " << cliOpts.renderOpts.soundName << " in " << cliOpts.inputFile << '\n';
+      exit(-1);
+    }
+    seqSounds.push_back(soundIdx);
+  } else {
+    for (u32 i = 0; i < soundArchive.soundTable->size; i++) {
+      if (soundArchive.getSoundInfo(i)->soundType == SoundInfoEntry::TYPE_SEQ) seqSounds.push_back(i);
+    }
+  }
+
+  // copies of a file and its wave data, false if the archive does not hold it
+  auto copyFile = [&](u32 fileIdx, std::vector<u8>& fileData, std::vector<u8>* waveData) {
+    if (fileIdx >= soundArchive.fileTable->size || soundArchive.isFileExternal(fileIdx) || soundArchive.getFileGroupInfo(fileIdx)->size == 0) return false;
+    const FileGroup* fileGroup = soundArchive.getFileGroup(fileIdx, 0);
+    if (soundArchive.isGroupExternal(fileGroup->groupIdx)) return false;
+    const GroupInfo* groupInfo = soundArchive.getGroupInfo(fileGroup->groupIdx);
+    const GroupItemInfo* groupItemInfo = soundArchive.getGroupItemInfo(fileGroup->groupIdx, fileGroup->idx);
+    size_t size;
+    const u8* data = static_cast<const u8*>(soundArchive.getInternalFileData(groupInfo, groupItemInfo, &size));
+    if (size == 0) return false;
+    fileData.assign(data, data + size);
+    if (waveData) {
+      data = static_cast<const u8*>(soundArchive.getInternalWaveData(groupInfo, groupItemInfo, &size));
+      waveData->assign(data, data + size);
+    }
+    return true;
+  };
+
+  std::map<u32, RenderSeq> seqFiles;
+  std::map<u32, RenderBank> banks;
+  std::vector<u32> rendered;
+  for (u32 soundIdx : seqSounds) {
+    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(soundIdx);
+    const u32 bankIdx = soundArchive.getSeqSoundInfo(soundInfo)->bankIdx;
+    if (bankIdx >= soundArchive.bankTable->size) {
+      RSND_WARN(LOG_PARSE, "skipping sound " << soundIdx << ", its bank " << bankIdx << " does not exist");
+      continue;
+    }
+    if (!seqFiles.contains(soundInfo->fileIdx)) {
+      RenderSeq seqFile;
+      if (!copyFile(soundInfo->fileIdx, seqFile.data, nullptr)) {
+        RSND_WARN(LOG_IO, "skipping sound " << soundIdx << ", its sequence is not stored in the archive");
+        continue;
+      }
+      seqFile.seq = std::make_unique<SoundSequence>(seqFile.data.data(), seqFile.data.size());
+      seqFiles[soundInfo->fileIdx] = std::move(seqFile);
+    }
+    if (!banks.contains(bankIdx)) {
+      RenderBank bank;
+      if (!copyFile(soundArchive.getBankInfo(bankIdx)->fileIdx, bank.fileData, &bank.waveData)) {
+        RSND_WARN(LOG_IO, "skipping sound " << soundIdx << ", its bank is not stored in the archive");
+        continue;
+      }
+      banks[bankIdx] = std::move(bank);
+    }
+    rendered.push_back(soundIdx);
+  }
+
+  if (cliOpts.outputPath.empty()) {
+    auto tmp = cliOpts.inputFile;
+    tmp.replace_extension(".d");
+    cliOpts.outputPath = tmp;
+  }
+  std::filesystem::create_directories(cliOpts.outputPath);
+  std::set<std::string> usedNames;
+  std::vector<std::string> fileNames;
+  for (u32 soundIdx : rendered) {
+    const char* name = soundArchive.getString(soundArchive.getSoundInfo(soundIdx)->fileNameIdx);
+    fileNames.push_back(uniqueFileName(usedNames, name ? name : "", soundIdx));
+  }
+
+  std::vector<RenderBank*> bankList;
+  for (auto& [bankIdx, bank] : banks) bankList.push_back(&bank);
+  parallelFor(bankList.size(), [&](size_t i) { bankList[i]->load(); });
+
+  parallelFor(rendered.size(), [&](size_t i) {
+    const SoundInfoEntry* soundInfo = soundArchive.getSoundInfo(rendered[i]);
+    const SeqSoundInfo* seqInfo = soundArchive.getSeqSoundInfo(soundInfo);
+    const RenderBank& bank = banks.at(seqInfo->bankIdx);
+    const SeqRenderer renderer(*bank.bank, *bank.waves, cliOpts.decodeOpts.seqLimits);
+    renderToFile(renderer, *seqFiles.at(soundInfo->fileIdx).seq, seqInfo->offset, cliOpts.outputPath / (fileNames[i] + audioExtension(cliOpts)), cliOpts);
+  });
+}
+
+void rsndRender(CliOpts& cliOpts) {
+  size_t inputSize;
+  void* inputData = readBinary(cliOpts.inputFile, inputSize);
+  FileFormat inputFormat = detectFileFormat(cliOpts.inputFile.filename().string(), inputData, inputSize);
+  switch (inputFormat)
+  {
+  case FMT_BRSAR: {
+    SoundArchive soundArchive(inputData, inputSize);
+    rsndRenderRsar(soundArchive, cliOpts);
+    break;
+
+  } case FMT_BRSEQ: {
+    SoundSequence soundSeq(inputData, inputSize);
+    rsndRenderRseq(soundSeq, cliOpts);
+    break;
+
+  } default:
+    std::cerr << cliOpts.inputFile << " file format render not supported, only BRSEQ and BRSAR\n";
+    exit(-1);
+  }
+  free(inputData);
+}
+}
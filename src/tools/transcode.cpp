@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "rsnd/AdpcmEncoder.hpp"
+#include "rsnd/SoundStream.hpp"
+#include "rsnd/SoundWriter.hpp"
+#include "common/fileUtil.hpp"
+#include "common/parallel.hpp"
+#include "tools/transcode.hpp"
+
+namespace rsnd {
+namespace {
+// output blocks held in memory per worker, the stream is transcoded one batch of blocks at a time
+const u32 BATCH_BLOCKS_PER_WORKER = 2;
+
+// samples [start, start + count) of one source channel
+std::vector<s16> decodeSamples(const SoundStream& stream, u8 channelIdx, u32 start, u32 count) {
+  std::vector<s16> pcm(count);
+  stream.decodeRange(&channelIdx, 1, start, count, pcm.data());
+  return pcm;
+}
+
+// one output block of every channel
+struct BlockRow {
+  std::vector<std::vector<u8>> channels;
+};
+
+class Transcoder {
+private:
+  const SoundStream& stream;
+  SoundStreamWriter& writer;
+  const u8 channelCount;
+  const u32 sampleCount;
+  const u32 batchBlocks;
+
+  u32 blockStart(u32 b) const { return b * writer.getInfo().blockSamples; }
+
+  // runs fn(b, c, row) for every block of every channel in batches, writing the rows of each batch in order.
+  // finishBatch runs between encoding a batch and writing it
+  template <typename F, typename G>
+  void runBatches(F&& fn, G&& finishBatch) {
+    const u32 blockCount = writer.getInfo().blockCount;
+    for (u32 first = 0; first < blockCount; first += batchBlocks) {
+      const u32 count = std::min(batchBlocks, blockCount - first);
+      std::vector<BlockRow> rows(count);
+      for (auto& row : rows) row.channels.resize(channelCount);
+      parallelFor(count * channelCount, [&](size_t task) {
+        u32 i = task / channelCount;
+        u8 c = task % channelCount;
+        fn(first + i, c, rows[i].channels[c]);
+      });
+      finishBatch(first, rows);
+
+      std::vector<const u8*> rowData(channelCount);
+      for (const auto& row : rows) {
+        for (int c = 0; c < channelCount; c++) rowData[c] = row.channels[c].data();
+        writer.writeBlockRow(rowData.data());
+      }
+    }
+  }
+
+public:
+  Transcoder(const SoundStream& stream, SoundStreamWriter& writer)
+      : stream(stream), writer(writer), channelCount(stream.strmDataInfo->channelCount), sampleCount(stream.getSampleCount()),
+        batchBlocks(std::max(1u, workerCount() * BATCH_BLOCKS_PER_WORKER)) {}
+
+  // ADPCM frames are copied as is into the new blocks, only the history at the block starts is recomputed
+  void copyAdpcm() {
+    const StreamDataInfo& source = *stream.strmDataInfo;
+    const u32 sourceBlockFrames = source.blockSamples / 14;
+    for (int c = 0; c < channelCount; c++) writer.setAdpcParams(c, *stream.getAdpcParams(c));
+
+    runBatches([&](u32 b, u8 c, std::vector<u8>& data) {
+      const u32 start = blockStart(b);
+      const u32 frameCount = (writer.getBlockSamples(b) + 13) / 14;
+      data.resize(frameCount * 8);
+      for (u32 f = start / 14, copied = 0; copied < frameCount;) {
+        const u32 sourceBlock = f / sourceBlockFrames;
+        const u32 sourceFrame = f % sourceBlockFrames;
+        const u32 count = std::min(frameCount - copied, sourceBlockFrames - sourceFrame);
+        memcpy(data.data() + copied * 8, stream.getBlockData(c, sourceBlock) + sourceFrame * 8, count * 8);
+        copied += count;
+        f += count;
+      }
+
+      // at source block starts the decoder is seeded from the source entry, elsewhere it continues from the samples before
+      if (start % source.blockSamples == 0) {
+        const AdpcEntry* entry = stream.getAdpcEntry(start / source.blockSamples, c);
+        writer.setAdpcEntry(b, c, entry->yn1, entry->yn2);
+      } else {
+        std::vector<s16> history = decodeSamples(stream, c, start - 2, 2);
+        writer.setAdpcEntry(b, c, history[1], history[0]);
+      }
+    }, [](u32, std::vector<BlockRow>&) {});
+  }
+
+  void encodePcm(u8 format) {
+    runBatches([&](u32 b, u8 c, std::vector<u8>& data) {
+      std::vector<s16> pcm = decodeSamples(stream, c, blockStart(b), writer.getBlockSamples(b));
+      if (format == StreamDataInfo::FORMAT_PCM16) {
+        data.resize(pcm.size() * 2);
+        for (size_t i = 0; i < pcm.size(); i++) {
+          u16 sample = std::byteswap(static_cast<u16>(pcm[i]));
+          memcpy(data.data() + i * 2, &sample, 2);
+        }
+      } else {
+        data.resize(pcm.size());
+        for (size_t i = 0; i < pcm.size(); i++) data[i] = static_cast<u8>(std::clamp(std::lround(pcm[i] / 256.0), -128l, 127l));
+      }
+    }, [](u32, std::vector<BlockRow>&) {});
+  }
+
+  // Solves each channel's coefficients from the records of its blocks in order. The solve takes several passes over
+  // the records, each decodes the source again one batch of blocks at a time so only a batch of records is held
+  void solveCoeffs(std::vector<AdpcParams>& adpcParams) {
+    const u32 blockCount = writer.getInfo().blockCount;
+    std::vector<AdpcmCoeffSolver> solvers(channelCount);
+    std::vector<std::vector<AdpcmRecord>> records(batchBlocks * channelCount);
+    while (std::any_of(solvers.begin(), solvers.end(), [](const auto& solver) { return solver.needsPass(); })) {
+      for (u32 first = 0; first < blockCount; first += batchBlocks) {
+        const u32 count = std::min(batchBlocks, blockCount - first);
+        parallelFor(count * channelCount, [&](size_t task) {
+          const u32 b = first + task / channelCount;
+          const u8 c = task % channelCount;
+          records[task].clear();
+          if (!solvers[c].needsPass()) return;
+          // the frame before the block is its first frame's history
+          const u32 start = blockStart(b);
+          const u32 from = start == 0 ? 0 : start - 14;
+          const u32 frameCount = (writer.getBlockSamples(b) + 13) / 14;
+          std::vector<s16> pcm = decodeSamples(stream, c, from, start - from + writer.getBlockSamples(b));
+          const u32 firstFrame = start == 0 ? 0 : 1;
+          collectAdpcmRecords(pcm.data(), pcm.size(), firstFrame, firstFrame + frameCount, records[task]);
+        });
+        parallelFor(channelCount, [&](size_t c) {
+          for (u32 i = 0; i < count; i++) {
+            for (const auto& record : records[i * channelCount + c]) solvers[c].add(record);
+          }
+        });
+      }
+      for (auto& solver : solvers) {
+        if (solver.needsPass()) solver.finishPass();
+      }
+    }
+    for (int c = 0; c < channelCount; c++) solvers[c].getCoeffs(adpcParams[c].params.coeffs);
+  }
+
+  // Same as encodeAdpcm, block by block: the coefficients come from the records of every block, then each batch of
+  // blocks is encoded speculatively and fixed up in order with the history carried over from the previous batch
+  void encodeAdpcm(AdpcmEncodeQuality quality) {
+    std::vector<AdpcParams> adpcParams(channelCount);
+    solveCoeffs(adpcParams);
+
+    const StreamDataInfo& info = writer.getInfo();
+    const bool loop = info.loop && info.loopStart < sampleCount;
+    // decoder history at the end of the previous batch
+    std::vector<AdpcEntry> history(channelCount, AdpcEntry{0, 0});
+    // input samples and decoded samples of the current batch, the input starts 2 samples early for the speculative history
+    std::vector<std::vector<s16>> pcm(batchBlocks * channelCount);
+    std::vector<std::vector<s16>> decoded(batchBlocks * channelCount);
+
+    runBatches([&](u32 b, u8 c, std::vector<u8>& data) {
+      const u32 i = b % batchBlocks;
+      const u32 start = blockStart(b);
+      const u32 count = writer.getBlockSamples(b);
+      const u32 lead = std::min(start, 2u);
+      std::vector<s16>& input = pcm[i * channelCount + c];
+      std::vector<s16>& output = decoded[i * channelCount + c];
+      input = decodeSamples(stream, c, start - lead, lead + count);
+      input.insert(input.begin(), 2 - lead, 0);
+      output.resize(count);
+      data.resize((count + 13) / 14 * 8);
+
+      s16 yn1 = input[1];
+      s16 yn2 = input[0];
+      encodeAdpcmFrames(input.data() + 2, count, yn1, yn2, adpcParams[c].params.coeffs, quality, data.data(), output.data());
+    }, [&](u32 first, std::vector<BlockRow>& rows) {
+      parallelFor(channelCount, [&](size_t c) {
+        for (u32 i = 0; i < rows.size(); i++) {
+          const u32 b = first + i;
+          const u32 start = blockStart(b);
+          const u32 count = writer.getBlockSamples(b);
+          std::vector<s16>& input = pcm[i * channelCount + c];
+          std::vector<s16>& output = decoded[i * channelCount + c];
+          u8* data = rows[i].channels[c].data();
+          AdpcEntry& entry = history[c];
+
+          writer.setAdpcEntry(b, c, entry.yn1, entry.yn2);
+          reencodeAdpcmFrames(input.data() + 2, count, entry.yn1, entry.yn2, input[1], input[0], adpcParams[c].params.coeffs, quality, data, output.data());
+          if (b == 0) adpcParams[c].params.predictorScale = data[0];
+          if (loop && info.loopStart >= start && info.loopStart < start + count) {
+            const u32 offset = info.loopStart - start;
+            adpcParams[c].paramsLoop.predictorScale = data[offset / 14 * 8];
+            adpcParams[c].paramsLoop.yn1 = offset >= 1 ? output[offset - 1] : entry.yn1;
+            adpcParams[c].paramsLoop.yn2 = offset >= 2 ? output[offset - 2] : offset == 1 ? entry.yn1 : entry.yn2;
+          }
+
+          entry.yn2 = count >= 2 ? output[count - 2] : entry.yn1;
+          entry.yn1 = output[count - 1];
+        }
+      });
+    });
+
+    for (int c = 0; c < channelCount; c++) writer.setAdpcParams(c, adpcParams[c]);
+  }
+};
+}
+
+void rsndTranscode(CliOpts& cliOpts) {
+  const TranscodeOpts& transcodeOpts = cliOpts.transcodeOpts;
+  size_t fileSize;
+  void* fileData = readBinary(cliOpts.inputFile, fileSize);
+  if (detectFileFormat(cliOpts.inputFile.filename().string(), fileData, fileSize) != FMT_BRSTM) {
+    std::cerr << cliOpts.inputFile << " is not a BRSTM\n";
+    exit(-1);
+  }
+  SoundStream stream(fileData, fileSize);
+  const StreamDataInfo& source = *stream.strmDataInfo;
+  if (source.format > StreamDataInfo::FORMAT_ADPCM) {
+    std::cerr << "Unknown stream format " << (int)source.format << '\n';
+    exit(-1);
+  }
+
+  StreamDataInfo info = {};
+  info.format = transcodeOpts.format < 0 ? source.format : transcodeOpts.format;
+  info.loop = source.loop;
+  info.channelCount = source.channelCount;
+  info.sampleRate = source.sampleRate;
+  info.loopStart = source.loopStart;
+  info.loopEnd = source.loopEnd;
+  info.blockSize = transcodeOpts.blockSize == 0 ? source.blockSize : transcodeOpts.blockSize;
+  if (info.blockSize % 0x20 != 0) {
+    std::cerr << "--block-size must be a multiple of 32 bytes, got " << info.blockSize << '\n';
+    exit(-1);
+  }
+
+  std::vector<StreamTrack> tracks(stream.trackTable->trackCount);
+  for (size_t t = 0; t < tracks.size(); t++) {
+    u8 channelCount;
+    const u8* channels = stream.getTrackChannels(t, channelCount);
+    tracks[t].channels.assign(channels, channels + channelCount);
+    if (stream.getTrackInfoType() == TrackTable::EXTENDED) {
+      tracks[t].volume = stream.getTrackInfoExtended(t)->volume;
+      tracks[t].pan = stream.getTrackInfoExtended(t)->pan;
+    }
+  }
+
+  if (cliOpts.outputPath.empty()) {
+    cliOpts.outputPath = cliOpts.inputFile;
+    cliOpts.outputPath.replace_extension(".transcoded.brstm");
+  }
+  std::ofstream out(cliOpts.outputPath, std::ios::binary);
+  if (!out) {
+    std::cerr << "Error opening file " << cliOpts.outputPath << '\n';
+    exit(-1);
+  }
+
+  SoundStreamWriter writer(out, info, stream.getSampleCount(), stream.getTrackInfoType(), tracks);
+  Transcoder transcoder(stream, writer);
+  if (info.format != StreamDataInfo::FORMAT_ADPCM) {
+    transcoder.encodePcm(info.format);
+  } else if (source.format == StreamDataInfo::FORMAT_ADPCM) {
+    transcoder.copyAdpcm();
+  } else {
+    transcoder.encodeAdpcm(cliOpts.encodeOpts.quality);
+  }
+  writer.finish();
+  if (!out) {
+    std::cerr << "Error writing file " << cliOpts.outputPath << '\n';
+    exit(-1);
+  }
+  free(fileData);
+}
+}
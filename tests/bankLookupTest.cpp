@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "check.hpp"
+#include "rsnd/SoundBank.hpp"
+#include "rsnd/SoundBankWriter.hpp"
+
+using namespace rsnd;
+using namespace rsnd::test;
+
+namespace {
+const int PROGRAM_COUNT = 128;
+const int ROUNDS = 20;
+const u32 NO_WAVE = 0xffffffff;
+
+BankRegion region(u8 keyLo, u8 keyHi, u8 velLo, u8 velHi, u32 waveIdx) {
+  BankRegion region = {keyLo, keyHi, velLo, velHi, {}};
+  region.info.waveIdx = waveIdx;
+  region.info.originalKey = 60;
+  region.info.volume = 127;
+  region.info.pan = 64;
+  region.info.pitch = 1.0f;
+  return region;
+}
+
+// every kind of split: wide key ranges (RANGE tables), one region per key (INDEX tables), velocity layers, gaps
+// where nothing plays, regions hidden behind earlier ones, and empty programs. Each region has its own wave index,
+// so the InstrInfo found tells which region won
+std::vector<std::vector<BankRegion>> testInstruments() {
+  std::vector<std::vector<BankRegion>> instruments(PROGRAM_COUNT);
+  u32 waveIdx = 0;
+  for (int prog = 0; prog < PROGRAM_COUNT; prog++) {
+    auto& regions = instruments[prog];
+    switch (prog % 6) {
+    case 0:
+      for (int key = 0; key < 128; key += 8) regions.push_back(region(key, key + 7, 0, 127, waveIdx++));
+      break;
+    case 1:
+      for (int key = 36; key < 96; key++) regions.push_back(region(key, key, 0, 127, waveIdx++));
+      break;
+    case 2:
+      for (int key = 0; key < 128; key += 32) {
+        for (int vel = 0; vel < 128; vel += 43) regions.push_back(region(key, key + 31, vel, std::min(vel + 42, 127), waveIdx++));
+      }
+      break;
+    case 3:
+      regions.push_back(region(20, 40, 0, 127, waveIdx++));
+      regions.push_back(region(70, 100, 64, 127, waveIdx++));
+      break;
+    case 4:
+      regions.push_back(region(0, 127, 0, 127, waveIdx++));
+      regions.push_back(region(50, 60, 0, 127, waveIdx++));
+      regions.push_back(region(30, 90, 100, 127, waveIdx++));
+      break;
+    default:
+      if (prog % 12 == 5) break;
+      regions.push_back(region(prog % 128, prog % 128, 0, 127, waveIdx++));
+      regions.push_back(region(0, 127, 0, 127, waveIdx++));
+    }
+  }
+  return instruments;
+}
+
+// what the bank should play: the first region covering the key and velocity
+u32 expectedWave(const std::vector<BankRegion>& regions, int key, int vel) {
+  for (const BankRegion& region : regions) {
+    if (key >= region.keyLo && key <= region.keyHi && vel >= region.velLo && vel <= region.velHi) return region.info.waveIdx;
+  }
+  return NO_WAVE;
+}
+
+u32 waveOf(const InstrInfo* info) {
+  return info ? info->waveIdx : NO_WAVE;
+}
+
+// ns per getInstrInfo over every program, key and velocity
+double timeLookups(const SoundBank& bank) {
+  u64 checksum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int prog = 0; prog < PROGRAM_COUNT; prog++) {
+      for (int key = 0; key < 128; key++) {
+        for (int vel = 0; vel < 128; vel++) checksum += waveOf(bank.getInstrInfo(prog, key, vel));
+      }
+    }
+  }
+  const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  // keeps the lookups from being optimized out
+  static volatile u64 result;
+  result = checksum;
+  return elapsed.count() / (static_cast<double>(ROUNDS) * PROGRAM_COUNT * 128 * 128);
+}
+}
+
+int main() {
+  const auto instruments = testInstruments();
+  // the bank is byte swapped in place, each SoundBank gets its own copy
+  std::vector<u8> treeData = buildSoundBank(instruments);
+  std::vector<u8> tableData = treeData;
+  const SoundBank tree(treeData.data(), treeData.size());
+  SoundBank table(tableData.data(), tableData.size());
+  table.buildLookupTable();
+
+  CHECK_EQ(tree.getInstrCount(), static_cast<u32>(PROGRAM_COUNT));
+  int mismatches = 0;
+  for (int prog = 0; prog < PROGRAM_COUNT; prog++) {
+    for (int key = 0; key < 128; key++) {
+      for (int vel = 0; vel < 128; vel++) {
+        const u32 expected = expectedWave(instruments[prog], key, vel);
+        const u32 walked = waveOf(tree.getInstrInfo(prog, key, vel));
+        const u32 looked = waveOf(table.getInstrInfo(prog, key, vel));
+        if (walked != expected || looked != expected) {
+          if (mismatches++ < 10) {
+            std::cerr << "program " << prog << " key " << key << " velocity " << vel << ": expected wave " << expected << ", tree walk " << walked
+                      << ", lookup table " << looked << '\n';
+          }
+        }
+      }
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+
+  const double walkNs = timeLookups(tree);
+  const double tableNs = timeLookups(table);
+  std::cout << "tree walk " << walkNs << " ns, lookup table " << tableNs << " ns per getInstrInfo\n";
+  return checkResult();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "common/pcmSink.hpp"
+#include "common/types.h"
+
+// Minimal checks for the test executables: a failed CHECK is reported and counted, and main returns
+// checkResult() so ctest sees the failure
+namespace rsnd::test {
+inline int failures = 0;
+
+inline int checkResult() {
+  if (failures > 0) std::cerr << failures << " check(s) failed\n";
+  return failures > 0 ? 1 : 0;
+}
+
+// Collects everything written to it
+class VectorSink : public PcmSink {
+public:
+  u32 sampleRate = 0;
+  u8 channelCount = 0;
+  u32 expectedFrames = 0;
+  std::vector<s16> frames;
+
+  void begin(u32 sampleRate, u8 channelCount, u32 frameCount) override {
+    this->sampleRate = sampleRate;
+    this->channelCount = channelCount;
+    expectedFrames = frameCount;
+  }
+  void write(const s16* data, u32 frameCount) override { frames.insert(frames.end(), data, data + frameCount * channelCount); }
+  u32 frameCount() const { return channelCount == 0 ? 0 : frames.size() / channelCount; }
+};
+
+// signal to noise ratio in dB of decoded against the first count samples of reference
+inline double snrDb(const s16* reference, const s16* decoded, size_t count) {
+  double signal = 0;
+  double noise = 0;
+  for (size_t i = 0; i < count; i++) {
+    signal += static_cast<double>(reference[i]) * reference[i];
+    noise += static_cast<double>(reference[i] - decoded[i]) * (reference[i] - decoded[i]);
+  }
+  return noise == 0 ? INFINITY : 10 * std::log10(signal / noise);
+}
+
+// a fresh directory for the files of one test
+inline std::filesystem::path tempDir(const char* name) {
+  auto dir = std::filesystem::temp_directory_path() / "rsnd-test" / name;
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+}
+
+#define CHECK(cond)                                                                   \
+  do {                                                                                \
+    if (!(cond)) {                                                                    \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #cond << '\n';   \
+      rsnd::test::failures++;                                                         \
+    }                                                                                 \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                                                   \
+  do {                                                                                                   \
+    const auto checkA = (a);                                                                             \
+    const auto checkB = (b);                                                                             \
+    if (!(checkA == checkB)) {                                                                           \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": " #a " == " #b " failed: " << checkA << " != " << checkB << '\n'; \
+      rsnd::test::failures++;                                                                            \
+    }                                                                                                    \
+  } while (0)
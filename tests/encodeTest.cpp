@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numbers>
+#include <vector>
+
+#include "check.hpp"
+#include "common/fileUtil.hpp"
+#include "rsnd/AdpcmEncoder.hpp"
+#include "rsnd/SoundStream.hpp"
+#include "rsnd/SoundWave.hpp"
+#include "rsnd/SoundWriter.hpp"
+#include "rsnd/soundCommon.hpp"
+
+using namespace rsnd;
+using namespace rsnd::test;
+
+namespace {
+const u32 SAMPLE_RATE = 32000;
+const u8 CHANNEL_COUNT = 2;
+// several encoder chunks and BRSTM blocks, and not a whole number of ADPCM frames
+const u32 SAMPLE_COUNT = 140003;
+const u32 LOOP_START = 20001;
+const u32 LOOPS = 2;
+
+// interleaved tones with a sweep and some noise on each channel
+std::vector<s16> testSignal() {
+  std::vector<s16> pcm(SAMPLE_COUNT * CHANNEL_COUNT);
+  u32 noise = 12345;
+  for (u32 i = 0; i < SAMPLE_COUNT; i++) {
+    const double t = static_cast<double>(i) / SAMPLE_RATE;
+    for (int c = 0; c < CHANNEL_COUNT; c++) {
+      noise = noise * 1103515245 + 12345;
+      const double tone = 9000 * std::sin(2 * std::numbers::pi * (220 + 110 * c) * t) + 4000 * std::sin(2 * std::numbers::pi * (200 + 3000 * t / 4.4) * t);
+      pcm[i * CHANNEL_COUNT + c] = static_cast<s16>(tone + static_cast<s32>(noise >> 16 & 0x3ff) - 512);
+    }
+  }
+  return pcm;
+}
+
+template <typename T>
+void writeLe(std::ofstream& out, T value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// 16 bit WAVE with one smpl loop, lastSample is inclusive like in the smpl chunk
+void writeLoopedWave(const std::filesystem::path& path, const std::vector<s16>& pcm, u32 loopStart, u32 lastSample) {
+  const u32 dataSize = pcm.size() * sizeof(s16);
+  const u32 smplSize = 36 + 24;
+  std::ofstream out(path, std::ios::binary);
+  out.write("RIFF", 4);
+  writeLe<u32>(out, 4 + 8 + 16 + 8 + smplSize + 8 + dataSize);
+  out.write("WAVE", 4);
+  out.write("fmt ", 4);
+  writeLe<u32>(out, 16);
+  writeLe<u16>(out, 1);
+  writeLe<u16>(out, CHANNEL_COUNT);
+  writeLe<u32>(out, SAMPLE_RATE);
+  writeLe<u32>(out, SAMPLE_RATE * CHANNEL_COUNT * sizeof(s16));
+  writeLe<u16>(out, CHANNEL_COUNT * sizeof(s16));
+  writeLe<u16>(out, 16);
+  out.write("smpl", 4);
+  writeLe<u32>(out, smplSize);
+  for (int i = 0; i < 7; i++) writeLe<u32>(out, 0);
+  writeLe<u32>(out, 1);
+  writeLe<u32>(out, 0);
+  // cue point id, type, start, end, fraction, play count
+  for (u32 value : {0u, 0u, loopStart, lastSample, 0u, 0u}) writeLe<u32>(out, value);
+  out.write("data", 4);
+  writeLe<u32>(out, dataSize);
+  out.write(reinterpret_cast<const char*>(pcm.data()), dataSize);
+}
+
+// the wave read back and set up for encoding like mrst encode does
+EncodedSound loopedSound(const WaveFileData& wave) {
+  EncodedSound sound;
+  sound.sampleRate = wave.sampleRate;
+  sound.sampleCount = std::min(wave.loopEnd, wave.sampleCount);
+  sound.loop = true;
+  sound.loopStart = wave.loopStart;
+  return sound;
+}
+
+std::vector<s16> channelOf(const std::vector<s16>& pcm, int c) {
+  std::vector<s16> channel(pcm.size() / CHANNEL_COUNT);
+  for (size_t i = 0; i < channel.size(); i++) channel[i] = pcm[i * CHANNEL_COUNT + c];
+  return channel;
+}
+
+// decodes each channel's frames with decodeAdpcmBlock, checks they match what the encoder expected the decoder to
+// produce, and returns the worst channel's SNR against the input
+double roundTripSnr(const std::vector<s16>& pcm, const std::vector<AdpcmChannel>& channels) {
+  double worst = INFINITY;
+  for (int c = 0; c < CHANNEL_COUNT; c++) {
+    std::vector<s16> decoded(SAMPLE_COUNT);
+    decodeAdpcmBlock(channels[c].data.data(), SAMPLE_COUNT, channels[c].coeffs, 0, 0, decoded.data(), 1);
+    CHECK(decoded == channels[c].decoded);
+    const std::vector<s16> input = channelOf(pcm, c);
+    worst = std::min(worst, snrDb(input.data(), decoded.data(), SAMPLE_COUNT));
+  }
+  return worst;
+}
+
+void testRoundTrip(const std::vector<s16>& pcm) {
+  const double fast = roundTripSnr(pcm, encodeAdpcm(pcm.data(), CHANNEL_COUNT, SAMPLE_COUNT, ADPCM_ENCODE_FAST));
+  const double best = roundTripSnr(pcm, encodeAdpcm(pcm.data(), CHANNEL_COUNT, SAMPLE_COUNT, ADPCM_ENCODE_BEST));
+  std::cout << "SNR fast " << fast << " dB, best " << best << " dB\n";
+  CHECK(fast > 30);
+  CHECK(best > 30);
+  CHECK(best >= fast);
+}
+
+// encodeAdpcm splits channels into chunks across threads, it has to match one channel encoded front to back
+void testParallelMatchesSerial(const std::vector<s16>& pcm, AdpcmEncodeQuality quality) {
+  EncodedSound parallel{SAMPLE_RATE, SAMPLE_COUNT, true, LOOP_START, encodeAdpcm(pcm.data(), CHANNEL_COUNT, SAMPLE_COUNT, quality)};
+  EncodedSound serial{SAMPLE_RATE, SAMPLE_COUNT, true, LOOP_START, std::vector<AdpcmChannel>(CHANNEL_COUNT)};
+  for (int c = 0; c < CHANNEL_COUNT; c++) {
+    const std::vector<s16> input = channelOf(pcm, c);
+    AdpcmChannel& channel = serial.channels[c];
+    correlateAdpcmCoeffs(input.data(), SAMPLE_COUNT, channel.coeffs);
+    channel.data.resize((SAMPLE_COUNT + 13) / 14 * 8);
+    channel.decoded.resize(SAMPLE_COUNT);
+    s16 yn1 = 0;
+    s16 yn2 = 0;
+    encodeAdpcmFrames(input.data(), SAMPLE_COUNT, yn1, yn2, channel.coeffs, quality, channel.data.data(), channel.decoded.data());
+
+    CHECK(memcmp(channel.coeffs, parallel.channels[c].coeffs, sizeof(channel.coeffs)) == 0);
+    CHECK(channel.data == parallel.channels[c].data);
+    CHECK(channel.decoded == parallel.channels[c].decoded);
+  }
+  CHECK(buildSoundWave(serial) == buildSoundWave(parallel));
+  CHECK(buildSoundStream(serial) == buildSoundStream(parallel));
+}
+
+// played LOOPS times: up to the loop end, then the loop body again
+void checkLooped(const VectorSink& sink, const std::vector<s16>& decodedOnce) {
+  const u32 loopLength = SAMPLE_COUNT - LOOP_START;
+  CHECK_EQ(sink.expectedFrames, LOOP_START + LOOPS * loopLength);
+  CHECK_EQ(sink.frameCount(), LOOP_START + LOOPS * loopLength);
+  if (sink.frameCount() != LOOP_START + LOOPS * loopLength) return;
+  // the first pass includes the last sample of the loop, and the second one starts over at the loop start
+  CHECK(std::equal(decodedOnce.begin(), decodedOnce.end(), sink.frames.begin()));
+  CHECK(std::equal(sink.frames.begin() + LOOP_START * CHANNEL_COUNT, sink.frames.begin() + SAMPLE_COUNT * CHANNEL_COUNT, sink.frames.begin() + SAMPLE_COUNT * CHANNEL_COUNT));
+}
+
+void testLoopedFiles(const std::filesystem::path& dir, const std::vector<s16>& pcm) {
+  const auto wavPath = dir / "looped.wav";
+  writeLoopedWave(wavPath, pcm, LOOP_START, SAMPLE_COUNT - 1);
+  const WaveFileData wave = readWaveFile(wavPath);
+  CHECK_EQ(wave.sampleCount, SAMPLE_COUNT);
+  CHECK(wave.loop);
+  CHECK_EQ(wave.loopStart, LOOP_START);
+  CHECK_EQ(wave.loopEnd, SAMPLE_COUNT);
+
+  EncodedSound sound = loopedSound(wave);
+  sound.channels = encodeAdpcm(wave.pcm.data(), wave.channelCount, sound.sampleCount, ADPCM_ENCODE_FAST);
+  std::vector<s16> decodedOnce(SAMPLE_COUNT * CHANNEL_COUNT);
+  for (int c = 0; c < CHANNEL_COUNT; c++) {
+    for (u32 i = 0; i < SAMPLE_COUNT; i++) decodedOnce[i * CHANNEL_COUNT + c] = sound.channels[c].decoded[i];
+  }
+
+  std::vector<u8> rwav = buildSoundWave(sound);
+  const SoundWave soundWave(rwav.data(), rwav.size());
+  CHECK(soundWave.isLooped());
+  CHECK_EQ(soundWave.getLoopStart(), LOOP_START);
+  CHECK_EQ(soundWave.getLoopEnd(), SAMPLE_COUNT);
+  CHECK_EQ(waveLoopEnd(soundWave.info), SAMPLE_COUNT);
+  VectorSink waveSink;
+  soundWave.decode(waveSink, LOOP_START + LOOPS * (SAMPLE_COUNT - LOOP_START));
+  checkLooped(waveSink, decodedOnce);
+
+  std::vector<u8> rstm = buildSoundStream(sound);
+  const SoundStream soundStream(rstm.data(), rstm.size());
+  CHECK(soundStream.isLooped());
+  CHECK_EQ(soundStream.getSampleCount(), SAMPLE_COUNT);
+  CHECK_EQ(soundStream.getLoopStart(), LOOP_START);
+  CHECK_EQ(soundStream.getLoopEnd(), SAMPLE_COUNT);
+  VectorSink streamSink;
+  soundStream.decodeTrack(0, streamSink, LOOP_START + LOOPS * (SAMPLE_COUNT - LOOP_START));
+  checkLooped(streamSink, decodedOnce);
+  CHECK(streamSink.frames == waveSink.frames);
+}
+}
+
+int main() {
+  const auto dir = tempDir("encode");
+  const std::vector<s16> pcm = testSignal();
+  testRoundTrip(pcm);
+  testParallelMatchesSerial(pcm, ADPCM_ENCODE_FAST);
+  testParallelMatchesSerial(pcm, ADPCM_ENCODE_BEST);
+  testLoopedFiles(dir, pcm);
+  std::filesystem::remove_all(dir);
+  return checkResult();
+}
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "rsnd/AdpcmEncoder.hpp"
+#include "rsnd/SeqRenderer.hpp"
+#include "rsnd/SoundArchiveWriter.hpp"
+#include "rsnd/SoundBank.hpp"
+#include "rsnd/SoundBankWriter.hpp"
+#include "rsnd/SoundSequence.hpp"
+#include "rsnd/SoundWriter.hpp"
+#include "vgmtrans/MidiFile.h"
+
+// Converts and renders the same sequence from several threads at once, which has to give the same output as one
+// conversion at a time. Build with -DRSND_TSAN=ON to have ThreadSanitizer check the conversions for data races
+using namespace rsnd;
+using namespace rsnd::test;
+
+namespace {
+const int THREAD_COUNT = 8;
+const int ROUNDS = 3;
+const int TRACK_COUNT = 4;
+const int NOTES_PER_TRACK = 300;
+
+class SeqBuilder {
+public:
+  std::vector<u8> bytes;
+
+  void u8s(std::initializer_list<int> values) {
+    for (int value : values) bytes.push_back(value);
+  }
+  void varLen(u32 value) {
+    std::vector<u8> groups = {static_cast<u8>(value & 0x7f)};
+    for (value >>= 7; value > 0; value >>= 7) groups.insert(groups.begin(), static_cast<u8>(value & 0x7f | 0x80));
+    bytes.insert(bytes.end(), groups.begin(), groups.end());
+  }
+  void be16(s16 value) { u8s({value >> 8 & 0xff, value & 0xff}); }
+  void be24(u32 value) { u8s({static_cast<int>(value >> 16 & 0xff), static_cast<int>(value >> 8 & 0xff), static_cast<int>(value & 0xff)}); }
+  void be32(u32 value) { u8s({static_cast<int>(value >> 24), static_cast<int>(value >> 16 & 0xff), static_cast<int>(value >> 8 & 0xff), static_cast<int>(value & 0xff)}); }
+  void align4() { bytes.resize((bytes.size() + 3) & ~3); }
+};
+
+// xorshift, so the sequence is the same everywhere
+u32 nextRandom(u32& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// One track: setup commands, then notes, rests, random arguments, pitch bends, calls and tempo changes, jumping
+// back to the first note forever
+std::vector<u8> buildTrack(int trackIdx, u32 subOffset, u32 trackOffset, u32& state) {
+  SeqBuilder track;
+  track.u8s({0x81});
+  track.varLen(trackIdx * 5 % 128);
+  track.u8s({0xc1, 100, 0xc0, 64 + trackIdx, 0xc5, 2, 0xca, 10, 0xce, 1, 0xcf, 5});
+  if (trackIdx == 0) {
+    track.u8s({0xe1});
+    track.be16(120);
+    track.u8s({0xc2, 110});
+  }
+  track.u8s({0xc3, trackIdx % 3});
+  const u32 loopOffset = trackOffset + track.bytes.size();
+  for (int i = 0; i < NOTES_PER_TRACK; i++) {
+    const u32 r = nextRandom(state) % 100;
+    if (r < 5) {
+      track.u8s({0x80});
+      track.varLen(1 + nextRandom(state) % 96);
+    } else if (r < 7) {
+      track.u8s({0xa0, 0x80});
+      track.be16(1);
+      track.be16(40);
+    } else if (r < 9) {
+      track.u8s({0xc4, static_cast<int>(nextRandom(state) % 256)});
+    } else if (r < 10) {
+      track.u8s({0x8a});
+      track.be24(subOffset);
+    } else if (r < 11) {
+      track.u8s({0xe1});
+      track.be16(60 + nextRandom(state) % 140);
+    } else {
+      track.u8s({static_cast<int>(30 + nextRandom(state) % 60), static_cast<int>(1 + nextRandom(state) % 127)});
+      track.varLen(1 + nextRandom(state) % 400);
+    }
+  }
+  track.u8s({0x89});
+  track.be24(loopOffset);
+  track.u8s({0xff});
+  return track.bytes;
+}
+
+// A BRSEQ whose SEQ_MAIN label opens TRACK_COUNT looping tracks (each also labelled SEQ_TRACK_n) sharing a call
+std::vector<u8> buildSequence() {
+  const u32 mainSize = 3 + 5 * (TRACK_COUNT - 1) + 4;
+  SeqBuilder sub;
+  sub.u8s({60, 100});
+  sub.varLen(24);
+  sub.u8s({0x80, 12, 64, 90});
+  sub.varLen(48);
+  sub.u8s({0xfd});
+  const u32 subOffset = mainSize;
+
+  u32 state = 0x12345678;
+  std::vector<std::vector<u8>> tracks;
+  std::vector<u32> trackOffsets;
+  u32 offset = mainSize + sub.bytes.size();
+  for (int t = 0; t < TRACK_COUNT; t++) {
+    trackOffsets.push_back(offset);
+    tracks.push_back(buildTrack(t, subOffset, offset, state));
+    offset += tracks.back().size();
+  }
+
+  SeqBuilder body;
+  body.u8s({0xfe});
+  body.be16((1 << TRACK_COUNT) - 1);
+  for (int t = 1; t < TRACK_COUNT; t++) {
+    body.u8s({0x88, t});
+    body.be24(trackOffsets[t]);
+  }
+  body.u8s({0x89});
+  body.be24(trackOffsets[0]);
+  body.bytes.insert(body.bytes.end(), sub.bytes.begin(), sub.bytes.end());
+  for (const auto& track : tracks) body.bytes.insert(body.bytes.end(), track.begin(), track.end());
+  body.align4();
+
+  std::vector<std::pair<std::string, u32>> labels = {{"SEQ_MAIN", 0}};
+  for (int t = 0; t < TRACK_COUNT; t++) labels.push_back({"SEQ_TRACK_" + std::to_string(t), trackOffsets[t]});
+  SeqBuilder labl;
+  labl.be32(labels.size());
+  u32 entryOffset = 4 + 4 * labels.size();
+  for (const auto& [name, dataOffset] : labels) {
+    labl.be32(entryOffset);
+    entryOffset += (8 + name.size() + 3) & ~3;
+  }
+  for (const auto& [name, dataOffset] : labels) {
+    labl.be32(dataOffset);
+    labl.be32(name.size());
+    labl.bytes.insert(labl.bytes.end(), name.begin(), name.end());
+    labl.align4();
+  }
+
+  const u32 headerSize = 0x20;
+  const u32 dataSize = 12 + body.bytes.size();
+  const u32 lablSize = 8 + labl.bytes.size();
+  SeqBuilder file;
+  file.bytes = {'R', 'S', 'E', 'Q', 0xfe, 0xff, 0x01, 0x00};
+  file.be32(headerSize + dataSize + lablSize);
+  file.be16(headerSize);
+  file.be16(2);
+  file.be32(headerSize);
+  file.be32(dataSize);
+  file.be32(headerSize + dataSize);
+  file.be32(lablSize);
+  file.u8s({'D', 'A', 'T', 'A'});
+  file.be32(dataSize);
+  file.be32(12);
+  file.bytes.insert(file.bytes.end(), body.bytes.begin(), body.bytes.end());
+  file.u8s({'L', 'A', 'B', 'L'});
+  file.be32(lablSize);
+  file.bytes.insert(file.bytes.end(), labl.bytes.begin(), labl.bytes.end());
+  return file.bytes;
+}
+
+// every program plays one looped sine wave from a BRWAR
+struct TestBank {
+  std::vector<u8> bankData;
+  std::vector<u8> waveData;
+  std::unique_ptr<SoundBank> bank;
+  std::unique_ptr<BankWaves> waves;
+
+  TestBank() {
+    const u32 sampleCount = 3200;
+    std::vector<s16> pcm(sampleCount);
+    for (u32 i = 0; i < sampleCount; i++) pcm[i] = static_cast<s16>(12000 * std::sin(2 * std::numbers::pi * 10 * i / sampleCount));
+    EncodedSound sound{32000, sampleCount, true, 0, encodeAdpcm(pcm.data(), 1, sampleCount, ADPCM_ENCODE_FAST)};
+    waveData = buildSoundWaveArchive({buildSoundWave(sound)});
+
+    BankRegion region = {0, 127, 0, 127, {}};
+    region.info.originalKey = 69;
+    region.info.volume = 127;
+    region.info.pan = 64;
+    region.info.pitch = 1.0f;
+    region.info.attack = 127;
+    region.info.sustain = 100;
+    region.info.release = 100;
+    bankData = buildSoundBank(std::vector<std::vector<BankRegion>>(128, {region}));
+
+    bank = std::make_unique<SoundBank>(bankData.data(), bankData.size(), waveData.data());
+    bank->buildLookupTable();
+    waves = std::make_unique<BankWaves>(*bank, waveData.data(), waveData.size());
+  }
+};
+
+std::vector<u8> convertLabel(const SoundSequence& seq, u32 offset) {
+  std::vector<u8> midi;
+  MidiFile(&seq).WriteMidiToBuffer(midi, offset);
+  return midi;
+}
+
+std::vector<s16> renderLabel(const SeqRenderer& renderer, const SoundSequence& seq, u32 offset) {
+  VectorSink sink;
+  renderer.render(seq, offset, sink);
+  return sink.frames;
+}
+
+// runs fn(thread) on THREAD_COUNT threads at once
+template <typename F>
+void onThreads(F&& fn) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREAD_COUNT; t++) threads.emplace_back(fn, t);
+  for (auto& thread : threads) thread.join();
+}
+}
+
+int main() {
+  std::vector<u8> seqData = buildSequence();
+  const SoundSequence seq(seqData.data(), seqData.size());
+  CHECK_EQ(seq.getLabelCount(), static_cast<u32>(TRACK_COUNT + 1));
+  std::vector<u32> offsets;
+  for (u32 i = 0; i < seq.getLabelCount(); i++) offsets.push_back(seq.getLabelOffset(seq.getSeqLabel(i)));
+
+  // MIDI conversions of every label, each thread starting at a different label
+  std::vector<std::vector<u8>> midis;
+  for (u32 offset : offsets) midis.push_back(convertLabel(seq, offset));
+  CHECK(std::all_of(midis.begin(), midis.end(), [](const auto& midi) { return midi.size() > 100; }));
+  std::vector<int> midiMismatches(THREAD_COUNT);
+  onThreads([&](int t) {
+    for (int round = 0; round < ROUNDS; round++) {
+      for (size_t i = 0; i < offsets.size(); i++) {
+        const size_t label = (i + t) % offsets.size();
+        midiMismatches[t] += convertLabel(seq, offsets[label]) != midis[label];
+      }
+    }
+  });
+  for (int t = 0; t < THREAD_COUNT; t++) CHECK_EQ(midiMismatches[t], 0);
+
+  // renders sharing one bank, bounded as the tracks loop forever
+  const TestBank bank;
+  const SeqRenderer renderer(*bank.bank, *bank.waves, {1, 960});
+  std::vector<std::vector<s16>> renders;
+  for (u32 offset : offsets) renders.push_back(renderLabel(renderer, seq, offset));
+  CHECK(std::any_of(renders[0].begin(), renders[0].end(), [](s16 sample) { return sample != 0; }));
+  std::vector<int> renderMismatches(THREAD_COUNT);
+  onThreads([&](int t) {
+    for (size_t i = 0; i < offsets.size(); i++) {
+      const size_t label = (i + t) % offsets.size();
+      renderMismatches[t] += renderLabel(renderer, seq, offsets[label]) != renders[label];
+    }
+  });
+  for (int t = 0; t < THREAD_COUNT; t++) CHECK_EQ(renderMismatches[t], 0);
+
+  return checkResult();
+}